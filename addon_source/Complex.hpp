@@ -14,6 +14,26 @@ namespace FM {
   static inline Complex<elem> complex_conj(const Complex<elem> &a) {
     return Complex<elem>(a.real, -a.imag);
   }
+
+  template <class elem>
+  inline Complex<elem> operator+(const Complex<elem> &a, const Complex<elem> &b) {
+    return Complex<elem>(a.real + b.real, a.imag + b.imag);
+  }
+
+  template <class elem>
+  inline Complex<elem> operator-(const Complex<elem> &a, const Complex<elem> &b) {
+    return Complex<elem>(a.real - b.real, a.imag - b.imag);
+  }
+
+  template <class elem>
+  inline Complex<elem> operator*(const Complex<elem> &a, const Complex<elem> &b) {
+    return Complex<elem>(a.real*b.real - a.imag*b.imag, a.real*b.imag + a.imag*b.real);
+  }
+
+  template <class elem>
+  inline Complex<elem> operator*(elem s, const Complex<elem> &a) {
+    return Complex<elem>(s*a.real, s*a.imag);
+  }
 }
 
 #endif
@@ -18,16 +18,17 @@
  */
 
 #include "LAPACK.hpp"
+#include "blas_backend.hpp"
 
 double getEPS() {
   char CMACH = 'E';
-  return dlamch_(&CMACH);
+  return FM_BACKEND(dlamch_)(&CMACH);
 }
 
 
 float getFloatEPS() {
   char CMACH = 'E';
-  return slamch_(&CMACH);
+  return FM_BACKEND(slamch_)(&CMACH);
 }
 
 template <>
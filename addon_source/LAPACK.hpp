@@ -50,6 +50,22 @@ extern "C" {
 	       int *RANK, FM::Complex<double> *WORK, int* LWORK, double* RWORK,
 	       int* INFO);
 
+  void dgels_(char *TRANS, int *M, int *N, int *NRHS, double *A, int *LDA,
+	      double *B, int *LDB, double *WORK, int *LWORK, int *INFO);
+
+  void zgels_(char *TRANS, int *M, int *N, int *NRHS, FM::Complex<double> *A, int *LDA,
+	      FM::Complex<double> *B, int *LDB, FM::Complex<double> *WORK, int *LWORK,
+	      int *INFO);
+
+  void dgelsd_(int *M, int *N, int *NRHS, double *A, int *LDA, double *B, int *LDB,
+	       double *S, double *RCOND, int *RANK, double *WORK, int *LWORK,
+	       int *IWORK, int *INFO);
+
+  void zgelsd_(int *M, int *N, int *NRHS, FM::Complex<double> *A, int *LDA,
+	       FM::Complex<double> *B, int *LDB, double *S, double *RCOND, int *RANK,
+	       FM::Complex<double> *WORK, int *LWORK, double *RWORK, int *IWORK,
+	       int *INFO);
+
   void sgelsy_(int* M, int *N, int *NRHS, float* A, int *LDA,
 	       float *B, int *LDB, int *JPVT, float* RCOND,
 	       int *RANK, float *WORK, int* LWORK, int* INFO);
@@ -205,6 +221,45 @@ extern "C" {
   
   void zgetri_(int *N, FM::Complex<double> *A, int *LDA, int *IPIV, FM::Complex<double> *WORK, int *LWORK, int *INFO);
 
+  void dgetrs_(char *TRANS, int *N, int *NRHS, double *A, int *LDA, int *IPIV,
+               double *B, int *LDB, int *INFO);
+
+  void zgetrs_(char *TRANS, int *N, int *NRHS, FM::Complex<double> *A, int *LDA, int *IPIV,
+               FM::Complex<double> *B, int *LDB, int *INFO);
+
+  void zgees_(char *JOBVS, char *SORT, int (*SELECT)(FM::Complex<double>*), int *N,
+              FM::Complex<double> *A, int *LDA, int *SDIM, FM::Complex<double> *W,
+              FM::Complex<double> *VS, int *LDVS, FM::Complex<double> *WORK, int *LWORK,
+              double *RWORK, int *BWORK, int *INFO);
+
+  void dpotrf_(char *UPLO, int *N, double *A, int *LDA, int *INFO);
+
+  void zpotrf_(char *UPLO, int *N, FM::Complex<double> *A, int *LDA, int *INFO);
+
+  void dgesdd_(char *JOBZ, int *M, int *N, double *A, int *LDA, double *S,
+	       double *U, int *LDU, double *VT, int *LDVT, double *WORK,
+	       int *LWORK, int *IWORK, int *INFO);
+
+  void zgesdd_(char *JOBZ, int *M, int *N, FM::Complex<double> *A, int *LDA, double *S,
+	       FM::Complex<double> *U, int *LDU, FM::Complex<double> *VT, int *LDVT,
+	       FM::Complex<double> *WORK, int *LWORK, double *RWORK, int *IWORK, int *INFO);
+
+  void dsyevd_(char *JOBZ, char *UPLO, int *N, double *A, int *LDA, double *W,
+	       double *WORK, int *LWORK, int *IWORK, int *LIWORK, int *INFO);
+
+  void zheevd_(char *JOBZ, char *UPLO, int *N, FM::Complex<double> *A, int *LDA, double *W,
+	       FM::Complex<double> *WORK, int *LWORK, double *RWORK, int *LRWORK,
+	       int *IWORK, int *LIWORK, int *INFO);
+
+  void dgeev_(char *JOBVL, char *JOBVR, int *N, double *A, int *LDA,
+	      double *WR, double *WI, double *VL, int *LDVL, double *VR, int *LDVR,
+	      double *WORK, int *LWORK, int *INFO);
+
+  void zgeev_(char *JOBVL, char *JOBVR, int *N, FM::Complex<double> *A, int *LDA,
+	      FM::Complex<double> *W, FM::Complex<double> *VL, int *LDVL,
+	      FM::Complex<double> *VR, int *LDVR, FM::Complex<double> *WORK, int *LWORK,
+	      double *RWORK, int *INFO);
+
   int xerbla_(char *srname, int *info);
 
   double snrm2_(int *N, float *X, int *INCX);
@@ -0,0 +1,41 @@
+#include "addon_data.hpp"
+#include "buffer_pool.hpp"
+#include "mapped_io.hpp"
+#include <mutex>
+#include <unordered_map>
+
+namespace FM {
+
+  static std::mutex addon_lock;
+
+  static std::unordered_map<v8::Isolate*, AddonData>& AddonTable() {
+    static std::unordered_map<v8::Isolate*, AddonData> table;
+    return table;
+  }
+
+  static void ReleaseAddonData(void *arg) {
+    ReleasePooledBuffers(static_cast<v8::Isolate*>(arg));
+    ReleaseMappedFiles(static_cast<v8::Isolate*>(arg));
+    std::lock_guard<std::mutex> guard(addon_lock);
+    AddonTable().erase(static_cast<v8::Isolate*>(arg));
+  }
+
+  void RegisterAddonData(v8::Isolate *isolate) {
+    bool inserted;
+    {
+      std::lock_guard<std::mutex> guard(addon_lock);
+      inserted = AddonTable().emplace(isolate,AddonData()).second;
+    }
+    // Further instances in the same isolate (e.g., vm contexts) share the
+    // entry, which goes away with the environment.
+    if (inserted)
+      node::AddEnvironmentCleanupHook(isolate,ReleaseAddonData,isolate);
+  }
+
+  AddonData& GetAddonData(v8::Isolate *isolate) {
+    // Entries are only erased from the isolate's own thread, and
+    // unordered_map references stay valid across other insertions.
+    std::lock_guard<std::mutex> guard(addon_lock);
+    return AddonTable()[isolate];
+  }
+}
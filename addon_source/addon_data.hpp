@@ -0,0 +1,34 @@
+#ifndef __addon_data_hpp__
+#define __addon_data_hpp__
+
+#include <node.h>
+#include <stdint.h>
+#include <unordered_set>
+
+namespace FM {
+
+  struct PooledBuffer;
+  struct MappedView;
+
+  // Settings that belong to one isolate (the main thread, or one worker
+  // thread).  Every instance of the addon loaded into the isolate shares
+  // them, and they are discarded when the isolate's environment is torn
+  // down.  Process-wide state does not belong here.
+  struct AddonData {
+    // Allocate native results in SharedArrayBuffers
+    bool shared_results = false;
+    // Pooled result buffers still held by ArrayBuffers in this isolate,
+    // and the bytes reported to V8 for them
+    std::unordered_set<PooledBuffer*> pooled;
+    int64_t external_bytes = 0;
+    // Typed arrays onto mapped array files
+    std::unordered_set<MappedView*> mapped;
+  };
+
+  // Called from Init for every instance of the addon.
+  void RegisterAddonData(v8::Isolate *isolate);
+
+  AddonData& GetAddonData(v8::Isolate *isolate);
+}
+
+#endif
@@ -8,7 +8,12 @@
 #include <stdlib.h>
 #include <string.h>
 #include "Complex.hpp"
+#include "cpu_dispatch.hpp"
+#include "addon_data.hpp"
+#include "buffer_pool.hpp"
+#include "integer.hpp"
 #include <functional>
+#include <type_traits>
 
 namespace FM {
 
@@ -52,32 +57,104 @@ namespace FM {
   }
 
 
+  // A column major matrix.  The storage is either owned (data), or is a
+  // view onto the contents of a typed array passed in from JS.  Views are
+  // only valid for the duration of the native call that created them.
   template <class T>
   struct BLASMatrix {
     int rows;
     int cols;
     std::vector<T> data;
-    BLASMatrix() : rows(0), cols(0), data() {
+    T* view;
+    BLASMatrix() : rows(0), cols(0), data(), view(nullptr) {
     }
-    BLASMatrix(int r, int c) {
+    BLASMatrix(int r, int c) : view(nullptr) {
       rows = r;
       cols = c;
       data.resize(r*c);
     }
+    BLASMatrix(int r, int c, T* p) : rows(r), cols(c), data(), view(p) {
+    }
     size_t elements() const {return rows*cols;}
-    const T* base() const {return &(data[0]);}
-    T* base() {return &(data[0]);}
+    const T* base() const {return view ? view : &(data[0]);}
+    T* base() {return view ? view : &(data[0]);}
+    // Replace a view with an owned copy of its contents
+    void detach() {
+      if (!view) return;
+      data.assign(view,view+elements());
+      view = nullptr;
+    }
   };
 
+  template <class T, class S>
+  inline bool Overlaps(const BLASMatrix<T> &a, const BLASMatrix<S> &b) {
+    const char *a0 = reinterpret_cast<const char*>(a.base());
+    const char *b0 = reinterpret_cast<const char*>(b.base());
+    return (a.elements() && b.elements() &&
+            (a0 < b0 + b.elements()*sizeof(S)) && (b0 < a0 + a.elements()*sizeof(T)));
+  }
+
+  // Returns a pointer to the first element of a typed array, whether it
+  // is backed by an ArrayBuffer or a SharedArrayBuffer.
+  inline char* TypedArrayData(Isolate *isolate, Local<Value> val) {
+    auto context = isolate->GetCurrentContext();
+    auto abv = Local<ArrayBufferView>::Cast(val);
+    auto buffer = abv->Get(context,String::NewFromUtf8(isolate,"buffer")).ToLocalChecked();
+    void *data;
+    if (buffer->IsSharedArrayBuffer())
+      data = Local<SharedArrayBuffer>::Cast(buffer)->GetContents().Data();
+    else
+      data = Local<ArrayBuffer>::Cast(buffer)->GetContents().Data();
+    return static_cast<char*>(data) + abv->ByteOffset();
+  }
+
+  // The class of the elements of a typed array, or 0 if it is not one
+  inline int TypedArrayClass(Local<Value> val) {
+    if (val->IsFloat64Array()) return CLASS_DOUBLE;
+    if (val->IsFloat32Array()) return CLASS_SINGLE;
+    if (val->IsInt8Array()) return CLASS_INT8;
+    if (val->IsUint8Array()) return CLASS_UINT8;
+    if (val->IsInt16Array()) return CLASS_INT16;
+    if (val->IsUint16Array()) return CLASS_UINT16;
+    if (val->IsInt32Array()) return CLASS_INT32;
+    if (val->IsUint32Array()) return CLASS_UINT32;
+    return 0;
+  }
+
+  // Conversions between planar and interleaved complex storage.  The
+  // double precision versions go through the dispatched kernels.
+  template <class T>
+  inline void InterleaveComplex(const T *re, const T *im, Complex<T> *out, size_t n) {
+    for (size_t i=0;i<n;i++)
+      out[i] = Complex<T>(re[i],im[i]);
+  }
+
+  inline void InterleaveComplex(const double *re, const double *im, Complex<double> *out, size_t n) {
+    Kernels().zinterleave(re,im,out,n);
+  }
+
+  template <class T>
+  inline void ComplexToReal(const Complex<T> *in, T *out, size_t n) {
+    for (size_t i=0;i<n;i++) out[i] = in[i].real;
+  }
+
+  inline void ComplexToReal(const Complex<double> *in, double *out, size_t n) {
+    Kernels().zreal(in,out,n);
+  }
+
+  template <class T>
+  inline void ComplexToImag(const Complex<T> *in, T *out, size_t n) {
+    for (size_t i=0;i<n;i++) out[i] = in[i].imag;
+  }
+
+  inline void ComplexToImag(const Complex<double> *in, double *out, size_t n) {
+    Kernels().zimag(in,out,n);
+  }
+
   template <class T>
   inline BLASMatrix<Complex<T> > BLASMatrixInterleave(const BLASMatrix<T> &r, const BLASMatrix<T> &i) {
     BLASMatrix<Complex<T> > ret(r.rows,r.cols);
-    const size_t numel = r.rows*r.cols;
-    Complex<T> *ptr = ret.base();
-    const T* aptr = r.base();
-    const T* bptr = i.base();
-    for (size_t i=0;i<numel;i++)
-      ptr[i] = Complex<T>(aptr[i],bptr[i]);
+    InterleaveComplex(r.base(),i.base(),ret.base(),r.elements());
     return ret;
   }
 
@@ -91,13 +168,26 @@ namespace FM {
       ThrowE(isolate,"Argument to matrix operation is not 2D");
       return false;
     }
-    mat = BLASMatrix<T>(dims[0],dims[1]);
-    auto cnt = mat.rows*mat.cols;
     auto val = obj->Get(context,String::NewFromUtf8(isolate, name)).ToLocalChecked();
     if (val->IsFloat64Array() && (sizeof(T) == sizeof(double))) {
-      ArrayBufferView *abv = ArrayBufferView::Cast(*val);
-      abv->CopyContents(mat.base(),cnt*sizeof(double));
+      if (Local<Float64Array>::Cast(val)->Length() < dims[0]*dims[1]) {
+        ThrowE(isolate,"Array data is shorter than its dimensions");
+        return false;
+      }
+      // Read double data in place, including SharedArrayBuffer backed arrays
+      mat = BLASMatrix<T>(dims[0],dims[1],reinterpret_cast<T*>(TypedArrayData(isolate,val)));
+    } else if (std::is_same<T,double>::value && TypedArrayClass(val)) {
+      if (Local<TypedArray>::Cast(val)->Length() < dims[0]*dims[1]) {
+        ThrowE(isolate,"Array data is shorter than its dimensions");
+        return false;
+      }
+      // Other numeric classes are widened natively
+      mat = BLASMatrix<T>(dims[0],dims[1]);
+      ConvertToDouble(TypedArrayData(isolate,val),TypedArrayClass(val),
+                      reinterpret_cast<double*>(mat.base()),mat.elements());
     } else {
+      mat = BLASMatrix<T>(dims[0],dims[1]);
+      auto cnt = mat.rows*mat.cols;
       auto arr = val->ToObject(context).ToLocalChecked();
       for (int i=0;i<cnt;i++) 
         mat.base()[i] = arr->Get(context,i).ToLocalChecked()->ToNumber(context).ToLocalChecked()->Value();
@@ -130,23 +220,98 @@ namespace FM {
     return ObjectToBLASMatrixComplex(mat,isolate,obj);
   }
 
+  // Write the contents of a matrix back into the named field of an
+  // existing array object.  This is the inverse of ObjectToBLASMatrixReal,
+  // and is used by operations that update their arguments in place.
+  template <class T>
+  inline void BLASMatrixToObjectReal(const BLASMatrix<T> &mat, Isolate * isolate, Value * arg, const char *name = "real") {
+    auto context = isolate->GetCurrentContext();
+    auto obj = arg->ToObject(context).ToLocalChecked();
+    auto cnt = mat.rows*mat.cols;
+    auto val = obj->Get(context,String::NewFromUtf8(isolate, name)).ToLocalChecked();
+    if (val->IsFloat64Array() && (sizeof(T) == sizeof(double))) {
+      char *p = TypedArrayData(isolate,val);
+      // Nothing to do if the matrix is a view of this array
+      if (p != reinterpret_cast<const char*>(mat.base()))
+        memcpy(p,mat.base(),cnt*sizeof(double));
+    } else {
+      auto arr = val->ToObject(context).ToLocalChecked();
+      for (int i=0;i<cnt;i++)
+        arr->Set(context,i,Number::New(isolate,mat.base()[i])).FromJust();
+    }
+  }
+
+  template <class T>
+  inline void BLASMatrixToObject(const BLASMatrix<T> &mat, Isolate *isolate, Value* obj) {
+    BLASMatrixToObjectReal(mat,isolate,obj);
+  }
+
+  template <class T>
+  inline void BLASMatrixToObject(const BLASMatrix<Complex<T> > &mat, Isolate *isolate, Value* obj) {
+    BLASMatrix<T> real_part(mat.rows,mat.cols);
+    BLASMatrix<T> imag_part(mat.rows,mat.cols);
+    ComplexToReal(mat.base(),real_part.base(),mat.elements());
+    ComplexToImag(mat.base(),imag_part.base(),mat.elements());
+    BLASMatrixToObjectReal(real_part,isolate,obj,"real");
+    BLASMatrixToObjectReal(imag_part,isolate,obj,"imag");
+  }
+
   template <class T>
   inline Local<Value> CArrayToTypedArray(T* p, int len, Isolate *isolate);
 
+  // Storage for a result that will be handed to CArrayToTypedArray
+  template <class T>
+  inline T* NewResultArray(Isolate *isolate, size_t len) {
+    return static_cast<T*>(AllocateResult(isolate,len*sizeof(T)));
+  }
+
+  // A typed array of len elements over p, which must come from
+  // NewResultArray, and which it takes ownership of.  In shared mode the
+  // result lives in a SharedArrayBuffer, so it can be handed to another
+  // worker without a copy.
+  template <class View>
+  inline Local<Value> ResultView(Isolate *isolate, void *p, size_t len, size_t bytes) {
+    if (GetAddonData(isolate).shared_results) {
+      auto buff = SharedArrayBuffer::New(isolate, p, bytes,
+                                         ArrayBufferCreationMode::kInternalized);
+      return View::New(buff,0,len);
+    }
+    auto buff = WrapResult(isolate, p, bytes);
+    return View::New(buff,0,len);
+  }
+
   template <>
   inline Local<Value> CArrayToTypedArray(double *p, int len, Isolate *isolate) {
-    auto buff = ArrayBuffer::New(isolate, p, len*sizeof(double),
-                                 ArrayBufferCreationMode::kInternalized);
-    return Float64Array::New(buff,0,len);
+    return ResultView<Float64Array>(isolate,p,len,len*sizeof(double));
   }
-  
+
+  template <>
+  inline Local<Value> CArrayToTypedArray(int32_t *p, int len, Isolate *isolate) {
+    return ResultView<Int32Array>(isolate,p,len,len*sizeof(int32_t));
+  }
+
+  // The typed array for len elements of class cls (see integer.hpp)
+  inline Local<Value> ClassArrayToTypedArray(void *p, size_t len, int cls, Isolate *isolate) {
+    const size_t bytes = len*ClassBytes(cls);
+    switch (StorageOf(cls)) {
+    case CLASS_SINGLE: return ResultView<Float32Array>(isolate,p,len,bytes);
+    case CLASS_INT8: return ResultView<Int8Array>(isolate,p,len,bytes);
+    case CLASS_UINT8: return ResultView<Uint8Array>(isolate,p,len,bytes);
+    case CLASS_INT16: return ResultView<Int16Array>(isolate,p,len,bytes);
+    case CLASS_UINT16: return ResultView<Uint16Array>(isolate,p,len,bytes);
+    case CLASS_INT32: return ResultView<Int32Array>(isolate,p,len,bytes);
+    case CLASS_UINT32: return ResultView<Uint32Array>(isolate,p,len,bytes);
+    default: return ResultView<Float64Array>(isolate,p,len,bytes);
+    }
+  }
+
   template <class T>
   inline Local<Value> BLASMatrixToBuffer(Isolate *isolate, BLASMatrix<T> &mat);
 
   template <>
   inline Local<Value> BLASMatrixToBuffer(Isolate *isolate, BLASMatrix<double> &mat) {
     size_t len = mat.elements();
-    double *c = (double*) (calloc(len,sizeof(double)));
+    double *c = NewResultArray<double>(isolate,len);
     memcpy(c,mat.base(),len*sizeof(double));
     return CArrayToTypedArray(c, len, isolate);
   }
@@ -154,18 +319,16 @@ namespace FM {
   template <class T>
   inline Local<Value> BLASMatrixToBufferReal(Isolate *isolate, BLASMatrix<Complex<T> >&mat) {
     size_t len = mat.elements();
-    T *c_r = (T*) (calloc(len,sizeof(T)));
-    const auto mp = mat.base();
-    for (int i=0;i<len;i++) c_r[i] = mp[i].real;
+    T *c_r = NewResultArray<T>(isolate,len);
+    ComplexToReal(mat.base(),c_r,len);
     return CArrayToTypedArray(c_r, len, isolate);
   }
 
   template <class T>
   inline Local<Value> BLASMatrixToBufferImag(Isolate *isolate, BLASMatrix<Complex<T> > &mat) {
     size_t len = mat.elements();
-    T *c_i = (T*) (calloc(len,sizeof(T)));
-    const auto mp = mat.base();
-    for (int i=0;i<len;i++) c_i[i] = mp[i].imag;
+    T *c_i = NewResultArray<T>(isolate,len);
+    ComplexToImag(mat.base(),c_i,len);
     return CArrayToTypedArray(c_i, len, isolate);
   }
 
@@ -202,6 +365,99 @@ namespace FM {
     return cb->Call(context,recv,argc,argv).ToLocalChecked();
   }
 
+  // An array with any number of dimensions, as planar double precision
+  // data (imag is null for real arrays).  Like BLASMatrix, Float64Array data
+  // is read in place and anything else is converted into a copy.
+  struct NDArray {
+    std::vector<size_t> dims;
+    size_t elements;
+    const double *real;
+    const double *imag;
+    std::vector<double> real_copy;
+    std::vector<double> imag_copy;
+  };
+
+  inline bool ReadNumericData(Isolate *isolate, Local<Value> val, size_t len,
+                              const double *&data, std::vector<double> &copy) {
+    auto context = isolate->GetCurrentContext();
+    if (val->IsTypedArray() && (Local<TypedArray>::Cast(val)->Length() < len)) {
+      ThrowE(isolate,"Array data is shorter than its dimensions");
+      return false;
+    }
+    if (val->IsFloat64Array()) {
+      data = reinterpret_cast<const double*>(TypedArrayData(isolate,val));
+      return true;
+    }
+    copy.resize(len);
+    const int cls = TypedArrayClass(val);
+    if (cls) {
+      ConvertToDouble(TypedArrayData(isolate,val),cls,copy.data(),len);
+    } else {
+      auto arr = val->ToObject(context).ToLocalChecked();
+      for (size_t i=0;i<len;i++)
+        copy[i] = arr->Get(context,i).ToLocalChecked()->ToNumber(context).ToLocalChecked()->Value();
+    }
+    data = copy.data();
+    return true;
+  }
+
+  inline bool ObjectToNDArray(NDArray &arr, Isolate *isolate, Value *arg) {
+    auto context = isolate->GetCurrentContext();
+    auto obj = arg->ToObject(context).ToLocalChecked();
+    auto dims = GetDoubleArray(isolate,obj,"dims");
+    arr.dims.assign(dims.begin(),dims.end());
+    arr.elements = 1;
+    for (auto d : arr.dims) arr.elements *= d;
+    auto real = obj->Get(context,String::NewFromUtf8(isolate,"real")).ToLocalChecked();
+    if (!ReadNumericData(isolate,real,arr.elements,arr.real,arr.real_copy)) return false;
+    arr.imag = nullptr;
+    auto imag = obj->Get(context,String::NewFromUtf8(isolate,"imag")).ToLocalChecked();
+    if (!imag->IsUndefined() &&
+        !ReadNumericData(isolate,imag,arr.elements,arr.imag,arr.imag_copy)) return false;
+    return true;
+  }
+
+  inline Local<Value> MakeDimsArray(Isolate *isolate, const std::vector<size_t> &dims) {
+    auto dim = Array::New(isolate,dims.size());
+    auto context = isolate->GetCurrentContext();
+    for (size_t i=0;i<dims.size();i++)
+      dim->Set(context,i,Number::New(isolate,static_cast<double>(dims[i]))).FromJust();
+    return dim;
+  }
+
+  // Call a maker with storage from NewResultArray, which it takes over.
+  // imag is null for a real result.
+  inline Local<Value> ConstructNDArray(Isolate *isolate, Local<Function> cb,
+                                       const std::vector<size_t> &dims,
+                                       double *real, double *imag) {
+    size_t len = 1;
+    for (auto d : dims) len *= d;
+    Local<Value> argv[3] = {MakeDimsArray(isolate,dims),
+                            CArrayToTypedArray(real,len,isolate),
+                            Local<Value>()};
+    if (imag) argv[2] = CArrayToTypedArray(imag,len,isolate);
+    auto context = isolate->GetCurrentContext();
+    auto recv = context->Global();
+    return cb->Call(context,recv,imag ? 3 : 2,argv).ToLocalChecked();
+  }
+
+  // As ConstructNDArray for a result of class cls, which is passed to the
+  // maker after the data (imag may be null)
+  inline Local<Value> ConstructTypedNDArray(Isolate *isolate, Local<Function> cb,
+                                            const std::vector<size_t> &dims,
+                                            void *real, void *imag, int cls) {
+    size_t len = 1;
+    for (auto d : dims) len *= d;
+    Local<Value> argv[4] = {MakeDimsArray(isolate,dims),
+                            ClassArrayToTypedArray(real,len,cls,isolate),
+                            Undefined(isolate),
+                            Number::New(isolate,cls)};
+    if (imag) argv[2] = ClassArrayToTypedArray(imag,len,cls,isolate);
+    auto context = isolate->GetCurrentContext();
+    auto recv = context->Global();
+    return cb->Call(context,recv,4,argv).ToLocalChecked();
+  }
+
   using warning_cb = std::function<void(std::string)>;
   
 }
@@ -0,0 +1,231 @@
+#ifdef __APPLE__
+#include <Accelerate.h>
+#else
+#include <cblas.h>
+#endif
+
+#include "blas_backend.hpp"
+#include "LAPACK.hpp"
+#include <dlfcn.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <atomic>
+#include <mutex>
+
+namespace FM {
+
+  // Handles are never closed once a backend is made from them, and tables
+  // are never freed once published - another thread may still be running
+  // a routine resolved from them.
+  struct Backend {
+    std::mutex lock;
+    void *blas = nullptr;
+    void *lapack = nullptr;
+    std::string blas_path;
+    std::string lapack_path;
+    std::vector<std::string> missing;
+  };
+
+  static Backend& TheBackend() {
+    static Backend backend;
+    return backend;
+  }
+
+  static const char* routine_names[BACKEND_ROUTINE_COUNT] = {
+#define FM_BACKEND_NAME(fn) #fn,
+    FM_BACKEND_ROUTINES(FM_BACKEND_NAME)
+#undef FM_BACKEND_NAME
+  };
+
+  static const BackendTable linked_table = {{
+#define FM_BACKEND_LINKED(fn) reinterpret_cast<void*>(&fn),
+      FM_BACKEND_ROUTINES(FM_BACKEND_LINKED)
+#undef FM_BACKEND_LINKED
+    }};
+
+  static std::atomic<const BackendTable*> active_table(&linked_table);
+
+  const BackendTable& ActiveBackend() {
+    return *active_table.load(std::memory_order_acquire);
+  }
+
+  static void* Lookup(void *blas, void *lapack, const char *name) {
+    void *sym = nullptr;
+    bool is_cblas = (strncmp(name,"cblas_",6) == 0);
+    // LAPACK routines come from the LAPACK library if one was given,
+    // BLAS routines from the BLAS library.
+    if (!is_cblas && lapack) sym = dlsym(lapack,name);
+    if (!sym && blas) sym = dlsym(blas,name);
+    if (!sym && is_cblas && lapack) sym = dlsym(lapack,name);
+    return sym;
+  }
+
+  static void ExpandAlias(std::string &blas, std::string &lapack) {
+#ifdef __APPLE__
+    const char *openblas = "libopenblas.dylib";
+    const char *mkl = "libmkl_rt.dylib";
+    const char *refblas = "libblas.dylib";
+    const char *reflapack = "liblapack.dylib";
+#else
+    const char *openblas = "libopenblas.so.0";
+    const char *mkl = "libmkl_rt.so";
+    const char *refblas = "libblas.so.3";
+    const char *reflapack = "liblapack.so.3";
+#endif
+    if (blas == "openblas") blas = openblas;
+    else if (blas == "mkl") blas = mkl;
+    else if (blas == "reference") {
+      blas = refblas;
+      if (lapack.empty()) lapack = reflapack;
+    }
+  }
+
+  bool LoadBackend(const std::string &blas_name, const std::string &lapack_name, std::string &error) {
+    std::string blas(blas_name);
+    std::string lapack(lapack_name);
+    ExpandAlias(blas,lapack);
+    void *bh = dlopen(blas.c_str(),RTLD_NOW | RTLD_LOCAL);
+    if (!bh) {
+      error = std::string("Unable to load BLAS library ") + blas + ": " + dlerror();
+      return false;
+    }
+    void *lh = nullptr;
+    if (!lapack.empty()) {
+      lh = dlopen(lapack.c_str(),RTLD_NOW | RTLD_LOCAL);
+      if (!lh) {
+        error = std::string("Unable to load LAPACK library ") + lapack + ": " + dlerror();
+        dlclose(bh);
+        return false;
+      }
+    }
+    if (!dlsym(bh,"cblas_dgemm") && !dlsym(bh,"dgemm_")) {
+      error = std::string("Library ") + blas + " does not look like a BLAS implementation";
+      if (lh) dlclose(lh);
+      dlclose(bh);
+      return false;
+    }
+    BackendTable *table = new BackendTable;
+    std::vector<std::string> missing;
+    for (int i=0;i<BACKEND_ROUTINE_COUNT;i++) {
+      table->routines[i] = Lookup(bh,lh,routine_names[i]);
+      if (!table->routines[i]) {
+        table->routines[i] = linked_table.routines[i];
+        missing.push_back(routine_names[i]);
+      }
+    }
+    Backend &b = TheBackend();
+    std::lock_guard<std::mutex> guard(b.lock);
+    b.blas = bh;
+    b.lapack = lh;
+    b.blas_path = blas;
+    b.lapack_path = lapack;
+    b.missing = missing;
+    active_table.store(table,std::memory_order_release);
+    return true;
+  }
+
+  void ResetBackend() {
+    Backend &b = TheBackend();
+    std::lock_guard<std::mutex> guard(b.lock);
+    active_table.store(&linked_table,std::memory_order_release);
+    b.blas = nullptr;
+    b.lapack = nullptr;
+    b.blas_path.clear();
+    b.lapack_path.clear();
+    b.missing.clear();
+  }
+
+  // Find the library that provides the linked implementation, so that we
+  // can query it in the same way as a loaded one.
+  static void* LinkedHandle(std::string &path) {
+    static std::once_flag once;
+    static void *handle = nullptr;
+    static std::string linked_path;
+    std::call_once(once,[]() {
+        Dl_info info;
+        if (!dladdr(reinterpret_cast<void*>(&cblas_dgemm),&info) || !info.dli_fname)
+          return;
+        linked_path = info.dli_fname;
+        handle = dlopen(info.dli_fname,RTLD_LAZY | RTLD_NOLOAD);
+      });
+    path = linked_path;
+    return handle;
+  }
+
+  static void* ActiveHandle(std::string &blas, std::string &lapack,
+                            std::vector<std::string> *missing = nullptr) {
+    Backend &b = TheBackend();
+    std::lock_guard<std::mutex> guard(b.lock);
+    if (b.blas) {
+      blas = b.blas_path;
+      lapack = b.lapack_path;
+      if (missing) *missing = b.missing;
+      return b.blas;
+    }
+    return nullptr;
+  }
+
+  static int QueryThreads(void *handle) {
+    if (!handle) return 1;
+    if (auto f = reinterpret_cast<int (*)()>(dlsym(handle,"openblas_get_num_threads")))
+      return f();
+    if (auto f = reinterpret_cast<int (*)()>(dlsym(handle,"MKL_Get_Max_Threads")))
+      return f();
+    if (auto f = reinterpret_cast<int64_t (*)()>(dlsym(handle,"bli_thread_get_num_threads")))
+      return static_cast<int>(f());
+    // Libraries without a thread query (e.g., the reference BLAS) are
+    // treated as single threaded.
+    return 1;
+  }
+
+  BackendInfo GetBackendInfo() {
+    BackendInfo info;
+    void *handle = ActiveHandle(info.blas,info.lapack,&info.missing);
+    if (handle) {
+      info.name = info.blas;
+    } else {
+      handle = LinkedHandle(info.blas);
+      info.name = "linked";
+    }
+    if (handle) {
+      if (auto f = reinterpret_cast<char* (*)()>(dlsym(handle,"openblas_get_config")))
+        info.name += std::string(" (") + f() + ")";
+    }
+    info.threads = QueryThreads(handle);
+    return info;
+  }
+
+  bool SetBackendThreads(int threads) {
+    std::string blas, lapack;
+    void *handle = ActiveHandle(blas,lapack);
+    if (!handle) handle = LinkedHandle(blas);
+    if (!handle) return false;
+    if (auto f = reinterpret_cast<void (*)(int)>(dlsym(handle,"openblas_set_num_threads"))) {
+      f(threads);
+      return true;
+    }
+    if (auto f = reinterpret_cast<void (*)(int)>(dlsym(handle,"MKL_Set_Num_Threads"))) {
+      f(threads);
+      return true;
+    }
+    if (auto f = reinterpret_cast<void (*)(int64_t)>(dlsym(handle,"bli_thread_set_num_threads"))) {
+      f(threads);
+      return true;
+    }
+    return false;
+  }
+
+  void InitBackend() {
+    static std::once_flag once;
+    std::call_once(once,[]() {
+        const char *blas = getenv("FREEMAT_BLAS");
+        const char *lapack = getenv("FREEMAT_LAPACK");
+        if (!blas) return;
+        std::string error;
+        // A bad setting should not stop the module from loading - we just
+        // keep using the linked implementation.
+        LoadBackend(blas,lapack ? lapack : "",error);
+      });
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef __blas_backend_hpp__
+#define __blas_backend_hpp__
+
+#include <string>
+#include <vector>
+
+// The BLAS and LAPACK routines are called through a backend layer, so that
+// the implementation can be switched at run time without rebuilding the
+// addon.  By default the implementation the addon was linked against is
+// used.  Setting FREEMAT_BLAS (and optionally FREEMAT_LAPACK) to a shared
+// library path, or to one of the aliases "openblas", "mkl" or "reference",
+// loads that library with dlopen instead.  Symbols that the loaded library
+// does not provide fall back to the linked implementation, and are listed
+// in the backend info.
+//
+// The routines are resolved once, when a backend is loaded, into a table
+// that is swapped in atomically, so a call only costs an indirection.
+
+// The routines called through the backend.  Each is declared in cblas.h or
+// LAPACK.hpp.
+#define FM_BACKEND_ROUTINES(X)                                          \
+  X(cblas_dgemm) X(cblas_dgemv) X(cblas_sgemm) X(cblas_zgemm) X(cblas_ztrsm) \
+  X(dlamch_) X(slamch_) X(dgesvx_) X(zgesvx_) X(sgesvx_) X(cgesvx_)    \
+  X(dgels_) X(zgels_) X(dgelsy_) X(zgelsy_) X(sgelsy_) X(cgelsy_)      \
+  X(dgelsd_) X(zgelsd_) X(dgetrf_) X(zgetrf_) X(dgetri_) X(zgetri_)    \
+  X(dgetrs_) X(zgetrs_) X(dgecon_) X(zgecon_) X(dgeqrf_) X(zgeqrf_)    \
+  X(dorgqr_) X(zungqr_) X(dpotrf_) X(zpotrf_) X(dgesdd_) X(zgesdd_)    \
+  X(dgesvd_) X(zgesvd_) X(dsyev_) X(zheev_) X(dsyevd_) X(zheevd_)      \
+  X(dgeev_) X(zgeev_) X(zgees_)
+
+namespace FM {
+
+  enum BackendRoutine {
+#define FM_BACKEND_ENUM(fn) BACKEND_##fn,
+    FM_BACKEND_ROUTINES(FM_BACKEND_ENUM)
+#undef FM_BACKEND_ENUM
+    BACKEND_ROUTINE_COUNT
+  };
+
+  // The entry points of a backend, indexed by BackendRoutine
+  struct BackendTable {
+    void *routines[BACKEND_ROUTINE_COUNT];
+  };
+
+  // The table of the active backend
+  const BackendTable& ActiveBackend();
+
+  struct BackendInfo {
+    std::string name;
+    std::string blas;
+    std::string lapack;
+    int threads;
+    // Routines taken from the linked implementation, as the loaded
+    // libraries do not export them
+    std::vector<std::string> missing;
+  };
+
+  // Load the given BLAS (and LAPACK, which may be empty) libraries.  On
+  // failure the current backend is left in place, and error is set.
+  bool LoadBackend(const std::string &blas, const std::string &lapack, std::string &error);
+
+  // Return to the linked implementation.
+  void ResetBackend();
+
+  BackendInfo GetBackendInfo();
+
+  // Set the number of threads used by the backend, if it supports it.
+  bool SetBackendThreads(int threads);
+
+  // Honour FREEMAT_BLAS/FREEMAT_LAPACK.  Safe to call more than once.
+  void InitBackend();
+}
+
+#define FM_BACKEND(fn) (reinterpret_cast<decltype(&fn)>(FM::ActiveBackend().routines[FM::BACKEND_##fn]))
+
+#endif
@@ -0,0 +1,67 @@
+#include "broadcast.hpp"
+#include "cpu_dispatch.hpp"
+
+namespace FM {
+
+  bool PlanBroadcast(const std::vector<size_t> &adims, const std::vector<size_t> &bdims,
+                     std::vector<size_t> &dims, BroadcastPlan &plan, std::string &error) {
+    const size_t count = std::max(adims.size(),bdims.size());
+    dims.assign(count,1);
+    plan.n.clear();
+    plan.astride.clear();
+    plan.bstride.clear();
+    plan.elements = 1;
+    size_t as = 1, bs = 1;
+    for (size_t k=0;k<count;k++) {
+      const size_t na = (k < adims.size()) ? adims[k] : 1;
+      const size_t nb = (k < bdims.size()) ? bdims[k] : 1;
+      if ((na != nb) && (na != 1) && (nb != 1)) {
+        error = "Cannot apply an operator to arrays whose dimensions do not agree";
+        return false;
+      }
+      const size_t n = (na == 1) ? nb : na;
+      dims[k] = n;
+      plan.elements *= n;
+      const size_t sa = (na == 1) ? 0 : as;
+      const size_t sb = (nb == 1) ? 0 : bs;
+      as *= na;
+      bs *= nb;
+      if (n == 1) continue;
+      // A dimension merges with the previous one when it continues it in
+      // each operand (an operand that is expanded along both continues it)
+      if (!plan.n.empty() &&
+          (sa == plan.astride.back()*plan.n.back()) &&
+          (sb == plan.bstride.back()*plan.n.back())) {
+        plan.n.back() *= n;
+        continue;
+      }
+      plan.n.push_back(n);
+      plan.astride.push_back(sa);
+      plan.bstride.push_back(sb);
+    }
+    if (plan.n.empty()) {
+      plan.n.push_back(1);
+      plan.astride.push_back(1);
+      plan.bstride.push_back(1);
+    }
+    return true;
+  }
+
+  void ApplyBroadcast(const BroadcastPlan &plan, int op, const double *ar, const double *ai,
+                      const double *br, const double *bi, double *yr, double *yi) {
+    const size_t sa = plan.astride[0];
+    const size_t sb = plan.bstride[0];
+    const bool complex = ai || bi;
+    const KernelTable &kernels = Kernels();
+    ForEachBroadcastPiece(plan,[&](size_t a, size_t b, size_t y, size_t n) {
+        // The complex kernel is not in the dispatch table, as it would be
+        // contracted to FMAs for some instruction sets and so round
+        // differently from complex.ts
+        if (complex)
+          zbinary_kernel(op,ar+a,ai ? ai+a : nullptr,sa,br+b,bi ? bi+b : nullptr,sb,
+                         yr+y,yi ? yi+y : nullptr,n);
+        else
+          kernels.dbinary(op,ar+a,sa,br+b,sb,yr+y,n);
+      });
+  }
+}
@@ -0,0 +1,239 @@
+#ifndef __broadcast_hpp__
+#define __broadcast_hpp__
+
+#include "parallel.hpp"
+#include "tuning.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Elementwise arithmetic and comparisons with implicit expansion: each
+// dimension of the operands must agree or be 1, and a dimension of 1 is
+// repeated to the length of the other (so a [n,1] column and a [1,m] row
+// give an [n,m] result).  Nothing is expanded in memory; the kernels run
+// over the innermost (merged) dimension with a stride of 1 or 0 for each
+// operand.  Real and planar complex data are supported, and a complex
+// operand may be mixed with a real one.
+
+namespace FM {
+
+  enum BinaryOp {
+    BINARY_PLUS = 0,
+    BINARY_MINUS = 1,
+    BINARY_TIMES = 2,
+    BINARY_RDIVIDE = 3,     // a./b
+    BINARY_LDIVIDE = 4,     // a.\b, i.e., b./a
+    BINARY_LT = 5,
+    BINARY_LE = 6,
+    BINARY_GT = 7,
+    BINARY_GE = 8,
+    BINARY_EQ = 9,
+    BINARY_NE = 10
+  };
+
+  // Comparisons give real (logical) results, and for complex operands the
+  // ordering comparisons look only at the real parts
+  inline bool IsComparison(int op) {
+    return (op >= BINARY_LT) && (op <= BINARY_NE);
+  }
+
+  // Complex products and quotients, with the same special cases (for real
+  // or imaginary operands) as the scalar code in complex.ts, so that the
+  // results do not depend on which path computed them
+  inline void complex_times(double ar, double ai, double br, double bi, double &cr, double &ci) {
+    if ((ai == 0) && (bi == 0)) {
+      cr = ar*br; ci = 0;
+    } else if ((ai == 0) && (br == 0)) {
+      cr = 0; ci = ar*bi;
+    } else if ((ar == 0) && (bi == 0)) {
+      cr = 0; ci = ai*br;
+    } else if (ai == 0) {
+      cr = ar*br; ci = ar*bi;
+    } else if (bi == 0) {
+      cr = br*ar; ci = br*ai;
+    } else {
+      cr = ar*br - ai*bi;
+      ci = ar*bi + ai*br;
+    }
+  }
+
+  inline void complex_divide(double ar, double ai, double br, double bi, double &cr, double &ci) {
+    if ((ai == 0) && (bi == 0)) {
+      cr = ar/br; ci = 0;
+      return;
+    }
+    if (bi == 0) {
+      cr = ar/br; ci = ai/br;
+      return;
+    }
+    if ((ai == 0) && (br == 0)) {
+      cr = 0; ci = -ar/bi;
+      return;
+    }
+    if ((ar == br) && (ai == bi)) {
+      cr = 1; ci = 0;
+      return;
+    }
+    const double abr = (br < 0) ? -br : br;
+    const double abi = (bi < 0) ? -bi : bi;
+    if (abr <= abi) {
+      const double ratio = br/bi;
+      const double den = bi*(1 + ratio*ratio);
+      cr = (ar*ratio + ai)/den;
+      ci = (ai*ratio - ar)/den;
+    } else {
+      const double ratio = bi/br;
+      const double den = br*(1 + ratio*ratio);
+      cr = (ar + ai*ratio)/den;
+      ci = (ai - ar*ratio)/den;
+    }
+  }
+
+  template <class Op>
+  inline void binary_loop(const double *a, size_t sa, const double *b, size_t sb,
+                          double *y, size_t n, Op op) {
+    if (sa && sb) {
+      for (size_t i=0;i<n;i++) y[i] = op(a[i],b[i]);
+    } else if (sa) {
+      const double s = b[0];
+      for (size_t i=0;i<n;i++) y[i] = op(a[i],s);
+    } else if (sb) {
+      const double s = a[0];
+      for (size_t i=0;i<n;i++) y[i] = op(s,b[i]);
+    } else {
+      const double v = op(a[0],b[0]);
+      for (size_t i=0;i<n;i++) y[i] = v;
+    }
+  }
+
+  // y[i] = a[i*sa] op b[i*sb] for i < n, where sa and sb are 0 or 1
+  inline void binary_kernel(int op, const double *a, size_t sa, const double *b, size_t sb,
+                            double *y, size_t n) {
+    switch (op) {
+    case BINARY_PLUS:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return u + v;});
+      break;
+    case BINARY_MINUS:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return u - v;});
+      break;
+    case BINARY_TIMES:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return u * v;});
+      break;
+    case BINARY_RDIVIDE:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return u / v;});
+      break;
+    case BINARY_LDIVIDE:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return v / u;});
+      break;
+    case BINARY_LT:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return (u < v) ? 1.0 : 0.0;});
+      break;
+    case BINARY_LE:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return (u <= v) ? 1.0 : 0.0;});
+      break;
+    case BINARY_GT:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return (u > v) ? 1.0 : 0.0;});
+      break;
+    case BINARY_GE:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return (u >= v) ? 1.0 : 0.0;});
+      break;
+    case BINARY_EQ:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return (u == v) ? 1.0 : 0.0;});
+      break;
+    case BINARY_NE:
+      binary_loop(a,sa,b,sb,y,n,[](double u, double v) {return (u != v) ? 1.0 : 0.0;});
+      break;
+    }
+  }
+
+  // As binary_kernel for complex operands.  A null imaginary part is
+  // zero, and yi is not used by comparisons.
+  inline void zbinary_kernel(int op, const double *ar, const double *ai, size_t sa,
+                             const double *br, const double *bi, size_t sb,
+                             double *yr, double *yi, size_t n) {
+    for (size_t i=0;i<n;i++) {
+      const double xr = ar[i*sa], xi = ai ? ai[i*sa] : 0.0;
+      const double zr = br[i*sb], zi = bi ? bi[i*sb] : 0.0;
+      switch (op) {
+      case BINARY_PLUS: yr[i] = xr + zr; yi[i] = xi + zi; break;
+      case BINARY_MINUS: yr[i] = xr - zr; yi[i] = xi - zi; break;
+      case BINARY_TIMES: complex_times(xr,xi,zr,zi,yr[i],yi[i]); break;
+      case BINARY_RDIVIDE: complex_divide(xr,xi,zr,zi,yr[i],yi[i]); break;
+      case BINARY_LDIVIDE: complex_divide(zr,zi,xr,xi,yr[i],yi[i]); break;
+      case BINARY_LT: yr[i] = (xr < zr) ? 1.0 : 0.0; break;
+      case BINARY_LE: yr[i] = (xr <= zr) ? 1.0 : 0.0; break;
+      case BINARY_GT: yr[i] = (xr > zr) ? 1.0 : 0.0; break;
+      case BINARY_GE: yr[i] = (xr >= zr) ? 1.0 : 0.0; break;
+      case BINARY_EQ: yr[i] = ((xr == zr) && (xi == zi)) ? 1.0 : 0.0; break;
+      case BINARY_NE: yr[i] = ((xr != zr) || (xi != zi)) ? 1.0 : 0.0; break;
+      }
+    }
+  }
+
+  // The merged dimensions of a broadcast, innermost first, with the stride
+  // of each operand along them (0 where it is expanded)
+  struct BroadcastPlan {
+    std::vector<size_t> n;
+    std::vector<size_t> astride;
+    std::vector<size_t> bstride;
+    size_t elements;
+  };
+
+  // Finds the dimensions of a op b (into dims), or fails if they do not
+  // agree
+  bool PlanBroadcast(const std::vector<size_t> &adims, const std::vector<size_t> &bdims,
+                     std::vector<size_t> &dims, BroadcastPlan &plan, std::string &error);
+
+  // Long inner dimensions are split into pieces of this many elements, so
+  // that a single (merged) vector can still be shared between threads
+  const size_t BROADCAST_PIECE = size_t(1) << 14;
+
+  // Calls body(a, b, y, n) in parallel for each piece of a broadcast: the
+  // n results from offset y are of the operands from offsets a and b,
+  // with the strides plan.astride[0] and plan.bstride[0]
+  template <class Body>
+  void ForEachBroadcastPiece(const BroadcastPlan &plan, Body body) {
+    if (plan.elements == 0) return;
+    const size_t len = plan.n[0];
+    const size_t sa = plan.astride[0];
+    const size_t sb = plan.bstride[0];
+    const size_t rows = plan.elements/len;
+    const size_t pieces = (len + BROADCAST_PIECE - 1)/BROADCAST_PIECE;
+    const size_t per_item = std::min(len,BROADCAST_PIECE);
+    ParallelFor(rows*pieces,std::max<size_t>(1,ParallelGrain()/per_item),
+                [&](size_t begin, size_t end) {
+        std::vector<size_t> coord(plan.n.size(),0);
+        size_t row = begin/pieces;
+        size_t aoff = 0, boff = 0;
+        for (size_t k=1;k<plan.n.size();k++) {
+          coord[k] = row % plan.n[k];
+          row /= plan.n[k];
+          aoff += coord[k]*plan.astride[k];
+          boff += coord[k]*plan.bstride[k];
+        }
+        for (size_t item=begin;item<end;item++) {
+          const size_t first = (item % pieces)*BROADCAST_PIECE;
+          body(aoff + first*sa,boff + first*sb,(item/pieces)*len + first,
+               std::min(len - first,BROADCAST_PIECE));
+          if ((item % pieces) != pieces-1) continue;
+          // Step to the next row
+          for (size_t k=1;k<plan.n.size();k++) {
+            aoff += plan.astride[k];
+            boff += plan.bstride[k];
+            if (++coord[k] < plan.n[k]) break;
+            aoff -= plan.n[k]*plan.astride[k];
+            boff -= plan.n[k]*plan.bstride[k];
+            coord[k] = 0;
+          }
+        }
+      });
+  }
+
+  // Evaluates a op b.  ai, bi and yi are null for real data (yi is always
+  // null for comparisons).
+  void ApplyBroadcast(const BroadcastPlan &plan, int op, const double *ar, const double *ai,
+                      const double *br, const double *bi, double *yr, double *yi);
+}
+
+#endif
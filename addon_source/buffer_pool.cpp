@@ -0,0 +1,185 @@
+#include "buffer_pool.hpp"
+#include "addon_data.hpp"
+#include <mutex>
+#include <vector>
+#include <stdlib.h>
+
+namespace FM {
+
+  using namespace v8;
+
+  // Blocks are kept in power of two size classes
+  const int POOL_CLASSES = 48;
+
+  // Default bound on the memory held in the pool, overridden by the
+  // FREEMAT_POOL_LIMIT environment variable (in bytes)
+  const size_t POOL_DEFAULT_LIMIT = size_t(256) << 20;
+
+  struct Pool {
+    std::mutex lock;
+    std::vector<void*> free_blocks[POOL_CLASSES];
+    PoolStats stats;
+    Pool() {
+      stats.hits = 0;
+      stats.misses = 0;
+      stats.cached_bytes = 0;
+      stats.live_bytes = 0;
+      const char *limit = getenv("FREEMAT_POOL_LIMIT");
+      stats.limit_bytes = limit ? strtoull(limit,nullptr,10) : POOL_DEFAULT_LIMIT;
+    }
+  };
+
+  static Pool& ThePool() {
+    static Pool pool;
+    return pool;
+  }
+
+  struct PooledBuffer {
+    Persistent<ArrayBuffer> handle;
+    Isolate *isolate;
+    void *data;
+    int cls;
+  };
+
+  static int ClassIndex(size_t bytes) {
+    int k = 0;
+    while ((size_t(1) << k) < bytes) k++;
+    return k;
+  }
+
+  static size_t ClassBytes(int cls) {
+    return size_t(1) << cls;
+  }
+
+  static void* PoolAcquire(int cls) {
+    Pool &p = ThePool();
+    const size_t size = ClassBytes(cls);
+    {
+      std::lock_guard<std::mutex> guard(p.lock);
+      p.stats.live_bytes += size;
+      auto &blocks = p.free_blocks[cls];
+      if (!blocks.empty()) {
+        void *block = blocks.back();
+        blocks.pop_back();
+        p.stats.hits++;
+        p.stats.cached_bytes -= size;
+        return block;
+      }
+      p.stats.misses++;
+    }
+    void *block = nullptr;
+    // Cache line alignment helps the vectorized kernels
+    if (posix_memalign(&block,64,size) != 0) {
+      std::lock_guard<std::mutex> guard(p.lock);
+      p.stats.live_bytes -= size;
+      return nullptr;
+    }
+    return block;
+  }
+
+  static void PoolRelease(void *block, int cls) {
+    Pool &p = ThePool();
+    const size_t size = ClassBytes(cls);
+    {
+      std::lock_guard<std::mutex> guard(p.lock);
+      p.stats.live_bytes -= size;
+      if (p.stats.cached_bytes + size <= p.stats.limit_bytes) {
+        p.free_blocks[cls].push_back(block);
+        p.stats.cached_bytes += size;
+        return;
+      }
+    }
+    free(block);
+  }
+
+  bool UsePool(Isolate *isolate, size_t bytes) {
+    return (bytes >= POOL_MIN_BYTES) && !GetAddonData(isolate).shared_results;
+  }
+
+  void* AllocateResult(Isolate *isolate, size_t bytes) {
+    if (UsePool(isolate,bytes))
+      return PoolAcquire(ClassIndex(bytes));
+    return calloc(bytes,1);
+  }
+
+  static void FinishRelease(PooledBuffer *pb) {
+    const size_t size = ClassBytes(pb->cls);
+    AddonData &data = GetAddonData(pb->isolate);
+    data.pooled.erase(pb);
+    data.external_bytes -= size;
+    pb->isolate->AdjustAmountOfExternalAllocatedMemory(-static_cast<int64_t>(size));
+    PoolRelease(pb->data,pb->cls);
+    delete pb;
+  }
+
+  static void ReleaseSecondPass(const WeakCallbackInfo<PooledBuffer> &info) {
+    FinishRelease(info.GetParameter());
+  }
+
+  // Only handle resets are allowed in the first pass, the rest of the
+  // work happens once the GC is done.
+  static void ReleaseFirstPass(const WeakCallbackInfo<PooledBuffer> &info) {
+    info.GetParameter()->handle.Reset();
+    info.SetSecondPassCallback(ReleaseSecondPass);
+  }
+
+  Local<ArrayBuffer> WrapResult(Isolate *isolate, void *data, size_t bytes) {
+    if (!UsePool(isolate,bytes))
+      return ArrayBuffer::New(isolate, data, bytes, ArrayBufferCreationMode::kInternalized);
+    auto buff = ArrayBuffer::New(isolate, data, bytes, ArrayBufferCreationMode::kExternalized);
+    PooledBuffer *pb = new PooledBuffer;
+    pb->isolate = isolate;
+    pb->data = data;
+    pb->cls = ClassIndex(bytes);
+    pb->handle.Reset(isolate,buff);
+    pb->handle.SetWeak(pb,ReleaseFirstPass,WeakCallbackType::kParameter);
+    const size_t size = ClassBytes(pb->cls);
+    AddonData &addon = GetAddonData(isolate);
+    addon.pooled.insert(pb);
+    addon.external_bytes += size;
+    isolate->AdjustAmountOfExternalAllocatedMemory(static_cast<int64_t>(size));
+    return buff;
+  }
+
+  PoolStats GetPoolStats() {
+    Pool &p = ThePool();
+    std::lock_guard<std::mutex> guard(p.lock);
+    return p.stats;
+  }
+
+  void TrimPool() {
+    Pool &p = ThePool();
+    std::vector<void*> blocks;
+    {
+      std::lock_guard<std::mutex> guard(p.lock);
+      for (int i=0;i<POOL_CLASSES;i++) {
+        blocks.insert(blocks.end(),p.free_blocks[i].begin(),p.free_blocks[i].end());
+        p.free_blocks[i].clear();
+      }
+      p.stats.cached_bytes = 0;
+    }
+    for (auto block : blocks) free(block);
+  }
+
+  void SetPoolLimit(size_t bytes) {
+    {
+      Pool &p = ThePool();
+      std::lock_guard<std::mutex> guard(p.lock);
+      p.stats.limit_bytes = bytes;
+      if (p.stats.cached_bytes <= bytes) return;
+    }
+    TrimPool();
+  }
+
+  void ReleasePooledBuffers(Isolate *isolate) {
+    AddonData &data = GetAddonData(isolate);
+    std::vector<PooledBuffer*> pending(data.pooled.begin(),data.pooled.end());
+    for (auto pb : pending) {
+      // Buffers already in the middle of a GC callback finish on their own
+      if (pb->handle.IsEmpty()) continue;
+      pb->handle.ClearWeak();
+      pb->handle.Reset();
+      FinishRelease(pb);
+    }
+  }
+}
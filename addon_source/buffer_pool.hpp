@@ -0,0 +1,54 @@
+#ifndef __buffer_pool_hpp__
+#define __buffer_pool_hpp__
+
+#include <node.h>
+#include <cstddef>
+#include <stdint.h>
+
+// Native results that are large enough are allocated from a size-classed
+// pool of blocks.  The blocks are handed to V8 as externalized ArrayBuffers,
+// and return to the pool (rather than to the system) when the ArrayBuffer
+// is collected, so that same-size temporaries in tight loops reuse memory.
+// The bytes held by live blocks are reported to V8 through
+// AdjustAmountOfExternalAllocatedMemory, so the GC sees the off-heap
+// pressure.  Pooled results can be copied to other workers, but not
+// transferred.
+
+namespace FM {
+
+  // Results smaller than this are left to the V8 allocator
+  const size_t POOL_MIN_BYTES = 32768;
+
+  struct PoolStats {
+    uint64_t hits;           // Allocations served from the pool
+    uint64_t misses;         // Allocations that went to the system
+    size_t cached_bytes;     // Bytes held in the pool, free for reuse
+    size_t live_bytes;       // Bytes in pooled blocks held by ArrayBuffers
+    size_t limit_bytes;      // Upper bound on cached_bytes
+  };
+
+  struct PooledBuffer;
+
+  // Returns true if a result of this size, for this isolate, should come
+  // from the pool.  AllocateResult and WrapResult use the same test.
+  bool UsePool(v8::Isolate *isolate, size_t bytes);
+
+  // Allocate storage for a native result.  Pooled blocks are not zeroed.
+  void* AllocateResult(v8::Isolate *isolate, size_t bytes);
+
+  // Wrap storage from AllocateResult in an ArrayBuffer that owns it.
+  v8::Local<v8::ArrayBuffer> WrapResult(v8::Isolate *isolate, void *data, size_t bytes);
+
+  PoolStats GetPoolStats();
+
+  // Release all cached blocks to the system
+  void TrimPool();
+
+  void SetPoolLimit(size_t bytes);
+
+  // Called when an isolate goes away, to recover blocks whose ArrayBuffers
+  // were never collected.
+  void ReleasePooledBuffers(v8::Isolate *isolate);
+}
+
+#endif
@@ -0,0 +1,405 @@
+#include "convolve.hpp"
+#include "cpu_dispatch.hpp"
+#include "fft.hpp"
+#include "nd_layout.hpp"
+#include "parallel.hpp"
+#include <cmath>
+#include <limits>
+#include <memory>
+
+namespace FM {
+
+  // The cost model counts multiply-adds of the direct kernel.  A complex
+  // FFT of length n is taken to cost CONV_FFT_COST*n*log2(n) of them.  The
+  // direct kernel vectorizes well, so on x86 the crossover for a long real
+  // signal comes at a kernel of about 256 taps.
+  const double CONV_FFT_COST = 18;
+
+  // The least work (in multiply-adds) worth giving to a thread
+  const size_t CONV_MIN_WORK_PER_THREAD = size_t(1) << 17;
+
+  static double FFTCost(size_t n) {
+    return CONV_FFT_COST*n*std::log2(static_cast<double>(n));
+  }
+
+  static size_t NextPow2(size_t n) {
+    size_t m = 1;
+    while (m < n) m *= 2;
+    return m;
+  }
+
+  // Run body over [0,count), split across threads or not
+  template <class F>
+  static void Split(bool parallel, size_t count, size_t min_chunk, F body) {
+    if (parallel)
+      ParallelFor(count,min_chunk,body);
+    else if (count)
+      body(size_t(0),count);
+  }
+
+  // The number of real convolutions the direct path needs
+  static size_t RealProducts(const ConvOperand &x, const ConvOperand &h) {
+    return 1 + (h.im ? 1 : 0) + (x.im ? 1 : 0) + ((x.im && h.im) ? 1 : 0);
+  }
+
+  // Outputs [begin,end) of the full convolution, added into y.  neg_h_im is
+  // the negated imaginary part of h.
+  static void DirectRange(const ConvOperand &x, const ConvOperand &h, const double *neg_h_im,
+                          size_t begin, size_t end, double *y_re, double *y_im) {
+    const size_t nx = x.size();
+    const size_t nh = h.size();
+    DispatchConvolve(x.re,nx,h.re,nh,y_re,begin,end);
+    if (x.im && h.im) DispatchConvolve(x.im,nx,neg_h_im,nh,y_re,begin,end);
+    if (h.im) DispatchConvolve(x.re,nx,h.im,nh,y_im,begin,end);
+    if (x.im) DispatchConvolve(x.im,nx,h.re,nh,y_im,begin,end);
+  }
+
+  // Overlap-add: blocks of L = N-nh+1 inputs are convolved with h by
+  // transforms of length N, and the results added up.  When everything is
+  // real, two blocks are packed into the real and imaginary parts of one
+  // transform.
+  struct OverlapAdd {
+    size_t N;
+    size_t L;
+    bool real;
+    std::shared_ptr<const FFTPlan> plan;
+    std::vector<fft_complex> H;
+  };
+
+  // The cheapest transform length for the overlap-add of the given problem,
+  // and what it costs
+  static size_t OverlapAddSize(size_t nx, size_t nh, size_t outputs, bool real, double &cost) {
+    // The inputs that contribute to the outputs
+    const size_t span = std::min(nx,outputs+nh-1);
+    cost = std::numeric_limits<double>::infinity();
+    size_t best = 0;
+    for (size_t N=NextPow2(2*nh);;N*=2) {
+      const size_t L = N-nh+1;
+      size_t segments = (span+L-1)/L;
+      if (real) segments = (segments+1)/2;
+      const double c = segments*(2*FFTCost(N) + 4.0*N);
+      if (c < cost) {
+        cost = c;
+        best = N;
+      }
+      if (L >= span) break;
+    }
+    return best;
+  }
+
+  static void FFTRange(const ConvOperand &x, const ConvOperand &h, const OverlapAdd &oa,
+                       size_t o0, size_t o1, double *y_re, double *y_im) {
+    const size_t nx = x.size();
+    const size_t nh = h.size();
+    const size_t N = oa.N;
+    const size_t L = oa.L;
+    // Only inputs [s0,s1) contribute to outputs [o0,o1)
+    const size_t s0 = (o0 >= nh-1) ? o0-(nh-1) : 0;
+    const size_t s1 = std::min(o1,nx);
+    if (s0 >= s1) return;
+    std::vector<fft_complex> a(N);
+    std::vector<fft_complex> scratch(oa.plan->work_size());
+    std::vector<fft_complex> acc(s1-s0+N);
+    const double scale = 1.0/N;
+    for (size_t seg=s0;seg<s1;seg+=(oa.real ? 2*L : L)) {
+      const size_t n1 = std::min(L,s1-seg);
+      std::fill(a.begin(),a.end(),fft_complex());
+      for (size_t k=0;k<n1;k++)
+        a[k] = fft_complex(x.re[seg+k],x.im ? x.im[seg+k] : 0.0);
+      const size_t seg2 = seg+L;
+      const size_t n2 = (oa.real && (seg2 < s1)) ? std::min(L,s1-seg2) : 0;
+      for (size_t k=0;k<n2;k++)
+        a[k].imag = x.re[seg2+k];
+      oa.plan->Forward(a.data(),scratch.data());
+      // The inverse is the conjugate of the transform of the conjugate
+      for (size_t k=0;k<N;k++)
+        a[k] = complex_conj(a[k]*oa.H[k]);
+      oa.plan->Forward(a.data(),scratch.data());
+      fft_complex *out = &acc[seg-s0];
+      if (oa.real) {
+        for (size_t k=0;k<N;k++)
+          out[k].real += scale*a[k].real;
+        if (n2) {
+          out += L;
+          for (size_t k=0;k<N;k++)
+            out[k].real -= scale*a[k].imag;
+        }
+      } else {
+        for (size_t k=0;k<N;k++)
+          out[k] = out[k] + fft_complex(scale*a[k].real,-scale*a[k].imag);
+      }
+    }
+    for (size_t o=o0;o<o1;o++) {
+      y_re[o-o0] = acc[o-s0].real;
+      if (y_im) y_im[o-o0] = acc[o-s0].imag;
+    }
+  }
+
+  static void ConvolveImpl(const ConvOperand &x0, const ConvOperand &h0, size_t begin, size_t end,
+                           ConvMethod method, bool parallel, double *y_re, double *y_im) {
+    const bool complex = x0.im || h0.im;
+    std::fill(y_re,y_re+(end-begin),0.0);
+    if (complex) std::fill(y_im,y_im+(end-begin),0.0);
+    // Convolution commutes, so the shorter operand is used as the kernel
+    ConvOperand x = x0;
+    ConvOperand h = h0;
+    if (h.size() > x.size()) std::swap(x,h);
+    const size_t nx = x.size();
+    const size_t nh = h.size();
+    if ((nx == 0) || (nh == 0) || (begin >= end)) return;
+    const size_t outputs = end-begin;
+    double fft_cost;
+    const size_t N = OverlapAddSize(nx,nh,outputs,!complex,fft_cost);
+    if (method == CONV_AUTO) {
+      const double direct_cost = static_cast<double>(outputs)*nh*RealProducts(x,h);
+      method = (fft_cost < direct_cost) ? CONV_FFT : CONV_DIRECT;
+    }
+    if (method == CONV_DIRECT) {
+      std::vector<double> neg_h_im(h.im ? nh : 0);
+      for (size_t k=0;k<neg_h_im.size();k++)
+        neg_h_im[k] = -h.im[k];
+      Split(parallel,outputs,std::max<size_t>(1,CONV_MIN_WORK_PER_THREAD/nh),
+            [&](size_t b, size_t e) {
+              DirectRange(x,h,neg_h_im.data(),begin+b,begin+e,y_re+b,y_im ? y_im+b : nullptr);
+            });
+      return;
+    }
+    OverlapAdd oa;
+    oa.N = N;
+    oa.L = N-nh+1;
+    oa.real = !complex;
+    oa.plan = GetFFTPlan(N);
+    oa.H.assign(N,fft_complex());
+    for (size_t k=0;k<nh;k++)
+      oa.H[k] = fft_complex(h.re[k],h.im ? h.im[k] : 0.0);
+    std::vector<fft_complex> scratch(oa.plan->work_size());
+    oa.plan->Forward(oa.H.data(),scratch.data());
+    Split(parallel,outputs,4*oa.L,[&](size_t b, size_t e) {
+        FFTRange(x,h,oa,begin+b,begin+e,y_re+b,complex ? y_im+b : nullptr);
+      });
+  }
+
+  void Convolve(const ConvOperand &x, const ConvOperand &h, size_t begin, size_t end,
+                ConvMethod method, double *y_re, double *y_im) {
+    ConvolveImpl(x,h,begin,end,method,true,y_re,y_im);
+  }
+
+  // The 2D convolution is done a column at a time: column c of the output
+  // gets the 1D convolutions of columns i of A and j of B with i+j = c.
+  static void Convolve2Direct(const ConvOperand &A, const ConvOperand &B, size_t row0, size_t rows,
+                              size_t col0, size_t cols, double *y_re, double *y_im) {
+    std::vector<double> neg_b_im(B.im ? B.size() : 0);
+    for (size_t k=0;k<neg_b_im.size();k++)
+      neg_b_im[k] = -B.im[k];
+    const size_t work = std::max<size_t>(1,rows*B.size()*RealProducts(A,B));
+    ParallelFor(cols,std::max<size_t>(1,CONV_MIN_WORK_PER_THREAD/work),[&](size_t c0, size_t c1) {
+        for (size_t c=c0;c<c1;c++) {
+          const size_t col = col0+c;
+          for (size_t j=0;j<B.cols;j++) {
+            if ((col < j) || (col-j >= A.cols)) continue;
+            const size_t i = col-j;
+            ConvOperand a = {A.re+i*A.rows,A.im ? A.im+i*A.rows : nullptr,A.rows,1};
+            ConvOperand b = {B.re+j*B.rows,B.im ? B.im+j*B.rows : nullptr,B.rows,1};
+            DirectRange(a,b,B.im ? &neg_b_im[j*B.rows] : nullptr,row0,row0+rows,
+                        y_re+c*rows,y_im ? y_im+c*rows : nullptr);
+          }
+        }
+      });
+  }
+
+  // Both operands are zero padded to P x Q and transformed along each
+  // dimension in turn
+  static void Transform2(const ConvOperand &A, size_t P, size_t Q,
+                         std::vector<double> &re, std::vector<double> &im) {
+    std::vector<double> t_re(P*A.cols), t_im(P*A.cols);
+    FFTDimension({A.rows,A.cols},0,P,false,A.re,A.im,false,t_re.data(),t_im.data());
+    re.resize(P*Q);
+    im.resize(P*Q);
+    FFTDimension({P,A.cols},1,Q,false,t_re.data(),t_im.data(),false,re.data(),im.data());
+  }
+
+  static void Convolve2FFT(const ConvOperand &A, const ConvOperand &B, size_t P, size_t Q,
+                           size_t row0, size_t rows, size_t col0, size_t cols,
+                           double *y_re, double *y_im) {
+    std::vector<double> a_re, a_im, b_re, b_im;
+    Transform2(A,P,Q,a_re,a_im);
+    Transform2(B,P,Q,b_re,b_im);
+    for (size_t k=0;k<P*Q;k++) {
+      const double re = a_re[k]*b_re[k] - a_im[k]*b_im[k];
+      const double im = a_re[k]*b_im[k] + a_im[k]*b_re[k];
+      a_re[k] = re;
+      a_im[k] = im;
+    }
+    const bool real = !A.im && !B.im;
+    FFTDimension({P,Q},1,Q,true,a_re.data(),a_im.data(),false,b_re.data(),b_im.data());
+    FFTDimension({P,Q},0,P,true,b_re.data(),b_im.data(),real,a_re.data(),a_im.data());
+    for (size_t c=0;c<cols;c++)
+      for (size_t r=0;r<rows;r++) {
+        const size_t k = (row0+r) + (col0+c)*P;
+        y_re[r+c*rows] = a_re[k];
+        if (!real) y_im[r+c*rows] = a_im[k];
+      }
+  }
+
+  void Convolve2(const ConvOperand &A0, const ConvOperand &B0, size_t row0, size_t rows,
+                 size_t col0, size_t cols, ConvMethod method, double *y_re, double *y_im) {
+    const bool complex = A0.im || B0.im;
+    std::fill(y_re,y_re+rows*cols,0.0);
+    if (complex) std::fill(y_im,y_im+rows*cols,0.0);
+    ConvOperand A = A0;
+    ConvOperand B = B0;
+    if (B.size() > A.size()) std::swap(A,B);
+    if ((A.size() == 0) || (B.size() == 0) || (rows == 0) || (cols == 0)) return;
+    const size_t P = FFTFastLength(A.rows+B.rows-1);
+    const size_t Q = FFTFastLength(A.cols+B.cols-1);
+    if (method == CONV_AUTO) {
+      const double direct_cost = static_cast<double>(rows)*cols*B.size()*RealProducts(A,B);
+      const double fft_cost = 3*CONV_FFT_COST*P*Q*std::log2(static_cast<double>(P*Q)) + 4.0*P*Q;
+      method = (fft_cost < direct_cost) ? CONV_FFT : CONV_DIRECT;
+    }
+    if (method == CONV_DIRECT)
+      Convolve2Direct(A,B,row0,rows,col0,cols,y_re,y_im);
+    else
+      Convolve2FFT(A,B,P,Q,row0,rows,col0,cols,y_re,y_im);
+  }
+
+  static inline void LoadValue(const double *re, const double *, size_t k, double &v) {
+    v = re[k];
+  }
+
+  static inline void LoadValue(const double *re, const double *im, size_t k, fft_complex &v) {
+    v = fft_complex(re[k],im ? im[k] : 0.0);
+  }
+
+  static inline void StoreValue(const double &v, double *re, double *, size_t k) {
+    re[k] = v;
+  }
+
+  static inline void StoreValue(const fft_complex &v, double *re, double *im, size_t k) {
+    re[k] = v.real;
+    im[k] = v.imag;
+  }
+
+  static inline double Divide(double a, double b) {
+    return a/b;
+  }
+
+  static inline fft_complex Divide(const fft_complex &a, const fft_complex &b) {
+    const double d = b.real*b.real + b.imag*b.imag;
+    return (1.0/d)*(a*complex_conj(b));
+  }
+
+  // Direct form II transposed, with b and a padded to the same length and
+  // scaled so that a[0] is 1
+  template <class T>
+  static void IIRFilter(const std::vector<T> &b, const std::vector<T> &a, const T *x, T *y,
+                        size_t len, T *z) {
+    const size_t order = b.size()-1;
+    std::fill(z,z+order,T());
+    for (size_t t=0;t<len;t++) {
+      const T xt = x[t];
+      const T yt = (order > 0) ? b[0]*xt + z[0] : b[0]*xt;
+      for (size_t i=0;i+1<order;i++)
+        z[i] = b[i+1]*xt + z[i+1] - a[i+1]*yt;
+      if (order > 0)
+        z[order-1] = b[order]*xt - a[order]*yt;
+      y[t] = yt;
+    }
+  }
+
+  template <class T>
+  static void FilterChannels(const ConvOperand &bop, const ConvOperand &aop,
+                             const VectorLayout &layout, const double *x_re, const double *x_im,
+                             double *y_re, double *y_im) {
+    const size_t order = std::max(bop.size(),aop.size())-1;
+    std::vector<T> b(order+1), a(order+1);
+    for (size_t k=0;k<bop.size();k++) LoadValue(bop.re,bop.im,k,b[k]);
+    for (size_t k=0;k<aop.size();k++) LoadValue(aop.re,aop.im,k,a[k]);
+    const T a0 = a[0];
+    for (auto &v : b) v = Divide(v,a0);
+    for (auto &v : a) v = Divide(v,a0);
+    const size_t n = layout.n;
+    const size_t stride = layout.stride;
+    const size_t work = std::max<size_t>(1,n*(2*order+1));
+    ParallelFor(layout.count,std::max<size_t>(1,CONV_MIN_WORK_PER_THREAD/work),
+                [&](size_t v0, size_t v1) {
+                  std::vector<T> x(n), y(n), z(order);
+                  for (size_t v=v0;v<v1;v++) {
+                    const size_t start = layout.start(v,n);
+                    for (size_t k=0;k<n;k++)
+                      LoadValue(x_re,x_im,start+k*stride,x[k]);
+                    IIRFilter(b,a,x.data(),y.data(),n,z.data());
+                    for (size_t k=0;k<n;k++)
+                      StoreValue(y[k],y_re,y_im,start+k*stride);
+                  }
+                });
+  }
+
+  // An FIR filter is the first n terms of a convolution.  With many
+  // channels each thread takes whole channels, otherwise each convolution
+  // is split.
+  static void FIRChannels(const ConvOperand &h, const VectorLayout &layout,
+                          const double *x_re, const double *x_im, double *y_re, double *y_im) {
+    const size_t n = layout.n;
+    const size_t stride = layout.stride;
+    const bool per_channel = layout.count >= static_cast<size_t>(KernelThreads());
+    const size_t work = std::max<size_t>(1,n*h.size());
+    Split(per_channel,layout.count,std::max<size_t>(1,CONV_MIN_WORK_PER_THREAD/work),
+          [&](size_t v0, size_t v1) {
+            std::vector<double> xr(n), xi(x_im ? n : 0), yr(n), yi(y_im ? n : 0);
+            for (size_t v=v0;v<v1;v++) {
+              const size_t start = layout.start(v,n);
+              for (size_t k=0;k<n;k++) {
+                xr[k] = x_re[start+k*stride];
+                if (x_im) xi[k] = x_im[start+k*stride];
+              }
+              ConvOperand x = {xr.data(),x_im ? xi.data() : nullptr,n,1};
+              ConvolveImpl(x,h,0,n,CONV_AUTO,!per_channel,yr.data(),y_im ? yi.data() : nullptr);
+              for (size_t k=0;k<n;k++) {
+                y_re[start+k*stride] = yr[k];
+                if (y_im) y_im[start+k*stride] = yi[k];
+              }
+            }
+          });
+  }
+
+  bool Filter(const ConvOperand &b, const ConvOperand &a, const std::vector<size_t> &dims,
+              size_t dim, const double *x_re, const double *x_im,
+              double *y_re, double *y_im, std::string &error) {
+    if (b.size() == 0) {
+      error = "Filter numerator must not be empty";
+      return false;
+    }
+    if ((a.size() == 0) || ((a.re[0] == 0) && (!a.im || (a.im[0] == 0)))) {
+      error = "First coefficient of the filter denominator must be nonzero";
+      return false;
+    }
+    const VectorLayout layout(dims,dim);
+    const bool complex = b.im || a.im || x_im;
+    bool fir = true;
+    for (size_t k=1;k<a.size();k++)
+      if ((a.re[k] != 0) || (a.im && (a.im[k] != 0))) fir = false;
+    if (fir) {
+      // Scale b by 1/a[0] and convolve
+      std::vector<double> h_re(b.size()), h_im(complex ? b.size() : 0);
+      fft_complex a0;
+      LoadValue(a.re,a.im,0,a0);
+      for (size_t k=0;k<b.size();k++) {
+        fft_complex v;
+        LoadValue(b.re,b.im,k,v);
+        v = Divide(v,a0);
+        h_re[k] = v.real;
+        if (complex) h_im[k] = v.imag;
+      }
+      const bool h_complex = (b.im != nullptr) || (a.im && (a.im[0] != 0));
+      ConvOperand h = {h_re.data(),h_complex ? h_im.data() : nullptr,b.size(),1};
+      FIRChannels(h,layout,x_re,x_im,y_re,complex ? y_im : nullptr);
+      return true;
+    }
+    if (complex)
+      FilterChannels<fft_complex>(b,a,layout,x_re,x_im,y_re,y_im);
+    else
+      FilterChannels<double>(b,a,layout,x_re,x_im,y_re,y_im);
+    return true;
+  }
+}
@@ -0,0 +1,70 @@
+#ifndef __convolve_hpp__
+#define __convolve_hpp__
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Convolution and filtering of real and complex data, stored planar (the
+// imaginary part is null for real data).  Short kernels are applied
+// directly, with a kernel that is vectorized for each instruction set
+// level (see cpu_dispatch.hpp).  Long ones go through the FFT, using
+// overlap-add in 1D.  A cost model picks between the two.
+
+namespace FM {
+
+  enum ConvMethod {
+    CONV_AUTO = 0,
+    CONV_DIRECT = 1,
+    CONV_FFT = 2
+  };
+
+  // A planar vector or column major matrix
+  struct ConvOperand {
+    const double *re;
+    const double *im;
+    size_t rows;
+    size_t cols;
+    size_t size() const {return rows*cols;}
+  };
+
+  // y[o-begin] += sum_j h[j]*x[o-j] for the outputs o in [begin,end) of the
+  // full convolution.  The output is worked through in blocks that stay in
+  // cache while each tap is added in.
+  inline void convolve_kernel(const double *x, size_t nx, const double *h, size_t nh,
+                              double *y, size_t begin, size_t end) {
+    const size_t block = 1024;
+    for (size_t b0=begin;b0<end;b0+=block) {
+      const size_t b1 = std::min(end,b0+block);
+      for (size_t j=0;j<nh;j++) {
+        const size_t lo = std::max(b0,j);
+        const size_t hi = std::min(b1,j+nx);
+        if (lo >= hi) continue;
+        const double hj = h[j];
+        double *yp = y + (lo-begin);
+        const double *xp = x + (lo-j);
+        for (size_t i=0;i<hi-lo;i++)
+          yp[i] += hj*xp[i];
+      }
+    }
+  }
+
+  // Outputs [begin,end) of the full 1D convolution of x and h, which has
+  // x.size() + h.size() - 1 terms.  y_im is not used if both are real.
+  void Convolve(const ConvOperand &x, const ConvOperand &h, size_t begin, size_t end,
+                ConvMethod method, double *y_re, double *y_im);
+
+  // The window of rows [row0,row0+rows) and columns [col0,col0+cols) of the
+  // full 2D convolution of A and B.
+  void Convolve2(const ConvOperand &A, const ConvOperand &B, size_t row0, size_t rows,
+                 size_t col0, size_t cols, ConvMethod method, double *y_re, double *y_im);
+
+  // Apply the rational filter b/a along dimension dim of x.  Fails if a(1)
+  // is zero.
+  bool Filter(const ConvOperand &b, const ConvOperand &a, const std::vector<size_t> &dims,
+              size_t dim, const double *x_re, const double *x_im,
+              double *y_re, double *y_im, std::string &error);
+}
+
+#endif
@@ -0,0 +1,191 @@
+#include "cpu_dispatch.hpp"
+#include "transpose.hpp"
+#include "convolve.hpp"
+#include "elementary.hpp"
+#include "random.hpp"
+#include "fuse.hpp"
+#include "broadcast.hpp"
+#include "scan.hpp"
+#include "integer.hpp"
+#include <atomic>
+#include <mutex>
+#include <stdlib.h>
+#include <string.h>
+
+// Each kernel is written once as an inline template, and then wrapped in a
+// function per instruction set level.  The wrappers carry a target attribute,
+// so the compiler inlines and vectorizes the template body separately for
+// each level.  On compilers or architectures where we cannot do this, only
+// the generic table is built.
+
+#if (defined(__GNUC__) || defined(__clang__)) && (defined(__x86_64__) || defined(__i386__))
+#define FM_X86_DISPATCH 1
+#define FM_TARGET(isa) __attribute__((target(isa)))
+#else
+#define FM_TARGET(isa)
+#endif
+
+namespace FM {
+
+  template <class T>
+  inline void interleave_kernel(const T *re, const T *im, Complex<T> *out, size_t n) {
+    for (size_t i=0;i<n;i++) {
+      out[i].real = re[i];
+      out[i].imag = im[i];
+    }
+  }
+
+  template <class T>
+  inline void real_kernel(const Complex<T> *in, T *out, size_t n) {
+    for (size_t i=0;i<n;i++) out[i] = in[i].real;
+  }
+
+  template <class T>
+  inline void imag_kernel(const Complex<T> *in, T *out, size_t n) {
+    for (size_t i=0;i<n;i++) out[i] = in[i].imag;
+  }
+
+#define FM_DEFINE_KERNELS(suffix, level, attr)                          \
+  attr static void dtranspose_##suffix(const double *A, double *B, size_t N, size_t M) { \
+    blocked_transpose(A,B,N,M);                                         \
+  }                                                                     \
+  attr static void ztranspose_##suffix(const Complex<double> *A, Complex<double> *B, size_t N, size_t M) { \
+    blocked_transpose(A,B,N,M);                                         \
+  }                                                                     \
+  attr static void zhermitian_##suffix(const Complex<double> *A, Complex<double> *B, size_t N, size_t M) { \
+    blocked_hermitian(A,B,N,M);                                         \
+  }                                                                     \
+  attr static void zinterleave_##suffix(const double *re, const double *im, Complex<double> *out, size_t n) { \
+    interleave_kernel(re,im,out,n);                                     \
+  }                                                                     \
+  attr static void zreal_##suffix(const Complex<double> *in, double *out, size_t n) { \
+    real_kernel(in,out,n);                                              \
+  }                                                                     \
+  attr static void zimag_##suffix(const Complex<double> *in, double *out, size_t n) { \
+    imag_kernel(in,out,n);                                              \
+  }                                                                     \
+  attr static void dconvolve_##suffix(const double *x, size_t nx, const double *h, size_t nh, \
+                                      double *y, size_t begin, size_t end) { \
+    convolve_kernel(x,nx,h,nh,y,begin,end);                             \
+  }                                                                     \
+  attr static void dexp_##suffix(const double *x, double *y, size_t n) { \
+    exp_kernel(x,y,n);                                                  \
+  }                                                                     \
+  attr static void dlog_##suffix(const double *x, double *y, size_t n) { \
+    log_kernel(x,y,n);                                                  \
+  }                                                                     \
+  attr static void dsqrt_##suffix(const double *x, double *y, size_t n) { \
+    sqrt_kernel(x,y,n);                                                 \
+  }                                                                     \
+  attr static void dsin_##suffix(const double *x, double *y, size_t n) { \
+    sincos_kernel(x,y,n,0);                                             \
+  }                                                                     \
+  attr static void dcos_##suffix(const double *x, double *y, size_t n) { \
+    sincos_kernel(x,y,n,1);                                             \
+  }                                                                     \
+  attr static void datan2_##suffix(const double *y, const double *x, double *out, size_t n) { \
+    atan2_kernel(y,x,out,n);                                            \
+  }                                                                     \
+  attr static void dhypot_##suffix(const double *a, const double *b, double *out, size_t n) { \
+    hypot_kernel(a,b,out,n);                                            \
+  }                                                                     \
+  attr static void philox_##suffix(uint64_t key, uint64_t first, uint64_t *out, size_t blocks) { \
+    philox_kernel(key,first,out,blocks);                                \
+  }                                                                     \
+  attr static void dfuse_##suffix(const int *ops, size_t nops, const FuseOperand *leaves, \
+                                  size_t offset, size_t n, double *stack, double *out) { \
+    fuse_kernel(ops,nops,leaves,offset,n,stack,out);                    \
+  }                                                                     \
+  attr static void dbinary_##suffix(int op, const double *a, size_t sa, const double *b, \
+                                    size_t sb, double *y, size_t n) {   \
+    binary_kernel(op,a,sa,b,sb,y,n);                                    \
+  }                                                                     \
+  attr static void dscan_##suffix(int op, const double *x, double *y, size_t n, \
+                                  size_t estride, size_t vstride, size_t width) { \
+    scan_kernel(op,x,y,n,estride,vstride,width);                        \
+  }                                                                     \
+  attr static void typedbinary_##suffix(int op, int cls, const void *a, bool a_double, \
+                                        size_t sa, const void *b, bool b_double, \
+                                        size_t sb, void *y, size_t n) { \
+    typed_binary_kernel(op,cls,a,a_double,sa,b,b_double,sb,y,n);       \
+  }                                                                     \
+  static const KernelTable kernels_##suffix = {                         \
+    level, dtranspose_##suffix, ztranspose_##suffix, zhermitian_##suffix, \
+    zinterleave_##suffix, zreal_##suffix, zimag_##suffix,               \
+    dconvolve_##suffix, dexp_##suffix, dlog_##suffix, dsqrt_##suffix,   \
+    dsin_##suffix, dcos_##suffix, datan2_##suffix, dhypot_##suffix,     \
+    philox_##suffix, dfuse_##suffix, dbinary_##suffix, dscan_##suffix,  \
+    typedbinary_##suffix                                                \
+  };
+
+  FM_DEFINE_KERNELS(generic, ISA_GENERIC, )
+#ifdef FM_X86_DISPATCH
+  FM_DEFINE_KERNELS(sse2, ISA_SSE2, FM_TARGET("sse2"))
+  FM_DEFINE_KERNELS(avx2, ISA_AVX2, FM_TARGET("avx2,fma"))
+  FM_DEFINE_KERNELS(avx512, ISA_AVX512, FM_TARGET("avx512f,avx512dq"))
+#endif
+
+  static const KernelTable* TableForLevel(ISALevel level) {
+#ifdef FM_X86_DISPATCH
+    switch (level) {
+    case ISA_AVX512: return &kernels_avx512;
+    case ISA_AVX2: return &kernels_avx2;
+    case ISA_SSE2: return &kernels_sse2;
+    default: break;
+    }
+#endif
+    return &kernels_generic;
+  }
+
+  static std::atomic<const KernelTable*> active_kernels(&kernels_generic);
+
+  const KernelTable& Kernels() {
+    return *active_kernels.load(std::memory_order_acquire);
+  }
+
+  ISALevel DetectISALevel() {
+#ifdef FM_X86_DISPATCH
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512dq"))
+      return ISA_AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma"))
+      return ISA_AVX2;
+    if (__builtin_cpu_supports("sse2"))
+      return ISA_SSE2;
+#endif
+    return ISA_GENERIC;
+  }
+
+  ISALevel SelectISALevel(ISALevel level) {
+    ISALevel best = DetectISALevel();
+    if (level > best) level = best;
+    const KernelTable *table = TableForLevel(level);
+    active_kernels.store(table, std::memory_order_release);
+    return table->level;
+  }
+
+  static const char* isa_names[] = {"generic", "sse2", "avx2", "avx512"};
+
+  const char* ISAName(ISALevel level) {
+    return isa_names[level];
+  }
+
+  bool ParseISAName(const char *name, ISALevel &level) {
+    for (int i=ISA_GENERIC;i<=ISA_AVX512;i++)
+      if (strcmp(name,isa_names[i]) == 0) {
+        level = static_cast<ISALevel>(i);
+        return true;
+      }
+    return false;
+  }
+
+  void InitDispatch() {
+    static std::once_flag once;
+    std::call_once(once,[]() {
+        ISALevel level = ISA_AVX512;
+        const char *forced = getenv("FREEMAT_ISA");
+        if (forced) ParseISAName(forced,level);
+        SelectISALevel(level);
+      });
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef __cpu_dispatch_hpp__
+#define __cpu_dispatch_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include "Complex.hpp"
+
+namespace FM {
+
+  struct FuseOperand;
+
+  // Instruction set levels that the hot native kernels are compiled for.
+  // A single binary carries a copy of each kernel per level, and the best
+  // one supported by the CPU is selected when the module is loaded.
+  enum ISALevel {
+    ISA_GENERIC = 0,
+    ISA_SSE2 = 1,
+    ISA_AVX2 = 2,
+    ISA_AVX512 = 3
+  };
+
+  // The set of kernels compiled for one instruction set level
+  struct KernelTable {
+    ISALevel level;
+    void (*dtranspose)(const double *A, double *B, size_t N, size_t M);
+    void (*ztranspose)(const Complex<double> *A, Complex<double> *B, size_t N, size_t M);
+    void (*zhermitian)(const Complex<double> *A, Complex<double> *B, size_t N, size_t M);
+    void (*zinterleave)(const double *re, const double *im, Complex<double> *out, size_t n);
+    void (*zreal)(const Complex<double> *in, double *out, size_t n);
+    void (*zimag)(const Complex<double> *in, double *out, size_t n);
+    void (*dconvolve)(const double *x, size_t nx, const double *h, size_t nh,
+                      double *y, size_t begin, size_t end);
+    void (*dexp)(const double *x, double *y, size_t n);
+    void (*dlog)(const double *x, double *y, size_t n);
+    void (*dsqrt)(const double *x, double *y, size_t n);
+    void (*dsin)(const double *x, double *y, size_t n);
+    void (*dcos)(const double *x, double *y, size_t n);
+    void (*datan2)(const double *y, const double *x, double *out, size_t n);
+    void (*dhypot)(const double *a, const double *b, double *out, size_t n);
+    void (*philox)(uint64_t key, uint64_t first, uint64_t *out, size_t blocks);
+    void (*dfuse)(const int *ops, size_t nops, const FuseOperand *leaves, size_t offset,
+                  size_t n, double *stack, double *out);
+    void (*dbinary)(int op, const double *a, size_t sa, const double *b, size_t sb,
+                    double *y, size_t n);
+    void (*dscan)(int op, const double *x, double *y, size_t n, size_t estride,
+                  size_t vstride, size_t width);
+    void (*typedbinary)(int op, int cls, const void *a, bool a_double, size_t sa,
+                        const void *b, bool b_double, size_t sb, void *y, size_t n);
+  };
+
+  // The kernel table currently in use
+  const KernelTable& Kernels();
+
+  // The highest level supported by the CPU we are running on
+  ISALevel DetectISALevel();
+
+  // Switch to the kernels for the given level.  Requests above what the
+  // CPU supports are clamped.  Returns the level actually selected.
+  ISALevel SelectISALevel(ISALevel level);
+
+  // Select the kernels at module load.  The FREEMAT_ISA environment
+  // variable (generic, sse2, avx2 or avx512) can be used to force a
+  // lower level, e.g., for reproducibility testing.
+  void InitDispatch();
+
+  const char* ISAName(ISALevel level);
+
+  bool ParseISAName(const char *name, ISALevel &level);
+
+  inline void DispatchTranspose(const double *A, double *B, size_t N, size_t M) {
+    Kernels().dtranspose(A,B,N,M);
+  }
+
+  inline void DispatchTranspose(const Complex<double> *A, Complex<double> *B, size_t N, size_t M) {
+    Kernels().ztranspose(A,B,N,M);
+  }
+
+  inline void DispatchHermitian(const Complex<double> *A, Complex<double> *B, size_t N, size_t M) {
+    Kernels().zhermitian(A,B,N,M);
+  }
+
+  inline void DispatchConvolve(const double *x, size_t nx, const double *h, size_t nh,
+                               double *y, size_t begin, size_t end) {
+    Kernels().dconvolve(x,nx,h,nh,y,begin,end);
+  }
+}
+
+#endif
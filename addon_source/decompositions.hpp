@@ -0,0 +1,461 @@
+#ifndef __decompositions_hpp__
+#define __decompositions_hpp__
+
+#include "Complex.hpp"
+#include "addon_utils.hpp"
+#include "LAPACK.hpp"
+#include "blas_backend.hpp"
+#include "workspace.hpp"
+#include <algorithm>
+#include <string>
+
+/***************************************************************************
+ * Matrix factorizations - LU, QR, Cholesky, SVD and eigendecomposition.
+ * As with the rest of the native code, these are only provided in double
+ * precision.  Each routine works on a copy of its input (which may be a
+ * view of a JS array), asks LAPACK for the optimal workspace size, and
+ * takes the workspace from a per-thread cache.
+ ***************************************************************************/
+
+namespace FM {
+
+  // Above these sizes the divide and conquer drivers are used
+  const int SVD_DC_CUTOFF = 64;
+  const int EIG_DC_CUTOFF = 64;
+
+  static inline void Tgetrf(int *M, int *N, double *A, int *LDA, int *IPIV, int *INFO) {
+    FM_BACKEND(dgetrf_)(M,N,A,LDA,IPIV,INFO);
+  }
+
+  static inline void Tgetrf(int *M, int *N, Complex<double> *A, int *LDA, int *IPIV, int *INFO) {
+    FM_BACKEND(zgetrf_)(M,N,A,LDA,IPIV,INFO);
+  }
+
+  static inline void Tgeqrf(int *M, int *N, double *A, int *LDA, double *TAU,
+                            double *WORK, int *LWORK, int *INFO) {
+    FM_BACKEND(dgeqrf_)(M,N,A,LDA,TAU,WORK,LWORK,INFO);
+  }
+
+  static inline void Tgeqrf(int *M, int *N, Complex<double> *A, int *LDA, Complex<double> *TAU,
+                            Complex<double> *WORK, int *LWORK, int *INFO) {
+    FM_BACKEND(zgeqrf_)(M,N,reinterpret_cast<double*>(A),LDA,reinterpret_cast<double*>(TAU),
+                        reinterpret_cast<double*>(WORK),LWORK,INFO);
+  }
+
+  static inline void Torgqr(int *M, int *N, int *K, double *A, int *LDA, double *TAU,
+                            double *WORK, int *LWORK, int *INFO) {
+    FM_BACKEND(dorgqr_)(M,N,K,A,LDA,TAU,WORK,LWORK,INFO);
+  }
+
+  static inline void Torgqr(int *M, int *N, int *K, Complex<double> *A, int *LDA, Complex<double> *TAU,
+                            Complex<double> *WORK, int *LWORK, int *INFO) {
+    FM_BACKEND(zungqr_)(M,N,K,reinterpret_cast<double*>(A),LDA,reinterpret_cast<double*>(TAU),
+                        reinterpret_cast<double*>(WORK),LWORK,INFO);
+  }
+
+  static inline void Tpotrf(char *UPLO, int *N, double *A, int *LDA, int *INFO) {
+    FM_BACKEND(dpotrf_)(UPLO,N,A,LDA,INFO);
+  }
+
+  static inline void Tpotrf(char *UPLO, int *N, Complex<double> *A, int *LDA, int *INFO) {
+    FM_BACKEND(zpotrf_)(UPLO,N,A,LDA,INFO);
+  }
+
+  // The real and complex SVD drivers differ in their real workspace, so
+  // these take a uniform set of arguments and size it themselves.
+  static inline void Tgesdd(char *JOBZ, int *M, int *N, double *A, int *LDA, double *S,
+                            double *U, int *LDU, double *VT, int *LDVT,
+                            double *WORK, int *LWORK, double *, int *IWORK, int *INFO) {
+    FM_BACKEND(dgesdd_)(JOBZ,M,N,A,LDA,S,U,LDU,VT,LDVT,WORK,LWORK,IWORK,INFO);
+  }
+
+  static inline void Tgesdd(char *JOBZ, int *M, int *N, Complex<double> *A, int *LDA, double *S,
+                            Complex<double> *U, int *LDU, Complex<double> *VT, int *LDVT,
+                            Complex<double> *WORK, int *LWORK, double *RWORK, int *IWORK, int *INFO) {
+    FM_BACKEND(zgesdd_)(JOBZ,M,N,A,LDA,S,U,LDU,VT,LDVT,WORK,LWORK,RWORK,IWORK,INFO);
+  }
+
+  static inline void Tgesvd(char *JOBU, char *JOBVT, int *M, int *N, double *A, int *LDA, double *S,
+                            double *U, int *LDU, double *VT, int *LDVT,
+                            double *WORK, int *LWORK, double *, int *INFO) {
+    FM_BACKEND(dgesvd_)(JOBU,JOBVT,M,N,A,LDA,S,U,LDU,VT,LDVT,WORK,LWORK,INFO);
+  }
+
+  static inline void Tgesvd(char *JOBU, char *JOBVT, int *M, int *N, Complex<double> *A, int *LDA, double *S,
+                            Complex<double> *U, int *LDU, Complex<double> *VT, int *LDVT,
+                            Complex<double> *WORK, int *LWORK, double *RWORK, int *INFO) {
+    FM_BACKEND(zgesvd_)(JOBU,JOBVT,M,N,reinterpret_cast<double*>(A),LDA,S,
+                        reinterpret_cast<double*>(U),LDU,reinterpret_cast<double*>(VT),LDVT,
+                        reinterpret_cast<double*>(WORK),LWORK,RWORK,INFO);
+  }
+
+  static inline void Tsyev(char *JOBZ, char *UPLO, int *N, double *A, int *LDA, double *W,
+                           double *WORK, int *LWORK, double *, int *INFO) {
+    FM_BACKEND(dsyev_)(JOBZ,UPLO,N,A,LDA,W,WORK,LWORK,INFO);
+  }
+
+  static inline void Tsyev(char *JOBZ, char *UPLO, int *N, Complex<double> *A, int *LDA, double *W,
+                           Complex<double> *WORK, int *LWORK, double *RWORK, int *INFO) {
+    FM_BACKEND(zheev_)(JOBZ,UPLO,N,A,LDA,W,WORK,LWORK,RWORK,INFO);
+  }
+
+  static inline void Tsyevd(char *JOBZ, char *UPLO, int *N, double *A, int *LDA, double *W,
+                            double *WORK, int *LWORK, double *, int *,
+                            int *IWORK, int *LIWORK, int *INFO) {
+    FM_BACKEND(dsyevd_)(JOBZ,UPLO,N,A,LDA,W,WORK,LWORK,IWORK,LIWORK,INFO);
+  }
+
+  static inline void Tsyevd(char *JOBZ, char *UPLO, int *N, Complex<double> *A, int *LDA, double *W,
+                            Complex<double> *WORK, int *LWORK, double *RWORK, int *LRWORK,
+                            int *IWORK, int *LIWORK, int *INFO) {
+    FM_BACKEND(zheevd_)(JOBZ,UPLO,N,A,LDA,W,WORK,LWORK,RWORK,LRWORK,IWORK,LIWORK,INFO);
+  }
+
+  inline double Conj(double x) {return x;}
+  inline Complex<double> Conj(const Complex<double> &x) {return complex_conj(x);}
+
+  inline bool Equal(double x, double y) {return x == y;}
+  inline bool Equal(const Complex<double> &x, const Complex<double> &y) {
+    return (x.real == y.real) && (x.imag == y.imag);
+  }
+
+  template <class T>
+  inline T Unit() {return T(1);}
+
+  template <>
+  inline Complex<double> Unit() {return Complex<double>(1,0);}
+
+  template <class T>
+  inline BLASMatrix<T> CopyOf(const BLASMatrix<T> &A) {
+    BLASMatrix<T> ret(A.rows,A.cols);
+    std::copy(A.base(),A.base()+A.elements(),ret.base());
+    return ret;
+  }
+
+  // B = A' (conjugated for complex matrices)
+  template <class T>
+  inline BLASMatrix<T> ConjTranspose(const T *A, int rows, int cols) {
+    BLASMatrix<T> ret(cols,rows);
+    for (int j=0;j<cols;j++)
+      for (int i=0;i<rows;i++)
+        ret.base()[j+i*cols] = Conj(A[i+j*rows]);
+    return ret;
+  }
+
+  template <class T>
+  inline BLASMatrix<T> DiagonalMatrix(const T *d, int n, int rows, int cols) {
+    BLASMatrix<T> ret(rows,cols);
+    for (int i=0;i<n;i++) ret.base()[i+i*rows] = d[i];
+    return ret;
+  }
+
+  inline bool IsRealValued(const BLASMatrix<Complex<double> > &A) {
+    for (size_t i=0;i<A.elements();i++)
+      if (A.base()[i].imag != 0) return false;
+    return true;
+  }
+
+  inline BLASMatrix<double> RealPart(const BLASMatrix<Complex<double> > &A) {
+    BLASMatrix<double> ret(A.rows,A.cols);
+    ComplexToReal(A.base(),ret.base(),A.elements());
+    return ret;
+  }
+
+  // Copy the upper trapezoid of the first rows of an LDA x cols array
+  template <class T>
+  inline BLASMatrix<T> UpperPart(const T *A, int LDA, int rows, int cols) {
+    BLASMatrix<T> ret(rows,cols);
+    for (int j=0;j<cols;j++)
+      for (int i=0;i<=std::min(j,rows-1);i++)
+        ret.base()[i+j*rows] = A[i+j*LDA];
+    return ret;
+  }
+
+  // P*A = L*U, with L unit lower trapezoidal (m x k), U upper trapezoidal
+  // (k x n), and P a permutation matrix.
+  template <class T>
+  inline void LUDecompose(const BLASMatrix<T> &A, BLASMatrix<T> &L, BLASMatrix<T> &U,
+                          BLASMatrix<double> &P) {
+    int M = A.rows;
+    int N = A.cols;
+    int K = std::min(M,N);
+    BLASMatrix<T> F(CopyOf(A));
+    Workspace<int,PivotTag> IPIV(K);
+    int INFO = 0;
+    int LDA = std::max(1,M);
+    if (K > 0)
+      Tgetrf(&M,&N,F.base(),&LDA,&IPIV,&INFO);
+    // INFO > 0 only means that U is singular, which is not an error here
+    L = BLASMatrix<T>(M,K);
+    for (int j=0;j<K;j++) {
+      L.base()[j+j*M] = Unit<T>();
+      for (int i=j+1;i<M;i++)
+        L.base()[i+j*M] = F.base()[i+j*M];
+    }
+    U = UpperPart(F.base(),LDA,K,N);
+    std::vector<int> perm(M);
+    for (int i=0;i<M;i++) perm[i] = i;
+    for (int i=0;i<K;i++) std::swap(perm[i],perm[(&IPIV)[i]-1]);
+    P = BLASMatrix<double>(M,M);
+    for (int i=0;i<M;i++) P.base()[i+perm[i]*M] = 1;
+  }
+
+  // A = Q*R.  In economy mode Q is m x k and R is k x n, otherwise Q is
+  // m x m and R is m x n.
+  template <class T>
+  inline void QRDecompose(const BLASMatrix<T> &A, bool economy, BLASMatrix<T> &Q, BLASMatrix<T> &R) {
+    int M = A.rows;
+    int N = A.cols;
+    int K = std::min(M,N);
+    int QC = economy ? K : M;
+    BLASMatrix<T> F(CopyOf(A));
+    int LDA = std::max(1,M);
+    Workspace<T,TauTag> TAU(K);
+    int INFO;
+    if (K > 0) {
+      int LWORK = -1;
+      T WORKSIZE;
+      Tgeqrf(&M,&N,F.base(),&LDA,&TAU,&WORKSIZE,&LWORK,&INFO);
+      LWORK = std::max(1,WorkSize(WORKSIZE));
+      Workspace<T> WORK(LWORK);
+      Tgeqrf(&M,&N,F.base(),&LDA,&TAU,&WORK,&LWORK,&INFO);
+    }
+    R = UpperPart(F.base(),LDA,QC,N);
+    // The reflectors are expanded in place into the leading columns of Q
+    Q = BLASMatrix<T>(M,QC);
+    std::copy(F.base(),F.base()+size_t(M)*std::min(QC,N),Q.base());
+    if (K > 0) {
+      int LWORK = -1;
+      T WORKSIZE;
+      Torgqr(&M,&QC,&K,Q.base(),&LDA,&TAU,&WORKSIZE,&LWORK,&INFO);
+      LWORK = std::max(1,WorkSize(WORKSIZE));
+      Workspace<T> WORK(LWORK);
+      Torgqr(&M,&QC,&K,Q.base(),&LDA,&TAU,&WORK,&LWORK,&INFO);
+    } else {
+      for (int i=0;i<QC;i++) Q.base()[i+i*M] = Unit<T>();
+    }
+  }
+
+  // A = R'*R, with R upper triangular.  Fails if A is not positive definite.
+  template <class T>
+  inline bool CholDecompose(const BLASMatrix<T> &A, BLASMatrix<T> &R, std::string &error) {
+    if (A.rows != A.cols) {
+      error = "Cholesky decomposition requires a square matrix";
+      return false;
+    }
+    int N = A.rows;
+    BLASMatrix<T> F(CopyOf(A));
+    char UPLO = 'U';
+    int LDA = std::max(1,N);
+    int INFO = 0;
+    if (N > 0)
+      Tpotrf(&UPLO,&N,F.base(),&LDA,&INFO);
+    if (INFO > 0) {
+      error = "Cholesky decomposition failed - matrix is not positive definite";
+      return false;
+    }
+    R = UpperPart(F.base(),LDA,N,N);
+    return true;
+  }
+
+  enum SVDMode {SVD_VALUES = 0, SVD_FULL = 1, SVD_ECONOMY = 2};
+
+  // The real workspace of the divide and conquer (gesdd) and QR iteration
+  // (gesvd) SVD drivers, which is only used for complex matrices
+  inline size_t SVDRealWork(const double*, SVDMode, int, int) {return 0;}
+  inline size_t SVDRealWork(const double*, int) {return 0;}
+
+  inline size_t SVDRealWork(const Complex<double>*, SVDMode mode, int MX, int K) {
+    return (mode == SVD_VALUES) ? size_t(7)*K :
+      std::max(size_t(5)*K*K + size_t(5)*K, size_t(2)*MX*K + size_t(2)*K*K + K);
+  }
+
+  inline size_t SVDRealWork(const Complex<double>*, int K) {return size_t(5)*K;}
+
+  // A = U*S*V'.  s holds the k singular values in decreasing order.  The
+  // sizes of U and V follow the mode, as in qr.
+  template <class T>
+  inline bool SVDDecompose(const BLASMatrix<T> &A, SVDMode mode, BLASMatrix<double> &s,
+                           BLASMatrix<T> &U, BLASMatrix<T> &V, std::string &error) {
+    int M = A.rows;
+    int N = A.cols;
+    int K = std::min(M,N);
+    char JOB = (mode == SVD_VALUES) ? 'N' : ((mode == SVD_FULL) ? 'A' : 'S');
+    int UC = (mode == SVD_FULL) ? M : K;
+    int VR = (mode == SVD_FULL) ? N : K;
+    s = BLASMatrix<double>(K,1);
+    BLASMatrix<T> VT;
+    if (mode != SVD_VALUES) {
+      U = BLASMatrix<T>(M,UC);
+      VT = BLASMatrix<T>(VR,N);
+      for (int i=0;i<std::min(M,UC);i++) U.base()[i+i*M] = Unit<T>();
+      for (int i=0;i<std::min(N,VR);i++) VT.base()[i+i*VR] = Unit<T>();
+    }
+    if (K > 0) {
+      BLASMatrix<T> F(CopyOf(A));
+      int LDA = M;
+      int LDU = M;
+      int LDVT = std::max(1,VR);
+      T *Up = (mode == SVD_VALUES) ? nullptr : U.base();
+      T *VTp = (mode == SVD_VALUES) ? nullptr : VT.base();
+      int MX = std::max(M,N);
+      int INFO;
+      int LWORK = -1;
+      T WORKSIZE;
+      if (K >= SVD_DC_CUTOFF) {
+        Workspace<double,RealWorkTag> RWORK(SVDRealWork(F.base(),mode,MX,K));
+        Workspace<int,IntWorkTag> IWORK(8*K);
+        Tgesdd(&JOB,&M,&N,F.base(),&LDA,s.base(),Up,&LDU,VTp,&LDVT,
+               &WORKSIZE,&LWORK,&RWORK,&IWORK,&INFO);
+        LWORK = std::max(1,WorkSize(WORKSIZE));
+        Workspace<T> WORK(LWORK);
+        Tgesdd(&JOB,&M,&N,F.base(),&LDA,s.base(),Up,&LDU,VTp,&LDVT,
+               &WORK,&LWORK,&RWORK,&IWORK,&INFO);
+      } else {
+        Workspace<double,RealWorkTag> RWORK(SVDRealWork(F.base(),K));
+        char JOBVT = JOB;
+        Tgesvd(&JOB,&JOBVT,&M,&N,F.base(),&LDA,s.base(),Up,&LDU,VTp,&LDVT,
+               &WORKSIZE,&LWORK,&RWORK,&INFO);
+        LWORK = std::max(1,WorkSize(WORKSIZE));
+        Workspace<T> WORK(LWORK);
+        Tgesvd(&JOB,&JOBVT,&M,&N,F.base(),&LDA,s.base(),Up,&LDU,VTp,&LDVT,
+               &WORK,&LWORK,&RWORK,&INFO);
+      }
+      if (INFO > 0) {
+        error = "SVD did not converge";
+        return false;
+      }
+    }
+    if (mode != SVD_VALUES)
+      V = ConjTranspose(VT.base(),VR,N);
+    return true;
+  }
+
+  template <class T>
+  inline bool IsHermitian(const BLASMatrix<T> &A) {
+    for (int j=0;j<A.cols;j++)
+      for (int i=0;i<=j;i++) {
+        if (!Equal(A.base()[i+j*A.rows],Conj(A.base()[j+i*A.rows])))
+          return false;
+      }
+    return true;
+  }
+
+  // Eigenvalues (w) and optionally eigenvectors (V, in place of A) of a
+  // symmetric or Hermitian matrix.  Eigenvalues are in ascending order.
+  template <class T>
+  inline bool SymmetricEig(BLASMatrix<T> &A, bool vectors, BLASMatrix<double> &w, std::string &error) {
+    int N = A.rows;
+    w = BLASMatrix<double>(N,1);
+    if (N == 0) return true;
+    char JOBZ = vectors ? 'V' : 'N';
+    char UPLO = 'U';
+    int LDA = N;
+    int INFO;
+    int LWORK = -1;
+    T WORKSIZE;
+    if (N >= EIG_DC_CUTOFF) {
+      int LRWORK = -1;
+      int LIWORK = -1;
+      double RWORKSIZE = 0;
+      int IWORKSIZE = 0;
+      Tsyevd(&JOBZ,&UPLO,&N,A.base(),&LDA,w.base(),&WORKSIZE,&LWORK,
+             &RWORKSIZE,&LRWORK,&IWORKSIZE,&LIWORK,&INFO);
+      LWORK = std::max(1,WorkSize(WORKSIZE));
+      LRWORK = std::max(1,WorkSize(RWORKSIZE));
+      LIWORK = std::max(1,IWORKSIZE);
+      Workspace<T> WORK(LWORK);
+      Workspace<double,RealWorkTag> RWORK(LRWORK);
+      Workspace<int,IntWorkTag> IWORK(LIWORK);
+      Tsyevd(&JOBZ,&UPLO,&N,A.base(),&LDA,w.base(),&WORK,&LWORK,
+             &RWORK,&LRWORK,&IWORK,&LIWORK,&INFO);
+    } else {
+      Workspace<double,RealWorkTag> RWORK(std::max(1,3*N-2));
+      Tsyev(&JOBZ,&UPLO,&N,A.base(),&LDA,w.base(),&WORKSIZE,&LWORK,&RWORK,&INFO);
+      LWORK = std::max(1,WorkSize(WORKSIZE));
+      Workspace<T> WORK(LWORK);
+      Tsyev(&JOBZ,&UPLO,&N,A.base(),&LDA,w.base(),&WORK,&LWORK,&RWORK,&INFO);
+    }
+    if (INFO > 0) {
+      error = "Eigenvalue decomposition did not converge";
+      return false;
+    }
+    return true;
+  }
+
+  // Eigenvalues (w) and optionally right eigenvectors (V) of a general
+  // matrix.  These are complex even for real matrices.
+  inline bool GeneralEig(BLASMatrix<double> &A, bool vectors, BLASMatrix<Complex<double> > &w,
+                         BLASMatrix<Complex<double> > &V, std::string &error) {
+    int N = A.rows;
+    w = BLASMatrix<Complex<double> >(N,1);
+    if (vectors) V = BLASMatrix<Complex<double> >(N,N);
+    if (N == 0) return true;
+    char JOBVL = 'N';
+    char JOBVR = vectors ? 'V' : 'N';
+    int LDA = N;
+    int LDV = N;
+    std::vector<double> WR(N), WI(N);
+    BLASMatrix<double> VR(vectors ? N : 1, vectors ? N : 1);
+    int INFO;
+    int LWORK = -1;
+    double WORKSIZE;
+    FM_BACKEND(dgeev_)(&JOBVL,&JOBVR,&N,A.base(),&LDA,&WR[0],&WI[0],nullptr,&LDV,
+                       VR.base(),&LDV,&WORKSIZE,&LWORK,&INFO);
+    LWORK = std::max(1,WorkSize(WORKSIZE));
+    Workspace<double> WORK(LWORK);
+    FM_BACKEND(dgeev_)(&JOBVL,&JOBVR,&N,A.base(),&LDA,&WR[0],&WI[0],nullptr,&LDV,
+                       VR.base(),&LDV,&WORK,&LWORK,&INFO);
+    if (INFO > 0) {
+      error = "Eigenvalue decomposition did not converge";
+      return false;
+    }
+    for (int j=0;j<N;j++) w.base()[j] = Complex<double>(WR[j],WI[j]);
+    if (!vectors) return true;
+    // Complex conjugate pairs of eigenvectors are stored as the real and
+    // imaginary parts in consecutive columns
+    const double *vr = VR.base();
+    Complex<double> *v = V.base();
+    for (int j=0;j<N;j++) {
+      if ((WI[j] != 0) && (j+1 < N)) {
+        for (int i=0;i<N;i++) {
+          v[i+j*N] = Complex<double>(vr[i+j*N],vr[i+(j+1)*N]);
+          v[i+(j+1)*N] = Complex<double>(vr[i+j*N],-vr[i+(j+1)*N]);
+        }
+        j++;
+      } else {
+        for (int i=0;i<N;i++) v[i+j*N] = Complex<double>(vr[i+j*N],0);
+      }
+    }
+    return true;
+  }
+
+  inline bool GeneralEig(BLASMatrix<Complex<double> > &A, bool vectors, BLASMatrix<Complex<double> > &w,
+                         BLASMatrix<Complex<double> > &V, std::string &error) {
+    int N = A.rows;
+    w = BLASMatrix<Complex<double> >(N,1);
+    V = BLASMatrix<Complex<double> >(vectors ? N : 1, vectors ? N : 1);
+    if (N == 0) return true;
+    char JOBVL = 'N';
+    char JOBVR = vectors ? 'V' : 'N';
+    int LDA = N;
+    int LDV = N;
+    int INFO;
+    int LWORK = -1;
+    Complex<double> WORKSIZE;
+    Workspace<double,RealWorkTag> RWORK(2*N);
+    FM_BACKEND(zgeev_)(&JOBVL,&JOBVR,&N,A.base(),&LDA,w.base(),nullptr,&LDV,
+                       V.base(),&LDV,&WORKSIZE,&LWORK,&RWORK,&INFO);
+    LWORK = std::max(1,WorkSize(WORKSIZE));
+    Workspace<Complex<double> > WORK(LWORK);
+    FM_BACKEND(zgeev_)(&JOBVL,&JOBVR,&N,A.base(),&LDA,w.base(),nullptr,&LDV,
+                       V.base(),&LDV,&WORK,&LWORK,&RWORK,&INFO);
+    if (INFO > 0) {
+      error = "Eigenvalue decomposition did not converge";
+      return false;
+    }
+    return true;
+  }
+}
+
+#endif
@@ -5,6 +5,10 @@
 #include "addon_utils.hpp"
 #include "MemPtr.hpp"
 #include "LAPACK.hpp"
+#include "blas_backend.hpp"
+#include "workspace.hpp"
+#include <algorithm>
+#include <cmath>
 #include <string>
 
 /***************************************************************************
@@ -24,7 +28,7 @@ static inline void Tgesvx(char* FACT, char* TRANS, int * N, int * NRHS,
                           float * B, int * LDB, float * X, int * LDX, 
                           float * RCOND, float * FERR, float * BERR,
                           float * WORK, int * IWORK, int * INFO) {
-  sgesvx_(FACT,TRANS,N,NRHS,A,LDA,AF,LDAF,IPIV,EQUED,R,C,B,
+  FM_BACKEND(sgesvx_)(FACT,TRANS,N,NRHS,A,LDA,AF,LDAF,IPIV,EQUED,R,C,B,
           LDB,X,LDX,RCOND,FERR,BERR,WORK,IWORK,INFO);
 }
 
@@ -34,7 +38,7 @@ static inline void Tgesvx(char* FACT, char* TRANS, int * N, int * NRHS,
                           double * B, int * LDB, double * X, int * LDX, 
                           double * RCOND, double * FERR, double * BERR,
                           double * WORK, int * IWORK, int * INFO) {
-  dgesvx_(FACT,TRANS,N,NRHS,A,LDA,AF,LDAF,IPIV,EQUED,R,C,B,
+  FM_BACKEND(dgesvx_)(FACT,TRANS,N,NRHS,A,LDA,AF,LDAF,IPIV,EQUED,R,C,B,
           LDB,X,LDX,RCOND,FERR,BERR,WORK,IWORK,INFO);
 }
 
@@ -44,7 +48,7 @@ static inline void Tgesvx(char* FACT, char* TRANS, int * N, int * NRHS,
                           FM::Complex<float> * B, int * LDB, FM::Complex<float> * X, int * LDX, 
                           float * RCOND, float * FERR, float * BERR,
                           FM::Complex<float> * WORK, float * RWORK, int * INFO) {
-  cgesvx_(FACT, TRANS, N, NRHS, TOCOMP(A), LDA,  TOCOMP(AF), LDAF, IPIV, EQUED, R, C,  TOCOMP(B),
+  FM_BACKEND(cgesvx_)(FACT, TRANS, N, NRHS, TOCOMP(A), LDA,  TOCOMP(AF), LDAF, IPIV, EQUED, R, C,  TOCOMP(B),
           LDB,  TOCOMP(X), LDX, RCOND, FERR, BERR,  TOCOMP(WORK), RWORK, INFO);
 }
 
@@ -54,7 +58,7 @@ static inline void Tgesvx(char* FACT, char* TRANS, int * N, int * NRHS,
                           FM::Complex<double> * B, int * LDB, FM::Complex<double> * X, int * LDX, 
                           double * RCOND, double * FERR, double * BERR,
                           FM::Complex<double> * WORK, double * RWORK, int * INFO) {
-  zgesvx_(FACT, TRANS, N, NRHS, TOCOMPZ( A), LDA, TOCOMPZ(AF), LDAF, IPIV, EQUED, R, C,
+  FM_BACKEND(zgesvx_)(FACT, TRANS, N, NRHS, TOCOMPZ( A), LDA, TOCOMPZ(AF), LDAF, IPIV, EQUED, R, C,
           TOCOMPZ( B), LDB, TOCOMPZ( X), LDX, RCOND, FERR, BERR,
           TOCOMPZ( WORK), RWORK, INFO);
 }
@@ -130,14 +134,14 @@ static inline void solveLinEq(int m, int n, T *c, T* a, T *b, FM::warning_cb io)
 static inline void Tgelsy(int* M, int *N, int *NRHS, double* A, int *LDA,
                           double *B, int *LDB, int *JPVT, double* RCOND,
                           int *RANK, double *WORK, int* LWORK, int* INFO) {
-  dgelsy_(M,N,NRHS,A,LDA,B,LDB,JPVT,RCOND,
+  FM_BACKEND(dgelsy_)(M,N,NRHS,A,LDA,B,LDB,JPVT,RCOND,
           RANK,WORK,LWORK,INFO);
 }
 
 static inline void Tgelsy(int* M, int *N, int *NRHS, float* A, int *LDA,
                           float *B, int *LDB, int *JPVT, float* RCOND,
                           int *RANK, float *WORK, int* LWORK, int* INFO) {
-  sgelsy_(M,N,NRHS,A,LDA,B,LDB,JPVT,RCOND,
+  FM_BACKEND(sgelsy_)(M,N,NRHS,A,LDA,B,LDB,JPVT,RCOND,
           RANK,WORK,LWORK,INFO);  
 }
 
@@ -145,7 +149,7 @@ static inline void Tgelsy(int* M, int *N, int *NRHS, FM::Complex<float>* A, int
                           FM::Complex<float> *B, int *LDB, int *JPVT, float* RCOND,
                           int *RANK, FM::Complex<float> *WORK, int* LWORK, float* RWORK,
                           int* INFO) {
-  cgelsy_(M,N,NRHS,TOCOMP(A),LDA,TOCOMP(B),LDB,JPVT,RCOND,
+  FM_BACKEND(cgelsy_)(M,N,NRHS,TOCOMP(A),LDA,TOCOMP(B),LDB,JPVT,RCOND,
           RANK,TOCOMP(WORK),LWORK,RWORK,INFO);
 }
 
@@ -153,33 +157,104 @@ static inline void Tgelsy(int* M, int *N, int *NRHS, FM::Complex<double>* A, int
                           FM::Complex<double> *B, int *LDB, int *JPVT, double* RCOND,
                           int *RANK, FM::Complex<double> *WORK, int* LWORK, double* RWORK,
                           int* INFO) {
-  zgelsy_(M,N,NRHS,TOCOMPZ(A),LDA,TOCOMPZ(B),LDB,JPVT,RCOND,
+  FM_BACKEND(zgelsy_)(M,N,NRHS,TOCOMPZ(A),LDA,TOCOMPZ(B),LDB,JPVT,RCOND,
           RANK,TOCOMPZ(WORK),LWORK,RWORK,INFO);
 }
 
+static inline void Tgels(char *TRANS, int *M, int *N, int *NRHS, double *A, int *LDA,
+                         double *B, int *LDB, double *WORK, int *LWORK, int *INFO) {
+  FM_BACKEND(dgels_)(TRANS,M,N,NRHS,A,LDA,B,LDB,WORK,LWORK,INFO);
+}
+
+static inline void Tgels(char *TRANS, int *M, int *N, int *NRHS, FM::Complex<double> *A, int *LDA,
+                         FM::Complex<double> *B, int *LDB, FM::Complex<double> *WORK, int *LWORK,
+                         int *INFO) {
+  FM_BACKEND(zgels_)(TRANS,M,N,NRHS,TOCOMPZ(A),LDA,TOCOMPZ(B),LDB,TOCOMPZ(WORK),LWORK,INFO);
+}
+
+// The real version has no RWORK, it is ignored
+static inline void Tgelsd(int *M, int *N, int *NRHS, double *A, int *LDA,
+                          double *B, int *LDB, double *S, double *RCOND, int *RANK,
+                          double *WORK, int *LWORK, double *, int *IWORK, int *INFO) {
+  FM_BACKEND(dgelsd_)(M,N,NRHS,A,LDA,B,LDB,S,RCOND,RANK,WORK,LWORK,IWORK,INFO);
+}
+
+static inline void Tgelsd(int *M, int *N, int *NRHS, FM::Complex<double> *A, int *LDA,
+                          FM::Complex<double> *B, int *LDB, double *S, double *RCOND, int *RANK,
+                          FM::Complex<double> *WORK, int *LWORK, double *RWORK, int *IWORK,
+                          int *INFO) {
+  FM_BACKEND(zgelsd_)(M,N,NRHS,TOCOMPZ(A),LDA,TOCOMPZ(B),LDB,S,RCOND,RANK,
+                      TOCOMPZ(WORK),LWORK,RWORK,IWORK,INFO);
+}
+
 /***************************************************************************
- * Least-squares solver for double matrices
+ * Least-squares solvers
  ***************************************************************************/
 
-/**
- * Solve A * X = B in a least-squares sense, where A is m x n, and B is m x k.
- * C is n x k.
- */
+namespace FM {
+  // How an over- or under-determined system is solved
+  enum LeastSqMode {
+    LSQ_AUTO = 0,   // QR, falling back to GELSY if A looks rank deficient
+    LSQ_QR = 1,     // Unpivoted QR (or LQ) with ?gels.  A must have full rank
+    LSQ_GELSY = 2,  // Rank revealing QR with column pivoting
+    LSQ_SVD = 3     // Divide and conquer SVD with ?gelsd
+  };
+}
+
+template <class T>
+struct LeastSqReal {typedef T type;};
+
+template <class T>
+struct LeastSqReal<FM::Complex<T> > {typedef T type;};
+
+static inline double lsqMagnitude(double x) {return std::abs(x);}
+
+static inline double lsqMagnitude(const FM::Complex<double> &x) {return std::hypot(x.real,x.imag);}
+
+static inline void warnRankDeficient(int M, int N, int RANK, FM::warning_cb io) {
+  // Overdetermined problems should have rank N, underdetermined rank M
+  if (RANK < std::min(M,N))
+    io(std::string("Matrix is rank deficient to machine precision.  RANK = ") + std::to_string(RANK));
+}
+
+// The B arguments below are LDB x NRHS, with LDB >= max(M,N).  On entry the
+// first M rows hold the right hand sides, on exit the first N rows hold the
+// solution.  A is M x N and is destroyed.
+
+// Returns false if A is exactly rank deficient, in which case B is garbage
 template <typename T>
-static inline void solveLeastSq(int m, int n, int k, T *c, T *a, T *b, FM::warning_cb io) {
-  if ((m == 0) || (n == 0)) return;
-  int M = m;
-  int N = n;
-  int NRHS = k;
-  T *A = a;
-  int LDA = m;
-  //*  B       (input/output) DOUBLE PRECISION array, dimension (LDB,NRHS)
-  int Bsize = (M > N) ? M : N;
-  // This passing convention requires that we copy our source matrix
-  // into the destination array with the appropriate padding.
-  MemBlock<T> B(Bsize*NRHS);
-  changeStride(&B,Bsize,b,m,m,NRHS);
-  int LDB = Bsize;
+static inline bool gelsLeastSq(int M, int N, int NRHS, T *A, T *B, int LDB) {
+  char TRANS = 'N';
+  int LDA = M;
+  T WORKSIZE;
+  int LWORK = -1;
+  int INFO;
+  Tgels(&TRANS, &M, &N, &NRHS, A, &LDA, B, &LDB, &WORKSIZE, &LWORK, &INFO);
+  LWORK = std::max(1,FM::WorkSize(WORKSIZE));
+  FM::Workspace<T> WORK(LWORK);
+  Tgels(&TRANS, &M, &N, &NRHS, A, &LDA, B, &LDB, &WORK, &LWORK, &INFO);
+  return (INFO == 0);
+}
+
+// After gelsLeastSq, A holds the triangular factor R (or L when M < N).
+// The ratio of its smallest to largest diagonal entries is a cheap estimate
+// of the reciprocal condition number.  It is never smaller than the true
+// value, so it can only be used to spot likely trouble.
+template <typename T>
+static inline double triangularDiagonalRatio(int M, int N, const T *A) {
+  double dmin = 0;
+  double dmax = 0;
+  for (int i=0;i<std::min(M,N);i++) {
+    double d = lsqMagnitude(A[i+size_t(i)*M]);
+    if ((i == 0) || (d < dmin)) dmin = d;
+    if (d > dmax) dmax = d;
+  }
+  return (dmax > 0) ? dmin/dmax : 0;
+}
+
+template <typename T>
+static inline int gelsyLeastSq(int M, int N, int NRHS, T *A, T *B, int LDB) {
+  int LDA = M;
   MemBlock<int> JPVT(N);
   T RCOND = lamch<T>();
   int RANK;
@@ -187,48 +262,18 @@ static inline void solveLeastSq(int m, int n, int k, T *c, T *a, T *b, FM::warni
   int LWORK;
   int INFO;
   LWORK = -1;
-  Tgelsy(&M, &N, &NRHS, A, &LDA, &B, &LDB, &JPVT, &RCOND,
+  Tgelsy(&M, &N, &NRHS, A, &LDA, B, &LDB, &JPVT, &RCOND,
 	 &RANK, &WORKSIZE, &LWORK, &INFO);
-  LWORK = (int) WORKSIZE;
-  MemBlock<T> WORK(LWORK);
-  Tgelsy(&M, &N, &NRHS, A, &LDA, &B, &LDB, &JPVT, &RCOND,
+  LWORK = std::max(1,FM::WorkSize(WORKSIZE));
+  FM::Workspace<T> WORK(LWORK);
+  Tgelsy(&M, &N, &NRHS, A, &LDA, B, &LDB, &JPVT, &RCOND,
 	 &RANK, &WORK, &LWORK, &INFO);
-  // Check the rank...
-  if (M > N) {
-    // Problem should be overdetermined, rank should be N
-    if (RANK < N) {
-      io(std::string("Matrix is rank deficient to machine precision.  RANK = ") + std::to_string(RANK));
-    }
-  } else
-    // Problem should be underdetermined, rank should be M
-    if (RANK < M) {
-      io(std::string("Matrix is rank deficient to machine precision.  RANK = ") + std::to_string(RANK));
-    }
-  changeStride(c,n,&B,Bsize,n,k);
+  return RANK;
 }
 
-/***************************************************************************
- * Least-squares solver for complex matrices
- ***************************************************************************/
-
-/**
- * Solve A * X = B in a least-squares sense, where A is m x n, and B is m x k.
- * C is n x k.
- */
 template <typename T>
-static inline void solveLeastSq(int m, int n, int k, FM::Complex<T> *c, FM::Complex<T> *a, FM::Complex<T> *b, FM::warning_cb io) {
-  if ((m == 0) || (n == 0)) return;
-  int M = m;
-  int N = n;
-  int NRHS = k;
-  FM::Complex<T> *A = a;
-  int LDA = m;
-  int Bsize = (M > N) ? M : N;
-  // This passing convention requires that we copy our source matrix
-  // into the destination array with the appropriate padding.
-  MemBlock<FM::Complex<T> > B(Bsize*NRHS);
-  changeStride(&B,Bsize,b,m,m,NRHS);
-  int LDB = Bsize;
+static inline int gelsyLeastSq(int M, int N, int NRHS, FM::Complex<T> *A, FM::Complex<T> *B, int LDB) {
+  int LDA = M;
   MemBlock<int> JPVT(N);
   T RCOND = lamch<T>();
   int RANK;
@@ -237,36 +282,102 @@ static inline void solveLeastSq(int m, int n, int k, FM::Complex<T> *c, FM::Comp
   MemBlock<T> RWORK(2*N);
   int INFO;
   LWORK = -1;
-  Tgelsy(&M, &N, &NRHS, A, &LDA, &B, &LDB, &JPVT, &RCOND,
+  Tgelsy(&M, &N, &NRHS, A, &LDA, B, &LDB, &JPVT, &RCOND,
 	 &RANK, &WORKSIZE, &LWORK, &RWORK, &INFO);
-  LWORK = (int) WORKSIZE.real;
-  MemBlock<FM::Complex<T> > WORK(LWORK);
-  Tgelsy(&M, &N, &NRHS, A, &LDA, &B, &LDB, &JPVT, &RCOND,
+  LWORK = std::max(1,FM::WorkSize(WORKSIZE));
+  FM::Workspace<FM::Complex<T> > WORK(LWORK);
+  Tgelsy(&M, &N, &NRHS, A, &LDA, B, &LDB, &JPVT, &RCOND,
 	 &RANK, &WORK, &LWORK, &RWORK, &INFO);
-  // Check the rank...
-  if (M > N) {
-    // Problem should be overdetermined, rank should be N
-    if (RANK < N)
-      io(std::string("Matrix is rank deficient to machine precision.  RANK = ") + std::to_string(RANK));
-  } else
-    // Problem should be underderemined, rank should be M
-    if (RANK < M) 
-      io(std::string("Matrix is rank deficient to machine precision.  RANK = ") + std::to_string(RANK));
-  changeStride(c,n,&B,Bsize,n,k);
+  return RANK;
+}
+
+template <typename T>
+static inline int gelsdLeastSq(int M, int N, int NRHS, T *A, T *B, int LDB, FM::warning_cb io) {
+  typedef typename LeastSqReal<T>::type R;
+  int LDA = M;
+  MemBlock<R> S(std::min(M,N));
+  // Singular values below this fraction of the largest are treated as zero
+  R RCOND = std::max(M,N)*lamch<R>();
+  int RANK = 0;
+  T WORKSIZE;
+  R RWORKSIZE = 0;
+  int IWORKSIZE = 0;
+  int LWORK = -1;
+  int INFO;
+  Tgelsd(&M, &N, &NRHS, A, &LDA, B, &LDB, &S, &RCOND, &RANK,
+         &WORKSIZE, &LWORK, &RWORKSIZE, &IWORKSIZE, &INFO);
+  LWORK = std::max(1,FM::WorkSize(WORKSIZE));
+  FM::Workspace<T> WORK(LWORK);
+  MemBlock<R> RWORK(std::max(1,static_cast<int>(RWORKSIZE)));
+  MemBlock<int> IWORK(std::max(1,IWORKSIZE));
+  Tgelsd(&M, &N, &NRHS, A, &LDA, B, &LDB, &S, &RCOND, &RANK,
+         &WORK, &LWORK, &RWORK, &IWORK, &INFO);
+  if (INFO > 0)
+    io("SVD failed to converge in least squares solution");
+  return RANK;
+}
+
+/**
+ * Solve A * X = B in a least-squares sense, where A is m x n, and B is m x k.
+ * C is n x k.  A and B are copied, since LAPACK overwrites both.
+ */
+template <typename T>
+static inline void solveLeastSq(int m, int n, int k, T *c, const T *a, const T *b,
+                                FM::LeastSqMode mode, FM::warning_cb io) {
+  if ((m == 0) || (n == 0) || (k == 0)) return;
+  // LAPACK returns the solution in the right hand side array, which must
+  // have max(m,n) rows.  For a wide A that is the size of C, so C is
+  // used directly.  Otherwise the first n rows are copied out at the end.
+  int LDB = std::max(m,n);
+  MemBlock<T> Acopy(size_t(m)*n);
+  MemBlock<T> Bcopy((m > n) ? size_t(m)*k : 0);
+  T *A = &Acopy;
+  T *B = (m > n) ? &Bcopy : c;
+  auto load = [&]() {
+    std::copy(a,a+size_t(m)*n,A);
+    for (int j=0;j<k;j++)
+      std::copy(b+size_t(j)*m,b+size_t(j+1)*m,B+size_t(j)*LDB);
+  };
+  load();
+  if ((mode == FM::LSQ_AUTO) || (mode == FM::LSQ_QR)) {
+    typedef typename LeastSqReal<T>::type R;
+    bool solved = gelsLeastSq(m,n,k,A,B,LDB);
+    if (solved && (mode == FM::LSQ_AUTO)) {
+      // The diagonal test is loose, so that full rank but poorly conditioned
+      // problems go to GELSY, which decides the rank properly.
+      solved = (triangularDiagonalRatio(m,n,A) > std::sqrt(lamch<R>()));
+    } else if (solved && (triangularDiagonalRatio(m,n,A) < std::max(m,n)*lamch<R>())) {
+      io("Matrix is close to rank deficient.  Results may be inaccurate.");
+    }
+    if (!solved) {
+      load();
+      mode = FM::LSQ_GELSY;
+    }
+  }
+  if (mode == FM::LSQ_GELSY)
+    warnRankDeficient(m,n,gelsyLeastSq(m,n,k,A,B,LDB),io);
+  else if (mode == FM::LSQ_SVD)
+    warnRankDeficient(m,n,gelsdLeastSq(m,n,k,A,B,LDB,io),io);
+  if (m > n)
+    for (int j=0;j<k;j++)
+      std::copy(B+size_t(j)*LDB,B+size_t(j)*LDB+n,c+size_t(j)*n);
 }
 
 namespace FM {
+  // The mode only affects non-square systems.  Square ones are solved by LU.
   template <class T>
-  void DenseSolve(int m, int n, int k, T *c, const T *a, const T *b, warning_cb io)
+  void DenseSolve(int m, int n, int k, T *c, const T *a, const T *b, warning_cb io,
+                  LeastSqMode mode = LSQ_AUTO)
   {
+    if (m != n) {
+      solveLeastSq(m,n,k,c,a,b,mode,io);
+      return;
+    }
     MemBlock<T> A(m*n);
     memcpy(&A,a,m*n*sizeof(T));
     MemBlock<T> B(m*k);
     memcpy(&B,b,m*k*sizeof(T));
-    if (m == n)
-      solveLinEq(m,k,c,&A,&B,io);
-    else
-      solveLeastSq(m,n,k,c,&A,&B,io);
+    solveLinEq(m,k,c,&A,&B,io);
   }
 }
 
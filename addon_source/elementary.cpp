@@ -0,0 +1,189 @@
+#include "elementary.hpp"
+#include "cpu_dispatch.hpp"
+#include "parallel.hpp"
+#include "tuning.hpp"
+#include <vector>
+
+namespace FM {
+
+  // Complex functions are evaluated a block at a time, so that their
+  // intermediate results stay in cache
+  const size_t ELEM_BLOCK = 1024;
+
+  const double ELEM_PI = 3.14159265358979311600e+00;
+
+  bool ElementaryNeedsComplex(ElementaryOp op, const double *re, size_t n) {
+    if ((op != ELEM_LOG) && (op != ELEM_SQRT)) return false;
+    for (size_t b=0;b<n;b+=ELEM_BLOCK) {
+      const size_t e = std::min(n,b+ELEM_BLOCK);
+      bool negative = false;
+      for (size_t i=b;i<e;i++)
+        negative |= (re[i] < 0);
+      if (negative) return true;
+    }
+    return false;
+  }
+
+  static void RealRange(ElementaryOp op, const double *x, double *y, size_t n) {
+    const auto &K = Kernels();
+    switch (op) {
+    case ELEM_EXP: K.dexp(x,y,n); break;
+    case ELEM_LOG: K.dlog(x,y,n); break;
+    case ELEM_SQRT: K.dsqrt(x,y,n); break;
+    case ELEM_SIN: K.dsin(x,y,n); break;
+    case ELEM_COS: K.dcos(x,y,n); break;
+    case ELEM_ABS:
+      for (size_t i=0;i<n;i++) y[i] = std::fabs(x[i]);
+      break;
+    }
+  }
+
+  // The log or square root of real data with negative elements
+  static void PromotedRange(ElementaryOp op, const double *x, double *y_re, double *y_im,
+                            size_t n) {
+    const auto &K = Kernels();
+    for (size_t i=0;i<n;i++) y_im[i] = std::fabs(x[i]);
+    if (op == ELEM_LOG) {
+      K.dlog(y_im,y_re,n);
+      for (size_t i=0;i<n;i++) y_im[i] = (x[i] < 0) ? ELEM_PI : 0.0;
+    } else {
+      K.dsqrt(y_im,y_re,n);
+      for (size_t i=0;i<n;i++) {
+        const double s = y_re[i];
+        y_re[i] = (x[i] < 0) ? 0.0 : s;
+        y_im[i] = (x[i] < 0) ? s : 0.0;
+      }
+    }
+  }
+
+  // sinh(x) for the elements of x, given e = exp(|x|).  Small arguments use
+  // a Taylor polynomial to avoid the cancellation in e - 1/e.
+  static void SinhFromExp(const double *x, const double *e, double *y, size_t n) {
+    for (size_t i=0;i<n;i++) {
+      const double v = x[i];
+      const double z = v*v;
+      double p = 1.0/51090942171709440000.0;
+      p = p*z + 1.0/121645100408832000.0;
+      p = p*z + 1.0/355687428096000.0;
+      p = p*z + 1.0/1307674368000.0;
+      p = p*z + 1.0/6227020800.0;
+      p = p*z + 1.0/39916800.0;
+      p = p*z + 1.0/362880.0;
+      p = p*z + 1.0/5040.0;
+      p = p*z + 1.0/120.0;
+      p = p*z + 1.0/6.0;
+      const double series = v + v*z*p;
+      const double large = std::copysign(0.5*(e[i] - 1.0/e[i]),v);
+      y[i] = (std::fabs(v) < 1.0) ? series : large;
+    }
+  }
+
+  struct ComplexScratch {
+    std::vector<double> t1, t2, t3, t4;
+    ComplexScratch() : t1(ELEM_BLOCK), t2(ELEM_BLOCK), t3(ELEM_BLOCK), t4(ELEM_BLOCK) {}
+  };
+
+  // One block (at most ELEM_BLOCK elements) of a function of complex data
+  static void ComplexBlock(ElementaryOp op, const double *a, const double *b,
+                           double *y_re, double *y_im, size_t n, ComplexScratch &w) {
+    const auto &K = Kernels();
+    double *t1 = w.t1.data();
+    double *t2 = w.t2.data();
+    double *t3 = w.t3.data();
+    double *t4 = w.t4.data();
+    switch (op) {
+    case ELEM_ABS:
+      K.dhypot(a,b,y_re,n);
+      break;
+    case ELEM_EXP:
+      // exp(a+ib) = exp(a) (cos(b) + i sin(b))
+      K.dexp(a,t1,n);
+      K.dcos(b,t2,n);
+      K.dsin(b,t3,n);
+      for (size_t i=0;i<n;i++) {
+        y_re[i] = t1[i]*t2[i];
+        y_im[i] = (b[i] == 0) ? b[i] : t1[i]*t3[i];
+      }
+      break;
+    case ELEM_LOG:
+      // log(z) = log|z| + i arg(z)
+      K.dhypot(a,b,t1,n);
+      K.dlog(t1,y_re,n);
+      K.datan2(b,a,y_im,n);
+      break;
+    case ELEM_SQRT:
+      // The principal root, computed from sqrt((|z| + |a|)/2) to avoid
+      // cancellation
+      K.dhypot(a,b,t1,n);
+      for (size_t i=0;i<n;i++)
+        t1[i] = 0.5*t1[i] + 0.5*std::fabs(a[i]);
+      K.dsqrt(t1,t2,n);
+      for (size_t i=0;i<n;i++) {
+        const double t = t2[i];
+        const double other = (t > 0) ? b[i]/(2.0*t) : b[i];
+        y_re[i] = (a[i] >= 0) ? t : std::fabs(other);
+        y_im[i] = (a[i] >= 0) ? other : std::copysign(t,b[i]);
+      }
+      break;
+    case ELEM_SIN:
+    case ELEM_COS:
+      // sin(a+ib) = sin(a) cosh(b) + i cos(a) sinh(b)
+      // cos(a+ib) = cos(a) cosh(b) - i sin(a) sinh(b)
+      for (size_t i=0;i<n;i++) t4[i] = std::fabs(b[i]);
+      K.dexp(t4,t3,n);
+      SinhFromExp(b,t3,t4,n);
+      for (size_t i=0;i<n;i++) t3[i] = 0.5*(t3[i] + 1.0/t3[i]);
+      K.dsin(a,t1,n);
+      K.dcos(a,t2,n);
+      if (op == ELEM_SIN) {
+        for (size_t i=0;i<n;i++) {
+          y_re[i] = t1[i]*t3[i];
+          y_im[i] = (b[i] == 0) ? b[i] : t2[i]*t4[i];
+        }
+      } else {
+        for (size_t i=0;i<n;i++) {
+          y_re[i] = t2[i]*t3[i];
+          y_im[i] = (b[i] == 0) ? -t1[i]*b[i] : -t1[i]*t4[i];
+        }
+      }
+      break;
+    }
+  }
+
+  void Elementary(ElementaryOp op, size_t n, const double *re, const double *im,
+                  double *out_re, double *out_im) {
+    ParallelFor(n,ParallelGrain(),[&](size_t begin, size_t end) {
+        if (!im && !out_im) {
+          RealRange(op,re+begin,out_re+begin,end-begin);
+          return;
+        }
+        if (!im) {
+          PromotedRange(op,re+begin,out_re+begin,out_im+begin,end-begin);
+          return;
+        }
+        ComplexScratch w;
+        for (size_t b=begin;b<end;b+=ELEM_BLOCK) {
+          const size_t len = std::min(end,b+ELEM_BLOCK) - b;
+          ComplexBlock(op,re+b,im+b,out_re+b,out_im ? out_im+b : nullptr,len,w);
+        }
+      });
+  }
+
+  void Atan2(size_t n, const double *y, size_t ny, const double *x, size_t nx, double *out) {
+    ParallelFor(n,ParallelGrain(),[&](size_t begin, size_t end) {
+        if ((ny == n) && (nx == n)) {
+          Kernels().datan2(y+begin,x+begin,out+begin,end-begin);
+          return;
+        }
+        // Expand the scalar argument a block at a time
+        std::vector<double> fill(ELEM_BLOCK,(ny == n) ? x[0] : y[0]);
+        for (size_t b=begin;b<end;b+=ELEM_BLOCK) {
+          const size_t len = std::min(end,b+ELEM_BLOCK) - b;
+          if (ny == n)
+            Kernels().datan2(y+b,fill.data(),out+b,len);
+          else
+            Kernels().datan2(fill.data(),x+b,out+b,len);
+        }
+      });
+  }
+}
@@ -0,0 +1,276 @@
+#ifndef __elementary_hpp__
+#define __elementary_hpp__
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+
+// Elementary functions of real and complex arrays.  The real kernels are
+// branch free polynomial approximations, written so that the compiler
+// vectorizes them for each instruction set level (see cpu_dispatch.hpp).
+// The complex functions are built from the real kernels, working on planar
+// data a block at a time.
+//
+// Errors of the real kernels, measured against correctly rounded results:
+//   exp    within 1 ULP
+//   log    within 1 ULP
+//   sin    within 1.5 ULP for |x| < 823550 (2^19 pi/2); larger arguments
+//   cos    go through the C library
+//   atan2  within 2 ULP
+//   hypot  within 1 ULP
+//   sqrt   correctly rounded
+// Arguments very close to a nonzero multiple of pi/2 lose relative (but
+// not absolute) accuracy in sin and cos.
+
+namespace FM {
+
+  enum ElementaryOp {
+    ELEM_EXP = 0,
+    ELEM_LOG = 1,
+    ELEM_SQRT = 2,
+    ELEM_SIN = 3,
+    ELEM_COS = 4,
+    ELEM_ABS = 5
+  };
+
+  inline uint64_t elem_bits(double x) {
+    uint64_t u;
+    memcpy(&u,&x,sizeof(u));
+    return u;
+  }
+
+  inline double elem_double(uint64_t u) {
+    double x;
+    memcpy(&x,&u,sizeof(x));
+    return x;
+  }
+
+  // Adding this rounds a double of magnitude below 2^51 to an integer,
+  // which then sits in the low bits of the representation
+  const double ELEM_ROUND = 6755399441055744.0;
+
+  // ln(2) split so that k*LN2_HI is exact for |k| < 2^20
+  const double ELEM_LN2_HI = 6.93147180369123816490e-01;
+  const double ELEM_LN2_LO = 1.90821492927058770002e-10;
+
+  // pi/2 split in 33 bit pieces, so that k*PIO2_n is exact for |k| < 2^20
+  const double ELEM_PIO2_1 = 1.57079632673412561417e+00;
+  const double ELEM_PIO2_2 = 6.07710050630396597660e-11;
+  const double ELEM_PIO2_3 = 2.02226624871116645580e-21;
+  const double ELEM_PIO2_3T = 8.47842766036889956997e-32;
+
+  // Beyond this, sin and cos reduce their arguments with the C library
+  const double ELEM_SINCOS_MAX = 823550.0;
+
+  // exp(x) = 2^k exp(r), with |r| <= ln(2)/2 and a degree 13 Taylor
+  // polynomial for exp(r).  2^k is applied in two halves so that results in
+  // the subnormal range are rounded only once.
+  inline void exp_kernel(const double *x, double *y, size_t n) {
+    for (size_t i=0;i<n;i++) {
+      const double v = x[i];
+      const double c = std::min(std::max(v,-746.0),710.0);
+      const double kd = (c*1.44269504088896338700 + ELEM_ROUND) - ELEM_ROUND;
+      const double r = (c - kd*ELEM_LN2_HI) - kd*ELEM_LN2_LO;
+      double p = 1.0/6227020800.0;
+      p = p*r + 1.0/479001600.0;
+      p = p*r + 1.0/39916800.0;
+      p = p*r + 1.0/3628800.0;
+      p = p*r + 1.0/362880.0;
+      p = p*r + 1.0/40320.0;
+      p = p*r + 1.0/5040.0;
+      p = p*r + 1.0/720.0;
+      p = p*r + 1.0/120.0;
+      p = p*r + 1.0/24.0;
+      p = p*r + 1.0/6.0;
+      p = p*r + 0.5;
+      p = p*r + 1.0;
+      p = p*r + 1.0;
+      const double k1 = (kd*0.5 + ELEM_ROUND) - ELEM_ROUND;
+      const double k2 = kd - k1;
+      const uint64_t e1 = elem_bits(k1 + ELEM_ROUND) - elem_bits(ELEM_ROUND) + 1023;
+      const uint64_t e2 = elem_bits(k2 + ELEM_ROUND) - elem_bits(ELEM_ROUND) + 1023;
+      const double s = (p*elem_double(e1 << 52))*elem_double(e2 << 52);
+      y[i] = (v != v) ? v : s;
+    }
+  }
+
+  // log(x) = k ln(2) + log(m), with m in [sqrt(2)/2, sqrt(2)).  log(m) is
+  // 2 atanh(s) with s = (m-1)/(m+1), arranged as in fdlibm so that the
+  // leading term is exact.
+  inline void log_kernel(const double *x, double *y, size_t n) {
+    const double inf = std::numeric_limits<double>::infinity();
+    const double nan = std::numeric_limits<double>::quiet_NaN();
+    for (size_t i=0;i<n;i++) {
+      const double v = x[i];
+      const bool subnormal = v < 2.2250738585072014e-308;
+      const double u = subnormal ? v*18014398509481984.0 : v;
+      const uint64_t b = elem_bits(u);
+      double e = elem_double(0x4330000000000000ULL | (b >> 52)) - 4503599627370496.0 - 1023.0;
+      e = subnormal ? e - 54.0 : e;
+      double m = elem_double((b & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL);
+      const bool big = m > 1.41421356237309514547;
+      m = big ? 0.5*m : m;
+      e = big ? e + 1.0 : e;
+      const double f = m - 1.0;
+      const double s = f/(2.0 + f);
+      const double z = s*s;
+      double R = 2.0/23.0;
+      R = R*z + 2.0/21.0;
+      R = R*z + 2.0/19.0;
+      R = R*z + 2.0/17.0;
+      R = R*z + 2.0/15.0;
+      R = R*z + 2.0/13.0;
+      R = R*z + 2.0/11.0;
+      R = R*z + 2.0/9.0;
+      R = R*z + 2.0/7.0;
+      R = R*z + 2.0/5.0;
+      R = R*z + 2.0/3.0;
+      R = R*z;
+      const double hfsq = 0.5*f*f;
+      const double r = e*ELEM_LN2_HI - ((hfsq - (s*(hfsq + R) + e*ELEM_LN2_LO)) - f);
+      const bool finite = (v > 0) && (v < inf);
+      y[i] = finite ? r : ((v == 0) ? -inf : ((v == inf) ? v : nan));
+    }
+  }
+
+  // sin (quadrant 0) or cos (quadrant 1).  x = k pi/2 + r with |r| <= pi/4,
+  // and sin(r) and cos(r) are Taylor polynomials of degree 17 and 18.
+  inline void sincos_kernel(const double *x, double *y, size_t n, uint64_t quadrant) {
+    for (size_t i=0;i<n;i++) {
+      const double v = x[i];
+      const double kr = v*6.36619772367581382433e-01 + ELEM_ROUND;
+      const uint64_t q = elem_bits(kr) + quadrant;
+      const double kd = kr - ELEM_ROUND;
+      // v - k*PIO2_1 is exact, so r is rounded only once
+      const double tail = kd*ELEM_PIO2_2 + (kd*ELEM_PIO2_3 + kd*ELEM_PIO2_3T);
+      const double r = (v - kd*ELEM_PIO2_1) - tail;
+      const double z = r*r;
+      double ps = 1.0/355687428096000.0;
+      ps = ps*z - 1.0/1307674368000.0;
+      ps = ps*z + 1.0/6227020800.0;
+      ps = ps*z - 1.0/39916800.0;
+      ps = ps*z + 1.0/362880.0;
+      ps = ps*z - 1.0/5040.0;
+      ps = ps*z + 1.0/120.0;
+      ps = ps*z - 1.0/6.0;
+      // The select keeps the sign of sin(-0)
+      const double s = (r == 0) ? r : r + r*z*ps;
+      double pc = -1.0/6402373705728000.0;
+      pc = pc*z + 1.0/20922789888000.0;
+      pc = pc*z - 1.0/87178291200.0;
+      pc = pc*z + 1.0/479001600.0;
+      pc = pc*z - 1.0/3628800.0;
+      pc = pc*z + 1.0/40320.0;
+      pc = pc*z - 1.0/720.0;
+      pc = pc*z + 1.0/24.0;
+      const double hz = 0.5*z;
+      const double w = 1.0 - hz;
+      const double c = w + (((1.0 - w) - hz) + z*z*pc);
+      const double t = (q & 1) ? c : s;
+      y[i] = (q & 2) ? -t : t;
+    }
+    for (size_t i=0;i<n;i++)
+      if (std::fabs(x[i]) > ELEM_SINCOS_MAX)
+        y[i] = quadrant ? std::cos(x[i]) : std::sin(x[i]);
+  }
+
+  // Reduce to t = min/max in [0,1], and then to |u| <= tan(pi/8) with
+  // atan(t) = pi/4 + atan((t-1)/(t+1)).  u is formed from min and max
+  // directly (unless their sum could overflow) to save a rounding.  atan(u)
+  // is a Taylor polynomial of degree 43.  Infinities and NaNs go through
+  // the C library.
+  inline void atan2_kernel(const double *y, const double *x, double *out, size_t n) {
+    for (size_t i=0;i<n;i++) {
+      const double a = x[i];
+      const double b = y[i];
+      const double ax = std::fabs(a);
+      const double ay = std::fabs(b);
+      const double mx = std::max(ax,ay);
+      const double mn = std::min(ax,ay);
+      const double t = (mx > 0) ? mn/mx : 0.0;
+      const bool reduce = t > 0.41421356237309503;
+      const double d = (mx < 1e300) ? (mn - mx)/(mn + mx) : (t - 1.0)/(t + 1.0);
+      const double u = reduce ? d : t;
+      const double z = u*u;
+      double p = -1.0/43.0;
+      p = p*z + 1.0/41.0;
+      p = p*z - 1.0/39.0;
+      p = p*z + 1.0/37.0;
+      p = p*z - 1.0/35.0;
+      p = p*z + 1.0/33.0;
+      p = p*z - 1.0/31.0;
+      p = p*z + 1.0/29.0;
+      p = p*z - 1.0/27.0;
+      p = p*z + 1.0/25.0;
+      p = p*z - 1.0/23.0;
+      p = p*z + 1.0/21.0;
+      p = p*z - 1.0/19.0;
+      p = p*z + 1.0/17.0;
+      p = p*z - 1.0/15.0;
+      p = p*z + 1.0/13.0;
+      p = p*z - 1.0/11.0;
+      p = p*z + 1.0/9.0;
+      p = p*z - 1.0/7.0;
+      p = p*z + 1.0/5.0;
+      p = p*z - 1.0/3.0;
+      double r = u + u*z*p;
+      r = reduce ? 7.85398163397448278999e-01 + (r + 3.06161699786838301793e-17) : r;
+      // Unfold to the quadrant as hi + (+-r + lo), where hi + lo is 0, pi/2
+      // or pi.  Folding in one step keeps atan2(1,-0) at pi/2.
+      const bool steep = ay > ax;
+      const bool left = (elem_bits(a) >> 63) != 0;
+      const double hi = steep ? 1.57079632679489655800e+00 : (left ? 3.14159265358979311600e+00 : 0.0);
+      const double lo = steep ? 6.12323399573676603587e-17 : (left ? 1.22464679914735317723e-16 : 0.0);
+      r = hi + (((steep != left) ? -r : r) + lo);
+      out[i] = std::copysign(r,b);
+    }
+    for (size_t i=0;i<n;i++)
+      if (!std::isfinite(x[i]) || !std::isfinite(y[i]))
+        out[i] = std::atan2(y[i],x[i]);
+  }
+
+  // sqrt(a^2+b^2), scaled by the larger magnitude when the squares could
+  // overflow or underflow
+  inline void hypot_kernel(const double *a, const double *b, double *out, size_t n) {
+    for (size_t i=0;i<n;i++) {
+      const double ax = std::fabs(a[i]);
+      const double ay = std::fabs(b[i]);
+      const double mx = std::max(ax,ay);
+      const double mn = std::min(ax,ay);
+      const double t = (mx > 0) ? mn/mx : 0.0;
+      const bool safe = (mx < 1e150) && (mn > 1e-150);
+      const double scaled = mx*std::sqrt(1.0 + t*t);
+      const double direct = std::sqrt(ax*ax + ay*ay);
+      out[i] = safe ? direct : scaled;
+    }
+    for (size_t i=0;i<n;i++)
+      if (!std::isfinite(a[i]) || !std::isfinite(b[i]))
+        out[i] = std::hypot(a[i],b[i]);
+  }
+
+  // Needs -fno-math-errno to vectorize; negative inputs are never passed
+  inline void sqrt_kernel(const double *x, double *y, size_t n) {
+    for (size_t i=0;i<n;i++)
+      y[i] = std::sqrt(x[i]);
+  }
+
+  // True if op applied to the real data needs a complex result (the log or
+  // square root of a negative number)
+  bool ElementaryNeedsComplex(ElementaryOp op, const double *re, size_t n);
+
+  // Apply op to n elements.  im is null for real input.  out_im is null if
+  // the result is real: abs of anything, and the other functions of real
+  // input unless ElementaryNeedsComplex says otherwise.  Large arrays are
+  // split across threads.
+  void Elementary(ElementaryOp op, size_t n, const double *re, const double *im,
+                  double *out_re, double *out_im);
+
+  // Four quadrant arctangent of real y and x.  A scalar argument (length 1)
+  // is used for every element of the other.
+  void Atan2(size_t n, const double *y, size_t ny, const double *x, size_t nx, double *out);
+}
+
+#endif
@@ -0,0 +1,421 @@
+#include "fft.hpp"
+#include "parallel.hpp"
+#include "nd_layout.hpp"
+#include <algorithm>
+#include <cmath>
+#include <map>
+#include <mutex>
+
+namespace FM {
+
+  // Plans are dropped from the cache once they hold more than this
+  const size_t FFT_CACHE_LIMIT = size_t(64) << 20;
+
+  // Multiply by i
+  static inline fft_complex times_i(const fft_complex &a) {
+    return fft_complex(-a.imag, a.real);
+  }
+
+  // exp(-2*pi*i*k/n), with k reduced first to keep the angle small
+  static fft_complex Root(size_t k, size_t n) {
+    const double angle = -2*M_PI*static_cast<double>(k % n)/static_cast<double>(n);
+    return fft_complex(cos(angle), sin(angle));
+  }
+
+  // Butterflies.  Each replaces v with its DFT.
+
+  struct Butterfly2 {
+    static const size_t radix = 2;
+    void operator()(fft_complex *v) const {
+      const fft_complex a = v[0];
+      v[0] = a + v[1];
+      v[1] = a - v[1];
+    }
+  };
+
+  struct Butterfly3 {
+    static const size_t radix = 3;
+    void operator()(fft_complex *v) const {
+      const double c = -0.5;
+      const double s = -0.86602540378443864676;
+      const fft_complex t1 = v[1] + v[2];
+      const fft_complex t2 = v[0] + c*t1;
+      const fft_complex t3 = times_i(s*(v[1] - v[2]));
+      v[0] = v[0] + t1;
+      v[1] = t2 + t3;
+      v[2] = t2 - t3;
+    }
+  };
+
+  struct Butterfly4 {
+    static const size_t radix = 4;
+    void operator()(fft_complex *v) const {
+      const fft_complex t0 = v[0] + v[2];
+      const fft_complex t1 = v[0] - v[2];
+      const fft_complex t2 = v[1] + v[3];
+      const fft_complex t3 = times_i(v[3] - v[1]);
+      v[0] = t0 + t2;
+      v[1] = t1 + t3;
+      v[2] = t0 - t2;
+      v[3] = t1 - t3;
+    }
+  };
+
+  struct Butterfly5 {
+    static const size_t radix = 5;
+    void operator()(fft_complex *v) const {
+      const double c1 = 0.30901699437494742410;
+      const double c2 = -0.80901699437494742410;
+      const double s1 = -0.95105651629515357212;
+      const double s2 = -0.58778525229247312917;
+      const fft_complex a1 = v[1] + v[4];
+      const fft_complex b1 = v[1] - v[4];
+      const fft_complex a2 = v[2] + v[3];
+      const fft_complex b2 = v[2] - v[3];
+      const fft_complex e1 = v[0] + c1*a1 + c2*a2;
+      const fft_complex e2 = v[0] + c2*a1 + c1*a2;
+      const fft_complex o1 = times_i(s1*b1 + s2*b2);
+      const fft_complex o2 = times_i(s2*b1 - s1*b2);
+      v[0] = v[0] + a1 + a2;
+      v[1] = e1 + o1;
+      v[4] = e1 - o1;
+      v[2] = e2 + o2;
+      v[3] = e2 - o2;
+    }
+  };
+
+  // One pass of the Stockham transform.  Element j + r*(n/R) of the input
+  // is combined into element (j/span)*span*R + j%span + r*span of the output.
+  template <class Butterfly>
+  static void Pass(size_t n, size_t span, const fft_complex *tw, const fft_complex *in,
+                   fft_complex *out, Butterfly bf) {
+    const size_t R = Butterfly::radix;
+    const size_t stride = n/R;
+    fft_complex v[R];
+    for (size_t b=0;b<stride;b+=span)
+      for (size_t q=0;q<span;q++) {
+        const fft_complex *w = tw + q*R;
+        const fft_complex *x = in + b + q;
+        for (size_t r=0;r<R;r++)
+          v[r] = x[r*stride]*w[r];
+        bf(v);
+        fft_complex *y = out + b*R + q;
+        for (size_t r=0;r<R;r++)
+          y[r*span] = v[r];
+      }
+  }
+
+  static void GenericPass(size_t R, size_t n, size_t span, const fft_complex *tw,
+                          const fft_complex *roots, const fft_complex *in, fft_complex *out) {
+    const size_t stride = n/R;
+    fft_complex v[FFT_MAX_RADIX];
+    for (size_t b=0;b<stride;b+=span)
+      for (size_t q=0;q<span;q++) {
+        const fft_complex *w = tw + q*R;
+        const fft_complex *x = in + b + q;
+        for (size_t r=0;r<R;r++)
+          v[r] = x[r*stride]*w[r];
+        fft_complex *y = out + b*R + q;
+        for (size_t k=0;k<R;k++) {
+          fft_complex sum = v[0];
+          size_t kr = k;
+          for (size_t r=1;r<R;r++) {
+            sum = sum + v[r]*roots[kr];
+            kr += k;
+            if (kr >= R) kr -= R;
+          }
+          y[k*span] = sum;
+        }
+      }
+  }
+
+  // Radices of n, largest power of 4 first.  Returns false if n has a
+  // prime factor above FFT_MAX_RADIX.
+  static bool Factor(size_t n, std::vector<size_t> &radices) {
+    if (n <= 1) return true;
+    while (n % 4 == 0) {radices.push_back(4); n /= 4;}
+    if (n % 2 == 0) {radices.push_back(2); n /= 2;}
+    for (size_t p=3;p*p<=n;p+=2)
+      while (n % p == 0) {radices.push_back(p); n /= p;}
+    if (n > 1) radices.push_back(n);
+    return radices.empty() || (radices.back() <= FFT_MAX_RADIX);
+  }
+
+  size_t FFTFastLength(size_t n) {
+    for (;;n++) {
+      size_t m = n;
+      for (size_t p : {2, 3, 5})
+        while ((m > 1) && (m % p == 0)) m /= p;
+      if (m <= 1) return n;
+    }
+  }
+
+  FFTPlan::FFTPlan(size_t n) : n(n), work(n) {
+    std::vector<size_t> radices;
+    if (Factor(n,radices)) {
+      size_t span = 1;
+      for (auto R : radices) {
+        Stage stage;
+        stage.radix = R;
+        stage.span = span;
+        stage.twiddles.resize(span*R);
+        for (size_t q=0;q<span;q++)
+          for (size_t r=0;r<R;r++)
+            stage.twiddles[q*R+r] = Root(q*r,span*R);
+        if (R > 5) {
+          stage.roots.resize(R);
+          for (size_t k=0;k<R;k++)
+            stage.roots[k] = Root(k,R);
+        }
+        stages.push_back(stage);
+        span *= R;
+      }
+      return;
+    }
+    // Bluestein: the transform is a convolution with a chirp, which is done
+    // with transforms of a power of two length m >= 2n-1.
+    size_t m = 1;
+    while (m < 2*n-1) m *= 2;
+    inner = GetFFTPlan(m);
+    work = m + inner->work_size();
+    chirp.resize(n);
+    for (size_t k=0;k<n;k++) {
+      // exp(-i*pi*k^2/n), with k^2 reduced mod 2n
+      const double angle = -M_PI*static_cast<double>((k*k) % (2*n))/static_cast<double>(n);
+      chirp[k] = fft_complex(cos(angle),sin(angle));
+    }
+    std::vector<fft_complex> scratch(inner->work_size());
+    filter.assign(m,fft_complex());
+    filter[0] = complex_conj(chirp[0]);
+    for (size_t k=1;k<n;k++)
+      filter[k] = filter[m-k] = complex_conj(chirp[k]);
+    inner->Forward(filter.data(),scratch.data());
+    // Fold in the 1/m of the inverse transform
+    for (auto &f : filter)
+      f = (1.0/m)*f;
+  }
+
+  size_t FFTPlan::bytes() const {
+    size_t total = (chirp.size() + filter.size())*sizeof(fft_complex);
+    for (auto &stage : stages)
+      total += (stage.twiddles.size() + stage.roots.size())*sizeof(fft_complex);
+    return total;
+  }
+
+  void FFTPlan::Forward(fft_complex *x, fft_complex *scratch) const {
+    if (inner)
+      Bluestein(x,scratch);
+    else
+      Stockham(x,scratch);
+  }
+
+  void FFTPlan::Stockham(fft_complex *x, fft_complex *scratch) const {
+    fft_complex *in = x;
+    fft_complex *out = scratch;
+    for (auto &stage : stages) {
+      const fft_complex *tw = stage.twiddles.data();
+      switch (stage.radix) {
+      case 2:
+        Pass(n,stage.span,tw,in,out,Butterfly2());
+        break;
+      case 3:
+        Pass(n,stage.span,tw,in,out,Butterfly3());
+        break;
+      case 4:
+        Pass(n,stage.span,tw,in,out,Butterfly4());
+        break;
+      case 5:
+        Pass(n,stage.span,tw,in,out,Butterfly5());
+        break;
+      default:
+        GenericPass(stage.radix,n,stage.span,tw,stage.roots.data(),in,out);
+      }
+      std::swap(in,out);
+    }
+    if (in != x)
+      std::copy(in,in+n,x);
+  }
+
+  void FFTPlan::Bluestein(fft_complex *x, fft_complex *scratch) const {
+    const size_t m = filter.size();
+    fft_complex *a = scratch;
+    fft_complex *inner_scratch = scratch + m;
+    for (size_t k=0;k<n;k++)
+      a[k] = x[k]*chirp[k];
+    std::fill(a+n,a+m,fft_complex());
+    inner->Forward(a,inner_scratch);
+    // The inverse transform is a forward transform of the conjugate
+    for (size_t k=0;k<m;k++)
+      a[k] = complex_conj(a[k]*filter[k]);
+    inner->Forward(a,inner_scratch);
+    for (size_t k=0;k<n;k++)
+      x[k] = chirp[k]*complex_conj(a[k]);
+  }
+
+  RealFFTPlan::RealFFTPlan(size_t n) : n(n), half(GetFFTPlan(n/2)) {
+    twiddles.resize(n/4+1);
+    for (size_t k=0;k<twiddles.size();k++)
+      twiddles[k] = Root(k,n);
+  }
+
+  size_t RealFFTPlan::bytes() const {
+    return twiddles.size()*sizeof(fft_complex);
+  }
+
+  // The even and odd samples are packed into the real and imaginary parts
+  // of a half length transform Z, then separated using the symmetry of the
+  // transforms of real data.
+  void RealFFTPlan::Forward(const double *x, fft_complex *X, fft_complex *scratch) const {
+    const size_t h = n/2;
+    fft_complex *z = X;
+    for (size_t k=0;k<h;k++)
+      z[k] = fft_complex(x[2*k],x[2*k+1]);
+    half->Forward(z,scratch);
+    const fft_complex z0 = z[0];
+    X[0] = fft_complex(z0.real + z0.imag,0);
+    X[h] = fft_complex(z0.real - z0.imag,0);
+    // Terms k and h-k are made from z[k] and z[h-k], so they can be
+    // written over them
+    for (size_t k=1;k<=h/2;k++) {
+      const fft_complex zk = z[k];
+      const fft_complex zm = complex_conj(z[h-k]);
+      const fft_complex even = 0.5*(zk + zm);
+      const fft_complex d = zk - zm;
+      const fft_complex odd(0.5*d.imag,-0.5*d.real);
+      const fft_complex t = twiddles[k]*odd;
+      X[k] = even + t;
+      X[h-k] = complex_conj(even - t);
+    }
+    for (size_t k=1;k<h;k++)
+      X[n-k] = complex_conj(X[k]);
+  }
+
+  static std::mutex cache_mutex;
+  static std::map<size_t, std::shared_ptr<const FFTPlan> > complex_plans;
+  static std::map<size_t, std::shared_ptr<const RealFFTPlan> > real_plans;
+  static size_t cache_bytes = 0;
+
+  // Plans are built outside the lock, since building a Bluestein plan looks
+  // up the plan it uses.  If two threads build the same plan, the first one
+  // into the cache wins.
+  template <class P>
+  static std::shared_ptr<const P> LookupPlan(std::map<size_t, std::shared_ptr<const P> > &plans,
+                                             size_t n) {
+    {
+      std::lock_guard<std::mutex> lock(cache_mutex);
+      auto i = plans.find(n);
+      if (i != plans.end()) return i->second;
+    }
+    auto plan = std::make_shared<const P>(n);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    auto i = plans.find(n);
+    if (i != plans.end()) return i->second;
+    if (cache_bytes + plan->bytes() > FFT_CACHE_LIMIT) {
+      complex_plans.clear();
+      real_plans.clear();
+      cache_bytes = 0;
+    }
+    plans[n] = plan;
+    cache_bytes += plan->bytes();
+    return plan;
+  }
+
+  std::shared_ptr<const FFTPlan> GetFFTPlan(size_t n) {
+    return LookupPlan(complex_plans,n);
+  }
+
+  std::shared_ptr<const RealFFTPlan> GetRealFFTPlan(size_t n) {
+    return LookupPlan(real_plans,n);
+  }
+
+  FFTCacheInfo GetFFTCacheInfo() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    FFTCacheInfo info;
+    info.plans = complex_plans.size() + real_plans.size();
+    info.bytes = cache_bytes;
+    return info;
+  }
+
+  void ClearFFTCache() {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    complex_plans.clear();
+    real_plans.clear();
+    cache_bytes = 0;
+  }
+
+  // Each thread is given at least this many points to transform
+  const size_t FFT_MIN_POINTS_PER_THREAD = 32768;
+
+  void FFTDimension(const std::vector<size_t> &dims, size_t dim, size_t len, bool inverse,
+                    const double *re, const double *im, bool real_out,
+                    double *out_re, double *out_im) {
+    const VectorLayout layout(dims,dim);
+    if ((layout.count == 0) || (len == 0)) return;
+    const size_t stride = layout.stride;
+    const size_t copy = std::min(layout.n,len);
+    const bool real_input = !im && !inverse && (len % 2 == 0);
+    std::shared_ptr<const FFTPlan> plan;
+    std::shared_ptr<const RealFFTPlan> real_plan;
+    size_t work;
+    if (real_input) {
+      real_plan = GetRealFFTPlan(len);
+      work = real_plan->work_size();
+    } else {
+      plan = GetFFTPlan(len);
+      work = plan->work_size();
+    }
+    // The inverse is the conjugate of the forward transform of the conjugate
+    const double scale = inverse ? 1.0/len : 1.0;
+    const double sign = inverse ? -1.0 : 1.0;
+    const size_t min_chunk = std::max<size_t>(1,FFT_MIN_POINTS_PER_THREAD/len);
+    ParallelFor(layout.count,min_chunk,[&](size_t begin, size_t end) {
+        std::vector<fft_complex> x(len);
+        std::vector<fft_complex> scratch(work);
+        std::vector<double> xr(real_input ? len : 0);
+        for (size_t v=begin;v<end;v++) {
+          const double *src_re = re + layout.start(v,layout.n);
+          const double *src_im = im ? im + layout.start(v,layout.n) : nullptr;
+          if (real_input) {
+            for (size_t k=0;k<copy;k++)
+              xr[k] = src_re[k*stride];
+            std::fill(xr.begin()+copy,xr.end(),0.0);
+            real_plan->Forward(xr.data(),x.data(),scratch.data());
+          } else {
+            for (size_t k=0;k<copy;k++)
+              x[k] = fft_complex(src_re[k*stride],src_im ? sign*src_im[k*stride] : 0.0);
+            std::fill(x.begin()+copy,x.end(),fft_complex());
+            plan->Forward(x.data(),scratch.data());
+            // Make the transform of real data exactly conjugate symmetric,
+            // so that its inverse comes back real
+            if (!im && !inverse) {
+              x[0].imag = 0;
+              for (size_t k=1;k<len-k;k++)
+                x[len-k] = complex_conj(x[k]);
+            }
+          }
+          const size_t dst = layout.start(v,len);
+          for (size_t k=0;k<len;k++)
+            out_re[dst+k*stride] = scale*x[k].real;
+          if (!real_out)
+            for (size_t k=0;k<len;k++)
+              out_im[dst+k*stride] = sign*scale*x[k].imag;
+        }
+      });
+  }
+
+  bool ConjugateSymmetric(const std::vector<size_t> &dims, size_t dim, size_t len,
+                          const double *re, const double *im) {
+    const VectorLayout layout(dims,dim);
+    const size_t stride = layout.stride;
+    const size_t copy = std::min(layout.n,len);
+    for (size_t v=0;v<layout.count;v++) {
+      const size_t src = layout.start(v,layout.n);
+      auto real = [&](size_t k) {return (k < copy) ? re[src+k*stride] : 0.0;};
+      auto imag = [&](size_t k) {return ((k < copy) && im) ? im[src+k*stride] : 0.0;};
+      if ((len > 0) && (imag(0) != 0)) return false;
+      for (size_t k=1;k<len;k++)
+        if ((real(k) != real(len-k)) || (imag(k) != -imag(len-k))) return false;
+    }
+    return true;
+  }
+}
@@ -0,0 +1,100 @@
+#ifndef __fft_hpp__
+#define __fft_hpp__
+
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "Complex.hpp"
+
+// Fast Fourier transforms of any length.  Lengths whose prime factors are
+// all small are done with a mixed radix Stockham transform (which needs no
+// bit reversal pass).  Other lengths are turned into a convolution of power
+// of two length with Bluestein's algorithm.  Real input of even length is
+// packed into a complex transform of half the length.
+//
+// Plans hold the factorization and the precomputed twiddle factors for a
+// length.  They are cached by length and never change once built, so one
+// plan can be used from several threads at once.
+
+namespace FM {
+
+  typedef Complex<double> fft_complex;
+
+  // Prime factors above this are handled by Bluestein's algorithm
+  const size_t FFT_MAX_RADIX = 64;
+
+  class FFTPlan {
+  public:
+    explicit FFTPlan(size_t n);
+    size_t size() const {return n;}
+    // Scratch needed by Forward, in elements
+    size_t work_size() const {return work;}
+    size_t bytes() const;
+    // Forward (negative exponent) transform of x, in place.  scratch must
+    // hold work_size() elements.
+    void Forward(fft_complex *x, fft_complex *scratch) const;
+  private:
+    struct Stage {
+      size_t radix;
+      size_t span;
+      std::vector<fft_complex> twiddles;
+      // Roots of unity for radices without a hand written butterfly
+      std::vector<fft_complex> roots;
+    };
+    void Stockham(fft_complex *x, fft_complex *scratch) const;
+    void Bluestein(fft_complex *x, fft_complex *scratch) const;
+    size_t n;
+    size_t work;
+    std::vector<Stage> stages;
+    std::vector<fft_complex> chirp;
+    std::vector<fft_complex> filter;
+    std::shared_ptr<const FFTPlan> inner;
+  };
+
+  // Transforms of real data of even length n
+  class RealFFTPlan {
+  public:
+    explicit RealFFTPlan(size_t n);
+    size_t size() const {return n;}
+    size_t work_size() const {return half->work_size();}
+    size_t bytes() const;
+    // X gets all n terms of the transform of x
+    void Forward(const double *x, fft_complex *X, fft_complex *scratch) const;
+  private:
+    size_t n;
+    std::shared_ptr<const FFTPlan> half;
+    std::vector<fft_complex> twiddles;
+  };
+
+  // The smallest length >= n whose only prime factors are 2, 3 and 5
+  size_t FFTFastLength(size_t n);
+
+  std::shared_ptr<const FFTPlan> GetFFTPlan(size_t n);
+  std::shared_ptr<const RealFFTPlan> GetRealFFTPlan(size_t n);
+
+  struct FFTCacheInfo {
+    size_t plans;
+    size_t bytes;
+  };
+
+  FFTCacheInfo GetFFTCacheInfo();
+
+  // Plans in use stay alive until they are finished with
+  void ClearFFTCache();
+
+  // Transform along dimension dim (zero based) of an array.  The result has
+  // length len along dim; the input is truncated or zero padded to fit.  im
+  // is null for real input.  The inverse is scaled by 1/len.  If real_out
+  // is set only the real part of the result is written, and out_im is not
+  // used.  Batches of vectors are split across threads.
+  void FFTDimension(const std::vector<size_t> &dims, size_t dim, size_t len, bool inverse,
+                    const double *re, const double *im, bool real_out,
+                    double *out_re, double *out_im);
+
+  // True if every vector along dim (after padding or truncation to len) is
+  // conjugate symmetric, so that its inverse transform is real.
+  bool ConjugateSymmetric(const std::vector<size_t> &dims, size_t dim, size_t len,
+                          const double *re, const double *im);
+}
+
+#endif
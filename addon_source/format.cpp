@@ -0,0 +1,286 @@
+#include "format.hpp"
+#include "parallel.hpp"
+#include "tuning.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+namespace FM {
+
+  // Spaces before each field
+  const int FORMAT_GUTTER = 3;
+
+  // Arrays of integers with magnitudes up to this are shown as integers
+  const double FORMAT_INTEGER_LIMIT = 1e9;
+
+  // The number of values summarized at a time when choosing the format
+  const size_t FORMAT_BLOCK = size_t(1) << 14;
+
+  static const double POW10[] = {1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8,
+                                 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16,
+                                 1e17, 1e18, 1e19};
+
+  // What the format of one part (real or imaginary) has to allow for
+  struct PartStats {
+    double maxabs;
+    bool finite;      // there is at least one finite value
+    bool integers;    // the finite values are all integers
+    bool negative;    // there is a negative finite value
+    bool nan;
+    bool inf;
+    bool neg_inf;
+  };
+
+  static PartStats NoStats() {
+    return PartStats{0.0,false,true,false,false,false,false};
+  }
+
+  static void Merge(PartStats &a, const PartStats &b) {
+    a.maxabs = std::max(a.maxabs,b.maxabs);
+    a.finite = a.finite || b.finite;
+    a.integers = a.integers && b.integers;
+    a.negative = a.negative || b.negative;
+    a.nan = a.nan || b.nan;
+    a.inf = a.inf || b.inf;
+    a.neg_inf = a.neg_inf || b.neg_inf;
+  }
+
+  static PartStats Summarize(const double *x, size_t n) {
+    const size_t blocks = (n + FORMAT_BLOCK - 1)/FORMAT_BLOCK;
+    std::vector<PartStats> partial(blocks,NoStats());
+    ParallelFor(blocks,std::max<size_t>(1,ParallelGrain()/FORMAT_BLOCK),[&](size_t b0, size_t b1) {
+        for (size_t blk=b0;blk<b1;blk++) {
+          PartStats s = NoStats();
+          const size_t e = std::min(n,(blk+1)*FORMAT_BLOCK);
+          for (size_t i=blk*FORMAT_BLOCK;i<e;i++) {
+            const double v = x[i];
+            if (std::isfinite(v)) {
+              s.finite = true;
+              s.maxabs = std::max(s.maxabs,std::fabs(v));
+              s.integers = s.integers && (v == std::floor(v));
+              s.negative = s.negative || (v < 0);
+            } else if (v != v) {
+              s.nan = true;
+            } else {
+              s.inf = true;
+              s.neg_inf = s.neg_inf || (v < 0);
+            }
+          }
+          partial[blk] = s;
+        }
+      });
+    PartStats s = NoStats();
+    for (auto &p : partial) Merge(s,p);
+    return s;
+  }
+
+  // Values are shown divided by 10^scale.  For the smallest scales (down
+  // to -324, for subnormals) 10^scale is itself subnormal or zero, so the
+  // value is first multiplied by 2^64, which is exact, and the divisor is
+  // 10^scale*2^64.
+  struct Divisor {
+    double pre;
+    double divisor;
+    explicit Divisor(int scale) {
+      if (scale >= -300) {
+        pre = 1.0;
+        divisor = std::pow(10.0,double(scale));
+      } else {
+        pre = 18446744073709551616.0;
+        divisor = std::pow(10.0,double(scale + 20))*0.18446744073709551616;
+      }
+    }
+    double operator()(double v) const {return v*pre/divisor;}
+  };
+
+  // The width of a part, with room for a minus sign if signed_part is set
+  // (the sign of an imaginary part is shown separately)
+  static int PartWidth(const PartStats &s, int decimals, const Divisor &divisor, bool signed_part) {
+    int digits = 1;
+    if (s.finite) {
+      const double whole = std::floor(std::floor(divisor(s.maxabs)*POW10[decimals] + 0.5)/POW10[decimals]);
+      while ((digits < 19) && (whole >= POW10[digits])) digits++;
+    }
+    int width = digits + (decimals ? decimals + 1 : 0);
+    if (signed_part && s.negative) width++;
+    if (s.nan || s.inf) width = std::max(width,3);
+    if (signed_part && s.neg_inf) width = std::max(width,4);
+    return width;
+  }
+
+  DisplayFormat ChooseDisplayFormat(const double *re, const double *im, size_t n,
+                                    const FormatOptions &opts) {
+    const PartStats rs = Summarize(re,n);
+    const PartStats is = im ? Summarize(im,n) : NoStats();
+    PartStats all = rs;
+    Merge(all,is);
+    DisplayFormat f;
+    f.complex = (im != nullptr);
+    f.decimals = 0;
+    f.scale = 0;
+    if (all.finite && (all.maxabs > 0) && !(all.integers && (all.maxabs < FORMAT_INTEGER_LIMIT))) {
+      f.decimals = opts.long_format ? (opts.single ? 7 : 15) : 4;
+      // The digits before the point that fit without a scale factor
+      const int whole_digits = opts.long_format ? 1 : 3;
+      const int e = int(std::floor(std::log10(all.maxabs)));
+      if ((e >= whole_digits) || (e < -3)) f.scale = e;
+    }
+    const Divisor divisor(f.scale);
+    f.real_width = PartWidth(rs,f.decimals,divisor,true);
+    f.imag_width = f.complex ? PartWidth(is,f.decimals,divisor,false) : 0;
+    return f;
+  }
+
+  // Writes v (divided by divisor) right aligned in the width characters
+  // before end
+  static void WriteValue(char *end, int width, double v, const Divisor &divisor, int decimals,
+                         bool signed_part) {
+    char *start = end - width;
+    char *p = end;
+    if (v != v) {
+      p -= 3;
+      memcpy(p,"NaN",3);
+    } else if (std::isinf(v)) {
+      p -= 3;
+      memcpy(p,"Inf",3);
+      if (signed_part && (v < 0)) *(--p) = '-';
+    } else {
+      uint64_t u = uint64_t(divisor(std::fabs(v))*POW10[decimals] + 0.5);
+      for (int k=0;k<decimals;k++) {
+        *(--p) = char('0' + u % 10);
+        u /= 10;
+      }
+      if (decimals) *(--p) = '.';
+      do {
+        *(--p) = char('0' + u % 10);
+        u /= 10;
+      } while (u);
+      if (signed_part && (v < 0)) *(--p) = '-';
+    }
+    while (p > start) *(--p) = ' ';
+  }
+
+  static size_t FieldWidth(const DisplayFormat &f) {
+    return size_t(FORMAT_GUTTER + f.real_width + (f.complex ? f.imag_width + 4 : 0));
+  }
+
+  // Writes the field for element k at out
+  static void WriteField(char *out, const DisplayFormat &f, const Divisor &divisor,
+                         const double *re, const double *im, size_t k) {
+    char *p = out + FORMAT_GUTTER + f.real_width;
+    // Exact zeros in a real array are shown as 0, as MATLAB does
+    const bool zero = !f.complex && (re[k] == 0);
+    WriteValue(p,FORMAT_GUTTER + f.real_width,re[k],divisor,zero ? 0 : f.decimals,true);
+    if (!f.complex) return;
+    const double v = im[k];
+    const bool minus = (v == v) && std::signbit(v);
+    memcpy(p,minus ? " - " : " + ",3);
+    p += 3 + f.imag_width;
+    WriteValue(p,f.imag_width,minus ? -v : v,divisor,f.decimals,false);
+    *p = 'i';
+  }
+
+  // A run of rows of one block of columns of one page
+  struct RowBlock {
+    size_t offset;       // of the first line in the text
+    size_t first;        // index of the element in the first row and column
+    size_t columns;
+    size_t rows;
+  };
+
+  static std::string CountNote(size_t count, const char *what) {
+    return "  ... (" + std::to_string(count) + " more " + what + ")\n";
+  }
+
+  static std::string ScaleHeader(int scale) {
+    char buffer[32];
+    snprintf(buffer,sizeof(buffer),"   1.0e%c%02d *\n\n",(scale < 0) ? '-' : '+',std::abs(scale));
+    return buffer;
+  }
+
+  static std::string PageHeader(const std::vector<size_t> &dims, size_t page) {
+    std::string header = "(:,:";
+    for (size_t d=2;d<dims.size();d++) {
+      header += "," + std::to_string(page % dims[d] + 1);
+      page /= dims[d];
+    }
+    return header + ") =\n\n";
+  }
+
+  std::string FormatArray(const std::vector<size_t> &dims, const double *re,
+                          const double *im, const FormatOptions &opts) {
+    size_t elements = 1;
+    for (auto d : dims) elements *= d;
+    if (elements == 0) {
+      std::string text = "  [](";
+      for (size_t d=0;d<dims.size();d++)
+        text += (d ? "x" : "") + std::to_string(dims[d]);
+      return text + ")\n";
+    }
+    const DisplayFormat f = ChooseDisplayFormat(re,im,elements,opts);
+    const Divisor divisor(f.scale);
+    const size_t rows = dims.empty() ? 1 : dims[0];
+    const size_t cols = (dims.size() < 2) ? 1 : dims[1];
+    const size_t pages = elements/(rows*cols);
+    const size_t shown_rows = opts.max_rows ? std::min(rows,opts.max_rows) : rows;
+    const size_t shown_cols = opts.max_cols ? std::min(cols,opts.max_cols) : cols;
+    const size_t shown_pages = opts.max_rows ?
+      std::min(pages,std::max<size_t>(1,opts.max_rows/rows)) : pages;
+    const size_t field = FieldWidth(f);
+    const size_t per_line = opts.page_width ?
+      std::max<size_t>(1,opts.page_width/field) : shown_cols;
+    const size_t chunks = (shown_cols + per_line - 1)/per_line;
+    // Lay out the text: the literal pieces, and the blocks of rows
+    std::vector<std::pair<size_t,std::string>> pieces;
+    std::vector<RowBlock> blocks;
+    size_t length = 0;
+    auto add = [&](const std::string &text) {
+      pieces.push_back(std::make_pair(length,text));
+      length += text.size();
+    };
+    if (f.scale) add(ScaleHeader(f.scale));
+    for (size_t page=0;page<shown_pages;page++) {
+      if (pages > 1) add(PageHeader(dims,page));
+      for (size_t chunk=0;chunk<chunks;chunk++) {
+        const size_t c0 = chunk*per_line;
+        const size_t c1 = std::min(shown_cols,c0 + per_line);
+        if (chunks > 1) {
+          if (c1 - c0 > 1)
+            add("  Columns " + std::to_string(c0+1) + " through " + std::to_string(c1) + "\n\n");
+          else
+            add("  Column " + std::to_string(c0+1) + "\n\n");
+        }
+        blocks.push_back(RowBlock{length,page*rows*cols + c0*rows,c1 - c0,shown_rows});
+        length += shown_rows*((c1 - c0)*field + 1);
+        if (shown_rows < rows) add(CountNote(rows - shown_rows,"rows"));
+        if (chunks > 1) add("\n");
+      }
+      if (shown_cols < cols) add(CountNote(cols - shown_cols,"columns"));
+      if (pages > 1) add("\n");
+    }
+    if (shown_pages < pages) add(CountNote(pages - shown_pages,"pages"));
+    std::string text(length,' ');
+    for (auto &p : pieces)
+      memcpy(&text[p.first],p.second.data(),p.second.size());
+    // Render the rows of all the blocks, in parallel
+    std::vector<size_t> starts(blocks.size()+1,0);
+    for (size_t b=0;b<blocks.size();b++) starts[b+1] = starts[b] + blocks[b].rows;
+    char *out = &text[0];
+    ParallelFor(starts.back(),std::max<size_t>(1,ParallelGrain()/per_line),[&](size_t r0, size_t r1) {
+        size_t b = std::upper_bound(starts.begin(),starts.end(),r0) - starts.begin() - 1;
+        for (size_t r=r0;r<r1;r++) {
+          while (r >= starts[b+1]) b++;
+          const RowBlock &blk = blocks[b];
+          const size_t i = r - starts[b];
+          const size_t line = blk.columns*field + 1;
+          char *p = out + blk.offset + i*line;
+          for (size_t j=0;j<blk.columns;j++,p+=field)
+            WriteField(p,f,divisor,re,im,blk.first + j*rows + i);
+          *p = '\n';
+        }
+      });
+    return text;
+  }
+}
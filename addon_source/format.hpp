@@ -0,0 +1,51 @@
+#ifndef __format_hpp__
+#define __format_hpp__
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+// Display of numeric arrays, in the style of MATLAB's format short and
+// format long.
+//
+// One pass over the data picks a format that is common to every element:
+// integers if all the values are (and are not too large), otherwise a
+// fixed number of decimals, with a power of ten factored out when the
+// largest magnitude does not fit in the integer digits.  Because every
+// field then has the same width, every line of a block of columns has the
+// same length, so the text is laid out in a buffer of exactly the right
+// size, and the rows are rendered into it in parallel.
+//
+// Columns that do not fit in the page width are shown in blocks ("Columns
+// 1 through 8"), and arrays of more than two dimensions a page at a time.
+// Rows, columns and pages beyond the limits in the options are left out,
+// with a note of how many.
+
+namespace FM {
+
+  struct FormatOptions {
+    size_t page_width;   // characters per line (0 for no limit)
+    size_t max_rows;     // rows shown (0 for all)
+    size_t max_cols;     // columns shown (0 for all)
+    bool long_format;    // 15 decimals (7 for single) instead of 4
+    bool single;         // the data was single precision
+  };
+
+  struct DisplayFormat {
+    int decimals;        // digits after the point (0 for integers)
+    int scale;           // power of ten factored out of every value
+    int real_width;      // width of a real value, or of the real part
+    int imag_width;      // width of the magnitude of the imaginary part
+    bool complex;
+  };
+
+  // The common format for n values.  im is null for real data.
+  DisplayFormat ChooseDisplayFormat(const double *re, const double *im, size_t n,
+                                    const FormatOptions &opts);
+
+  // The text of an array with the given (column major) dimensions
+  std::string FormatArray(const std::vector<size_t> &dims, const double *re,
+                          const double *im, const FormatOptions &opts);
+}
+
+#endif
@@ -0,0 +1,64 @@
+#include "fuse.hpp"
+#include "cpu_dispatch.hpp"
+#include "parallel.hpp"
+#include "tuning.hpp"
+#include <algorithm>
+
+namespace FM {
+
+  bool CheckFuseProgram(const std::vector<int> &ops, size_t nleaves, size_t &depth,
+                        std::string &error) {
+    size_t sp = 0;
+    size_t leaves = 0;
+    depth = 0;
+    for (auto op : ops) {
+      switch (op) {
+      case FUSE_LEAF:
+        sp++;
+        leaves++;
+        break;
+      case FUSE_NEG:
+        if (sp < 1) {
+          error = "Fused program negates an empty stack";
+          return false;
+        }
+        break;
+      case FUSE_PLUS:
+      case FUSE_MINUS:
+      case FUSE_TIMES:
+      case FUSE_RDIVIDE:
+      case FUSE_LDIVIDE:
+        if (sp < 2) {
+          error = "Fused program applies an operator to too few operands";
+          return false;
+        }
+        sp--;
+        break;
+      default:
+        error = "Unknown operation in fused program";
+        return false;
+      }
+      depth = std::max(depth,sp);
+      if (depth > FUSE_MAX_DEPTH) {
+        error = "Fused program is too deeply nested";
+        return false;
+      }
+    }
+    if ((sp != 1) || (leaves != nleaves)) {
+      error = "Fused program does not use its leaves to make one result";
+      return false;
+    }
+    return true;
+  }
+
+  void EvaluateFused(const std::vector<int> &ops, const std::vector<FuseOperand> &leaves,
+                     size_t depth, size_t n, double *out) {
+    ParallelFor(n,ParallelGrain(),[&](size_t begin, size_t end) {
+        std::vector<double> stack(depth*FUSE_BLOCK);
+        for (size_t b=begin;b<end;b+=FUSE_BLOCK) {
+          const size_t len = std::min(end,b+FUSE_BLOCK) - b;
+          Kernels().dfuse(ops.data(),ops.size(),leaves.data(),b,len,stack.data(),out+b);
+        }
+      });
+  }
+}
@@ -0,0 +1,133 @@
+#ifndef __fuse_hpp__
+#define __fuse_hpp__
+
+#include <cstddef>
+#include <cstring>
+#include <string>
+#include <vector>
+
+// Fused evaluation of elementwise arithmetic.  An expression such as
+// a.*x + b - c./d is given as a postfix program over its leaves (real
+// arrays of one size, or scalars), and is evaluated a block at a time, so
+// that the intermediate results never leave cache and only the output is
+// allocated.  Each operation is its own loop over the block, which keeps
+// the rounding identical to evaluating the operations one at a time.
+
+namespace FM {
+
+  enum FuseOp {
+    FUSE_LEAF = 0,       // push the next leaf
+    FUSE_PLUS = 1,
+    FUSE_MINUS = 2,
+    FUSE_TIMES = 3,
+    FUSE_RDIVIDE = 4,    // a./b
+    FUSE_LDIVIDE = 5,    // a.\b, i.e., b./a
+    FUSE_NEG = 6
+  };
+
+  // Elements evaluated at a time
+  const size_t FUSE_BLOCK = 1024;
+
+  // The deepest a program's stack may get
+  const size_t FUSE_MAX_DEPTH = 64;
+
+  // A leaf, or a value on the evaluation stack.  data is null for a scalar.
+  struct FuseOperand {
+    const double *data;
+    double scalar;
+  };
+
+  template <class Op>
+  inline void fuse_apply(const FuseOperand &a, const FuseOperand &b, double *y, size_t n, Op op) {
+    if (a.data && b.data) {
+      const double *x1 = a.data;
+      const double *x2 = b.data;
+      for (size_t i=0;i<n;i++) y[i] = op(x1[i],x2[i]);
+    } else if (a.data) {
+      const double *x1 = a.data;
+      const double s = b.scalar;
+      for (size_t i=0;i<n;i++) y[i] = op(x1[i],s);
+    } else {
+      const double s = a.scalar;
+      const double *x2 = b.data;
+      for (size_t i=0;i<n;i++) y[i] = op(s,x2[i]);
+    }
+  }
+
+  template <class Op>
+  inline FuseOperand fuse_binary(const FuseOperand &a, const FuseOperand &b, double *y,
+                                 size_t n, Op op) {
+    if (!a.data && !b.data) return FuseOperand{nullptr,op(a.scalar,b.scalar)};
+    fuse_apply(a,b,y,n,op);
+    return FuseOperand{y,0.0};
+  }
+
+  // Evaluates elements [offset, offset+n) of the program into out, where n
+  // is at most FUSE_BLOCK.  stack has room for depth blocks, where depth is
+  // the deepest the program's stack gets (see CheckFuseProgram).
+  inline void fuse_kernel(const int *ops, size_t nops, const FuseOperand *leaves,
+                          size_t offset, size_t n, double *stack, double *out) {
+    FuseOperand vals[FUSE_MAX_DEPTH];
+    size_t sp = 0;
+    size_t leaf = 0;
+    for (size_t k=0;k<nops;k++) {
+      if (ops[k] == FUSE_LEAF) {
+        const FuseOperand &x = leaves[leaf++];
+        vals[sp++] = x.data ? FuseOperand{x.data+offset,0.0} : x;
+        continue;
+      }
+      // The result goes in the block for its stack slot, except that the
+      // last operation writes straight to the output
+      if (ops[k] == FUSE_NEG) {
+        double *y = (k+1 == nops) ? out : stack + (sp-1)*FUSE_BLOCK;
+        const FuseOperand a = vals[sp-1];
+        if (!a.data) {
+          vals[sp-1] = FuseOperand{nullptr,-a.scalar};
+          continue;
+        }
+        for (size_t i=0;i<n;i++) y[i] = -a.data[i];
+        vals[sp-1] = FuseOperand{y,0.0};
+        continue;
+      }
+      const FuseOperand b = vals[--sp];
+      const FuseOperand a = vals[sp-1];
+      double *y = (k+1 == nops) ? out : stack + (sp-1)*FUSE_BLOCK;
+      switch (ops[k]) {
+      case FUSE_PLUS:
+        vals[sp-1] = fuse_binary(a,b,y,n,[](double u, double v) {return u + v;});
+        break;
+      case FUSE_MINUS:
+        vals[sp-1] = fuse_binary(a,b,y,n,[](double u, double v) {return u - v;});
+        break;
+      case FUSE_TIMES:
+        vals[sp-1] = fuse_binary(a,b,y,n,[](double u, double v) {return u * v;});
+        break;
+      case FUSE_RDIVIDE:
+        vals[sp-1] = fuse_binary(a,b,y,n,[](double u, double v) {return u / v;});
+        break;
+      case FUSE_LDIVIDE:
+        vals[sp-1] = fuse_binary(a,b,y,n,[](double u, double v) {return v / u;});
+        break;
+      }
+    }
+    // A result that did not come from the last operation (e.g., a lone
+    // leaf, or an expression that folded to a scalar)
+    const FuseOperand &r = vals[0];
+    if (r.data == out) return;
+    if (r.data)
+      memcpy(out,r.data,n*sizeof(double));
+    else
+      for (size_t i=0;i<n;i++) out[i] = r.scalar;
+  }
+
+  // Checks that ops is a well formed program over nleaves leaves whose stack
+  // stays within FUSE_MAX_DEPTH, and finds that depth
+  bool CheckFuseProgram(const std::vector<int> &ops, size_t nleaves, size_t &depth,
+                        std::string &error);
+
+  // Evaluates the program over n elements into out
+  void EvaluateFused(const std::vector<int> &ops, const std::vector<FuseOperand> &leaves,
+                     size_t depth, size_t n, double *out);
+}
+
+#endif
@@ -0,0 +1,87 @@
+#include "integer.hpp"
+#include "cpu_dispatch.hpp"
+#include <atomic>
+
+namespace FM {
+
+  size_t ClassBytes(int cls) {
+    switch (cls) {
+    case CLASS_DOUBLE: return sizeof(double);
+    case CLASS_SINGLE: return sizeof(float);
+    case CLASS_INT16: case CLASS_UINT16: return 2;
+    case CLASS_INT32: case CLASS_UINT32: return 4;
+    default: return 1;
+    }
+  }
+
+  template <class T>
+  static void WidenAs(const void *x, double *y, size_t n) {
+    const T *p = static_cast<const T*>(x);
+    ParallelFor(n,ParallelGrain(),[&](size_t b, size_t e) {
+        for (size_t i=b;i<e;i++) y[i] = double(p[i]);
+      });
+  }
+
+  void ConvertToDouble(const void *x, int cls, double *y, size_t n) {
+    switch (StorageOf(cls)) {
+    case CLASS_DOUBLE: WidenAs<double>(x,y,n); break;
+    case CLASS_SINGLE: WidenAs<float>(x,y,n); break;
+    case CLASS_INT8: WidenAs<int8_t>(x,y,n); break;
+    case CLASS_UINT8: WidenAs<uint8_t>(x,y,n); break;
+    case CLASS_INT16: WidenAs<int16_t>(x,y,n); break;
+    case CLASS_UINT16: WidenAs<uint16_t>(x,y,n); break;
+    case CLASS_INT32: WidenAs<int32_t>(x,y,n); break;
+    case CLASS_UINT32: WidenAs<uint32_t>(x,y,n); break;
+    }
+  }
+
+  template <class T, class Op>
+  static void NarrowAs(const double *x, void *y, size_t n, Op op) {
+    T *p = static_cast<T*>(y);
+    ParallelFor(n,ParallelGrain(),[&](size_t b, size_t e) {
+        for (size_t i=b;i<e;i++) p[i] = op(x[i]);
+      });
+  }
+
+  void ConvertFromDouble(const double *x, int cls, void *y, size_t n) {
+    switch (cls) {
+    case CLASS_DOUBLE: NarrowAs<double>(x,y,n,[](double v) {return v;}); break;
+    case CLASS_SINGLE: NarrowAs<float>(x,y,n,[](double v) {return float(v);}); break;
+    case CLASS_LOGICAL: NarrowAs<uint8_t>(x,y,n,[](double v) {return uint8_t(v != 0);}); break;
+    case CLASS_INT8: NarrowAs<int8_t>(x,y,n,Narrow<int8_t>); break;
+    case CLASS_UINT8: NarrowAs<uint8_t>(x,y,n,Narrow<uint8_t>); break;
+    case CLASS_INT16: NarrowAs<int16_t>(x,y,n,Narrow<int16_t>); break;
+    case CLASS_UINT16: NarrowAs<uint16_t>(x,y,n,Narrow<uint16_t>); break;
+    case CLASS_INT32: NarrowAs<int32_t>(x,y,n,Narrow<int32_t>); break;
+    case CLASS_UINT32: NarrowAs<uint32_t>(x,y,n,Narrow<uint32_t>); break;
+    }
+  }
+
+  bool AnyNaN(const double *x, size_t n) {
+    std::atomic<bool> found(false);
+    ParallelFor(n,ParallelGrain(),[&](size_t b, size_t e) {
+        bool nan = false;
+        for (size_t i=b;i<e;i++) nan = nan || (x[i] != x[i]);
+        if (nan) found = true;
+      });
+    return found;
+  }
+
+  void ApplyTypedBroadcast(const BroadcastPlan &plan, int op, int cls,
+                           const void *a, bool a_double, const void *b, bool b_double,
+                           void *y) {
+    const size_t sa = plan.astride[0];
+    const size_t sb = plan.bstride[0];
+    const size_t abytes = a_double ? sizeof(double) : ClassBytes(cls);
+    const size_t bbytes = b_double ? sizeof(double) : ClassBytes(cls);
+    const size_t ybytes = IsComparison(op) ? 1 : ClassBytes(cls);
+    const char *ac = static_cast<const char*>(a);
+    const char *bc = static_cast<const char*>(b);
+    char *yc = static_cast<char*>(y);
+    const KernelTable &kernels = Kernels();
+    ForEachBroadcastPiece(plan,[&](size_t ao, size_t bo, size_t yo, size_t n) {
+        kernels.typedbinary(op,cls,ac + ao*abytes,a_double,sa,bc + bo*bbytes,b_double,sb,
+                            yc + yo*ybytes,n);
+      });
+  }
+}
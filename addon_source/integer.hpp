@@ -0,0 +1,237 @@
+#ifndef __integer_hpp__
+#define __integer_hpp__
+
+#include "broadcast.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+// Arrays of the integer classes (int8 to uint32), and logical arrays held
+// in one byte per element.
+//
+// Integer arithmetic follows MATLAB: each result is computed in double
+// precision, then rounded to the nearest integer (ties away from zero) and
+// saturated to the range of the class, with NaN going to 0.  For these
+// widths the double result is exact whenever it is in range.  An integer
+// operand combines with doubles and logicals of any size, or with integers
+// of its own class, and the result is of that integer class.  Comparisons
+// of any classes give logical results.
+//
+// The kernels read operands of the class in place, at their own width;
+// anything else is widened to double first.  They are in the dispatch
+// table (cpu_dispatch.hpp), and like it are compiled without trapping
+// math, without which the rounding does not vectorize.
+
+namespace FM {
+
+  // Numbered as ArrayType in arrays.ts
+  enum StorageClass {
+    CLASS_DOUBLE = 1,
+    CLASS_LOGICAL = 2,
+    CLASS_SINGLE = 3,
+    CLASS_INT8 = 4,
+    CLASS_UINT8 = 5,
+    CLASS_INT16 = 6,
+    CLASS_UINT16 = 7,
+    CLASS_INT32 = 8,
+    CLASS_UINT32 = 9
+  };
+
+  inline bool IsIntegerClass(int cls) {
+    return (cls >= CLASS_INT8) && (cls <= CLASS_UINT32);
+  }
+
+  inline bool IsStorageClass(int cls) {
+    return (cls >= CLASS_DOUBLE) && (cls <= CLASS_UINT32);
+  }
+
+  // The class whose elements hold those of cls in memory (a logical is a
+  // uint8 that is 0 or 1)
+  inline int StorageOf(int cls) {
+    return (cls == CLASS_LOGICAL) ? CLASS_UINT8 : cls;
+  }
+
+  size_t ClassBytes(int cls);
+
+  // v rounded to the nearest T, ties away from zero, and saturated.  The
+  // rounding is done with truncating conversions (to a type that holds any
+  // T) rather than std::round, so that the loops vectorize: if t is v
+  // truncated, 2*(v - t) is exact and truncates to the step away from t.
+  template <class T>
+  inline T Narrow(double v) {
+    typedef typename std::conditional<(sizeof(T) < 4) || std::is_signed<T>::value,
+                                      int32_t,int64_t>::type Wide;
+    const double lo = double(std::numeric_limits<T>::min());
+    const double hi = double(std::numeric_limits<T>::max());
+    double c = std::min(std::max(v,lo),hi);
+    c = (v == v) ? c : 0.0;
+    const Wide t = Wide(c);
+    return T(t + Wide(2*(c - double(t))));
+  }
+
+  // v saturated to T, where v is known to be an integer (as the sums,
+  // differences and products of integers are)
+  template <class T>
+  inline T Saturate(double v) {
+    typedef typename std::conditional<(sizeof(T) < 4) || std::is_signed<T>::value,
+                                      int32_t,int64_t>::type Wide;
+    const double lo = double(std::numeric_limits<T>::min());
+    const double hi = double(std::numeric_limits<T>::max());
+    return T(Wide(std::min(std::max(v,lo),hi)));
+  }
+
+  // y[i] = op(a[i*sa], b[i*sb]) for i < n, where sa and sb are 0 or 1, and
+  // op takes doubles
+  template <class Y, class A, class B, class Op>
+  inline void typed_loop(const A *a, size_t sa, const B *b, size_t sb, Y *y, size_t n, Op op) {
+    if (sa && sb) {
+      for (size_t i=0;i<n;i++) y[i] = op(double(a[i]),double(b[i]));
+    } else if (sa) {
+      const double s = double(b[0]);
+      for (size_t i=0;i<n;i++) y[i] = op(double(a[i]),s);
+    } else if (sb) {
+      const double s = double(a[0]);
+      for (size_t i=0;i<n;i++) y[i] = op(s,double(b[i]));
+    } else {
+      const Y v = op(double(a[0]),double(b[0]));
+      for (size_t i=0;i<n;i++) y[i] = v;
+    }
+  }
+
+  // Integer operands give integers, except in division
+  template <class Y>
+  inline void arithmetic_kernel(int op, const Y *a, size_t sa, const Y *b, size_t sb,
+                                Y *y, size_t n) {
+    switch (op) {
+    case BINARY_PLUS:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Saturate<Y>(u + v);});
+      break;
+    case BINARY_MINUS:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Saturate<Y>(u - v);});
+      break;
+    case BINARY_TIMES:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Saturate<Y>(u * v);});
+      break;
+    case BINARY_RDIVIDE:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Narrow<Y>(u / v);});
+      break;
+    case BINARY_LDIVIDE:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Narrow<Y>(v / u);});
+      break;
+    }
+  }
+
+  template <class Y, class A, class B>
+  inline void arithmetic_kernel(int op, const A *a, size_t sa, const B *b, size_t sb,
+                                Y *y, size_t n) {
+    switch (op) {
+    case BINARY_PLUS:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Narrow<Y>(u + v);});
+      break;
+    case BINARY_MINUS:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Narrow<Y>(u - v);});
+      break;
+    case BINARY_TIMES:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Narrow<Y>(u * v);});
+      break;
+    case BINARY_RDIVIDE:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Narrow<Y>(u / v);});
+      break;
+    case BINARY_LDIVIDE:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return Narrow<Y>(v / u);});
+      break;
+    }
+  }
+
+  template <class A, class B>
+  inline void compare_kernel(int op, const A *a, size_t sa, const B *b, size_t sb,
+                             uint8_t *y, size_t n) {
+    switch (op) {
+    case BINARY_LT:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return uint8_t(u < v);});
+      break;
+    case BINARY_LE:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return uint8_t(u <= v);});
+      break;
+    case BINARY_GT:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return uint8_t(u > v);});
+      break;
+    case BINARY_GE:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return uint8_t(u >= v);});
+      break;
+    case BINARY_EQ:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return uint8_t(u == v);});
+      break;
+    case BINARY_NE:
+      typed_loop(a,sa,b,sb,y,n,[](double u, double v) {return uint8_t(u != v);});
+      break;
+    }
+  }
+
+  // Arithmetic gives T, and comparisons uint8 (logical)
+  template <class T, class A, class B>
+  inline void typed_piece(int op, const A *a, size_t sa, const B *b, size_t sb,
+                          void *y, size_t n) {
+    if (IsComparison(op))
+      compare_kernel(op,a,sa,b,sb,static_cast<uint8_t*>(y),n);
+    else
+      arithmetic_kernel(op,a,sa,b,sb,static_cast<T*>(y),n);
+  }
+
+  template <class T>
+  inline void typed_class_kernel(int op, const void *a, bool a_double, size_t sa,
+                                 const void *b, bool b_double, size_t sb, void *y, size_t n) {
+    const double *ad = static_cast<const double*>(a);
+    const double *bd = static_cast<const double*>(b);
+    const T *at = static_cast<const T*>(a);
+    const T *bt = static_cast<const T*>(b);
+    if (a_double && b_double)
+      typed_piece<T>(op,ad,sa,bd,sb,y,n);
+    else if (a_double)
+      typed_piece<T>(op,ad,sa,bt,sb,y,n);
+    else if (b_double)
+      typed_piece<T>(op,at,sa,bd,sb,y,n);
+    else
+      typed_piece<T>(op,at,sa,bt,sb,y,n);
+  }
+
+  // One piece of ApplyTypedBroadcast: y[i] = a[i*sa] op b[i*sb] for i < n,
+  // where sa and sb are 0 or 1.  Comparisons of doubles have no
+  // arithmetic to instantiate.
+  inline void typed_binary_kernel(int op, int cls, const void *a, bool a_double, size_t sa,
+                                  const void *b, bool b_double, size_t sb, void *y, size_t n) {
+    switch (StorageOf(cls)) {
+    case CLASS_INT8: typed_class_kernel<int8_t>(op,a,a_double,sa,b,b_double,sb,y,n); break;
+    case CLASS_UINT8: typed_class_kernel<uint8_t>(op,a,a_double,sa,b,b_double,sb,y,n); break;
+    case CLASS_INT16: typed_class_kernel<int16_t>(op,a,a_double,sa,b,b_double,sb,y,n); break;
+    case CLASS_UINT16: typed_class_kernel<uint16_t>(op,a,a_double,sa,b,b_double,sb,y,n); break;
+    case CLASS_INT32: typed_class_kernel<int32_t>(op,a,a_double,sa,b,b_double,sb,y,n); break;
+    case CLASS_UINT32: typed_class_kernel<uint32_t>(op,a,a_double,sa,b,b_double,sb,y,n); break;
+    default:
+      compare_kernel(op,static_cast<const double*>(a),sa,static_cast<const double*>(b),sb,
+                     static_cast<uint8_t*>(y),n);
+      break;
+    }
+  }
+
+  // Widens n elements of class cls to double
+  void ConvertToDouble(const void *x, int cls, double *y, size_t n);
+
+  // Narrows n doubles to class cls: rounded and saturated for the
+  // integers, and nonzero to 1 for logical (NaN must be ruled out first)
+  void ConvertFromDouble(const double *x, int cls, void *y, size_t n);
+
+  bool AnyNaN(const double *x, size_t n);
+
+  // y = a op b (a BinaryOp) with expansion.  a and b are each of class cls,
+  // or double if a_double or b_double is set.  y is of class cls for
+  // arithmetic (which cls must be an integer class for), and logical for
+  // comparisons.
+  void ApplyTypedBroadcast(const BroadcastPlan &plan, int op, int cls,
+                           const void *a, bool a_double, const void *b, bool b_double,
+                           void *y);
+}
+
+#endif
@@ -0,0 +1,386 @@
+#include "krylov.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <memory>
+
+namespace FM {
+
+  // The size (in elements) of the blocks that vector work is split into,
+  // and that reductions are summed over
+  const size_t KRYLOV_BLOCK = size_t(1) << 14;
+
+  // body(b, e) over the blocks of [0, n)
+  template <class F>
+  static void ForBlocks(size_t n, F body) {
+    const size_t blocks = (n + KRYLOV_BLOCK - 1)/KRYLOV_BLOCK;
+    ParallelFor(blocks,2,[&](size_t b0, size_t b1) {
+        for (size_t blk=b0;blk<b1;blk++)
+          body(blk*KRYLOV_BLOCK,std::min(n,(blk+1)*KRYLOV_BLOCK));
+      });
+  }
+
+  static double Dot(size_t n, const double *x, const double *y) {
+    const size_t blocks = (n + KRYLOV_BLOCK - 1)/KRYLOV_BLOCK;
+    std::vector<double> partial(blocks,0.0);
+    ForBlocks(n,[&](size_t b, size_t e) {
+        double s = 0;
+        for (size_t i=b;i<e;i++) s += x[i]*y[i];
+        partial[b/KRYLOV_BLOCK] = s;
+      });
+    double sum = 0;
+    for (auto s : partial) sum += s;
+    return sum;
+  }
+
+  static double Norm(size_t n, const double *x) {
+    return std::sqrt(Dot(n,x,x));
+  }
+
+  // y += a*x
+  static void Axpy(size_t n, double a, const double *x, double *y) {
+    ForBlocks(n,[&](size_t b, size_t e) {
+        for (size_t i=b;i<e;i++) y[i] += a*x[i];
+      });
+  }
+
+  // r = b - A*x
+  static void Residual(size_t n, const LinearOperator &A, const double *b, const double *x,
+                       double *r) {
+    A(x,r);
+    ForBlocks(n,[&](size_t lo, size_t hi) {
+        for (size_t i=lo;i<hi;i++) r[i] = b[i] - r[i];
+      });
+  }
+
+  // z = M\r, or a copy of r without a preconditioner
+  static void Precondition(size_t n, const PreconditionerOp &M, const double *r, double *z) {
+    if (M) M(r,z);
+    else std::copy(r,r+n,z);
+  }
+
+  static bool Usable(double x) {
+    return (x != 0) && std::isfinite(x);
+  }
+
+  static void CG(size_t n, const LinearOperator &A, const PreconditionerOp &M, const double *b,
+                 double *x, double bnorm, const KrylovOptions &opts, KrylovResult &res) {
+    std::vector<double> r(n), z(n), p(n), q(n);
+    Residual(n,A,b,x,r.data());
+    res.resvec.push_back(Norm(n,r.data()));
+    if (res.resvec.back() <= opts.tol*bnorm) {
+      res.flag = KRYLOV_CONVERGED;
+      return;
+    }
+    Precondition(n,M,r.data(),z.data());
+    p = z;
+    double rz = Dot(n,r.data(),z.data());
+    while (res.iter < opts.maxit) {
+      A(p.data(),q.data());
+      const double pq = Dot(n,p.data(),q.data());
+      if (!Usable(pq) || !Usable(rz)) {
+        res.flag = KRYLOV_BREAKDOWN;
+        return;
+      }
+      const double alpha = rz/pq;
+      Axpy(n,alpha,p.data(),x);
+      Axpy(n,-alpha,q.data(),r.data());
+      res.iter++;
+      res.resvec.push_back(Norm(n,r.data()));
+      if (res.resvec.back() <= opts.tol*bnorm) {
+        res.flag = KRYLOV_CONVERGED;
+        return;
+      }
+      Precondition(n,M,r.data(),z.data());
+      const double rz_next = Dot(n,r.data(),z.data());
+      const double beta = rz_next/rz;
+      rz = rz_next;
+      ForBlocks(n,[&](size_t lo, size_t hi) {
+          for (size_t i=lo;i<hi;i++) p[i] = z[i] + beta*p[i];
+        });
+    }
+    res.flag = KRYLOV_MAXIT;
+  }
+
+  // Returns the Givens rotation (c, s) that zeros b in (a, b)
+  static void Givens(double a, double b, double &c, double &s) {
+    if (b == 0) {
+      c = 1;
+      s = 0;
+      return;
+    }
+    const double h = std::hypot(a,b);
+    c = a/h;
+    s = b/h;
+  }
+
+  static void GMRES(size_t n, const LinearOperator &A, const PreconditionerOp &M, const double *b,
+                    double *x, double bnorm, const KrylovOptions &opts, KrylovResult &res) {
+    const size_t m = std::max<size_t>(1,std::min(opts.restart,std::max<size_t>(1,opts.maxit)));
+    // The Krylov basis, one vector of n after another
+    std::vector<double> V((m+1)*n), w(n), z(n);
+    // The Hessenberg matrix (column major, m+1 x m), its rotations, and
+    // the rotated right hand side
+    std::vector<double> H((m+1)*m), cs(m), sn(m), g(m+1), y(m);
+    Residual(n,A,b,x,V.data());
+    double beta = Norm(n,V.data());
+    res.resvec.push_back(beta);
+    while (true) {
+      if (beta <= opts.tol*bnorm) {
+        res.flag = KRYLOV_CONVERGED;
+        return;
+      }
+      if (res.iter >= opts.maxit) {
+        res.flag = KRYLOV_MAXIT;
+        return;
+      }
+      if (!std::isfinite(beta)) {
+        res.flag = KRYLOV_BREAKDOWN;
+        return;
+      }
+      for (size_t i=0;i<n;i++) V[i] /= beta;
+      std::fill(g.begin(),g.end(),0.0);
+      g[0] = beta;
+      size_t k = 0;
+      while ((k < m) && (res.iter < opts.maxit)) {
+        double *vk = V.data() + k*n;
+        double *h = H.data() + k*(m+1);
+        Precondition(n,M,vk,z.data());
+        A(z.data(),w.data());
+        // Modified Gram-Schmidt against the basis so far
+        for (size_t i=0;i<=k;i++) {
+          h[i] = Dot(n,w.data(),V.data()+i*n);
+          Axpy(n,-h[i],V.data()+i*n,w.data());
+        }
+        h[k+1] = Norm(n,w.data());
+        for (size_t i=0;i<k;i++) {
+          const double t = cs[i]*h[i] + sn[i]*h[i+1];
+          h[i+1] = -sn[i]*h[i] + cs[i]*h[i+1];
+          h[i] = t;
+        }
+        const double next = h[k+1];
+        Givens(h[k],next,cs[k],sn[k]);
+        h[k] = cs[k]*h[k] + sn[k]*next;
+        h[k+1] = 0;
+        g[k+1] = -sn[k]*g[k];
+        g[k] = cs[k]*g[k];
+        k++;
+        res.iter++;
+        res.resvec.push_back(std::fabs(g[k]));
+        if ((std::fabs(g[k]) <= opts.tol*bnorm) || (next == 0) || !std::isfinite(next)) break;
+        double *vnext = V.data() + k*n;
+        for (size_t i=0;i<n;i++) vnext[i] = w[i]/next;
+      }
+      // x += M\(V*y), with y from the triangular system H*y = g
+      for (size_t i=k;i-- > 0;) {
+        double s = g[i];
+        for (size_t j=i+1;j<k;j++) s -= H[j*(m+1)+i]*y[j];
+        y[i] = s/H[i*(m+1)+i];
+      }
+      std::fill(w.begin(),w.end(),0.0);
+      for (size_t j=0;j<k;j++) Axpy(n,y[j],V.data()+j*n,w.data());
+      Precondition(n,M,w.data(),z.data());
+      Axpy(n,1.0,z.data(),x);
+      // Restart from the true residual
+      Residual(n,A,b,x,V.data());
+      beta = Norm(n,V.data());
+      res.resvec.back() = beta;
+    }
+  }
+
+  static void BiCGSTAB(size_t n, const LinearOperator &A, const PreconditionerOp &M,
+                       const double *b, double *x, double bnorm, const KrylovOptions &opts,
+                       KrylovResult &res) {
+    std::vector<double> r(n), rhat(n), p(n,0.0), v(n,0.0), phat(n), s(n), shat(n), t(n);
+    Residual(n,A,b,x,r.data());
+    rhat = r;
+    res.resvec.push_back(Norm(n,r.data()));
+    if (res.resvec.back() <= opts.tol*bnorm) {
+      res.flag = KRYLOV_CONVERGED;
+      return;
+    }
+    double rho = 1, alpha = 1, omega = 1;
+    while (res.iter < opts.maxit) {
+      const double rho_next = Dot(n,rhat.data(),r.data());
+      if (!Usable(rho_next)) {
+        res.flag = KRYLOV_BREAKDOWN;
+        return;
+      }
+      const double beta = (rho_next/rho)*(alpha/omega);
+      rho = rho_next;
+      ForBlocks(n,[&](size_t lo, size_t hi) {
+          for (size_t i=lo;i<hi;i++) p[i] = r[i] + beta*(p[i] - omega*v[i]);
+        });
+      Precondition(n,M,p.data(),phat.data());
+      A(phat.data(),v.data());
+      const double rv = Dot(n,rhat.data(),v.data());
+      if (!Usable(rv)) {
+        res.flag = KRYLOV_BREAKDOWN;
+        return;
+      }
+      alpha = rho/rv;
+      s = r;
+      Axpy(n,-alpha,v.data(),s.data());
+      res.iter++;
+      const double snorm = Norm(n,s.data());
+      if (snorm <= opts.tol*bnorm) {
+        // Converged half way through the step
+        Axpy(n,alpha,phat.data(),x);
+        res.resvec.push_back(snorm);
+        res.flag = KRYLOV_CONVERGED;
+        return;
+      }
+      Precondition(n,M,s.data(),shat.data());
+      A(shat.data(),t.data());
+      const double tt = Dot(n,t.data(),t.data());
+      if (!Usable(tt)) {
+        res.flag = KRYLOV_BREAKDOWN;
+        return;
+      }
+      omega = Dot(n,t.data(),s.data())/tt;
+      Axpy(n,alpha,phat.data(),x);
+      Axpy(n,omega,shat.data(),x);
+      r = s;
+      Axpy(n,-omega,t.data(),r.data());
+      res.resvec.push_back(Norm(n,r.data()));
+      if (res.resvec.back() <= opts.tol*bnorm) {
+        res.flag = KRYLOV_CONVERGED;
+        return;
+      }
+      if (!Usable(omega)) {
+        res.flag = KRYLOV_BREAKDOWN;
+        return;
+      }
+    }
+    res.flag = KRYLOV_MAXIT;
+  }
+
+  KrylovResult KrylovSolve(KrylovMethod method, size_t n, const LinearOperator &A,
+                           const PreconditionerOp &M, const double *b, double *x,
+                           const KrylovOptions &opts) {
+    KrylovResult res;
+    res.flag = KRYLOV_CONVERGED;
+    res.iter = 0;
+    const double bnorm = Norm(n,b);
+    if (bnorm == 0) {
+      // The solution is zero
+      std::fill(x,x+n,0.0);
+      res.relres = 0;
+      res.resvec.push_back(0);
+      return res;
+    }
+    switch (method) {
+    case KRYLOV_CG:
+      CG(n,A,M,b,x,bnorm,opts,res);
+      break;
+    case KRYLOV_GMRES:
+      GMRES(n,A,M,b,x,bnorm,opts,res);
+      break;
+    case KRYLOV_BICGSTAB:
+      BiCGSTAB(n,A,M,b,x,bnorm,opts,res);
+      break;
+    }
+    std::vector<double> r(n);
+    Residual(n,A,b,x,r.data());
+    res.relres = Norm(n,r.data())/bnorm;
+    return res;
+  }
+
+  bool JacobiPreconditioner(const std::vector<double> &diagonal, PreconditionerOp &M,
+                            std::string &error) {
+    auto inverse = std::make_shared<std::vector<double> >(diagonal.size());
+    for (size_t i=0;i<diagonal.size();i++) {
+      if (diagonal[i] == 0) {
+        error = "Jacobi preconditioner needs a nonzero diagonal";
+        return false;
+      }
+      (*inverse)[i] = 1.0/diagonal[i];
+    }
+    M = [inverse](const double *r, double *z) {
+      const std::vector<double> &d = *inverse;
+      ForBlocks(d.size(),[&](size_t b, size_t e) {
+          for (size_t i=b;i<e;i++) z[i] = d[i]*r[i];
+        });
+    };
+    return true;
+  }
+
+  // The ILU(0) factors, by rows: L (unit, not stored) is left of diag[i] in
+  // row i, and U from diag[i] on
+  struct ILUFactors {
+    size_t n;
+    std::vector<int32_t> rowptr;
+    std::vector<int32_t> colind;
+    std::vector<int32_t> diag;
+    std::vector<double> values;
+  };
+
+  bool ILUPreconditioner(const SparseView &A, PreconditionerOp &M, std::string &error) {
+    if (A.rows != A.cols) {
+      error = "Incomplete LU needs a square matrix";
+      return false;
+    }
+    const size_t n = A.rows;
+    // The rows of A are the columns of its transpose
+    SparseMatrix T;
+    SparseTranspose(A,T);
+    auto F = std::make_shared<ILUFactors>();
+    F->n = n;
+    F->rowptr.swap(T.colptr);
+    F->colind.swap(T.rowind);
+    F->values.swap(T.values);
+    F->diag.assign(n,-1);
+    std::vector<int32_t> pos(n,-1);
+    const std::vector<int32_t> &rp = F->rowptr;
+    const std::vector<int32_t> &ci = F->colind;
+    std::vector<double> &a = F->values;
+    for (size_t i=0;i<n;i++) {
+      for (int32_t p=rp[i];p<rp[i+1];p++) {
+        pos[ci[p]] = p;
+        if (size_t(ci[p]) == i) F->diag[i] = p;
+      }
+      // Eliminate with the rows above, keeping only the pattern of row i
+      for (int32_t p=rp[i];(p<rp[i+1]) && (size_t(ci[p]) < i);p++) {
+        const int32_t k = ci[p];
+        a[p] /= a[F->diag[k]];
+        for (int32_t q=F->diag[k]+1;q<rp[k+1];q++)
+          if (pos[ci[q]] >= 0) a[pos[ci[q]]] -= a[p]*a[q];
+      }
+      for (int32_t p=rp[i];p<rp[i+1];p++) pos[ci[p]] = -1;
+      if ((F->diag[i] < 0) || !Usable(a[F->diag[i]])) {
+        error = "Incomplete LU broke down on a zero pivot";
+        return false;
+      }
+    }
+    M = [F](const double *r, double *z) {
+      const size_t n = F->n;
+      const int32_t *rp = F->rowptr.data();
+      const int32_t *ci = F->colind.data();
+      const int32_t *d = F->diag.data();
+      const double *a = F->values.data();
+      for (size_t i=0;i<n;i++) {
+        double s = r[i];
+        for (int32_t p=rp[i];p<d[i];p++) s -= a[p]*z[ci[p]];
+        z[i] = s;
+      }
+      for (size_t i=n;i-- > 0;) {
+        double s = z[i];
+        for (int32_t p=d[i]+1;p<rp[i+1];p++) s -= a[p]*z[ci[p]];
+        z[i] = s/a[d[i]];
+      }
+    };
+    return true;
+  }
+
+  const char* KrylovName(KrylovMethod method) {
+    switch (method) {
+    case KRYLOV_CG:
+      return "pcg";
+    case KRYLOV_GMRES:
+      return "gmres";
+    case KRYLOV_BICGSTAB:
+      return "bicgstab";
+    }
+    return "";
+  }
+}
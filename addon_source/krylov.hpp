@@ -0,0 +1,81 @@
+#ifndef __krylov_hpp__
+#define __krylov_hpp__
+
+#include "sparse.hpp"
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Krylov iterative solvers (preconditioned conjugate gradients, restarted
+// GMRES and BiCGSTAB) for A*x = b, where A is applied by a callback (a
+// dense matrix through BLAS, or a sparse one), so that the iteration runs
+// entirely natively.  Preconditioning is on the right for GMRES and
+// BiCGSTAB, so for all three methods the residual that is tested against
+// the tolerance is that of the unpreconditioned system,
+// norm(b - A*x)/norm(b).  The vector reductions are summed in fixed
+// blocks, so the results do not depend on the number of threads.
+
+namespace FM {
+
+  enum KrylovMethod {
+    KRYLOV_CG = 0,
+    KRYLOV_GMRES = 1,
+    KRYLOV_BICGSTAB = 2
+  };
+
+  enum PreconditionerType {
+    PRECOND_NONE = 0,
+    PRECOND_JACOBI = 1,
+    PRECOND_ILU = 2
+  };
+
+  // As for MATLAB: converged, out of iterations, or a scalar in the
+  // recurrence became zero or non-finite
+  enum KrylovFlag {
+    KRYLOV_CONVERGED = 0,
+    KRYLOV_MAXIT = 1,
+    KRYLOV_BREAKDOWN = 4
+  };
+
+  // y = A*x
+  using LinearOperator = std::function<void(const double *x, double *y)>;
+
+  // z = M\r (with z and r distinct)
+  using PreconditionerOp = std::function<void(const double *r, double *z)>;
+
+  struct KrylovOptions {
+    double tol;
+    // The most iterations (for GMRES, the most inner steps over all cycles)
+    size_t maxit;
+    // The GMRES cycle length
+    size_t restart;
+  };
+
+  struct KrylovResult {
+    int flag;
+    double relres;
+    size_t iter;
+    // The residual norm after each iteration, starting with the initial one
+    std::vector<double> resvec;
+  };
+
+  // Solves A*x = b for n unknowns, with x holding the initial guess.  M may
+  // be empty for no preconditioning.
+  KrylovResult KrylovSolve(KrylovMethod method, size_t n, const LinearOperator &A,
+                           const PreconditionerOp &M, const double *b, double *x,
+                           const KrylovOptions &opts);
+
+  // The Jacobi (diagonal) preconditioner.  Fails if the diagonal has a zero.
+  bool JacobiPreconditioner(const std::vector<double> &diagonal, PreconditionerOp &M,
+                            std::string &error);
+
+  // The zero fill incomplete LU factorization of a square sparse A (with
+  // the pattern of A), as a preconditioner.  Fails on a zero pivot.
+  bool ILUPreconditioner(const SparseView &A, PreconditionerOp &M, std::string &error);
+
+  // The name of a method, for messages
+  const char* KrylovName(KrylovMethod method);
+}
+
+#endif
@@ -0,0 +1,440 @@
+#include "mapped_io.hpp"
+#include "addon_utils.hpp"
+#include "integer.hpp"
+#include <algorithm>
+#include <atomic>
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace FM {
+
+  using namespace v8;
+
+  static size_t AlignUp(size_t x) {
+    return (x + MAPPED_ALIGN - 1) / MAPPED_ALIGN * MAPPED_ALIGN;
+  }
+
+  static std::string SystemError(const char *what, const char *filename) {
+    return std::string(what) + " " + filename + ": " + strerror(errno);
+  }
+
+  bool MakeMappedLayout(uint32_t typecode, bool complex, const std::vector<uint64_t> &dims,
+                        MappedLayout &layout, std::string &error, uint32_t version) {
+    if ((typecode < MAPPED_DOUBLE) || (typecode > MAPPED_UINT32) ||
+        ((version < 2) && (typecode > MAPPED_SINGLE))) {
+      error = "Unsupported array type code";
+      return false;
+    }
+    if (complex && (typecode != MAPPED_DOUBLE) && (typecode != MAPPED_SINGLE)) {
+      error = "Integer and logical arrays cannot be complex";
+      return false;
+    }
+    if (dims.size() > MAPPED_MAX_DIMS) {
+      error = "Too many dimensions for an array file";
+      return false;
+    }
+    layout.typecode = typecode;
+    layout.complex = complex;
+    layout.dims = dims;
+    layout.element_size = ((version < 2) && (typecode == MAPPED_LOGICAL)) ?
+      sizeof(double) : ClassBytes(typecode);
+    const size_t limit = SIZE_MAX / 4;
+    size_t elements = 1;
+    for (auto d : dims) {
+      if (d && (elements > limit / d)) {
+        error = "Array in file is too large";
+        return false;
+      }
+      elements *= d;
+    }
+    if (elements > limit / layout.element_size) {
+      error = "Array in file is too large";
+      return false;
+    }
+    size_t block = elements*layout.element_size;
+    layout.elements = elements;
+    layout.real_offset = AlignUp(sizeof(MappedHeader) + dims.size()*sizeof(uint64_t));
+    layout.imag_offset = complex ? AlignUp(layout.real_offset + block) : 0;
+    layout.file_size = complex ? layout.imag_offset + block : layout.real_offset + block;
+    return true;
+  }
+
+  bool ReadFully(int fd, void *p, size_t bytes, size_t offset) {
+    char *c = static_cast<char*>(p);
+    while (bytes) {
+      ssize_t n = pread(fd,c,bytes,offset);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      c += n;
+      bytes -= n;
+      offset += n;
+    }
+    return true;
+  }
+
+  bool WriteFully(int fd, const void *p, size_t bytes, size_t offset) {
+    const char *c = static_cast<const char*>(p);
+    while (bytes) {
+      ssize_t n = pwrite(fd,c,bytes,offset);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) return false;
+      c += n;
+      bytes -= n;
+      offset += n;
+    }
+    return true;
+  }
+
+  static void FillHeader(MappedHeader &header, const MappedLayout &layout) {
+    memset(&header,0,sizeof(header));
+    memcpy(header.magic,MAPPED_MAGIC,sizeof(MAPPED_MAGIC));
+    header.version = MAPPED_VERSION;
+    header.typecode = layout.typecode;
+    header.complex = layout.complex ? 1 : 0;
+    header.ndims = layout.dims.size();
+  }
+
+  bool ReadMappedLayout(int fd, MappedLayout &layout, std::string &error) {
+    MappedHeader header;
+    if (!ReadFully(fd,&header,sizeof(header),0) ||
+        (memcmp(header.magic,MAPPED_MAGIC,sizeof(MAPPED_MAGIC)) != 0)) {
+      error = "Not an array file";
+      return false;
+    }
+    if ((header.version == 0) || (header.version > MAPPED_VERSION)) {
+      error = "Unsupported array file version";
+      return false;
+    }
+    if (header.ndims > MAPPED_MAX_DIMS) {
+      error = "Too many dimensions for an array file";
+      return false;
+    }
+    std::vector<uint64_t> dims(header.ndims);
+    if (header.ndims && !ReadFully(fd,&dims[0],header.ndims*sizeof(uint64_t),sizeof(header))) {
+      error = "Array file header is truncated";
+      return false;
+    }
+    if (!MakeMappedLayout(header.typecode,header.complex != 0,dims,layout,error,header.version))
+      return false;
+    struct stat st;
+    if ((fstat(fd,&st) != 0) || (static_cast<size_t>(st.st_size) < layout.file_size)) {
+      error = "Array file is truncated";
+      return false;
+    }
+    return true;
+  }
+
+  int CreateArrayFile(const char *filename, const MappedLayout &layout, std::string &error) {
+    int fd = open(filename,O_RDWR | O_CREAT | O_TRUNC,0666);
+    if (fd < 0) {
+      error = SystemError("Unable to create",filename);
+      return -1;
+    }
+    MappedHeader header;
+    FillHeader(header,layout);
+    if (!WriteFully(fd,&header,sizeof(header),0) ||
+        (!layout.dims.empty() &&
+         !WriteFully(fd,&layout.dims[0],layout.dims.size()*sizeof(uint64_t),sizeof(header))) ||
+        (ftruncate(fd,layout.file_size) != 0)) {
+      error = SystemError("Unable to write",filename);
+      close(fd);
+      unlink(filename);
+      return -1;
+    }
+    return fd;
+  }
+
+  MappedWriter::MappedWriter() : fd(-1), position(0) {
+  }
+
+  MappedWriter::~MappedWriter() {
+    if (fd >= 0) close(fd);
+  }
+
+  bool MappedWriter::Open(const char *filename, const MappedLayout &l, std::string &error) {
+    layout = l;
+    fd = open(filename,O_WRONLY | O_CREAT | O_TRUNC,0666);
+    if (fd < 0) {
+      error = SystemError("Unable to create",filename);
+      return false;
+    }
+    MappedHeader header;
+    FillHeader(header,layout);
+    position = 0;
+    if (!Write(&header,sizeof(header),error)) return false;
+    if (!layout.dims.empty() &&
+        !Write(&layout.dims[0],layout.dims.size()*sizeof(uint64_t),error)) return false;
+    return Pad(layout.real_offset,error);
+  }
+
+  bool MappedWriter::Write(const void *data, size_t bytes, std::string &error) {
+    const char *c = static_cast<const char*>(data);
+    while (bytes) {
+      ssize_t n = write(fd,c,bytes);
+      if (n < 0 && errno == EINTR) continue;
+      if (n <= 0) {
+        error = std::string("Unable to write array file: ") + strerror(errno);
+        return false;
+      }
+      c += n;
+      bytes -= n;
+      position += n;
+    }
+    return true;
+  }
+
+  bool MappedWriter::Pad(size_t offset, std::string &error) {
+    static const char zeros[MAPPED_ALIGN] = {0};
+    while (position < offset) {
+      if (!Write(zeros,std::min(offset - position,MAPPED_ALIGN),error)) return false;
+    }
+    return true;
+  }
+
+  bool MappedWriter::NextBlock(std::string &error) {
+    return Pad(layout.imag_offset,error);
+  }
+
+  bool MappedWriter::Close(std::string &error) {
+    int ret = close(fd);
+    fd = -1;
+    if (ret != 0) {
+      error = std::string("Unable to write array file: ") + strerror(errno);
+      return false;
+    }
+    if (position != layout.file_size) {
+      error = "Array file is incomplete";
+      return false;
+    }
+    return true;
+  }
+
+  // One mapping, shared by the real and imaginary typed arrays
+  struct MappedFile {
+    void *base;
+    size_t length;
+    std::atomic<int> refs;
+  };
+
+  struct MappedView {
+    Persistent<ArrayBuffer> handle;
+    Isolate *isolate;
+    MappedFile *file;
+  };
+
+  static void UnrefMappedFile(MappedFile *file) {
+    if (--file->refs == 0) {
+      munmap(file->base,file->length);
+      delete file;
+    }
+  }
+
+  static void FinishUnmap(MappedView *view) {
+    GetAddonData(view->isolate).mapped.erase(view);
+    UnrefMappedFile(view->file);
+    delete view;
+  }
+
+  static void UnmapSecondPass(const WeakCallbackInfo<MappedView> &info) {
+    FinishUnmap(info.GetParameter());
+  }
+
+  static void UnmapFirstPass(const WeakCallbackInfo<MappedView> &info) {
+    info.GetParameter()->handle.Reset();
+    info.SetSecondPassCallback(UnmapSecondPass);
+  }
+
+  static Local<Value> TypedView(Local<ArrayBuffer> buff, uint32_t typecode, size_t elements) {
+    switch (typecode) {
+    case CLASS_SINGLE: return Float32Array::New(buff,0,elements);
+    case CLASS_LOGICAL: case CLASS_UINT8: return Uint8Array::New(buff,0,elements);
+    case CLASS_INT8: return Int8Array::New(buff,0,elements);
+    case CLASS_INT16: return Int16Array::New(buff,0,elements);
+    case CLASS_UINT16: return Uint16Array::New(buff,0,elements);
+    case CLASS_INT32: return Int32Array::New(buff,0,elements);
+    case CLASS_UINT32: return Uint32Array::New(buff,0,elements);
+    default: return Float64Array::New(buff,0,elements);
+    }
+  }
+
+  // The mapped pages are not reported to V8 as external memory - they are
+  // backed by the file, and only resident once touched.  Logicals from a
+  // version 1 file are held as doubles, and are copied into bytes instead.
+  static Local<Value> WrapBlock(Isolate *isolate, MappedFile *file, size_t offset,
+                                const MappedLayout &layout) {
+    const size_t bytes = layout.elements*layout.element_size;
+    Local<ArrayBuffer> buff;
+    if (!bytes) {
+      buff = ArrayBuffer::New(isolate,0);
+    } else if (layout.element_size != ClassBytes(layout.typecode)) {
+      buff = ArrayBuffer::New(isolate,layout.elements);
+      ConvertFromDouble(reinterpret_cast<const double*>(static_cast<char*>(file->base) + offset),
+                        CLASS_LOGICAL,buff->GetContents().Data(),layout.elements);
+    } else {
+      buff = ArrayBuffer::New(isolate,static_cast<char*>(file->base) + offset,bytes,
+                              ArrayBufferCreationMode::kExternalized);
+      MappedView *view = new MappedView;
+      view->isolate = isolate;
+      view->file = file;
+      file->refs++;
+      view->handle.Reset(isolate,buff);
+      view->handle.SetWeak(view,UnmapFirstPass,WeakCallbackType::kParameter);
+      GetAddonData(isolate).mapped.insert(view);
+    }
+    return TypedView(buff,layout.typecode,layout.elements);
+  }
+
+  bool LoadArrayFile(Isolate *isolate, const char *filename, bool writable,
+                     Local<Object> &ret, std::string &error) {
+    int fd = open(filename,writable ? O_RDWR : O_RDONLY);
+    if (fd < 0) {
+      error = SystemError("Unable to open",filename);
+      return false;
+    }
+    MappedLayout layout;
+    if (!ReadMappedLayout(fd,layout,error)) {
+      close(fd);
+      return false;
+    }
+    MappedFile *file = nullptr;
+    if (layout.elements) {
+      // A private mapping is copy on write, so the arrays can be modified
+      // without changing the file.
+      void *base = mmap(nullptr,layout.file_size,PROT_READ | PROT_WRITE,
+                        writable ? MAP_SHARED : MAP_PRIVATE,fd,0);
+      if (base == MAP_FAILED) {
+        error = SystemError("Unable to map",filename);
+        close(fd);
+        return false;
+      }
+      file = new MappedFile;
+      file->base = base;
+      file->length = layout.file_size;
+      file->refs = 1;
+    }
+    // The mapping outlives the descriptor
+    close(fd);
+    auto context = isolate->GetCurrentContext();
+    auto dims = Array::New(isolate,layout.dims.size());
+    for (size_t i=0;i<layout.dims.size();i++)
+      dims->Set(context,i,Number::New(isolate,static_cast<double>(layout.dims[i]))).FromJust();
+    ret = Object::New(isolate);
+    ret->Set(context,String::NewFromUtf8(isolate,"dims"),dims).FromJust();
+    ret->Set(context,String::NewFromUtf8(isolate,"real"),
+             WrapBlock(isolate,file,layout.real_offset,layout)).FromJust();
+    if (layout.complex)
+      ret->Set(context,String::NewFromUtf8(isolate,"imag"),
+               WrapBlock(isolate,file,layout.imag_offset,layout)).FromJust();
+    ret->Set(context,String::NewFromUtf8(isolate,"mytype"),
+             Number::New(isolate,layout.typecode)).FromJust();
+    // Drop the reference held while the views were made
+    if (file) UnrefMappedFile(file);
+    return true;
+  }
+
+  template <class T> static bool IsStored(Local<Value> val);
+  template <> bool IsStored<double>(Local<Value> val) {return val->IsFloat64Array();}
+  template <> bool IsStored<float>(Local<Value> val) {return val->IsFloat32Array();}
+  template <> bool IsStored<int8_t>(Local<Value> val) {return val->IsInt8Array();}
+  template <> bool IsStored<uint8_t>(Local<Value> val) {return val->IsUint8Array();}
+  template <> bool IsStored<int16_t>(Local<Value> val) {return val->IsInt16Array();}
+  template <> bool IsStored<uint16_t>(Local<Value> val) {return val->IsUint16Array();}
+  template <> bool IsStored<int32_t>(Local<Value> val) {return val->IsInt32Array();}
+  template <> bool IsStored<uint32_t>(Local<Value> val) {return val->IsUint32Array();}
+
+  // Stream one block of an array of class cls.  Typed arrays of the stored
+  // type are written directly from their storage, anything else is
+  // converted (as by cast) a chunk at a time.
+  template <class T>
+  static bool SaveBlock(Isolate *isolate, MappedWriter &writer, Local<Value> val,
+                        int cls, size_t elements, std::string &error) {
+    auto context = isolate->GetCurrentContext();
+    if (IsStored<T>(val)) {
+      if (Local<TypedArray>::Cast(val)->Length() < elements) {
+        error = "Array data is shorter than its dimensions";
+        return false;
+      }
+      return writer.Write(TypedArrayData(isolate,val),elements*sizeof(T),error);
+    }
+    auto arr = val->ToObject(context).ToLocalChecked();
+    const size_t chunk = 8192;
+    std::vector<double> values(std::min(elements,chunk));
+    std::vector<T> buffer(values.size());
+    for (size_t i=0;i<elements;i+=chunk) {
+      size_t n = std::min(chunk,elements-i);
+      for (size_t j=0;j<n;j++)
+        values[j] = arr->Get(context,i+j).ToLocalChecked()->ToNumber(context).ToLocalChecked()->Value();
+      if ((cls == CLASS_LOGICAL) && AnyNaN(&values[0],n)) {
+        error = "NaN's cannot be converted to logicals";
+        return false;
+      }
+      ConvertFromDouble(&values[0],cls,&buffer[0],n);
+      if (!writer.Write(&buffer[0],n*sizeof(T),error)) return false;
+    }
+    return true;
+  }
+
+  static bool SaveBlockAs(Isolate *isolate, MappedWriter &writer, Local<Value> val,
+                          int cls, size_t elements, std::string &error) {
+    switch (StorageOf(cls)) {
+    case CLASS_SINGLE: return SaveBlock<float>(isolate,writer,val,cls,elements,error);
+    case CLASS_INT8: return SaveBlock<int8_t>(isolate,writer,val,cls,elements,error);
+    case CLASS_UINT8: return SaveBlock<uint8_t>(isolate,writer,val,cls,elements,error);
+    case CLASS_INT16: return SaveBlock<int16_t>(isolate,writer,val,cls,elements,error);
+    case CLASS_UINT16: return SaveBlock<uint16_t>(isolate,writer,val,cls,elements,error);
+    case CLASS_INT32: return SaveBlock<int32_t>(isolate,writer,val,cls,elements,error);
+    case CLASS_UINT32: return SaveBlock<uint32_t>(isolate,writer,val,cls,elements,error);
+    default: return SaveBlock<double>(isolate,writer,val,cls,elements,error);
+    }
+  }
+
+  bool SaveArrayFile(Isolate *isolate, const char *filename, Local<Object> array,
+                     std::string &error) {
+    auto context = isolate->GetCurrentContext();
+    auto jsdims = array->Get(context,String::NewFromUtf8(isolate,"dims")).ToLocalChecked();
+    if (!jsdims->IsArray()) {
+      error = "Expected an array with dimensions";
+      return false;
+    }
+    auto dims_arr = Local<Array>::Cast(jsdims);
+    std::vector<uint64_t> dims(dims_arr->Length());
+    for (size_t i=0;i<dims.size();i++)
+      dims[i] = static_cast<uint64_t>(dims_arr->Get(context,i).ToLocalChecked()->ToNumber(context).ToLocalChecked()->Value());
+    uint32_t typecode = GetInt(isolate,array,"mytype");
+    if (!typecode) typecode = MAPPED_DOUBLE;
+    auto imag = array->Get(context,String::NewFromUtf8(isolate,"imag")).ToLocalChecked();
+    bool complex = !imag->IsUndefined();
+    MappedLayout layout;
+    if (!MakeMappedLayout(typecode,complex,dims,layout,error)) return false;
+    MappedWriter writer;
+    if (!writer.Open(filename,layout,error)) return false;
+    auto real = array->Get(context,String::NewFromUtf8(isolate,"real")).ToLocalChecked();
+    bool ok = SaveBlockAs(isolate,writer,real,typecode,layout.elements,error);
+    if (ok && complex)
+      ok = writer.NextBlock(error) &&
+        SaveBlockAs(isolate,writer,imag,typecode,layout.elements,error);
+    if (!ok) {
+      std::string ignored;
+      writer.Close(ignored);
+      unlink(filename);
+      return false;
+    }
+    return writer.Close(error);
+  }
+
+  void ReleaseMappedFiles(Isolate *isolate) {
+    AddonData &data = GetAddonData(isolate);
+    std::vector<MappedView*> pending(data.mapped.begin(),data.mapped.end());
+    for (auto view : pending) {
+      // Views already in the middle of a GC callback finish on their own
+      if (view->handle.IsEmpty()) continue;
+      view->handle.ClearWeak();
+      view->handle.Reset();
+      FinishUnmap(view);
+    }
+  }
+}
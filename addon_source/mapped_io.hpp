@@ -0,0 +1,110 @@
+#ifndef __mapped_io_hpp__
+#define __mapped_io_hpp__
+
+#include <node.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Binary array files.  A file holds one array: a header with the type code,
+// complex flag and dimensions, followed by the real part and (for complex
+// arrays) the imaginary part, each as a planar column major block.  Blocks
+// start on a 64 byte boundary, so that a mapped file can be used directly
+// as the storage of typed arrays.  Data is in native byte order.
+//
+// Elements are stored at the width of their class: 8 bytes for double, 4
+// for single, and 1, 2 or 4 for the integer classes.  Logicals take one
+// byte (version 1 files held them as doubles; those are still read, into
+// a copy).  Integer and logical arrays are never complex.
+//
+// Loading maps the file and wraps the blocks as typed arrays without
+// reading them, so only the pages that are used are ever touched.  Saving
+// streams the blocks to disk without building a copy of the array.
+
+namespace FM {
+
+  const char MAPPED_MAGIC[8] = {'F','M','A','R','R','A','Y','\0'};
+  const uint32_t MAPPED_VERSION = 2;
+  const size_t MAPPED_ALIGN = 64;
+  const uint32_t MAPPED_MAX_DIMS = 64;
+
+  // Type codes match ArrayType in arrays.ts (and StorageClass in
+  // integer.hpp), up to MAPPED_UINT32
+  const uint32_t MAPPED_DOUBLE = 1;
+  const uint32_t MAPPED_LOGICAL = 2;
+  const uint32_t MAPPED_SINGLE = 3;
+  const uint32_t MAPPED_UINT32 = 9;
+
+  struct MappedHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t typecode;
+    uint32_t complex;
+    uint32_t ndims;
+    // Followed by ndims 64 bit dimensions
+  };
+
+  // Where the parts of an array live in its file
+  struct MappedLayout {
+    uint32_t typecode;
+    bool complex;
+    std::vector<uint64_t> dims;
+    size_t elements;
+    size_t element_size;
+    size_t real_offset;
+    size_t imag_offset;
+    size_t file_size;
+  };
+
+  // The layout of an array in a file of the given version
+  bool MakeMappedLayout(uint32_t typecode, bool complex, const std::vector<uint64_t> &dims,
+                        MappedLayout &layout, std::string &error,
+                        uint32_t version = MAPPED_VERSION);
+
+  // Read and check the header of an open file
+  bool ReadMappedLayout(int fd, MappedLayout &layout, std::string &error);
+
+  // Positioned reads and writes that retry until all bytes are moved
+  bool ReadFully(int fd, void *p, size_t bytes, size_t offset);
+  bool WriteFully(int fd, const void *p, size_t bytes, size_t offset);
+
+  // Create a full size array file whose blocks will be filled in out of
+  // order with WriteFully.  Returns an open descriptor, or -1 on failure.
+  int CreateArrayFile(const char *filename, const MappedLayout &layout, std::string &error);
+
+  // Writes an array file front to back.  The header is written by Open,
+  // then the real block, then (after NextBlock) the imaginary block.
+  class MappedWriter {
+  public:
+    MappedWriter();
+    ~MappedWriter();
+    bool Open(const char *filename, const MappedLayout &layout, std::string &error);
+    bool Write(const void *data, size_t bytes, std::string &error);
+    // Pad out to the start of the imaginary block
+    bool NextBlock(std::string &error);
+    bool Close(std::string &error);
+  private:
+    bool Pad(size_t offset, std::string &error);
+    int fd;
+    size_t position;
+    MappedLayout layout;
+  };
+
+  // Map an array file and return {dims, real, imag, mytype}.  The typed
+  // arrays keep the mapping alive.  A writable mapping writes changes
+  // through to the file; otherwise changes are private to this process.
+  bool LoadArrayFile(v8::Isolate *isolate, const char *filename, bool writable,
+                     v8::Local<v8::Object> &ret, std::string &error);
+
+  // Save an array object ({dims, real, imag?, mytype}) to a file
+  bool SaveArrayFile(v8::Isolate *isolate, const char *filename,
+                     v8::Local<v8::Object> array, std::string &error);
+
+  struct MappedView;
+
+  // Called when an isolate goes away, to unmap files whose typed arrays
+  // were never collected.
+  void ReleaseMappedFiles(v8::Isolate *isolate);
+}
+
+#endif
@@ -5,9 +5,30 @@
 #endif
 
 #include "addon_utils.hpp"
+#include "blas_backend.hpp"
+#include "mapped_io.hpp"
+#include "out_of_core.hpp"
 #include "dense_solver.hpp"
+#include "decompositions.hpp"
+#include "matrix_functions.hpp"
+#include "fft.hpp"
+#include "convolve.hpp"
+#include "elementary.hpp"
+#include "sort.hpp"
+#include "random.hpp"
+#include "fuse.hpp"
+#include "permute.hpp"
+#include "broadcast.hpp"
+#include "integer.hpp"
+#include "scan.hpp"
+#include "format.hpp"
+#include "sparse.hpp"
+#include "krylov.hpp"
+#include "parallel.hpp"
 #include "transpose.hpp"
+#include "tuning.hpp"
 #include <iostream>
+#include <type_traits>
 
 using namespace v8;
 using namespace FM;
@@ -16,23 +37,30 @@ using namespace FM;
 // Note to self - do not add support for single precision ops.  Just do ops in double precision
 // and cast the result.  Remember that single precision is a storage technique, not for performance.
 
-void BLAS_gemm(int Arows, int Acols, int Bcols,
-                const double *A, const double *B,
-                double *C)
+void BLAS_gemm(int Arows, int Acols, int Bcols, double alpha,
+               const double *A, const double *B,
+               double beta, double *C)
 {
-  cblas_dgemm(CblasColMajor,CblasNoTrans,CblasNoTrans,
-              Arows,Bcols,Acols,1.0,A,Arows,B,Acols,0.0,C,Arows);
+  FM_BACKEND(cblas_dgemm)(CblasColMajor,CblasNoTrans,CblasNoTrans,
+              Arows,Bcols,Acols,alpha,A,Arows,B,Acols,beta,C,Arows);
 }
 
-void BLAS_gemm(int Arows, int Acols, int Bcols,
+void BLAS_gemm(int Arows, int Acols, int Bcols, double alpha,
                const Complex<double> *A,
                const Complex<double> *B,
-               Complex<double> *C)
+               double beta, Complex<double> *C)
+{
+  double alphac[] = {alpha,0};
+  double betac[] = {beta,0};
+  FM_BACKEND(cblas_zgemm)(CblasColMajor,CblasNoTrans,CblasNoTrans,Arows,Bcols,
+              Acols,alphac,A,Arows,B,Acols,betac,C,Arows);
+}
+
+template <class T>
+void BLAS_gemm(int Arows, int Acols, int Bcols,
+               const T *A, const T *B, T *C)
 {
-  double alpha[] = {1,0};
-  double beta[] = {0,0};
-  cblas_zgemm(CblasColMajor,CblasNoTrans,CblasNoTrans,Arows,Bcols,
-              Acols,alpha,A,Arows,B,Acols,beta,C,Arows);
+  BLAS_gemm(Arows,Acols,Bcols,1.0,A,B,0.0,C);
 }
 
 template <class T>
@@ -65,14 +93,61 @@ void TGEMM(const FunctionCallbackInfo<Value> &args) {
 
 INSTANCE2(GEMM)
 
+// Computes C = alpha*A*B + beta*C, and writes the result back into the
+// storage of C, so that repeated updates do not allocate temporaries.
+// When C is held in a Float64Array, BLAS writes into it directly.
+template <class T>
+void TGEMMACC(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 5) {
+    ThrowE(isolate,"Expected five arguments to GEMMACC function");
+    return;
+  }
+  auto context = isolate->GetCurrentContext();
+  BLASMatrix<T> Amat;
+  if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
+  BLASMatrix<T> Bmat;
+  if (!ObjectToBLASMatrix<T>(Bmat,isolate,*(args[1]))) return;
+  BLASMatrix<T> Cmat;
+  if (!ObjectToBLASMatrix<T>(Cmat,isolate,*(args[2]))) return;
+  if (Amat.cols != Bmat.rows) {
+    ThrowE(isolate,"Columns and rows must match in matrix multiplication");
+    return;
+  }
+  if ((Cmat.rows != Amat.rows) || (Cmat.cols != Bmat.cols)) {
+    ThrowE(isolate,"Accumulator is not conformant with the matrix product");
+    return;
+  }
+  // C is usually a view of the accumulator.  If it shares storage with
+  // one of the factors, work on a copy so that BLAS sees distinct arrays.
+  if (Overlaps(Cmat,Amat) || Overlaps(Cmat,Bmat)) Cmat.detach();
+  double alpha = args[3]->NumberValue(context).FromJust();
+  double beta = args[4]->NumberValue(context).FromJust();
+  BLAS_gemm(Amat.rows, Amat.cols, Bmat.cols, alpha,
+            Amat.base(), Bmat.base(), beta, Cmat.base());
+  BLASMatrixToObject(Cmat,isolate,*(args[2]));
+  args.GetReturnValue().Set(args[2]);
+}
+
+INSTANCE2(GEMMACC)
+
 template <class T>
 void TSOLVE(const FunctionCallbackInfo<Value> &args) {
   auto isolate = args.GetIsolate();
   HandleScope handleScope(isolate);
-  if (args.Length() != 4) {
-    ThrowE(isolate,"Expected four arguments to DSOLVE function");
+  if ((args.Length() != 4) && (args.Length() != 5)) {
+    ThrowE(isolate,"Expected four or five arguments to DSOLVE function");
     return;
   }
+  int mode = LSQ_AUTO;
+  if (args.Length() == 5) {
+    mode = args[4]->Int32Value(isolate->GetCurrentContext()).FromJust();
+    if ((mode < LSQ_AUTO) || (mode > LSQ_SVD)) {
+      ThrowE(isolate,"Unknown least squares mode in DSOLVE function");
+      return;
+    }
+  }
   BLASMatrix<T> Amat;
   if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
   BLASMatrix<T> Bmat;
@@ -89,12 +164,311 @@ void TSOLVE(const FunctionCallbackInfo<Value> &args) {
     cb->Call(Null(isolate), argc, argv);
   };
   auto ma = Local<Function>::Cast(args[3]);
-  DenseSolve(Amat.rows,Amat.cols,Bmat.cols,Cmat.base(),Amat.base(),Bmat.base(),cback);
+  DenseSolve(Amat.rows,Amat.cols,Bmat.cols,Cmat.base(),Amat.base(),Bmat.base(),cback,
+             static_cast<LeastSqMode>(mode));
   args.GetReturnValue().Set(ConstructArray(isolate,ma,Cmat));
 }
 
 INSTANCE2(SOLVE)
 
+// The decompositions take makers for both real and complex arrays, since
+// some of their outputs are real whatever the input.  Multiple outputs are
+// returned as a JS array.
+
+static Local<Value> MakeOutput(Isolate *isolate, Local<Function> mr, Local<Function>,
+                               BLASMatrix<double> &M) {
+  return ConstructArray(isolate,mr,M);
+}
+
+static Local<Value> MakeOutput(Isolate *isolate, Local<Function>, Local<Function> mc,
+                               BLASMatrix<Complex<double> > &M) {
+  return ConstructArray(isolate,mc,M);
+}
+
+static Local<Value> MakeOutputList(Isolate *isolate, std::initializer_list<Local<Value> > outputs) {
+  auto context = isolate->GetCurrentContext();
+  auto ret = Array::New(isolate,outputs.size());
+  int i = 0;
+  for (auto &out : outputs)
+    ret->Set(context,i++,out).FromJust();
+  return ret;
+}
+
+template <class T>
+void TLU(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 3) {
+    ThrowE(isolate,"Expected three arguments to LU function");
+    return;
+  }
+  BLASMatrix<T> Amat;
+  if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
+  auto mr = Local<Function>::Cast(args[1]);
+  auto mc = Local<Function>::Cast(args[2]);
+  BLASMatrix<T> L, U;
+  BLASMatrix<double> P;
+  LUDecompose(Amat,L,U,P);
+  args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,L),
+          MakeOutput(isolate,mr,mc,U),MakeOutput(isolate,mr,mc,P)}));
+}
+
+INSTANCE2(LU)
+
+template <class T>
+void TQR(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 4) {
+    ThrowE(isolate,"Expected four arguments to QR function");
+    return;
+  }
+  BLASMatrix<T> Amat;
+  if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
+  bool economy = args[1]->BooleanValue(isolate->GetCurrentContext()).FromJust();
+  auto mr = Local<Function>::Cast(args[2]);
+  auto mc = Local<Function>::Cast(args[3]);
+  BLASMatrix<T> Q, R;
+  QRDecompose(Amat,economy,Q,R);
+  args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,Q),
+          MakeOutput(isolate,mr,mc,R)}));
+}
+
+INSTANCE2(QR)
+
+template <class T>
+void TCHOL(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 3) {
+    ThrowE(isolate,"Expected three arguments to CHOL function");
+    return;
+  }
+  BLASMatrix<T> Amat;
+  if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
+  auto mr = Local<Function>::Cast(args[1]);
+  auto mc = Local<Function>::Cast(args[2]);
+  BLASMatrix<T> R;
+  std::string error;
+  if (!CholDecompose(Amat,R,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  args.GetReturnValue().Set(MakeOutput(isolate,mr,mc,R));
+}
+
+INSTANCE2(CHOL)
+
+// The mode is 0 for the singular values only, 1 for the full
+// decomposition and 2 for the economy decomposition.
+template <class T>
+void TSVD(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 4) {
+    ThrowE(isolate,"Expected four arguments to SVD function");
+    return;
+  }
+  BLASMatrix<T> Amat;
+  if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
+  int mode = args[1]->Int32Value(isolate->GetCurrentContext()).FromJust();
+  if ((mode < SVD_VALUES) || (mode > SVD_ECONOMY)) {
+    ThrowE(isolate,"Unknown mode in SVD function");
+    return;
+  }
+  auto mr = Local<Function>::Cast(args[2]);
+  auto mc = Local<Function>::Cast(args[3]);
+  BLASMatrix<double> s;
+  BLASMatrix<T> U, V;
+  std::string error;
+  if (!SVDDecompose(Amat,static_cast<SVDMode>(mode),s,U,V,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  if (mode == SVD_VALUES) {
+    args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,s)}));
+    return;
+  }
+  BLASMatrix<double> S(DiagonalMatrix(s.base(),s.rows,U.cols,V.cols));
+  args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,U),
+          MakeOutput(isolate,mr,mc,S),MakeOutput(isolate,mr,mc,V)}));
+}
+
+INSTANCE2(SVD)
+
+// Returns [X, d, r], the inverse (empty unless asked for), determinant and
+// reciprocal condition number, all from one LU factorization.  A singular
+// or badly conditioned inverse is reported through the logger.
+template <class T>
+void TINVERSE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 5) {
+    ThrowE(isolate,"Expected five arguments to INVERSE function");
+    return;
+  }
+  BLASMatrix<T> Amat;
+  if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
+  bool want_inverse = args[1]->BooleanValue(isolate->GetCurrentContext()).FromJust();
+  Local<Function> logger = Local<Function>::Cast(args[2]);
+  auto mr = Local<Function>::Cast(args[3]);
+  auto mc = Local<Function>::Cast(args[4]);
+  BLASMatrix<T> X;
+  BLASMatrix<T> D(1,1);
+  BLASMatrix<double> R(1,1);
+  std::string error;
+  if (!LUInverse(Amat,want_inverse ? &X : nullptr,D.base()[0],R.base()[0],error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  const double rcond = R.base()[0];
+  if (want_inverse && (rcond < getEPS())) {
+    std::string msg = (rcond == 0) ? "Matrix is singular to working precision." :
+      "Matrix is close to singular or badly scaled.  Results may be inaccurate.  RCOND = " +
+      std::to_string(rcond);
+    Local<Value> argv[1] = {String::NewFromUtf8(isolate,msg.c_str())};
+    logger->Call(Null(isolate),1,argv);
+  }
+  args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,X),
+          MakeOutput(isolate,mr,mc,D),MakeOutput(isolate,mr,mc,R)}));
+}
+
+INSTANCE2(INVERSE)
+
+static bool ComplexMatrixFunction(int op, const BLASMatrix<Complex<double> > &A,
+                                  BLASMatrix<Complex<double> > &X, bool &real_result,
+                                  warning_cb warn, std::string &error) {
+  if (op == MATFUN_SQRT) return MatrixSqrt(A,X,real_result,warn,error);
+  return MatrixLog(A,X,real_result,warn,error);
+}
+
+static void ToComplex(const BLASMatrix<double> &A, BLASMatrix<Complex<double> > &C) {
+  C = BLASMatrix<Complex<double> >(A.rows,A.cols);
+  for (size_t i=0;i<A.elements();i++) C.base()[i] = Complex<double>(A.base()[i],0);
+}
+
+static void ToComplex(const BLASMatrix<Complex<double> > &A, BLASMatrix<Complex<double> > &C) {
+  C = CopyOf(A);
+}
+
+// expm, sqrtm or logm of a square matrix (see matrix_functions.hpp).  The
+// square root and logarithm of a real matrix are real unless it has
+// eigenvalues on the negative real axis.
+template <class T>
+void TMATFUN(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 5) {
+    ThrowE(isolate,"Expected five arguments to MATFUN function");
+    return;
+  }
+  BLASMatrix<T> Amat;
+  if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
+  int op = args[1]->Int32Value(isolate->GetCurrentContext()).FromJust();
+  if ((op < MATFUN_EXP) || (op > MATFUN_LOG)) {
+    ThrowE(isolate,"Unknown matrix function");
+    return;
+  }
+  std::function<void(std::string) > cback = [=](std::string msg) {
+    Local<Function> cb = Local<Function>::Cast(args[2]);
+    Local<Value> argv[1] = {String::NewFromUtf8(isolate,msg.c_str())};
+    cb->Call(Null(isolate),1,argv);
+  };
+  auto mr = Local<Function>::Cast(args[3]);
+  auto mc = Local<Function>::Cast(args[4]);
+  std::string error;
+  if (op == MATFUN_EXP) {
+    BLASMatrix<T> E;
+    if (!MatrixExp(Amat,E,error)) {
+      ThrowE(isolate,error.c_str());
+      return;
+    }
+    args.GetReturnValue().Set(MakeOutput(isolate,mr,mc,E));
+    return;
+  }
+  BLASMatrix<Complex<double> > C, X;
+  ToComplex(Amat,C);
+  bool real_result = false;
+  if (!ComplexMatrixFunction(op,C,X,real_result,cback,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  if (real_result && std::is_same<T,double>::value) {
+    BLASMatrix<double> XR(RealPart(X));
+    args.GetReturnValue().Set(MakeOutput(isolate,mr,mc,XR));
+    return;
+  }
+  args.GetReturnValue().Set(MakeOutput(isolate,mr,mc,X));
+}
+
+INSTANCE2(MATFUN)
+
+// Symmetric (Hermitian) matrices have real eigenvalues, and are handled by
+// the symmetric drivers.  For general real matrices the eigenvalues are
+// returned as real if none of them is complex.
+template <class T>
+void TEIG(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 4) {
+    ThrowE(isolate,"Expected four arguments to EIG function");
+    return;
+  }
+  BLASMatrix<T> Amat;
+  if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
+  if (Amat.rows != Amat.cols) {
+    ThrowE(isolate,"Eigenvalue decomposition requires a square matrix");
+    return;
+  }
+  bool vectors = args[1]->BooleanValue(isolate->GetCurrentContext()).FromJust();
+  auto mr = Local<Function>::Cast(args[2]);
+  auto mc = Local<Function>::Cast(args[3]);
+  BLASMatrix<T> F(CopyOf(Amat));
+  std::string error;
+  if (IsHermitian(F)) {
+    BLASMatrix<double> w;
+    if (!SymmetricEig(F,vectors,w,error)) {
+      ThrowE(isolate,error.c_str());
+      return;
+    }
+    if (!vectors) {
+      args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,w)}));
+      return;
+    }
+    BLASMatrix<double> D(DiagonalMatrix(w.base(),w.rows,w.rows,w.rows));
+    args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,F),
+            MakeOutput(isolate,mr,mc,D)}));
+    return;
+  }
+  BLASMatrix<Complex<double> > w, V;
+  if (!GeneralEig(F,vectors,w,V,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  BLASMatrix<Complex<double> > D;
+  if (vectors) D = DiagonalMatrix(w.base(),w.rows,w.rows,w.rows);
+  if (IsRealValued(w) && (!vectors || IsRealValued(V))) {
+    BLASMatrix<double> wr(RealPart(w));
+    if (!vectors) {
+      args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,wr)}));
+      return;
+    }
+    BLASMatrix<double> Vr(RealPart(V));
+    BLASMatrix<double> Dr(RealPart(D));
+    args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,Vr),
+            MakeOutput(isolate,mr,mc,Dr)}));
+    return;
+  }
+  if (!vectors) {
+    args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,w)}));
+    return;
+  }
+  args.GetReturnValue().Set(MakeOutputList(isolate,{MakeOutput(isolate,mr,mc,V),
+          MakeOutput(isolate,mr,mc,D)}));
+}
+
+INSTANCE2(EIG)
+
 // Should this code be auto-generated?
 
 template <class T>
@@ -109,7 +483,7 @@ void TTRANSPOSE(const FunctionCallbackInfo<Value> &args) {
   if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
   auto ma = Local<Function>::Cast(args[1]);
   BLASMatrix<T> Cmat(Amat.cols, Amat.rows);
-  blocked_transpose(Amat.base(),Cmat.base(),Amat.rows,Amat.cols);
+  DispatchTranspose(Amat.base(),Cmat.base(),Amat.rows,Amat.cols);
   args.GetReturnValue().Set(ConstructArray(isolate,ma,Cmat));
 }
 
@@ -127,7 +501,7 @@ void THERMITIAN(const FunctionCallbackInfo<Value> &args) {
   if (!ObjectToBLASMatrix<T>(Amat,isolate,*(args[0]))) return;
   auto ma = Local<Function>::Cast(args[1]);
   BLASMatrix<T> Cmat(Amat.cols, Amat.rows);
-  blocked_hermitian(Amat.base(),Cmat.base(),Amat.rows,Amat.cols);
+  DispatchHermitian(Amat.base(),Cmat.base(),Amat.rows,Amat.cols);
   args.GetReturnValue().Set(ConstructArray(isolate,ma,Cmat));
 }
 
@@ -135,15 +509,1667 @@ void ZHERMITIAN(const FunctionCallbackInfo<Value> &args) {
   THERMITIAN<Complex<double> >(args);
 }
 
-void Init(Local<Object> exports) {
-  NODE_SET_METHOD(exports, "DGEMM", DGEMM);
-  NODE_SET_METHOD(exports, "ZGEMM", ZGEMM);
-  NODE_SET_METHOD(exports, "DSOLVE", DSOLVE);
-  NODE_SET_METHOD(exports, "ZSOLVE", ZSOLVE);
-  NODE_SET_METHOD(exports, "DTRANSPOSE", DTRANSPOSE);
-  NODE_SET_METHOD(exports, "ZTRANSPOSE", ZTRANSPOSE);
-  NODE_SET_METHOD(exports, "ZHERMITIAN", ZHERMITIAN);
+// Force the native kernels to a given instruction set level (clamped
+// to what the CPU supports).  Returns the name of the level selected.
+void SETISA(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 1) {
+    ThrowE(isolate,"Expected one argument to SETISA function");
+    return;
+  }
+  String::Utf8Value name(isolate,args[0]);
+  ISALevel level;
+  if (!*name || !ParseISAName(*name,level)) {
+    ThrowE(isolate,"Unknown instruction set level - expected generic, sse2, avx2 or avx512");
+    return;
+  }
+  ISALevel selected = SelectISALevel(level);
+  args.GetReturnValue().Set(String::NewFromUtf8(isolate,ISAName(selected)));
+}
+
+void GETISA(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  auto ret = Object::New(isolate);
+  ret->Set(context,String::NewFromUtf8(isolate,"active"),
+           String::NewFromUtf8(isolate,ISAName(Kernels().level))).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"detected"),
+           String::NewFromUtf8(isolate,ISAName(DetectISALevel()))).FromJust();
+  args.GetReturnValue().Set(ret);
+}
+
+// The kernel tuning parameters in use, where they came from, and where
+// the profile is kept
+static Local<Value> TuningInfo(Isolate *isolate) {
+  auto context = isolate->GetCurrentContext();
+  const TuningProfile p = CurrentTuning();
+  auto ret = Object::New(isolate);
+  ret->Set(context,String::NewFromUtf8(isolate,"transpose_block"),
+           Number::New(isolate,double(p.transpose_block))).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"parallel_grain"),
+           Number::New(isolate,double(p.parallel_grain))).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"source"),
+           String::NewFromUtf8(isolate,TuningSourceName(CurrentTuningSource()))).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"path"),
+           String::NewFromUtf8(isolate,TuningProfilePath().c_str())).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"machine"),
+           String::NewFromUtf8(isolate,MachineSignature().c_str())).FromJust();
+  return ret;
+}
+
+void GETTUNING(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  args.GetReturnValue().Set(TuningInfo(isolate));
+}
+
+// Benchmark the kernels on this machine and use the best parameters.  With
+// save set, they are also written to the tuning profile.
+void TUNE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 1) {
+    ThrowE(isolate,"Expected one argument to TUNE function");
+    return;
+  }
+  const bool save = args[0]->BooleanValue(isolate->GetCurrentContext()).FromJust();
+  const TuningProfile p = AutoTune();
+  ApplyTuning(p,TUNING_TUNED);
+  std::string error;
+  if (save && !SaveTuningProfile(TuningProfilePath(),p,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  args.GetReturnValue().Set(TuningInfo(isolate));
+}
+
+// Set the transpose block and parallel grain.  Zero (or no argument) keeps
+// the current value, and no arguments at all returns to the defaults.
+void SETTUNING(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() > 2) {
+    ThrowE(isolate,"Expected at most two arguments to SETTUNING function");
+    return;
+  }
+  if (args.Length() == 0) {
+    ApplyTuning(DefaultTuning(),TUNING_DEFAULT);
+    args.GetReturnValue().Set(TuningInfo(isolate));
+    return;
+  }
+  TuningProfile p = CurrentTuning();
+  double values[2] = {0, 0};
+  for (int i=0;i<args.Length();i++) {
+    values[i] = args[i]->NumberValue(context).FromJust();
+    if (!(values[i] >= 0) || (values[i] != floor(values[i]))) {
+      ThrowE(isolate,"Tuning parameters must be non-negative integers");
+      return;
+    }
+  }
+  if (values[0] > 0) p.transpose_block = size_t(values[0]);
+  if (values[1] > 0) p.parallel_grain = size_t(values[1]);
+  ApplyTuning(p,TUNING_SET);
+  args.GetReturnValue().Set(TuningInfo(isolate));
+}
+
+// Re-read the tuning profile, if there is one for this machine
+void LOADTUNING(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (!LoadSavedTuning()) ApplyTuning(DefaultTuning(),TUNING_DEFAULT);
+  args.GetReturnValue().Set(TuningInfo(isolate));
+}
+
+// Select whether native results are allocated in SharedArrayBuffers
+// for this isolate.  Returns the previous setting.
+void SETSHARED(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 1) {
+    ThrowE(isolate,"Expected one argument to SETSHARED function");
+    return;
+  }
+  auto &data = GetAddonData(isolate);
+  bool previous = data.shared_results;
+  data.shared_results = args[0]->BooleanValue(isolate->GetCurrentContext()).FromJust();
+  args.GetReturnValue().Set(Boolean::New(isolate,previous));
+}
+
+void BLASINFO(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  BackendInfo info = GetBackendInfo();
+  auto ret = Object::New(isolate);
+  ret->Set(context,String::NewFromUtf8(isolate,"name"),
+           String::NewFromUtf8(isolate,info.name.c_str())).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"blas"),
+           String::NewFromUtf8(isolate,info.blas.c_str())).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"lapack"),
+           String::NewFromUtf8(isolate,info.lapack.c_str())).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"threads"),
+           Number::New(isolate,info.threads)).FromJust();
+  auto missing = Array::New(isolate,info.missing.size());
+  for (size_t i=0;i<info.missing.size();i++)
+    missing->Set(context,i,String::NewFromUtf8(isolate,info.missing[i].c_str())).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"missing"),missing).FromJust();
+  args.GetReturnValue().Set(ret);
+}
+
+// Switch the BLAS/LAPACK implementation.  With no arguments, returns to
+// the linked implementation.  Returns the same report as BLASINFO.
+void SETBLAS(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() > 2) {
+    ThrowE(isolate,"Expected at most two arguments to SETBLAS function");
+    return;
+  }
+  if ((args.Length() == 0) || args[0]->IsUndefined()) {
+    ResetBackend();
+  } else {
+    String::Utf8Value blas(isolate,args[0]);
+    std::string lapack;
+    if ((args.Length() == 2) && !args[1]->IsUndefined())
+      lapack = *String::Utf8Value(isolate,args[1]);
+    std::string error;
+    if (!*blas || !LoadBackend(*blas,lapack,error)) {
+      ThrowE(isolate,error.empty() ? "Expected a library name in SETBLAS" : error.c_str());
+      return;
+    }
+  }
+  BLASINFO(args);
+}
+
+void SETBLASTHREADS(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 1) {
+    ThrowE(isolate,"Expected one argument to SETBLASTHREADS function");
+    return;
+  }
+  int threads = args[0]->Int32Value(context).FromJust();
+  if (threads < 1) {
+    ThrowE(isolate,"Thread count must be positive");
+    return;
+  }
+  args.GetReturnValue().Set(Boolean::New(isolate,SetBackendThreads(threads)));
+}
+
+// Report on the pool of result buffers.  external is the number of bytes
+// this isolate has reported to V8 for pooled results it still holds.
+void POOLSTATS(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  PoolStats stats = GetPoolStats();
+  auto ret = Object::New(isolate);
+  ret->Set(context,String::NewFromUtf8(isolate,"hits"),
+           Number::New(isolate,stats.hits)).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"misses"),
+           Number::New(isolate,stats.misses)).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"cached"),
+           Number::New(isolate,stats.cached_bytes)).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"live"),
+           Number::New(isolate,stats.live_bytes)).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"limit"),
+           Number::New(isolate,stats.limit_bytes)).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"external"),
+           Number::New(isolate,GetAddonData(isolate).external_bytes)).FromJust();
+  args.GetReturnValue().Set(ret);
+}
+
+void POOLTRIM(const FunctionCallbackInfo<Value> &) {
+  TrimPool();
+}
+
+void SETPOOLLIMIT(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 1) {
+    ThrowE(isolate,"Expected one argument to SETPOOLLIMIT function");
+    return;
+  }
+  double limit = args[0]->NumberValue(context).FromJust();
+  if (!(limit >= 0)) {
+    ThrowE(isolate,"Pool limit must be non-negative");
+    return;
+  }
+  SetPoolLimit(static_cast<size_t>(limit));
+}
+
+// Map an array file.  Returns {dims, real, imag, mytype}, with the typed
+// arrays backed by the mapping.
+void MAPOPEN(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() < 1 || args.Length() > 2) {
+    ThrowE(isolate,"Expected one or two arguments to MAPOPEN function");
+    return;
+  }
+  String::Utf8Value filename(isolate,args[0]);
+  bool writable = (args.Length() == 2) && args[1]->BooleanValue(context).FromJust();
+  Local<Object> ret;
+  std::string error;
+  if (!*filename || !LoadArrayFile(isolate,*filename,writable,ret,error)) {
+    ThrowE(isolate,error.empty() ? "Expected a file name in MAPOPEN" : error.c_str());
+    return;
+  }
+  args.GetReturnValue().Set(ret);
+}
+
+void MAPSAVE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 2) {
+    ThrowE(isolate,"Expected two arguments to MAPSAVE function");
+    return;
+  }
+  String::Utf8Value filename(isolate,args[0]);
+  std::string error;
+  if (!*filename || !args[1]->IsObject() ||
+      !SaveArrayFile(isolate,*filename,args[1]->ToObject(context).ToLocalChecked(),error)) {
+    ThrowE(isolate,error.empty() ? "Expected a file name and an array in MAPSAVE" : error.c_str());
+    return;
+  }
+}
+
+static Local<Object> TilePlanToObject(Isolate *isolate, const TilePlan &plan) {
+  auto context = isolate->GetCurrentContext();
+  auto ret = Object::New(isolate);
+  ret->Set(context,String::NewFromUtf8(isolate,"rows"),
+           Number::New(isolate,plan.rows)).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"cols"),
+           Number::New(isolate,plan.cols)).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"inner"),
+           Number::New(isolate,plan.inner)).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"bytes"),
+           Number::New(isolate,plan.bytes)).FromJust();
+  return ret;
 }
 
-NODE_MODULE(mat, Init)
+static bool GetBudget(Isolate *isolate, const FunctionCallbackInfo<Value> &args, int n, size_t &budget) {
+  budget = OOC_DEFAULT_BUDGET;
+  if ((args.Length() <= n) || args[n]->IsUndefined()) return true;
+  double val = args[n]->NumberValue(isolate->GetCurrentContext()).FromJust();
+  if (!(val > 0)) {
+    ThrowE(isolate,"Memory budget must be positive");
+    return false;
+  }
+  budget = static_cast<size_t>(val);
+  return true;
+}
+
+// Multiply two array files into a third, without holding them in memory.
+// Returns the tiling that was used.
+void OOCGEMM(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() < 3 || args.Length() > 4) {
+    ThrowE(isolate,"Expected three or four arguments to OOCGEMM function");
+    return;
+  }
+  size_t budget;
+  if (!GetBudget(isolate,args,3,budget)) return;
+  String::Utf8Value a(isolate,args[0]);
+  String::Utf8Value b(isolate,args[1]);
+  String::Utf8Value c(isolate,args[2]);
+  TilePlan plan;
+  std::string error;
+  if (!*a || !*b || !*c || !OutOfCoreGemm(*a,*b,*c,budget,plan,error)) {
+    ThrowE(isolate,error.empty() ? "Expected file names in OOCGEMM" : error.c_str());
+    return;
+  }
+  args.GetReturnValue().Set(TilePlanToObject(isolate,plan));
+}
+
+void OOCTRANSPOSE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() < 2 || args.Length() > 3) {
+    ThrowE(isolate,"Expected two or three arguments to OOCTRANSPOSE function");
+    return;
+  }
+  size_t budget;
+  if (!GetBudget(isolate,args,2,budget)) return;
+  String::Utf8Value a(isolate,args[0]);
+  String::Utf8Value b(isolate,args[1]);
+  TilePlan plan;
+  std::string error;
+  if (!*a || !*b || !OutOfCoreTranspose(*a,*b,budget,plan,error)) {
+    ThrowE(isolate,error.empty() ? "Expected file names in OOCTRANSPOSE" : error.c_str());
+    return;
+  }
+  args.GetReturnValue().Set(TilePlanToObject(isolate,plan));
+}
+
+// Transform along dimension dim (zero based), to length len.  The inverse
+// of conjugate symmetric data is returned as a real array, everything
+// else as a complex one.
+void FFT(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 6) {
+    ThrowE(isolate,"Expected six arguments to FFT function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  double len = args[1]->NumberValue(context).FromJust();
+  if (!(len >= 0) || (len != floor(len))) {
+    ThrowE(isolate,"FFT length must be a non-negative integer");
+    return;
+  }
+  double dim = args[2]->NumberValue(context).FromJust();
+  if (!(dim >= 0) || (dim != floor(dim)) || (dim >= MAPPED_MAX_DIMS)) {
+    ThrowE(isolate,"FFT dimension is out of range");
+    return;
+  }
+  bool inverse = args[3]->BooleanValue(context).FromJust();
+  auto mr = Local<Function>::Cast(args[4]);
+  auto mc = Local<Function>::Cast(args[5]);
+  std::vector<size_t> dims(A.dims);
+  if (dims.size() <= dim) dims.resize(dim+1,1);
+  std::vector<size_t> out_dims(dims);
+  out_dims[dim] = len;
+  size_t count = 1;
+  for (auto d : out_dims) count *= d;
+  bool real_out = inverse && ConjugateSymmetric(dims,dim,len,A.real,A.imag);
+  double *re = NewResultArray<double>(isolate,count);
+  double *im = real_out ? nullptr : NewResultArray<double>(isolate,count);
+  FFTDimension(dims,dim,len,inverse,A.real,A.imag,real_out,re,im);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,real_out ? mr : mc,out_dims,re,im));
+}
+
+// Report on the cache of FFT plans, optionally emptying it first.
+void FFTCACHE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if ((args.Length() > 0) && args[0]->BooleanValue(context).FromJust())
+    ClearFFTCache();
+  FFTCacheInfo info = GetFFTCacheInfo();
+  auto ret = Object::New(isolate);
+  ret->Set(context,String::NewFromUtf8(isolate,"plans"),
+           Number::New(isolate,info.plans)).FromJust();
+  ret->Set(context,String::NewFromUtf8(isolate,"bytes"),
+           Number::New(isolate,info.bytes)).FromJust();
+  args.GetReturnValue().Set(ret);
+}
+
+// The shape (0 full, 1 same, 2 valid) and method (a ConvMethod) arguments
+// of CONV and CONV2
+static bool GetConvOptions(Isolate *isolate, const FunctionCallbackInfo<Value> &args,
+                           int &shape, ConvMethod &method) {
+  auto context = isolate->GetCurrentContext();
+  shape = args[2]->Int32Value(context).FromJust();
+  int m = args[3]->Int32Value(context).FromJust();
+  if ((shape < 0) || (shape > 2)) {
+    ThrowE(isolate,"Convolution shape must be full, same or valid");
+    return false;
+  }
+  if ((m < CONV_AUTO) || (m > CONV_FFT)) {
+    ThrowE(isolate,"Convolution method must be auto, direct or fft");
+    return false;
+  }
+  method = static_cast<ConvMethod>(m);
+  return true;
+}
+
+// The first and number of terms of a full convolution of lengths n and k
+// that make up the given shape
+static void ConvWindow(int shape, size_t n, size_t k, size_t &first, size_t &count) {
+  if (shape == 1) {
+    first = k/2;
+    count = n;
+  } else if (shape == 2) {
+    first = (k > 0) ? k-1 : 0;
+    count = ((k > 0) && (n >= k)) ? n-k+1 : 0;
+  } else {
+    first = 0;
+    count = ((n > 0) && (k > 0)) ? n+k-1 : 0;
+  }
+}
+
+// Convolve the vectors u and v.  The result is a column; the caller
+// reshapes it.
+void CONV(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 6) {
+    ThrowE(isolate,"Expected six arguments to CONV function");
+    return;
+  }
+  NDArray U, V;
+  if (!ObjectToNDArray(U,isolate,*(args[0]))) return;
+  if (!ObjectToNDArray(V,isolate,*(args[1]))) return;
+  int shape;
+  ConvMethod method;
+  if (!GetConvOptions(isolate,args,shape,method)) return;
+  auto mr = Local<Function>::Cast(args[4]);
+  auto mc = Local<Function>::Cast(args[5]);
+  size_t first, count;
+  ConvWindow(shape,U.elements,V.elements,first,count);
+  const bool complex = U.imag || V.imag;
+  double *re = NewResultArray<double>(isolate,count);
+  double *im = complex ? NewResultArray<double>(isolate,count) : nullptr;
+  ConvOperand u = {U.real,U.imag,U.elements,1};
+  ConvOperand v = {V.real,V.imag,V.elements,1};
+  Convolve(u,v,first,first+count,method,re,im);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,complex ? mc : mr,{count,1},re,im));
+}
+
+// Two dimensional convolution of the matrices A and B
+void CONV2(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 6) {
+    ThrowE(isolate,"Expected six arguments to CONV2 function");
+    return;
+  }
+  NDArray A, B;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  if (!ObjectToNDArray(B,isolate,*(args[1]))) return;
+  if ((A.dims.size() > 2) || (B.dims.size() > 2)) {
+    ThrowE(isolate,"Arguments to conv2 must be 2D");
+    return;
+  }
+  int shape;
+  ConvMethod method;
+  if (!GetConvOptions(isolate,args,shape,method)) return;
+  auto mr = Local<Function>::Cast(args[4]);
+  auto mc = Local<Function>::Cast(args[5]);
+  A.dims.resize(2,1);
+  B.dims.resize(2,1);
+  size_t row0, rows, col0, cols;
+  ConvWindow(shape,A.dims[0],B.dims[0],row0,rows);
+  ConvWindow(shape,A.dims[1],B.dims[1],col0,cols);
+  const bool complex = A.imag || B.imag;
+  double *re = NewResultArray<double>(isolate,rows*cols);
+  double *im = complex ? NewResultArray<double>(isolate,rows*cols) : nullptr;
+  ConvOperand a = {A.real,A.imag,A.dims[0],A.dims[1]};
+  ConvOperand b = {B.real,B.imag,B.dims[0],B.dims[1]};
+  Convolve2(a,b,row0,rows,col0,cols,method,re,im);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,complex ? mc : mr,{rows,cols},re,im));
+}
+
+// Apply the filter with numerator b and denominator a along dimension dim
+// (zero based) of x.
+void FILTER(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 6) {
+    ThrowE(isolate,"Expected six arguments to FILTER function");
+    return;
+  }
+  NDArray B, A, X;
+  if (!ObjectToNDArray(B,isolate,*(args[0]))) return;
+  if (!ObjectToNDArray(A,isolate,*(args[1]))) return;
+  if (!ObjectToNDArray(X,isolate,*(args[2]))) return;
+  double dim = args[3]->NumberValue(context).FromJust();
+  if (!(dim >= 0) || (dim != floor(dim)) || (dim >= MAPPED_MAX_DIMS)) {
+    ThrowE(isolate,"Filter dimension is out of range");
+    return;
+  }
+  auto mr = Local<Function>::Cast(args[4]);
+  auto mc = Local<Function>::Cast(args[5]);
+  std::vector<size_t> dims(X.dims);
+  if (dims.size() <= dim) dims.resize(dim+1,1);
+  const bool complex = A.imag || B.imag || X.imag;
+  double *re = NewResultArray<double>(isolate,X.elements);
+  double *im = complex ? NewResultArray<double>(isolate,X.elements) : nullptr;
+  ConvOperand b = {B.real,B.imag,B.elements,1};
+  ConvOperand a = {A.real,A.imag,A.elements,1};
+  std::string error;
+  if (!Filter(b,a,dims,dim,X.real,X.imag,re,im,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  args.GetReturnValue().Set(ConstructNDArray(isolate,complex ? mc : mr,X.dims,re,im));
+}
+
+// Apply an elementary function (an ElementaryOp) to every element of A.
+// The result is complex if A is (except for abs), or if the function takes
+// a real element to a complex one.
+void ELEMENTARY(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 4) {
+    ThrowE(isolate,"Expected four arguments to ELEMENTARY function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  int op = args[1]->Int32Value(context).FromJust();
+  if ((op < ELEM_EXP) || (op > ELEM_ABS)) {
+    ThrowE(isolate,"Unknown elementary function");
+    return;
+  }
+  auto mr = Local<Function>::Cast(args[2]);
+  auto mc = Local<Function>::Cast(args[3]);
+  const ElementaryOp eop = static_cast<ElementaryOp>(op);
+  const bool complex = A.imag ? (eop != ELEM_ABS) :
+    ElementaryNeedsComplex(eop,A.real,A.elements);
+  double *re = NewResultArray<double>(isolate,A.elements);
+  double *im = complex ? NewResultArray<double>(isolate,A.elements) : nullptr;
+  Elementary(eop,A.elements,A.real,A.imag,re,im);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,complex ? mc : mr,A.dims,re,im));
+}
+
+// Four quadrant arctangent of Y/X.  Either may be a scalar.
+void ATAN2(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 3) {
+    ThrowE(isolate,"Expected three arguments to ATAN2 function");
+    return;
+  }
+  NDArray Y, X;
+  if (!ObjectToNDArray(Y,isolate,*(args[0]))) return;
+  if (!ObjectToNDArray(X,isolate,*(args[1]))) return;
+  if (Y.imag || X.imag) {
+    ThrowE(isolate,"Arguments to atan2 must be real");
+    return;
+  }
+  const bool x_scalar = (X.elements == 1);
+  if (!x_scalar && (Y.elements != 1) && (Y.dims != X.dims)) {
+    ThrowE(isolate,"Arguments to atan2 must be the same size, or one must be a scalar");
+    return;
+  }
+  auto mr = Local<Function>::Cast(args[2]);
+  const std::vector<size_t> &dims = x_scalar ? Y.dims : X.dims;
+  const size_t count = x_scalar ? Y.elements : X.elements;
+  double *re = NewResultArray<double>(isolate,count);
+  Atan2(count,Y.real,Y.elements,X.real,X.elements,re);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,mr,dims,re,nullptr));
+}
+
+// Sort along dimension dim (zero based).  Returns [B] or, if index is set,
+// [B, I] with the one based positions I of the sorted elements.
+void SORT(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 6) {
+    ThrowE(isolate,"Expected six arguments to SORT function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  double dim = args[1]->NumberValue(context).FromJust();
+  if (!(dim >= 0) || (dim != floor(dim)) || (dim >= MAPPED_MAX_DIMS)) {
+    ThrowE(isolate,"Sort dimension is out of range");
+    return;
+  }
+  bool descending = args[2]->BooleanValue(context).FromJust();
+  bool want_index = args[3]->BooleanValue(context).FromJust();
+  auto mr = Local<Function>::Cast(args[4]);
+  auto mc = Local<Function>::Cast(args[5]);
+  std::vector<size_t> dims(A.dims);
+  if (dims.size() <= dim) dims.resize(dim+1,1);
+  double *re = NewResultArray<double>(isolate,A.elements);
+  double *im = A.imag ? NewResultArray<double>(isolate,A.elements) : nullptr;
+  double *index = want_index ? NewResultArray<double>(isolate,A.elements) : nullptr;
+  SortDimension(dims,dim,descending,A.real,A.imag,re,im,index);
+  auto B = ConstructNDArray(isolate,A.imag ? mc : mr,A.dims,re,im);
+  if (!want_index) {
+    args.GetReturnValue().Set(MakeOutputList(isolate,{B}));
+    return;
+  }
+  args.GetReturnValue().Set(MakeOutputList(isolate,{B,ConstructNDArray(isolate,mr,A.dims,index,nullptr)}));
+}
+
+// Returns [C, ia, ic], all columns, with C the sorted distinct values of A,
+// C = A(ia) and A(:) = C(ic).
+void UNIQUE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 3) {
+    ThrowE(isolate,"Expected three arguments to UNIQUE function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  auto mr = Local<Function>::Cast(args[1]);
+  auto mc = Local<Function>::Cast(args[2]);
+  std::vector<double> c_re, c_im, ia;
+  double *ic = NewResultArray<double>(isolate,A.elements);
+  Unique(A.elements,A.real,A.imag,c_re,c_im,ia,ic);
+  const size_t count = c_re.size();
+  double *re = NewResultArray<double>(isolate,count);
+  std::copy(c_re.begin(),c_re.end(),re);
+  double *im = nullptr;
+  if (A.imag) {
+    im = NewResultArray<double>(isolate,count);
+    std::copy(c_im.begin(),c_im.end(),im);
+  }
+  double *first = NewResultArray<double>(isolate,count);
+  std::copy(ia.begin(),ia.end(),first);
+  args.GetReturnValue().Set(MakeOutputList(isolate,{
+        ConstructNDArray(isolate,A.imag ? mc : mr,{count,1},re,im),
+        ConstructNDArray(isolate,mr,{count,1},first,nullptr),
+        ConstructNDArray(isolate,mr,{A.elements,1},ic,nullptr)}));
+}
+
+// The one based linear indices of the nonzero elements of A, as a column.
+// A non-negative limit returns at most that many (the first ones).
+void FIND(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 3) {
+    ThrowE(isolate,"Expected three arguments to FIND function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  double limit = args[1]->NumberValue(context).FromJust();
+  auto mr = Local<Function>::Cast(args[2]);
+  size_t count = CountNonzero(A.elements,A.real,A.imag);
+  if ((limit >= 0) && (limit < count)) count = static_cast<size_t>(limit);
+  double *index = NewResultArray<double>(isolate,count);
+  FindNonzero(A.elements,A.real,A.imag,count,index);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,mr,{count,1},index,nullptr));
+}
+
+// Random numbers with distribution dist, drawn from the stream with the
+// given seed starting at block offset.  The caller keeps track of the
+// position in the stream (see RandomBlocks).
+void RANDOM(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 7) {
+    ThrowE(isolate,"Expected seven arguments to RANDOM function");
+    return;
+  }
+  if (!args[0]->IsArray()) {
+    ThrowE(isolate,"Expected an array of dimensions");
+    return;
+  }
+  auto jsdims = Local<Array>::Cast(args[0]);
+  if (jsdims->Length() > MAPPED_MAX_DIMS) {
+    ThrowE(isolate,"Too many dimensions");
+    return;
+  }
+  std::vector<size_t> dims;
+  size_t n = 1;
+  for (uint32_t i=0;i<jsdims->Length();i++) {
+    double d = jsdims->Get(context,i).ToLocalChecked()->NumberValue(context).FromJust();
+    if (!(d >= 0) || (d != floor(d)) || (d > 9007199254740992.0)) {
+      ThrowE(isolate,"Dimensions must be non-negative integers");
+      return;
+    }
+    dims.push_back(static_cast<size_t>(d));
+    n *= dims.back();
+  }
+  int dist = args[1]->Int32Value(context).FromJust();
+  double seed = args[2]->NumberValue(context).FromJust();
+  double offset = args[3]->NumberValue(context).FromJust();
+  double lo = args[4]->NumberValue(context).FromJust();
+  double hi = args[5]->NumberValue(context).FromJust();
+  auto mr = Local<Function>::Cast(args[6]);
+  if ((dist < RAND_UNIFORM) || (dist > RAND_INTEGER)) {
+    ThrowE(isolate,"Unknown random distribution");
+    return;
+  }
+  if (!(seed >= 0) || (seed != floor(seed)) || (seed >= 9007199254740992.0) ||
+      !(offset >= 0) || (offset != floor(offset)) || (offset >= 9007199254740992.0)) {
+    ThrowE(isolate,"Seed and offset must be non-negative integers below 2^53");
+    return;
+  }
+  if ((dist == RAND_INTEGER) && (!(lo <= hi) || (lo != floor(lo)) || (hi != floor(hi)) ||
+                                 !(hi - lo < 9007199254740992.0))) {
+    ThrowE(isolate,"Integer range must have integer limits less than 2^53 apart");
+    return;
+  }
+  double *out = NewResultArray<double>(isolate,n);
+  RandomFill(static_cast<RandomDist>(dist),static_cast<uint64_t>(seed),
+             static_cast<uint64_t>(offset),n,lo,hi,out);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,mr,dims,out,nullptr));
+}
+
+// Evaluate a postfix program of elementwise operations (see fuse.hpp) over
+// its leaves, which are numbers or real arrays.  The arrays that are not
+// scalars must all have the same size, which the result takes.
+void FUSE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 3) {
+    ThrowE(isolate,"Expected three arguments to FUSE function");
+    return;
+  }
+  if (!args[0]->IsArray() || !args[1]->IsArray()) {
+    ThrowE(isolate,"Expected arrays of operations and leaves");
+    return;
+  }
+  auto jsops = Local<Array>::Cast(args[0]);
+  auto jsleaves = Local<Array>::Cast(args[1]);
+  auto mr = Local<Function>::Cast(args[2]);
+  std::vector<int> ops(jsops->Length());
+  for (uint32_t i=0;i<jsops->Length();i++)
+    ops[i] = jsops->Get(context,i).ToLocalChecked()->Int32Value(context).FromJust();
+  size_t depth;
+  std::string error;
+  if (!CheckFuseProgram(ops,jsleaves->Length(),depth,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  std::vector<NDArray> arrays(jsleaves->Length());
+  std::vector<FuseOperand> leaves(jsleaves->Length());
+  std::vector<size_t> dims = {1, 1};
+  size_t n = 1;
+  bool sized = false;
+  for (uint32_t i=0;i<jsleaves->Length();i++) {
+    auto leaf = jsleaves->Get(context,i).ToLocalChecked();
+    if (leaf->IsNumber()) {
+      leaves[i] = FuseOperand{nullptr,leaf->NumberValue(context).FromJust()};
+      continue;
+    }
+    NDArray &A = arrays[i];
+    if (!ObjectToNDArray(A,isolate,*leaf)) return;
+    if (A.imag) {
+      ThrowE(isolate,"Fused expressions must be real");
+      return;
+    }
+    if (A.elements == 1) {
+      leaves[i] = FuseOperand{nullptr,A.real[0]};
+      continue;
+    }
+    if (!sized) {
+      dims = A.dims;
+      n = A.elements;
+      sized = true;
+    } else if (A.elements != n) {
+      ThrowE(isolate,"Fused expression operands must have the same size");
+      return;
+    }
+    leaves[i] = FuseOperand{A.real,0.0};
+  }
+  double *out = NewResultArray<double>(isolate,n);
+  EvaluateFused(ops,leaves,depth,n,out);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,mr,dims,out,nullptr));
+}
+
+// B = permute(A, order) with output dimension k shifted circularly by
+// shift[k] (order is zero based, and may be longer than the dimensions of
+// A).  Trailing singleton dimensions of B are dropped, down to two.
+void PERMUTE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 5) {
+    ThrowE(isolate,"Expected five arguments to PERMUTE function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  if (!args[1]->IsArray() || !args[2]->IsArray()) {
+    ThrowE(isolate,"Expected arrays for the order and shift");
+    return;
+  }
+  auto jsorder = Local<Array>::Cast(args[1]);
+  auto jsshift = Local<Array>::Cast(args[2]);
+  auto mr = Local<Function>::Cast(args[3]);
+  auto mc = Local<Function>::Cast(args[4]);
+  const size_t count = jsorder->Length();
+  if ((count < A.dims.size()) || (count > MAPPED_MAX_DIMS) || (jsshift->Length() > count)) {
+    ThrowE(isolate,"Permutation does not match the dimensions of the array");
+    return;
+  }
+  std::vector<size_t> order(count);
+  std::vector<bool> used(count,false);
+  for (size_t k=0;k<count;k++) {
+    double d = jsorder->Get(context,k).ToLocalChecked()->NumberValue(context).FromJust();
+    if (!(d >= 0) || (d >= count) || (d != floor(d)) || used[size_t(d)]) {
+      ThrowE(isolate,"Order is not a permutation of the dimensions");
+      return;
+    }
+    order[k] = size_t(d);
+    used[order[k]] = true;
+  }
+  std::vector<double> shift(jsshift->Length());
+  for (size_t k=0;k<shift.size();k++) {
+    shift[k] = jsshift->Get(context,k).ToLocalChecked()->NumberValue(context).FromJust();
+    if (!std::isfinite(shift[k]) || (shift[k] != floor(shift[k]))) {
+      ThrowE(isolate,"Shifts must be integers");
+      return;
+    }
+  }
+  std::vector<size_t> dims(count);
+  for (size_t k=0;k<count;k++)
+    dims[k] = (order[k] < A.dims.size()) ? A.dims[order[k]] : 1;
+  while ((dims.size() > 2) && (dims.back() == 1)) dims.pop_back();
+  while (dims.size() < 2) dims.push_back(1);
+  auto plan = PlanPermute(A.dims,order,shift);
+  double *re = NewResultArray<double>(isolate,A.elements);
+  ApplyPermute(plan,A.real,re);
+  double *im = nullptr;
+  if (A.imag) {
+    im = NewResultArray<double>(isolate,A.elements);
+    ApplyPermute(plan,A.imag,im);
+  }
+  args.GetReturnValue().Set(ConstructNDArray(isolate,A.imag ? mc : mr,dims,re,im));
+}
+
+// Elementwise A op B (a BinaryOp), with singleton dimensions of either
+// operand expanded to match the other.  Comparisons are logical, made
+// with mr as for TYPEDBINARY (with a uint8 array and the class);
+// arithmetic is complex (made with mc) if either operand is.
+void BINARY(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 5) {
+    ThrowE(isolate,"Expected five arguments to BINARY function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  NDArray B;
+  if (!ObjectToNDArray(B,isolate,*(args[1]))) return;
+  int op = args[2]->Int32Value(context).FromJust();
+  if ((op < BINARY_PLUS) || (op > BINARY_NE)) {
+    ThrowE(isolate,"Unknown binary operation");
+    return;
+  }
+  auto mr = Local<Function>::Cast(args[3]);
+  auto mc = Local<Function>::Cast(args[4]);
+  std::vector<size_t> dims;
+  BroadcastPlan plan;
+  std::string error;
+  if (!PlanBroadcast(A.dims,B.dims,dims,plan,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  if (IsComparison(op)) {
+    // Logical results are held in one byte per element, as TYPEDBINARY
+    // gives them
+    std::vector<double> flags(plan.elements);
+    ApplyBroadcast(plan,op,A.real,A.imag,B.real,B.imag,flags.data(),nullptr);
+    void *y = NewResultArray<char>(isolate,plan.elements);
+    ConvertFromDouble(flags.data(),CLASS_LOGICAL,y,plan.elements);
+    args.GetReturnValue().Set(ConstructTypedNDArray(isolate,mr,dims,y,nullptr,CLASS_LOGICAL));
+    return;
+  }
+  const bool complex = A.imag || B.imag;
+  double *re = NewResultArray<double>(isolate,plan.elements);
+  double *im = complex ? NewResultArray<double>(isolate,plan.elements) : nullptr;
+  ApplyBroadcast(plan,op,A.real,A.imag,B.real,B.imag,re,im);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,complex ? mc : mr,dims,re,im));
+}
+
+// An operand of TYPEDBINARY: its class (the mytype of the array) and
+// data, which is read in place if it is stored in the class the kernels
+// work in, and widened to double otherwise
+struct TypedOperand {
+  std::vector<size_t> dims;
+  size_t elements;
+  int cls;
+  Local<Value> real;
+  const void *data;
+  bool widened;
+  std::vector<double> copy;
+};
+
+bool ReadTypedOperand(TypedOperand &arr, Isolate *isolate, Value *arg) {
+  auto context = isolate->GetCurrentContext();
+  auto obj = arg->ToObject(context).ToLocalChecked();
+  auto dims = GetDoubleArray(isolate,obj,"dims");
+  arr.dims.assign(dims.begin(),dims.end());
+  arr.elements = 1;
+  for (auto d : arr.dims) arr.elements *= d;
+  auto mytype = obj->Get(context,String::NewFromUtf8(isolate,"mytype")).ToLocalChecked();
+  arr.cls = mytype->IsNumber() ? mytype->Int32Value(context).FromJust() : int(CLASS_DOUBLE);
+  if (!IsStorageClass(arr.cls)) {
+    ThrowE(isolate,"Unknown array class");
+    return false;
+  }
+  auto imag = obj->Get(context,String::NewFromUtf8(isolate,"imag")).ToLocalChecked();
+  if (!imag->IsUndefined()) {
+    ThrowE(isolate,"Integer and logical operations do not take complex operands");
+    return false;
+  }
+  arr.real = obj->Get(context,String::NewFromUtf8(isolate,"real")).ToLocalChecked();
+  return true;
+}
+
+// Points arr.data at its elements as class cls if they are stored that
+// way, or at a double copy
+bool PrepareTypedOperand(TypedOperand &arr, Isolate *isolate, int cls) {
+  if (TypedArrayClass(arr.real) == StorageOf(cls)) {
+    if (Local<TypedArray>::Cast(arr.real)->Length() < arr.elements) {
+      ThrowE(isolate,"Array data is shorter than its dimensions");
+      return false;
+    }
+    arr.data = TypedArrayData(isolate,arr.real);
+    arr.widened = (StorageOf(cls) == CLASS_DOUBLE);
+    return true;
+  }
+  const double *p;
+  if (!ReadNumericData(isolate,arr.real,arr.elements,p,arr.copy)) return false;
+  arr.data = p;
+  arr.widened = true;
+  return true;
+}
+
+// Elementwise A op B (a BinaryOp) for integer classes, and comparisons of
+// real arrays of any class, with singleton dimensions expanded as for
+// BINARY.  Arithmetic gives the integer class of the operands, rounded and
+// saturated, and comparisons give logical arrays of one byte per element.
+// make is called with the dimensions, data, undefined and the class.
+void TYPEDBINARY(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 4) {
+    ThrowE(isolate,"Expected four arguments to TYPEDBINARY function");
+    return;
+  }
+  TypedOperand A;
+  if (!ReadTypedOperand(A,isolate,*(args[0]))) return;
+  TypedOperand B;
+  if (!ReadTypedOperand(B,isolate,*(args[1]))) return;
+  int op = args[2]->Int32Value(context).FromJust();
+  if ((op < BINARY_PLUS) || (op > BINARY_NE)) {
+    ThrowE(isolate,"Unknown binary operation");
+    return;
+  }
+  auto make = Local<Function>::Cast(args[3]);
+  // The class the kernels work in
+  int cls;
+  if (IsComparison(op)) {
+    // Integers and logicals are read in place against their own class or
+    // floating point operands, and other mixtures are compared as doubles
+    const bool ia = IsIntegerClass(A.cls) || (A.cls == CLASS_LOGICAL);
+    const bool ib = IsIntegerClass(B.cls) || (B.cls == CLASS_LOGICAL);
+    if ((A.cls == B.cls) && ia)
+      cls = A.cls;
+    else if (ia && !ib)
+      cls = A.cls;
+    else if (ib && !ia)
+      cls = B.cls;
+    else
+      cls = CLASS_DOUBLE;
+  } else {
+    if (IsIntegerClass(A.cls) && IsIntegerClass(B.cls) && (A.cls != B.cls)) {
+      ThrowE(isolate,"Integers can only be combined with integers of the same class, or with doubles");
+      return;
+    }
+    if (!IsIntegerClass(A.cls) && !IsIntegerClass(B.cls)) {
+      ThrowE(isolate,"Expected an integer operand");
+      return;
+    }
+    cls = IsIntegerClass(A.cls) ? A.cls : B.cls;
+  }
+  std::vector<size_t> dims;
+  BroadcastPlan plan;
+  std::string error;
+  if (!PlanBroadcast(A.dims,B.dims,dims,plan,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  if (!PrepareTypedOperand(A,isolate,cls)) return;
+  if (!PrepareTypedOperand(B,isolate,cls)) return;
+  const int out = IsComparison(op) ? int(CLASS_LOGICAL) : cls;
+  void *y = NewResultArray<char>(isolate,plan.elements*ClassBytes(out));
+  ApplyTypedBroadcast(plan,op,cls,A.data,A.widened,B.data,B.widened,y);
+  args.GetReturnValue().Set(ConstructTypedNDArray(isolate,make,dims,y,nullptr,out));
+}
+
+// A converted to class cls: integers are rounded and saturated, and
+// logicals are nonzero (NaN and complex values cannot be logical).  make
+// is called with the dimensions, the real and imaginary data (or
+// undefined) and the class.
+void CONVERT(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 3) {
+    ThrowE(isolate,"Expected three arguments to CONVERT function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  int cls = args[1]->Int32Value(context).FromJust();
+  if (!IsStorageClass(cls)) {
+    ThrowE(isolate,"Unknown array class");
+    return;
+  }
+  auto make = Local<Function>::Cast(args[2]);
+  if (cls == CLASS_LOGICAL) {
+    if (A.imag) {
+      ThrowE(isolate,"Complex values cannot be converted to logicals");
+      return;
+    }
+    if (AnyNaN(A.real,A.elements)) {
+      ThrowE(isolate,"NaN's cannot be converted to logicals");
+      return;
+    }
+  }
+  if (A.imag && IsIntegerClass(cls)) {
+    ThrowE(isolate,"Complex values cannot be converted to integer classes");
+    return;
+  }
+  const size_t bytes = A.elements*ClassBytes(cls);
+  void *re = NewResultArray<char>(isolate,bytes);
+  ConvertFromDouble(A.real,cls,re,A.elements);
+  void *im = nullptr;
+  if (A.imag) {
+    im = NewResultArray<char>(isolate,bytes);
+    ConvertFromDouble(A.imag,cls,im,A.elements);
+  }
+  args.GetReturnValue().Set(ConstructTypedNDArray(isolate,make,A.dims,re,im,cls));
+}
+
+// The cumulative op (a ScanOp) along dimension dim (zero based)
+void SCAN(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 5) {
+    ThrowE(isolate,"Expected five arguments to SCAN function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  double dim = args[1]->NumberValue(context).FromJust();
+  if (!(dim >= 0) || (dim != floor(dim)) || (dim >= MAPPED_MAX_DIMS)) {
+    ThrowE(isolate,"Scan dimension is out of range");
+    return;
+  }
+  int op = args[2]->Int32Value(context).FromJust();
+  if ((op < SCAN_SUM) || (op > SCAN_MIN)) {
+    ThrowE(isolate,"Unknown cumulative operation");
+    return;
+  }
+  auto mr = Local<Function>::Cast(args[3]);
+  auto mc = Local<Function>::Cast(args[4]);
+  std::vector<size_t> dims(A.dims);
+  if (dims.size() <= dim) dims.resize(dim+1,1);
+  double *re = NewResultArray<double>(isolate,A.elements);
+  double *im = A.imag ? NewResultArray<double>(isolate,A.elements) : nullptr;
+  ScanDimension(dims,dim,ScanOp(op),A.real,A.imag,re,im);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,A.imag ? mc : mr,A.dims,re,im));
+}
+
+// The order'th difference along dimension dim (zero based)
+void DIFF(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 5) {
+    ThrowE(isolate,"Expected five arguments to DIFF function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  double order = args[1]->NumberValue(context).FromJust();
+  double dim = args[2]->NumberValue(context).FromJust();
+  if (!(order >= 0) || (order != floor(order))) {
+    ThrowE(isolate,"Difference order must be a non-negative integer");
+    return;
+  }
+  if (!(dim >= 0) || (dim != floor(dim)) || (dim >= MAPPED_MAX_DIMS)) {
+    ThrowE(isolate,"Difference dimension is out of range");
+    return;
+  }
+  auto mr = Local<Function>::Cast(args[3]);
+  auto mc = Local<Function>::Cast(args[4]);
+  std::vector<size_t> dims(A.dims);
+  if (dims.size() <= dim) dims.resize(dim+1,1);
+  std::vector<size_t> out_dims(dims);
+  out_dims[dim] = (dims[dim] > order) ? dims[dim] - size_t(order) : 0;
+  size_t elements = 1;
+  for (auto d : out_dims) elements *= d;
+  double *re = NewResultArray<double>(isolate,elements);
+  double *im = A.imag ? NewResultArray<double>(isolate,elements) : nullptr;
+  DiffDimension(dims,dim,size_t(order),A.real,A.imag,re,im);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,A.imag ? mc : mr,out_dims,re,im));
+}
+
+// The display text of an array (see format.hpp)
+void FORMAT(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 6) {
+    ThrowE(isolate,"Expected six arguments to FORMAT function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  double limits[3];
+  for (int i=0;i<3;i++) {
+    limits[i] = args[i+1]->NumberValue(context).FromJust();
+    if (!(limits[i] >= 0) || (limits[i] != floor(limits[i]))) {
+      ThrowE(isolate,"Display limits must be non-negative integers");
+      return;
+    }
+  }
+  FormatOptions opts;
+  opts.page_width = size_t(limits[0]);
+  opts.max_rows = size_t(limits[1]);
+  opts.max_cols = size_t(limits[2]);
+  opts.long_format = args[4]->BooleanValue(context).FromJust();
+  opts.single = args[5]->BooleanValue(context).FromJust();
+  const std::string text = FormatArray(A.dims,A.real,A.imag,opts);
+  Local<String> ret;
+  if ((text.size() > size_t(String::kMaxLength)) ||
+      !String::NewFromOneByte(isolate,reinterpret_cast<const uint8_t*>(text.data()),
+                              NewStringType::kNormal,int(text.size())).ToLocal(&ret)) {
+    ThrowE(isolate,"Array is too large to display (limit the rows or columns shown)");
+    return;
+  }
+  args.GetReturnValue().Set(ret);
+}
+
+// Sparse matrices cross as objects with dims ([rows, cols]), colptr and
+// rowind (Int32Arrays) and real (a Float64Array), as described in
+// sparse.hpp.  The views point into the typed arrays, so must not outlive
+// the call.
+static bool IsSparseObject(Isolate *isolate, Local<Value> val) {
+  auto context = isolate->GetCurrentContext();
+  if (!val->IsObject()) return false;
+  auto obj = val->ToObject(context).ToLocalChecked();
+  return obj->Get(context,String::NewFromUtf8(isolate,"colptr")).ToLocalChecked()->IsInt32Array();
+}
+
+static bool ObjectToSparse(SparseView &S, Isolate *isolate, Local<Value> val) {
+  auto context = isolate->GetCurrentContext();
+  auto obj = val->ToObject(context).ToLocalChecked();
+  auto dims = GetDoubleArray(isolate,obj,"dims");
+  auto colptr = obj->Get(context,String::NewFromUtf8(isolate,"colptr")).ToLocalChecked();
+  auto rowind = obj->Get(context,String::NewFromUtf8(isolate,"rowind")).ToLocalChecked();
+  auto real = obj->Get(context,String::NewFromUtf8(isolate,"real")).ToLocalChecked();
+  if ((dims.size() != 2) || !colptr->IsInt32Array() || !rowind->IsInt32Array() ||
+      !real->IsFloat64Array()) {
+    ThrowE(isolate,"Expected a sparse matrix");
+    return false;
+  }
+  for (auto d : dims)
+    if (!(d >= 0) || (d != std::floor(d)) || (d > INT32_MAX)) {
+      ThrowE(isolate,"Sparse dimensions must be non-negative integers");
+      return false;
+    }
+  S.rows = size_t(dims[0]);
+  S.cols = size_t(dims[1]);
+  if (Local<TypedArray>::Cast(colptr)->Length() != S.cols+1) {
+    ThrowE(isolate,"Sparse column pointers do not match the dimensions");
+    return false;
+  }
+  S.colptr = reinterpret_cast<const int32_t*>(TypedArrayData(isolate,colptr));
+  if ((S.colptr[S.cols] < 0) ||
+      (Local<TypedArray>::Cast(rowind)->Length() < S.nnz()) ||
+      (Local<TypedArray>::Cast(real)->Length() < S.nnz())) {
+    ThrowE(isolate,"Sparse data is shorter than its column pointers");
+    return false;
+  }
+  S.rowind = reinterpret_cast<const int32_t*>(TypedArrayData(isolate,rowind));
+  S.values = reinterpret_cast<const double*>(TypedArrayData(isolate,real));
+  std::string error;
+  if (!CheckSparse(S,error)) {
+    ThrowE(isolate,error.c_str());
+    return false;
+  }
+  return true;
+}
+
+template <class T>
+static T* SparseResultArray(Isolate *isolate, const std::vector<T> &data) {
+  T *out = NewResultArray<T>(isolate,data.size());
+  std::copy(data.begin(),data.end(),out);
+  return out;
+}
+
+// Call a sparse maker (dims, colptr, rowind, real) with a copy of S
+static Local<Value> ConstructSparse(Isolate *isolate, Local<Function> cb, const SparseMatrix &S) {
+  Local<Value> argv[4] = {MakeDimsArray(isolate,std::vector<size_t>{S.rows,S.cols}),
+                          CArrayToTypedArray(SparseResultArray(isolate,S.colptr),
+                                             S.colptr.size(),isolate),
+                          CArrayToTypedArray(SparseResultArray(isolate,S.rowind),
+                                             S.rowind.size(),isolate),
+                          CArrayToTypedArray(SparseResultArray(isolate,S.values),
+                                             S.values.size(),isolate)};
+  auto context = isolate->GetCurrentContext();
+  return cb->Call(context,context->Global(),4,argv).ToLocalChecked();
+}
+
+// A rows x cols sparse matrix from one based triplets (i, j, v), all of the
+// same length.  Duplicates are summed.
+void SPARSE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 6) {
+    ThrowE(isolate,"Expected six arguments to SPARSE function");
+    return;
+  }
+  NDArray I, J, V;
+  if (!ObjectToNDArray(I,isolate,*(args[0]))) return;
+  if (!ObjectToNDArray(J,isolate,*(args[1]))) return;
+  if (!ObjectToNDArray(V,isolate,*(args[2]))) return;
+  if ((I.elements != J.elements) || (I.elements != V.elements)) {
+    ThrowE(isolate,"Sparse indices and values must have the same length");
+    return;
+  }
+  if (V.imag) {
+    ThrowE(isolate,"Sparse matrices must be real");
+    return;
+  }
+  double rows = args[3]->NumberValue(context).FromJust();
+  double cols = args[4]->NumberValue(context).FromJust();
+  if (!(rows >= 0) || !(cols >= 0) || (rows != floor(rows)) || (cols != floor(cols))) {
+    ThrowE(isolate,"Sparse dimensions must be non-negative integers");
+    return;
+  }
+  auto ms = Local<Function>::Cast(args[5]);
+  SparseMatrix S;
+  std::string error;
+  if (!SparseFromTriplets(size_t(rows),size_t(cols),I.elements,I.real,J.real,V.real,S,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  args.GetReturnValue().Set(ConstructSparse(isolate,ms,S));
+}
+
+// The nonzeros of a real matrix, as a sparse matrix
+void SPDENSE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 2) {
+    ThrowE(isolate,"Expected two arguments to SPDENSE function");
+    return;
+  }
+  NDArray A;
+  if (!ObjectToNDArray(A,isolate,*(args[0]))) return;
+  if ((A.dims.size() > 2) || A.imag) {
+    ThrowE(isolate,"Sparse matrices must be real and two dimensional");
+    return;
+  }
+  A.dims.resize(2,1);
+  auto ms = Local<Function>::Cast(args[1]);
+  SparseMatrix S;
+  std::string error;
+  if (!SparseFromDense(A.dims[0],A.dims[1],A.real,S,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  args.GetReturnValue().Set(ConstructSparse(isolate,ms,S));
+}
+
+// The full form of a sparse matrix
+void SPFULL(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 2) {
+    ThrowE(isolate,"Expected two arguments to SPFULL function");
+    return;
+  }
+  SparseView S;
+  if (!ObjectToSparse(S,isolate,args[0])) return;
+  auto mr = Local<Function>::Cast(args[1]);
+  std::vector<size_t> dims{S.rows,S.cols};
+  double *re = NewResultArray<double>(isolate,S.rows*S.cols);
+  std::fill(re,re+S.rows*S.cols,0.0);
+  SparseToDense(S,re);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,mr,dims,re,nullptr));
+}
+
+void SPTRANSPOSE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 2) {
+    ThrowE(isolate,"Expected two arguments to SPTRANSPOSE function");
+    return;
+  }
+  SparseView S;
+  if (!ObjectToSparse(S,isolate,args[0])) return;
+  auto ms = Local<Function>::Cast(args[1]);
+  SparseMatrix T;
+  SparseTranspose(S,T);
+  args.GetReturnValue().Set(ConstructSparse(isolate,ms,T));
+}
+
+// A*B where either or both are sparse (and the dense one real).  The
+// product is sparse (made with ms) if both are, and dense (made with mr)
+// otherwise.
+void SPMTIMES(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 4) {
+    ThrowE(isolate,"Expected four arguments to SPMTIMES function");
+    return;
+  }
+  auto mr = Local<Function>::Cast(args[2]);
+  auto ms = Local<Function>::Cast(args[3]);
+  const bool asparse = IsSparseObject(isolate,args[0]);
+  const bool bsparse = IsSparseObject(isolate,args[1]);
+  SparseView A, B;
+  NDArray D;
+  if (asparse && !ObjectToSparse(A,isolate,args[0])) return;
+  if (bsparse && !ObjectToSparse(B,isolate,args[1])) return;
+  if (!asparse || !bsparse) {
+    if (!ObjectToNDArray(D,isolate,*(args[asparse ? 1 : 0]))) return;
+    if ((D.dims.size() > 2) || D.imag) {
+      ThrowE(isolate,"Expected a real matrix in SPMTIMES");
+      return;
+    }
+    D.dims.resize(2,1);
+  }
+  const size_t arows = asparse ? A.rows : D.dims[0];
+  const size_t acols = asparse ? A.cols : D.dims[1];
+  const size_t brows = bsparse ? B.rows : D.dims[0];
+  const size_t bcols = bsparse ? B.cols : D.dims[1];
+  if (acols != brows) {
+    ThrowE(isolate,"Columns and rows must match in matrix multiplication");
+    return;
+  }
+  if (asparse && bsparse) {
+    SparseMatrix C;
+    std::string error;
+    if (!SparseTimesSparse(A,B,C,error)) {
+      ThrowE(isolate,error.c_str());
+      return;
+    }
+    args.GetReturnValue().Set(ConstructSparse(isolate,ms,C));
+    return;
+  }
+  std::vector<size_t> dims{arows,bcols};
+  double *re = NewResultArray<double>(isolate,arows*bcols);
+  if (asparse)
+    SparseTimesDense(A,D.real,bcols,re);
+  else
+    DenseTimesSparse(D.real,arows,B,re);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,mr,dims,re,nullptr));
+}
+
+// Solves A*X = B for a sparse A and a real dense B.  Arguments are (A, B,
+// logger, mr); a nearly singular A is reported through the logger.
+void SPSOLVE(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  if (args.Length() != 4) {
+    ThrowE(isolate,"Expected four arguments to SPSOLVE function");
+    return;
+  }
+  SparseView A;
+  if (!ObjectToSparse(A,isolate,args[0])) return;
+  NDArray B;
+  if (!ObjectToNDArray(B,isolate,*(args[1]))) return;
+  if ((B.dims.size() > 2) || B.imag) {
+    ThrowE(isolate,"Expected a real matrix in SPSOLVE");
+    return;
+  }
+  B.dims.resize(2,1);
+  if (A.rows != B.dims[0]) {
+    ThrowE(isolate,"Mismatch - matrices being solved are not conformant");
+    return;
+  }
+  std::function<void(std::string) > cback = [=](std::string msg) {
+    Local<Function> cb = Local<Function>::Cast(args[2]);
+    Local<Value> argv[1] = {String::NewFromUtf8(isolate,msg.c_str())};
+    cb->Call(Null(isolate),1,argv);
+  };
+  auto mr = Local<Function>::Cast(args[3]);
+  std::vector<size_t> dims{A.cols,B.dims[1]};
+  std::vector<double> X(A.cols*B.dims[1]);
+  std::string error;
+  if (!SparseSolve(A,B.real,B.dims[1],X.data(),cback,error)) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  double *re = SparseResultArray(isolate,X);
+  args.GetReturnValue().Set(ConstructNDArray(isolate,mr,dims,re,nullptr));
+}
+
+// Solves A*x = b iteratively by a KrylovMethod, where A is a real square
+// dense or sparse matrix.  Arguments are (method, A, b, x0, tol, maxit,
+// restart, precond, verbose, logger, mr); x0 may be empty for a zero
+// initial guess.  Returns [x, flag, relres, iter, resvec].  The logger gets
+// a warning if the method did not converge, and with verbose set, the
+// residual history, once the solve is done.
+void KRYLOV(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if (args.Length() != 11) {
+    ThrowE(isolate,"Expected eleven arguments to KRYLOV function");
+    return;
+  }
+  int method = args[0]->Int32Value(context).FromJust();
+  if ((method < KRYLOV_CG) || (method > KRYLOV_BICGSTAB)) {
+    ThrowE(isolate,"Unknown iterative method");
+    return;
+  }
+  const bool sparse = IsSparseObject(isolate,args[1]);
+  SparseView S;
+  NDArray D;
+  if (sparse && !ObjectToSparse(S,isolate,args[1])) return;
+  if (!sparse && !ObjectToNDArray(D,isolate,*(args[1]))) return;
+  if (!sparse && ((D.dims.size() > 2) || D.imag)) {
+    ThrowE(isolate,"Iterative solvers need a real matrix");
+    return;
+  }
+  D.dims.resize(2,1);
+  const size_t n = sparse ? S.rows : D.dims[0];
+  if ((sparse ? S.cols : D.dims[1]) != n) {
+    ThrowE(isolate,"Iterative solvers need a square matrix");
+    return;
+  }
+  NDArray B;
+  if (!ObjectToNDArray(B,isolate,*(args[2]))) return;
+  if (B.imag || (B.elements != n)) {
+    ThrowE(isolate,"Right hand side must be a real vector as long as the matrix");
+    return;
+  }
+  NDArray X0;
+  if (!ObjectToNDArray(X0,isolate,*(args[3]))) return;
+  if (X0.imag || ((X0.elements != 0) && (X0.elements != n))) {
+    ThrowE(isolate,"Initial guess must be a real vector as long as the matrix");
+    return;
+  }
+  KrylovOptions opts;
+  opts.tol = args[4]->NumberValue(context).FromJust();
+  double maxit = args[5]->NumberValue(context).FromJust();
+  double restart = args[6]->NumberValue(context).FromJust();
+  if (!(opts.tol > 0) || !(maxit >= 0) || !(restart >= 1)) {
+    ThrowE(isolate,"Tolerance and restart must be positive, and iterations non-negative");
+    return;
+  }
+  opts.maxit = size_t(maxit);
+  opts.restart = size_t(restart);
+  int precond = args[7]->Int32Value(context).FromJust();
+  bool verbose = args[8]->BooleanValue(context).FromJust();
+  auto logger = Local<Function>::Cast(args[9]);
+  auto mr = Local<Function>::Cast(args[10]);
+  LinearOperator A;
+  std::vector<double> diagonal(n);
+  if (sparse) {
+    A = [&](const double *x, double *y) {SparseTimesDense(S,x,1,y);};
+    for (size_t j=0;j<n;j++) {
+      const int32_t *b = S.rowind + S.colptr[j];
+      const int32_t *e = S.rowind + S.colptr[j+1];
+      const int32_t *p = std::lower_bound(b,e,int32_t(j));
+      diagonal[j] = ((p != e) && (*p == int32_t(j))) ? S.values[p - S.rowind] : 0.0;
+    }
+  } else {
+    const double *a = D.real;
+    A = [=](const double *x, double *y) {
+      FM_BACKEND(cblas_dgemv)(CblasColMajor,CblasNoTrans,int(n),int(n),1.0,a,int(n),
+                              x,1,0.0,y,1);
+    };
+    for (size_t j=0;j<n;j++) diagonal[j] = a[j*n+j];
+  }
+  PreconditionerOp M;
+  std::string error;
+  bool ok = true;
+  switch (precond) {
+  case PRECOND_NONE:
+    break;
+  case PRECOND_JACOBI:
+    ok = JacobiPreconditioner(diagonal,M,error);
+    break;
+  case PRECOND_ILU:
+    if (!sparse) {
+      ThrowE(isolate,"Incomplete LU preconditioning needs a sparse matrix");
+      return;
+    }
+    ok = ILUPreconditioner(S,M,error);
+    break;
+  default:
+    ThrowE(isolate,"Unknown preconditioner");
+    return;
+  }
+  if (!ok) {
+    ThrowE(isolate,error.c_str());
+    return;
+  }
+  double *x = NewResultArray<double>(isolate,n);
+  if (X0.elements)
+    std::copy(X0.real,X0.real+n,x);
+  else
+    std::fill(x,x+n,0.0);
+  KrylovResult res = KrylovSolve(KrylovMethod(method),n,A,M,B.real,x,opts);
+  auto log = [&](const std::string &msg) {
+    Local<Value> argv[1] = {String::NewFromUtf8(isolate,msg.c_str())};
+    logger->Call(context,context->Global(),1,argv).ToLocalChecked();
+  };
+  const char *name = KrylovName(KrylovMethod(method));
+  if (verbose)
+    for (size_t k=0;k<res.resvec.size();k++)
+      log(std::string(name) + " iteration " + std::to_string(k) + ": residual " +
+          std::to_string(res.resvec[k]));
+  if (res.flag == KRYLOV_MAXIT)
+    log(std::string(name) + " stopped at iteration " + std::to_string(res.iter) +
+        " without converging to the desired tolerance (relative residual " +
+        std::to_string(res.relres) + ")");
+  else if (res.flag == KRYLOV_BREAKDOWN)
+    log(std::string(name) + " stopped at iteration " + std::to_string(res.iter) +
+        " because a scalar quantity became too small or too large");
+  double *resvec = NewResultArray<double>(isolate,res.resvec.size());
+  std::copy(res.resvec.begin(),res.resvec.end(),resvec);
+  args.GetReturnValue().Set(MakeOutputList(isolate,{
+        ConstructNDArray(isolate,mr,std::vector<size_t>{n,1},x,nullptr),
+        Number::New(isolate,res.flag),
+        Number::New(isolate,res.relres),
+        Number::New(isolate,double(res.iter)),
+        ConstructNDArray(isolate,mr,std::vector<size_t>{res.resvec.size(),1},resvec,nullptr)}));
+}
+
+// Set the number of threads used to split batched kernels.  Returns the
+// previous setting.  With no argument, just returns the setting.
+void SETTHREADS(const FunctionCallbackInfo<Value> &args) {
+  auto isolate = args.GetIsolate();
+  HandleScope handleScope(isolate);
+  auto context = isolate->GetCurrentContext();
+  if ((args.Length() == 0) || args[0]->IsUndefined()) {
+    args.GetReturnValue().Set(Number::New(isolate,KernelThreads()));
+    return;
+  }
+  int threads = args[0]->Int32Value(context).FromJust();
+  if (threads < 1) {
+    ThrowE(isolate,"Thread count must be positive");
+    return;
+  }
+  args.GetReturnValue().Set(Number::New(isolate,SetKernelThreads(threads)));
+}
+
+// The addon is context aware, so that it can be loaded into worker threads
+// and vm contexts.  Init runs once per instance; anything it sets up for
+// the whole process (the kernel dispatch table, the BLAS backend) is
+// guarded so that only the first instance initializes it.  The native
+// routines themselves keep no state between calls.
+void Init(Local<Object> exports, Local<Value>, Local<Context> context) {
+  InitDispatch();
+  InitBackend();
+  InitTuning();
+  RegisterAddonData(context->GetIsolate());
+  NODE_SET_METHOD(exports, "DGEMM", DGEMM);
+  NODE_SET_METHOD(exports, "ZGEMM", ZGEMM);
+  NODE_SET_METHOD(exports, "DGEMMACC", DGEMMACC);
+  NODE_SET_METHOD(exports, "ZGEMMACC", ZGEMMACC);
+  NODE_SET_METHOD(exports, "DSOLVE", DSOLVE);
+  NODE_SET_METHOD(exports, "ZSOLVE", ZSOLVE);
+  NODE_SET_METHOD(exports, "DLU", DLU);
+  NODE_SET_METHOD(exports, "DINVERSE", DINVERSE);
+  NODE_SET_METHOD(exports, "ZINVERSE", ZINVERSE);
+  NODE_SET_METHOD(exports, "DMATFUN", DMATFUN);
+  NODE_SET_METHOD(exports, "ZMATFUN", ZMATFUN);
+  NODE_SET_METHOD(exports, "ZLU", ZLU);
+  NODE_SET_METHOD(exports, "DQR", DQR);
+  NODE_SET_METHOD(exports, "ZQR", ZQR);
+  NODE_SET_METHOD(exports, "DCHOL", DCHOL);
+  NODE_SET_METHOD(exports, "ZCHOL", ZCHOL);
+  NODE_SET_METHOD(exports, "DSVD", DSVD);
+  NODE_SET_METHOD(exports, "ZSVD", ZSVD);
+  NODE_SET_METHOD(exports, "DEIG", DEIG);
+  NODE_SET_METHOD(exports, "ZEIG", ZEIG);
+  NODE_SET_METHOD(exports, "DTRANSPOSE", DTRANSPOSE);
+  NODE_SET_METHOD(exports, "ZTRANSPOSE", ZTRANSPOSE);
+  NODE_SET_METHOD(exports, "ZHERMITIAN", ZHERMITIAN);
+  NODE_SET_METHOD(exports, "SETISA", SETISA);
+  NODE_SET_METHOD(exports, "GETISA", GETISA);
+  NODE_SET_METHOD(exports, "GETTUNING", GETTUNING);
+  NODE_SET_METHOD(exports, "TUNE", TUNE);
+  NODE_SET_METHOD(exports, "SETTUNING", SETTUNING);
+  NODE_SET_METHOD(exports, "LOADTUNING", LOADTUNING);
+  NODE_SET_METHOD(exports, "SETSHARED", SETSHARED);
+  NODE_SET_METHOD(exports, "SETBLAS", SETBLAS);
+  NODE_SET_METHOD(exports, "BLASINFO", BLASINFO);
+  NODE_SET_METHOD(exports, "SETBLASTHREADS", SETBLASTHREADS);
+  NODE_SET_METHOD(exports, "POOLSTATS", POOLSTATS);
+  NODE_SET_METHOD(exports, "POOLTRIM", POOLTRIM);
+  NODE_SET_METHOD(exports, "SETPOOLLIMIT", SETPOOLLIMIT);
+  NODE_SET_METHOD(exports, "MAPOPEN", MAPOPEN);
+  NODE_SET_METHOD(exports, "MAPSAVE", MAPSAVE);
+  NODE_SET_METHOD(exports, "OOCGEMM", OOCGEMM);
+  NODE_SET_METHOD(exports, "OOCTRANSPOSE", OOCTRANSPOSE);
+  NODE_SET_METHOD(exports, "FFT", FFT);
+  NODE_SET_METHOD(exports, "FFTCACHE", FFTCACHE);
+  NODE_SET_METHOD(exports, "CONV", CONV);
+  NODE_SET_METHOD(exports, "CONV2", CONV2);
+  NODE_SET_METHOD(exports, "FILTER", FILTER);
+  NODE_SET_METHOD(exports, "ELEMENTARY", ELEMENTARY);
+  NODE_SET_METHOD(exports, "ATAN2", ATAN2);
+  NODE_SET_METHOD(exports, "SORT", SORT);
+  NODE_SET_METHOD(exports, "UNIQUE", UNIQUE);
+  NODE_SET_METHOD(exports, "FIND", FIND);
+  NODE_SET_METHOD(exports, "RANDOM", RANDOM);
+  NODE_SET_METHOD(exports, "FUSE", FUSE);
+  NODE_SET_METHOD(exports, "PERMUTE", PERMUTE);
+  NODE_SET_METHOD(exports, "BINARY", BINARY);
+  NODE_SET_METHOD(exports, "TYPEDBINARY", TYPEDBINARY);
+  NODE_SET_METHOD(exports, "CONVERT", CONVERT);
+  NODE_SET_METHOD(exports, "SCAN", SCAN);
+  NODE_SET_METHOD(exports, "DIFF", DIFF);
+  NODE_SET_METHOD(exports, "FORMAT", FORMAT);
+  NODE_SET_METHOD(exports, "SPARSE", SPARSE);
+  NODE_SET_METHOD(exports, "SPDENSE", SPDENSE);
+  NODE_SET_METHOD(exports, "SPFULL", SPFULL);
+  NODE_SET_METHOD(exports, "SPTRANSPOSE", SPTRANSPOSE);
+  NODE_SET_METHOD(exports, "SPMTIMES", SPMTIMES);
+  NODE_SET_METHOD(exports, "SPSOLVE", SPSOLVE);
+  NODE_SET_METHOD(exports, "KRYLOV", KRYLOV);
+  NODE_SET_METHOD(exports, "SETTHREADS", SETTHREADS);
+}
+
+#ifndef NODE_GYP_MODULE_NAME
+#define NODE_GYP_MODULE_NAME mat
+#endif
+
+NODE_MODULE_INIT() {
+  Init(exports,module,context);
+}
 
@@ -0,0 +1,506 @@
+#ifdef __APPLE__
+#include <Accelerate.h>
+#else
+#include <cblas.h>
+#endif
+
+#include "matrix_functions.hpp"
+#include "decompositions.hpp"
+#include <cmath>
+#include <complex>
+#include <limits>
+#include <vector>
+
+namespace FM {
+
+  typedef std::complex<double> cdouble;
+
+  // Pade approximants for expm (Higham, 2005).  The degree m approximant
+  // is used when the 1-norm of A is at most theta_m.  Above theta_13, A is
+  // scaled down by a power of 2 first.
+  static const int EXPM_DEGREES[] = {3, 5, 7, 9};
+  static const double EXPM_THETA[] = {1.495585217958292e-2, 2.539398330063230e-1,
+                                      9.504178996162932e-1, 2.097847961257068e0};
+  static const double EXPM_COEFFICIENTS[][10] = {
+    {120, 60, 12, 1},
+    {30240, 15120, 3360, 420, 30, 1},
+    {17297280, 8648640, 1995840, 277200, 25200, 1512, 56, 1},
+    {17643225600., 8821612800., 2075673600., 302702400., 30270240., 2162160., 110880., 3960.,
+     90., 1.}
+  };
+  static const double EXPM_THETA13 = 5.371920351148152e0;
+  static const double EXPM_COEFFICIENTS13[] = {
+    64764752532480000., 32382376266240000., 7771770303897600., 1187353796428800.,
+    129060195264000., 10559470521600., 670442572800., 33522128640., 1323241920., 40840800.,
+    960960., 16380., 182., 1.};
+
+  // logm takes square roots of the triangular factor until it is within
+  // this (1-norm) distance of I, and then uses the Pade approximant of
+  // this degree, which is accurate to double precision there.
+  const double LOGM_THETA = 0.25;
+  const int LOGM_DEGREE = 8;
+  const int LOGM_MAX_ROOTS = 64;
+
+  static inline void Tgetrs(char *TRANS, int *N, int *NRHS, double *A, int *LDA, int *IPIV,
+                            double *B, int *LDB, int *INFO) {
+    FM_BACKEND(dgetrs_)(TRANS,N,NRHS,A,LDA,IPIV,B,LDB,INFO);
+  }
+
+  static inline void Tgetrs(char *TRANS, int *N, int *NRHS, Complex<double> *A, int *LDA, int *IPIV,
+                            Complex<double> *B, int *LDB, int *INFO) {
+    FM_BACKEND(zgetrs_)(TRANS,N,NRHS,A,LDA,IPIV,B,LDB,INFO);
+  }
+
+  static inline void Tgetri(int *N, double *A, int *LDA, int *IPIV, double *WORK, int *LWORK,
+                            int *INFO) {
+    FM_BACKEND(dgetri_)(N,A,LDA,IPIV,WORK,LWORK,INFO);
+  }
+
+  static inline void Tgetri(int *N, Complex<double> *A, int *LDA, int *IPIV, Complex<double> *WORK,
+                            int *LWORK, int *INFO) {
+    FM_BACKEND(zgetri_)(N,A,LDA,IPIV,WORK,LWORK,INFO);
+  }
+
+  static inline void Tgecon(int *N, double *A, int *LDA, double *ANORM, double *RCOND, int *INFO) {
+    char NORM = '1';
+    std::vector<double> WORK(4*size_t(*N));
+    std::vector<int> IWORK(*N);
+    FM_BACKEND(dgecon_)(&NORM,N,A,LDA,ANORM,RCOND,WORK.data(),IWORK.data(),INFO);
+  }
+
+  static inline void Tgecon(int *N, Complex<double> *A, int *LDA, double *ANORM, double *RCOND,
+                            int *INFO) {
+    char NORM = '1';
+    std::vector<Complex<double> > WORK(2*size_t(*N));
+    std::vector<double> RWORK(2*size_t(*N));
+    FM_BACKEND(zgecon_)(&NORM,N,reinterpret_cast<double*>(A),LDA,ANORM,RCOND,
+                        reinterpret_cast<double*>(WORK.data()),RWORK.data(),INFO);
+  }
+
+  // C = A*B + beta*C, all n x n
+  static inline void Tgemm(int n, const double *A, const double *B, double beta, double *C) {
+    FM_BACKEND(cblas_dgemm)(CblasColMajor,CblasNoTrans,CblasNoTrans,n,n,n,1.0,A,n,B,n,beta,C,n);
+  }
+
+  static inline void Tgemm(int n, const Complex<double> *A, const Complex<double> *B, double beta,
+                           Complex<double> *C) {
+    double alphac[] = {1,0};
+    double betac[] = {beta,0};
+    FM_BACKEND(cblas_zgemm)(CblasColMajor,CblasNoTrans,CblasNoTrans,n,n,n,alphac,A,n,B,n,
+                            betac,C,n);
+  }
+
+  static inline double Magnitude(double x) {return std::fabs(x);}
+
+  static inline double Magnitude(const Complex<double> &x) {return std::hypot(x.real,x.imag);}
+
+  template <class T>
+  static double OneNorm(const T *A, int n) {
+    double norm = 0;
+    for (int j=0;j<n;j++) {
+      double sum = 0;
+      for (int i=0;i<n;i++) sum += Magnitude(A[i+size_t(j)*n]);
+      // A NaN anywhere makes the norm NaN
+      if (!(sum <= norm)) norm = sum;
+    }
+    return norm;
+  }
+
+  template <class T>
+  static bool IsDiagonal(const T *A, int n) {
+    for (int j=0;j<n;j++)
+      for (int i=0;i<n;i++)
+        if ((i != j) && !Equal(A[i+size_t(j)*n],T())) return false;
+    return true;
+  }
+
+  template <class T>
+  static void Fill(BLASMatrix<T> &A, T value) {
+    std::fill(A.base(),A.base()+A.elements(),value);
+  }
+
+  template <class T>
+  static T Scaled(double s, const T &x) {return s*x;}
+
+  template <class T>
+  static bool LUInverseT(const BLASMatrix<T> &A, BLASMatrix<T> *inv, T &det, double &rcond,
+                         std::string &error) {
+    if (A.rows != A.cols) {
+      error = "Matrix must be square";
+      return false;
+    }
+    int N = A.rows;
+    det = Unit<T>();
+    rcond = std::numeric_limits<double>::infinity();
+    if (inv) *inv = BLASMatrix<T>(N,N);
+    if (N == 0) return true;
+    BLASMatrix<T> F(CopyOf(A));
+    int LDA = N;
+    Workspace<int,PivotTag> IPIV(N);
+    int INFO = 0;
+    double ANORM = OneNorm(A.base(),N);
+    Tgetrf(&N,&N,F.base(),&LDA,&IPIV,&INFO);
+    for (int i=0;i<N;i++) {
+      det = det*F.base()[i+size_t(i)*N];
+      if ((&IPIV)[i] != i+1) det = Scaled(-1.0,det);
+    }
+    const bool singular = (INFO > 0);
+    if (singular) {
+      rcond = 0;
+    } else if (!std::isfinite(ANORM)) {
+      rcond = std::numeric_limits<double>::quiet_NaN();
+    } else {
+      int CINFO = 0;
+      Tgecon(&N,F.base(),&LDA,&ANORM,&rcond,&CINFO);
+    }
+    if (!inv) return true;
+    if (singular) {
+      Fill(*inv,Scaled(std::numeric_limits<double>::infinity(),Unit<T>()));
+      return true;
+    }
+    int LWORK = -1;
+    T WORKSIZE;
+    Tgetri(&N,F.base(),&LDA,&IPIV,&WORKSIZE,&LWORK,&INFO);
+    LWORK = std::max(1,WorkSize(WORKSIZE));
+    Workspace<T> WORK(LWORK);
+    Tgetri(&N,F.base(),&LDA,&IPIV,&WORK,&LWORK,&INFO);
+    std::copy(F.base(),F.base()+F.elements(),inv->base());
+    return true;
+  }
+
+  bool LUInverse(const BLASMatrix<double> &A, BLASMatrix<double> *inv, double &det,
+                 double &rcond, std::string &error) {
+    return LUInverseT(A,inv,det,rcond,error);
+  }
+
+  bool LUInverse(const BLASMatrix<Complex<double> > &A, BLASMatrix<Complex<double> > *inv,
+                 Complex<double> &det, double &rcond, std::string &error) {
+    return LUInverseT(A,inv,det,rcond,error);
+  }
+
+  // out = c0*I + sum of c*P over the terms
+  template <class T>
+  static void Combine(int n, T *out, double c0,
+                      std::initializer_list<std::pair<double,const T*> > terms) {
+    const size_t nn = size_t(n)*n;
+    std::fill(out,out+nn,T());
+    for (auto &t : terms)
+      for (size_t i=0;i<nn;i++) out[i] = out[i] + Scaled(t.first,t.second[i]);
+    for (int i=0;i<n;i++) out[i+size_t(i)*n] = out[i+size_t(i)*n] + Scaled(c0,Unit<T>());
+  }
+
+  template <class T>
+  static bool MatrixExpT(const BLASMatrix<T> &A, BLASMatrix<T> &E, std::string &error) {
+    if (A.rows != A.cols) {
+      error = "Matrix exponential requires a square matrix";
+      return false;
+    }
+    int n = A.rows;
+    const size_t nn = size_t(n)*n;
+    E = BLASMatrix<T>(n,n);
+    if (n == 0) return true;
+    const double norm = OneNorm(A.base(),n);
+    if (!std::isfinite(norm)) {
+      Fill(E,Scaled(std::numeric_limits<double>::quiet_NaN(),Unit<T>()));
+      return true;
+    }
+    std::vector<T> X(A.base(),A.base()+nn), A2(nn), U(nn), V(nn), W(nn);
+    int squarings = 0;
+    int degree = 0;
+    while ((degree < 4) && (norm > EXPM_THETA[degree])) degree++;
+    if (degree < 4) {
+      // The even powers of A, up to A^(m-1)
+      const int m = EXPM_DEGREES[degree];
+      const double *b = EXPM_COEFFICIENTS[degree];
+      std::vector<std::vector<T> > powers;
+      Tgemm(n,X.data(),X.data(),0,A2.data());
+      powers.push_back(A2);
+      for (int p=4;p<m;p+=2) {
+        std::vector<T> next(nn);
+        Tgemm(n,powers.back().data(),A2.data(),0,next.data());
+        powers.push_back(next);
+      }
+      // W = sum of b[2k+1]*A^(2k), V = sum of b[2k]*A^(2k), U = A*W
+      Combine(n,W.data(),b[1],{});
+      Combine(n,V.data(),b[0],{});
+      for (size_t k=0;k<powers.size();k++)
+        for (size_t i=0;i<nn;i++) {
+          W[i] = W[i] + Scaled(b[2*k+3],powers[k][i]);
+          V[i] = V[i] + Scaled(b[2*k+2],powers[k][i]);
+        }
+      Tgemm(n,X.data(),W.data(),0,U.data());
+    } else {
+      squarings = std::max(0,int(std::ceil(std::log2(norm/EXPM_THETA13))));
+      const double scale = std::ldexp(1.0,-squarings);
+      for (auto &x : X) x = Scaled(scale,x);
+      const double *b = EXPM_COEFFICIENTS13;
+      std::vector<T> A4(nn), A6(nn);
+      Tgemm(n,X.data(),X.data(),0,A2.data());
+      Tgemm(n,A2.data(),A2.data(),0,A4.data());
+      Tgemm(n,A2.data(),A4.data(),0,A6.data());
+      // U = A*(A6*(b13*A6 + b11*A4 + b9*A2) + b7*A6 + b5*A4 + b3*A2 + b1*I)
+      std::vector<T> Z(nn);
+      Combine(n,Z.data(),0,{{b[13],A6.data()},{b[11],A4.data()},{b[9],A2.data()}});
+      Combine(n,W.data(),b[1],{{b[7],A6.data()},{b[5],A4.data()},{b[3],A2.data()}});
+      Tgemm(n,A6.data(),Z.data(),1,W.data());
+      Tgemm(n,X.data(),W.data(),0,U.data());
+      // V = A6*(b12*A6 + b10*A4 + b8*A2) + b6*A6 + b4*A4 + b2*A2 + b0*I
+      Combine(n,Z.data(),0,{{b[12],A6.data()},{b[10],A4.data()},{b[8],A2.data()}});
+      Combine(n,V.data(),b[0],{{b[6],A6.data()},{b[4],A4.data()},{b[2],A2.data()}});
+      Tgemm(n,A6.data(),Z.data(),1,V.data());
+    }
+    // Solve (V - U)*E = V + U, then square
+    for (size_t i=0;i<nn;i++) {
+      W[i] = V[i] - U[i];
+      E.base()[i] = V[i] + U[i];
+    }
+    Workspace<int,PivotTag> IPIV(n);
+    int LDA = n;
+    int INFO = 0;
+    char TRANS = 'N';
+    Tgetrf(&n,&n,W.data(),&LDA,&IPIV,&INFO);
+    if (INFO > 0) {
+      error = "Matrix exponential failed - the Pade denominator is singular";
+      return false;
+    }
+    Tgetrs(&TRANS,&n,&n,W.data(),&LDA,&IPIV,E.base(),&LDA,&INFO);
+    for (int s=0;s<squarings;s++) {
+      Tgemm(n,E.base(),E.base(),0,W.data());
+      std::copy(W.begin(),W.end(),E.base());
+    }
+    return true;
+  }
+
+  bool MatrixExp(const BLASMatrix<double> &A, BLASMatrix<double> &E, std::string &error) {
+    return MatrixExpT(A,E,error);
+  }
+
+  bool MatrixExp(const BLASMatrix<Complex<double> > &A, BLASMatrix<Complex<double> > &E,
+                 std::string &error) {
+    return MatrixExpT(A,E,error);
+  }
+
+  // A = Q*T*Q', with T upper triangular
+  static bool ComplexSchur(const BLASMatrix<Complex<double> > &A, std::vector<cdouble> &T,
+                           std::vector<cdouble> &Q, std::string &error) {
+    int N = A.rows;
+    const size_t nn = size_t(N)*N;
+    BLASMatrix<Complex<double> > F(CopyOf(A));
+    BLASMatrix<Complex<double> > VS(N,N);
+    std::vector<Complex<double> > W(N);
+    std::vector<double> RWORK(N);
+    int BWORK = 0;
+    char JOBVS = 'V';
+    char SORT = 'N';
+    int LDA = N;
+    int SDIM = 0;
+    int INFO = 0;
+    int LWORK = -1;
+    Complex<double> WORKSIZE;
+    FM_BACKEND(zgees_)(&JOBVS,&SORT,nullptr,&N,F.base(),&LDA,&SDIM,W.data(),VS.base(),&LDA,
+                       &WORKSIZE,&LWORK,RWORK.data(),&BWORK,&INFO);
+    LWORK = std::max(1,WorkSize(WORKSIZE));
+    Workspace<Complex<double> > WORK(LWORK);
+    FM_BACKEND(zgees_)(&JOBVS,&SORT,nullptr,&N,F.base(),&LDA,&SDIM,W.data(),VS.base(),&LDA,
+                       &WORK,&LWORK,RWORK.data(),&BWORK,&INFO);
+    if (INFO > 0) {
+      error = "Schur decomposition did not converge";
+      return false;
+    }
+    T.resize(nn);
+    Q.resize(nn);
+    for (size_t i=0;i<nn;i++) {
+      T[i] = cdouble(F.base()[i].real,F.base()[i].imag);
+      Q[i] = cdouble(VS.base()[i].real,VS.base()[i].imag);
+    }
+    // Clear what zgees leaves below the diagonal
+    for (int j=0;j<N;j++)
+      for (int i=j+1;i<N;i++) T[i+size_t(j)*N] = 0.0;
+    return true;
+  }
+
+  // X = Q*R*Q'
+  static void SchurProduct(int n, const std::vector<cdouble> &Q, const std::vector<cdouble> &R,
+                           BLASMatrix<Complex<double> > &X) {
+    std::vector<cdouble> QR(size_t(n)*n);
+    const cdouble one(1,0), zero(0,0);
+    FM_BACKEND(cblas_zgemm)(CblasColMajor,CblasNoTrans,CblasNoTrans,n,n,n,&one,Q.data(),n,
+                            R.data(),n,&zero,QR.data(),n);
+    X = BLASMatrix<Complex<double> >(n,n);
+    FM_BACKEND(cblas_zgemm)(CblasColMajor,CblasNoTrans,CblasConjTrans,n,n,n,&one,QR.data(),n,
+                            Q.data(),n,&zero,X.base(),n);
+  }
+
+  // The principal square root of upper triangular T (Bjorck-Hammarling).
+  // Above the diagonal, column j of R solves (R(0:j-1,0:j-1) + R(j,j)*I)*x
+  // = T(0:j-1,j), which is done by back substitution a column at a time,
+  // so the inner loop runs down a column.  Returns false if a pair of
+  // diagonal roots sums to zero where it is needed, in which case there
+  // may be no square root.
+  static bool TriangularSqrt(int n, const cdouble *T, cdouble *R) {
+    bool exists = true;
+    std::fill(R,R+size_t(n)*n,cdouble(0));
+    for (int j=0;j<n;j++) {
+      cdouble *Rj = R + size_t(j)*n;
+      std::copy(T + size_t(j)*n,T + size_t(j)*n + j + 1,Rj);
+      Rj[j] = std::sqrt(Rj[j]);
+      for (int i=j-1;i>=0;i--) {
+        const cdouble *Ri = R + size_t(i)*n;
+        const cdouble d = Ri[i] + Rj[j];
+        if (d == 0.0) {
+          exists = exists && (Rj[i] == 0.0);
+          if (Rj[i] == 0.0) continue;
+        }
+        const cdouble x = Rj[i]/d;
+        Rj[i] = x;
+        for (int k=0;k<i;k++) Rj[k] -= x*Ri[k];
+      }
+    }
+    return exists;
+  }
+
+  // Whether the principal function of a real matrix with these
+  // eigenvalues is real
+  static bool RealFunction(int n, const std::vector<cdouble> &T) {
+    for (int i=0;i<n;i++) {
+      const cdouble e = T[i+size_t(i)*n];
+      if ((e.real() < 0) && (std::fabs(e.imag()) <= 1e-10*std::abs(e))) return false;
+    }
+    return true;
+  }
+
+  static bool Singular(int n, const std::vector<cdouble> &T) {
+    for (int i=0;i<n;i++)
+      if (T[i+size_t(i)*n] == 0.0) return true;
+    return false;
+  }
+
+  // f applied to the diagonal of a diagonal matrix
+  template <class F>
+  static void DiagonalFunction(const BLASMatrix<Complex<double> > &A,
+                               BLASMatrix<Complex<double> > &X, F f) {
+    const int n = A.rows;
+    X = BLASMatrix<Complex<double> >(n,n);
+    for (int i=0;i<n;i++) {
+      const Complex<double> &a = A.base()[i+size_t(i)*n];
+      const cdouble v = f(cdouble(a.real,a.imag));
+      X.base()[i+size_t(i)*n] = Complex<double>(v.real(),v.imag());
+    }
+  }
+
+  static bool DiagonalReal(const BLASMatrix<Complex<double> > &A) {
+    for (int i=0;i<A.rows;i++)
+      if (A.base()[i+size_t(i)*A.rows].real < 0) return false;
+    return true;
+  }
+
+  bool MatrixSqrt(const BLASMatrix<Complex<double> > &A, BLASMatrix<Complex<double> > &X,
+                  bool &real_result, warning_cb warn, std::string &error) {
+    if (A.rows != A.cols) {
+      error = "Matrix square root requires a square matrix";
+      return false;
+    }
+    const int n = A.rows;
+    if (IsDiagonal(A.base(),n)) {
+      DiagonalFunction(A,X,[](cdouble x) {return std::sqrt(x);});
+      real_result = DiagonalReal(A);
+      return true;
+    }
+    std::vector<cdouble> T, Q;
+    if (!ComplexSchur(A,T,Q,error)) return false;
+    std::vector<cdouble> R(T.size());
+    if (!TriangularSqrt(n,T.data(),R.data()))
+      warn("Matrix is singular and may not have a square root.");
+    real_result = RealFunction(n,T);
+    SchurProduct(n,Q,R,X);
+    return true;
+  }
+
+  // Nodes and weights of the m point Gauss-Legendre rule on [0, 1]
+  static void GaussLegendre(int m, std::vector<double> &x, std::vector<double> &w) {
+    x.resize(m);
+    w.resize(m);
+    for (int i=0;i<m;i++) {
+      double z = std::cos(M_PI*(i+0.75)/(m+0.5));
+      double dp = 1;
+      for (int iter=0;iter<100;iter++) {
+        double p0 = 1, p1 = z;
+        for (int k=2;k<=m;k++) {
+          const double p2 = ((2*k-1)*z*p1 - (k-1)*p0)/k;
+          p0 = p1;
+          p1 = p2;
+        }
+        dp = m*(z*p1 - p0)/(z*z - 1);
+        const double dz = p1/dp;
+        z -= dz;
+        if (std::fabs(dz) < 1e-15) break;
+      }
+      x[i] = (1 - z)/2;
+      w[i] = 1/((1 - z*z)*dp*dp);
+    }
+  }
+
+  static double TriangularDistanceFromIdentity(int n, const std::vector<cdouble> &T) {
+    double norm = 0;
+    for (int j=0;j<n;j++) {
+      double sum = 0;
+      for (int i=0;i<=j;i++) sum += std::abs(T[i+size_t(j)*n] - ((i == j) ? 1.0 : 0.0));
+      norm = std::max(norm,sum);
+    }
+    return norm;
+  }
+
+  bool MatrixLog(const BLASMatrix<Complex<double> > &A, BLASMatrix<Complex<double> > &X,
+                 bool &real_result, warning_cb warn, std::string &error) {
+    if (A.rows != A.cols) {
+      error = "Matrix logarithm requires a square matrix";
+      return false;
+    }
+    const int n = A.rows;
+    const size_t nn = size_t(n)*n;
+    if (IsDiagonal(A.base(),n)) {
+      DiagonalFunction(A,X,[](cdouble x) {
+          return (x == 0.0) ? cdouble(-std::numeric_limits<double>::infinity(),0) : std::log(x);
+        });
+      real_result = DiagonalReal(A);
+      return true;
+    }
+    std::vector<cdouble> T, Q;
+    if (!ComplexSchur(A,T,Q,error)) return false;
+    real_result = RealFunction(n,T);
+    if (Singular(n,T)) {
+      warn("Matrix is singular, so its logarithm is not finite.");
+      X = BLASMatrix<Complex<double> >(n,n);
+      Fill(X,Complex<double>(std::numeric_limits<double>::quiet_NaN(),0));
+      return true;
+    }
+    // Square roots until T is close to I: log(A) = 2^k log(A^(1/2^k))
+    std::vector<cdouble> R(nn);
+    int roots = 0;
+    while ((TriangularDistanceFromIdentity(n,T) > LOGM_THETA) && (roots < LOGM_MAX_ROOTS)) {
+      TriangularSqrt(n,T.data(),R.data());
+      T.swap(R);
+      roots++;
+    }
+    if (roots == LOGM_MAX_ROOTS)
+      warn("Matrix logarithm may be inaccurate - square roots did not converge.");
+    // log(I + Y) ~ sum of w_j*(I + x_j*Y)\Y, with Y = T - I upper triangular
+    std::vector<double> nodes, weights;
+    GaussLegendre(LOGM_DEGREE,nodes,weights);
+    std::vector<cdouble> Y(T), L(nn,cdouble(0)), M(nn), S(nn);
+    for (int i=0;i<n;i++) Y[i+size_t(i)*n] -= 1.0;
+    const cdouble one(1,0);
+    for (int k=0;k<LOGM_DEGREE;k++) {
+      for (size_t i=0;i<nn;i++) M[i] = nodes[k]*Y[i];
+      for (int i=0;i<n;i++) M[i+size_t(i)*n] += 1.0;
+      S = Y;
+      FM_BACKEND(cblas_ztrsm)(CblasColMajor,CblasLeft,CblasUpper,CblasNoTrans,CblasNonUnit,
+                              n,n,&one,M.data(),n,S.data(),n);
+      for (size_t i=0;i<nn;i++) L[i] += weights[k]*S[i];
+    }
+    const double scale = std::ldexp(1.0,roots);
+    for (auto &l : L) l *= scale;
+    SchurProduct(n,Q,L,X);
+    return true;
+  }
+}
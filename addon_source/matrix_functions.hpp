@@ -0,0 +1,52 @@
+#ifndef __matrix_functions_hpp__
+#define __matrix_functions_hpp__
+
+#include "Complex.hpp"
+#include "addon_utils.hpp"
+#include <string>
+
+/***************************************************************************
+ * The inverse, determinant and condition of a square matrix, and the
+ * matrix exponential, square root and logarithm.  As with the
+ * factorizations, everything is computed in double precision, on BLAS
+ * and LAPACK, without returning to JS in between.
+ *
+ * inv, det and rcond all come from one LU factorization.  expm is the
+ * scaling and squaring method with Pade approximants of degree 3 to 13
+ * (Higham, 2005).  sqrtm and logm work on the complex Schur form: the
+ * square root of the triangular factor by the Bjorck-Hammarling
+ * recurrence, and the logarithm by inverse scaling and squaring (repeated
+ * square roots until the factor is close to I, then a Pade approximant of
+ * log(I + X) evaluated as a sum of partial fractions).
+ ***************************************************************************/
+
+namespace FM {
+
+  enum MatrixFunction {MATFUN_EXP = 0, MATFUN_SQRT = 1, MATFUN_LOG = 2};
+
+  // From P*A = L*U: the determinant, the reciprocal condition number in
+  // the 1-norm (estimated by ?gecon, and 0 if A is exactly singular), and
+  // if inv is not null, the inverse (all Inf if A is exactly singular).
+  bool LUInverse(const BLASMatrix<double> &A, BLASMatrix<double> *inv, double &det,
+                 double &rcond, std::string &error);
+
+  bool LUInverse(const BLASMatrix<Complex<double> > &A, BLASMatrix<Complex<double> > *inv,
+                 Complex<double> &det, double &rcond, std::string &error);
+
+  bool MatrixExp(const BLASMatrix<double> &A, BLASMatrix<double> &E, std::string &error);
+
+  bool MatrixExp(const BLASMatrix<Complex<double> > &A, BLASMatrix<Complex<double> > &E,
+                 std::string &error);
+
+  // The principal square root and logarithm.  These are complex in
+  // general; real_result is set when they are real for a real A (which
+  // is when A has no eigenvalues on the negative real axis).  Singular
+  // matrices are reported through warn.
+  bool MatrixSqrt(const BLASMatrix<Complex<double> > &A, BLASMatrix<Complex<double> > &X,
+                  bool &real_result, warning_cb warn, std::string &error);
+
+  bool MatrixLog(const BLASMatrix<Complex<double> > &A, BLASMatrix<Complex<double> > &X,
+                 bool &real_result, warning_cb warn, std::string &error);
+}
+
+#endif
@@ -0,0 +1,31 @@
+#ifndef __nd_layout_hpp__
+#define __nd_layout_hpp__
+
+#include <cstddef>
+#include <vector>
+
+namespace FM {
+
+  // The vectors along dimension dim (zero based) of a column major array
+  // with the given dims.  Vector v starts at start(v, n), and its n
+  // elements are stride apart.  Passing a different length to start gives
+  // the position of the vector in an array that differs only in the
+  // length along dim.
+  struct VectorLayout {
+    size_t stride;
+    size_t n;
+    size_t count;
+    VectorLayout(const std::vector<size_t> &dims, size_t dim) : stride(1), n(1), count(1) {
+      for (size_t d=0;d<dims.size();d++)
+        if (d < dim) stride *= dims[d];
+        else if (d == dim) n = dims[d];
+        else count *= dims[d];
+      count *= stride;
+    }
+    size_t start(size_t v, size_t len) const {
+      return (v/stride)*stride*len + v%stride;
+    }
+  };
+}
+
+#endif
@@ -0,0 +1,329 @@
+#ifdef __APPLE__
+#include <Accelerate.h>
+#else
+#include <cblas.h>
+#endif
+
+#include "out_of_core.hpp"
+#include "mapped_io.hpp"
+#include "blas_backend.hpp"
+#include "cpu_dispatch.hpp"
+#include "transpose.hpp"
+#include <algorithm>
+#include <cmath>
+#include <future>
+#include <vector>
+#include <fcntl.h>
+#include <unistd.h>
+
+namespace FM {
+
+  // Closes the descriptor on the way out of every error path
+  struct ArrayFile {
+    int fd = -1;
+    MappedLayout layout;
+    ~ArrayFile() {
+      if (fd >= 0) close(fd);
+    }
+  };
+
+  static bool OpenArrayFile(const char *filename, ArrayFile &file, std::string &error) {
+    file.fd = open(filename,O_RDONLY);
+    if (file.fd < 0) {
+      error = std::string("Unable to open ") + filename;
+      return false;
+    }
+    if (!ReadMappedLayout(file.fd,file.layout,error)) return false;
+    if (file.layout.dims.size() > 2) {
+      error = std::string("Array in ") + filename + " is not 2D";
+      return false;
+    }
+    file.layout.dims.resize(2,1);
+    return true;
+  }
+
+  // Tiles are addressed by their rows [r0,r0+nr) and columns [c0,c0+nc)
+  // within a column major block with ld rows.  Full height tiles are
+  // contiguous in the file and move in one call.
+  template <class T>
+  static bool ReadTile(int fd, size_t offset, size_t ld, size_t r0, size_t nr,
+                       size_t c0, size_t nc, T *dst) {
+    if (nr == ld)
+      return ReadFully(fd,dst,nr*nc*sizeof(T),offset + c0*ld*sizeof(T));
+    for (size_t j=0;j<nc;j++)
+      if (!ReadFully(fd,dst+j*nr,nr*sizeof(T),offset + ((c0+j)*ld + r0)*sizeof(T)))
+        return false;
+    return true;
+  }
+
+  template <class T>
+  static bool WriteTile(int fd, size_t offset, size_t ld, size_t r0, size_t nr,
+                        size_t c0, size_t nc, const T *src) {
+    if (nr == ld)
+      return WriteFully(fd,src,nr*nc*sizeof(T),offset + c0*ld*sizeof(T));
+    for (size_t j=0;j<nc;j++)
+      if (!WriteFully(fd,src+j*nr,nr*sizeof(T),offset + ((c0+j)*ld + r0)*sizeof(T)))
+        return false;
+    return true;
+  }
+
+  static void TileGemm(size_t m, size_t n, size_t k, const double *A, const double *B,
+                       double beta, double *C) {
+    FM_BACKEND(cblas_dgemm)(CblasColMajor,CblasNoTrans,CblasNoTrans,m,n,k,
+                            1.0,A,m,B,k,beta,C,m);
+  }
+
+  static void TileGemm(size_t m, size_t n, size_t k, const float *A, const float *B,
+                       float beta, float *C) {
+    FM_BACKEND(cblas_sgemm)(CblasColMajor,CblasNoTrans,CblasNoTrans,m,n,k,
+                            1.0f,A,m,B,k,beta,C,m);
+  }
+
+  static void TileTranspose(const double *A, double *B, size_t N, size_t M) {
+    DispatchTranspose(A,B,N,M);
+  }
+
+  // Singles and the integer and logical classes
+  template <class T>
+  static void TileTranspose(const T *A, T *B, size_t N, size_t M) {
+    blocked_transpose(A,B,N,M);
+  }
+
+  static size_t Tiles(size_t n, size_t t) {
+    return (n + t - 1) / t;
+  }
+
+  // Largest square tile such that count tiles of it fit in the budget
+  static size_t TileSize(size_t budget, size_t element_size, size_t count) {
+    return static_cast<size_t>(std::sqrt(static_cast<double>(budget/element_size/count)));
+  }
+
+  static std::string IOError(const char *what) {
+    return std::string("Unable to ") + what + " array file during out of core operation";
+  }
+
+  // The work is done as a sequence of (i,j,p) steps, with C(i,j) += A(i,p)*B(p,j)
+  // accumulated over the p tiles.  Two sets of A/B buffers alternate between
+  // the step being computed and the step being read; two C buffers alternate
+  // between the tile being accumulated and the tile being written.
+  template <class T>
+  static bool GemmTiles(ArrayFile &fa, ArrayFile &fb, int fc, const MappedLayout &lc,
+                        size_t budget, TilePlan &plan, std::string &error) {
+    const size_t m = fa.layout.dims[0];
+    const size_t k = fa.layout.dims[1];
+    const size_t n = fb.layout.dims[1];
+    const size_t t = TileSize(budget,sizeof(T),6);
+    if (t == 0) {
+      error = "Memory budget is too small for out of core operation";
+      return false;
+    }
+    // Square tiles, with any budget left over by a small dimension given
+    // to the others
+    const size_t half = budget/sizeof(T)/2;
+    plan.rows = std::max<size_t>(1,std::min(t,m));
+    plan.inner = std::min(t,k);
+    plan.cols = std::max<size_t>(1,std::min(n,(half - plan.rows*plan.inner)/(plan.rows + plan.inner)));
+    plan.rows = std::max<size_t>(1,std::min(m,(half - plan.inner*plan.cols)/(plan.inner + plan.cols)));
+    plan.bytes = 2*(plan.rows*plan.inner + plan.inner*plan.cols + plan.rows*plan.cols)*sizeof(T);
+    if (!m || !n) return true;
+    const size_t ni = Tiles(m,plan.rows);
+    const size_t nj = Tiles(n,plan.cols);
+    // An empty inner dimension still needs a pass to zero the result
+    const size_t np = k ? Tiles(k,plan.inner) : 1;
+    std::vector<T> abuf[2], bbuf[2], cbuf[2];
+    for (int s=0;s<2;s++) {
+      abuf[s].resize(plan.rows*plan.inner);
+      bbuf[s].resize(plan.inner*plan.cols);
+      cbuf[s].resize(plan.rows*plan.cols);
+    }
+    const size_t steps = ni*nj*np;
+    auto load = [&](size_t step, int s) -> bool {
+      const size_t p = step % np;
+      const size_t i = (step / np) % ni;
+      const size_t j = step / (np*ni);
+      const size_t i0 = i*plan.rows, j0 = j*plan.cols, p0 = p*plan.inner;
+      const size_t nr = std::min(plan.rows,m-i0);
+      const size_t nc = std::min(plan.cols,n-j0);
+      const size_t nk = k ? std::min(plan.inner,k-p0) : 0;
+      return ReadTile(fa.fd,fa.layout.real_offset,m,i0,nr,p0,nk,&abuf[s][0]) &&
+        ReadTile(fb.fd,fb.layout.real_offset,k,p0,nk,j0,nc,&bbuf[s][0]);
+    };
+    std::future<bool> reading = std::async(std::launch::async,load,0,0);
+    std::future<bool> writing;
+    int cs = 0;
+    for (size_t step=0;step<steps;step++) {
+      const int s = step & 1;
+      if (!reading.get()) {
+        error = IOError("read");
+        break;
+      }
+      if (step+1 < steps)
+        reading = std::async(std::launch::async,load,step+1,1-s);
+      const size_t p = step % np;
+      const size_t i = (step / np) % ni;
+      const size_t j = step / (np*ni);
+      const size_t i0 = i*plan.rows, j0 = j*plan.cols, p0 = p*plan.inner;
+      const size_t nr = std::min(plan.rows,m-i0);
+      const size_t nc = std::min(plan.cols,n-j0);
+      const size_t nk = k ? std::min(plan.inner,k-p0) : 0;
+      if (nk)
+        TileGemm(nr,nc,nk,&abuf[s][0],&bbuf[s][0],p ? T(1) : T(0),&cbuf[cs][0]);
+      else
+        std::fill(cbuf[cs].begin(),cbuf[cs].end(),T(0));
+      if (p+1 < np) continue;
+      // The other C buffer must be on disk before it is reused
+      if (writing.valid() && !writing.get()) {
+        error = IOError("write");
+        break;
+      }
+      const T *ctile = &cbuf[cs][0];
+      writing = std::async(std::launch::async,[=,&lc]() {
+          return WriteTile(fc,lc.real_offset,m,i0,nr,j0,nc,ctile);
+        });
+      cs = 1 - cs;
+    }
+    // Let any background transfers finish before the buffers go away
+    if (reading.valid()) reading.wait();
+    if (writing.valid() && !writing.get() && error.empty())
+      error = IOError("write");
+    return error.empty();
+  }
+
+  bool OutOfCoreGemm(const char *a, const char *b, const char *c, size_t budget,
+                     TilePlan &plan, std::string &error) {
+    ArrayFile fa, fb;
+    if (!OpenArrayFile(a,fa,error) || !OpenArrayFile(b,fb,error)) return false;
+    if (fa.layout.complex || fb.layout.complex) {
+      error = "Out of core matrix multiply supports real arrays only";
+      return false;
+    }
+    if (fa.layout.dims[1] != fb.layout.dims[0]) {
+      error = "Mismatch in matrix dimensions";
+      return false;
+    }
+    for (auto code : {fa.layout.typecode, fb.layout.typecode})
+      if ((code != MAPPED_DOUBLE) && (code != MAPPED_SINGLE)) {
+        error = "Out of core matrix multiply supports double and single arrays only";
+        return false;
+      }
+    bool single = (fa.layout.typecode == MAPPED_SINGLE);
+    if (single != (fb.layout.typecode == MAPPED_SINGLE)) {
+      error = "Out of core matrix multiply needs both arrays in the same precision";
+      return false;
+    }
+    std::vector<uint64_t> dims = {fa.layout.dims[0], fb.layout.dims[1]};
+    MappedLayout lc;
+    if (!MakeMappedLayout(single ? MAPPED_SINGLE : MAPPED_DOUBLE,false,dims,lc,error))
+      return false;
+    int fc = CreateArrayFile(c,lc,error);
+    if (fc < 0) return false;
+    bool ok;
+    if (single)
+      ok = GemmTiles<float>(fa,fb,fc,lc,budget,plan,error);
+    else
+      ok = GemmTiles<double>(fa,fb,fc,lc,budget,plan,error);
+    if (close(fc) != 0 && ok) {
+      error = IOError("write");
+      ok = false;
+    }
+    if (!ok) unlink(c);
+    return ok;
+  }
+
+  // Tile (i,j) of the source, rows [i0,i0+nr) and columns [j0,j0+nc), is
+  // transposed into rows [j0,j0+nc) and columns [i0,i0+nr) of the result.
+  template <class T>
+  static bool TransposeTiles(ArrayFile &fa, size_t src_offset, int fb, size_t dst_offset,
+                             size_t budget, TilePlan &plan, std::string &error) {
+    const size_t m = fa.layout.dims[0];
+    const size_t n = fa.layout.dims[1];
+    const size_t t = TileSize(budget,sizeof(T),4);
+    if (t == 0) {
+      error = "Memory budget is too small for out of core operation";
+      return false;
+    }
+    const size_t quarter = budget/sizeof(T)/4;
+    plan.rows = std::max<size_t>(1,std::min(t,m));
+    plan.cols = std::max<size_t>(1,std::min(n,quarter/plan.rows));
+    plan.rows = std::max<size_t>(1,std::min(m,quarter/plan.cols));
+    plan.inner = 0;
+    plan.bytes = 4*plan.rows*plan.cols*sizeof(T);
+    if (!m || !n) return true;
+    const size_t ni = Tiles(m,plan.rows);
+    const size_t nj = Tiles(n,plan.cols);
+    std::vector<T> in[2], out[2];
+    for (int s=0;s<2;s++) {
+      in[s].resize(plan.rows*plan.cols);
+      out[s].resize(plan.rows*plan.cols);
+    }
+    const size_t steps = ni*nj;
+    auto load = [&](size_t step, int s) -> bool {
+      const size_t i0 = (step % ni)*plan.rows, j0 = (step / ni)*plan.cols;
+      return ReadTile(fa.fd,src_offset,m,i0,std::min(plan.rows,m-i0),
+                      j0,std::min(plan.cols,n-j0),&in[s][0]);
+    };
+    std::future<bool> reading = std::async(std::launch::async,load,0,0);
+    std::future<bool> writing;
+    for (size_t step=0;step<steps;step++) {
+      const int s = step & 1;
+      if (!reading.get()) {
+        error = IOError("read");
+        break;
+      }
+      if (step+1 < steps)
+        reading = std::async(std::launch::async,load,step+1,1-s);
+      const size_t i0 = (step % ni)*plan.rows, j0 = (step / ni)*plan.cols;
+      const size_t nr = std::min(plan.rows,m-i0);
+      const size_t nc = std::min(plan.cols,n-j0);
+      // The pending write is from the other output buffer
+      TileTranspose(&in[s][0],&out[s][0],nr,nc);
+      if (writing.valid() && !writing.get()) {
+        error = IOError("write");
+        break;
+      }
+      const T *tile = &out[s][0];
+      writing = std::async(std::launch::async,[=]() {
+          return WriteTile(fb,dst_offset,n,j0,nc,i0,nr,tile);
+        });
+    }
+    if (reading.valid()) reading.wait();
+    if (writing.valid() && !writing.get() && error.empty())
+      error = IOError("write");
+    return error.empty();
+  }
+
+  bool OutOfCoreTranspose(const char *a, const char *b, size_t budget,
+                          TilePlan &plan, std::string &error) {
+    ArrayFile fa;
+    if (!OpenArrayFile(a,fa,error)) return false;
+    const MappedLayout &la = fa.layout;
+    std::vector<uint64_t> dims = {la.dims[1], la.dims[0]};
+    MappedLayout lb;
+    if (!MakeMappedLayout(la.typecode,la.complex,dims,lb,error)) return false;
+    if (la.element_size != lb.element_size) {
+      error = std::string("Logical array in ") + a + " is from an older file version";
+      return false;
+    }
+    int fb = CreateArrayFile(b,lb,error);
+    if (fb < 0) return false;
+    // Elements are only moved, so any type of their width will do.  The
+    // real and imaginary blocks are transposed one after the other.
+    auto transpose = [&](size_t src, size_t dst) {
+      switch (la.element_size) {
+      case 1: return TransposeTiles<uint8_t>(fa,src,fb,dst,budget,plan,error);
+      case 2: return TransposeTiles<uint16_t>(fa,src,fb,dst,budget,plan,error);
+      case 4: return TransposeTiles<float>(fa,src,fb,dst,budget,plan,error);
+      default: return TransposeTiles<double>(fa,src,fb,dst,budget,plan,error);
+      }
+    };
+    bool ok = transpose(la.real_offset,lb.real_offset);
+    if (ok && la.complex)
+      ok = transpose(la.imag_offset,lb.imag_offset);
+    if (close(fb) != 0 && ok) {
+      error = IOError("write");
+      ok = false;
+    }
+    if (!ok) unlink(b);
+    return ok;
+  }
+}
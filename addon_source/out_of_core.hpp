@@ -0,0 +1,36 @@
+#ifndef __out_of_core_hpp__
+#define __out_of_core_hpp__
+
+#include <cstddef>
+#include <string>
+
+// Matrix operations on array files (see mapped_io.hpp) that are too large
+// to hold in memory.  The operands are read in tiles sized to fit a memory
+// budget.  The next tiles are read on a background thread while the
+// current ones are being worked on, and finished result tiles are written
+// back to the output file in the background, so the peak memory use is
+// bounded by the budget whatever the size of the problem.
+
+namespace FM {
+
+  const size_t OOC_DEFAULT_BUDGET = size_t(256) << 20;
+
+  // The tiling chosen for a problem, and the memory it used
+  struct TilePlan {
+    size_t rows;
+    size_t cols;
+    size_t inner;
+    size_t bytes;
+  };
+
+  // C = A*B for real 2D arrays.  Single precision operands give a single
+  // precision result, everything else is computed in double precision.
+  bool OutOfCoreGemm(const char *a, const char *b, const char *c, size_t budget,
+                     TilePlan &plan, std::string &error);
+
+  // B = A.'  Complex arrays are supported (the transpose is not conjugated).
+  bool OutOfCoreTranspose(const char *a, const char *b, size_t budget,
+                          TilePlan &plan, std::string &error);
+}
+
+#endif
@@ -0,0 +1,25 @@
+#include "parallel.hpp"
+#include <atomic>
+#include <cstdlib>
+
+namespace FM {
+
+  static int DefaultThreads() {
+    const char *env = getenv("FREEMAT_THREADS");
+    if (env && atoi(env) > 0) return atoi(env);
+    return std::max<int>(1,std::thread::hardware_concurrency());
+  }
+
+  static std::atomic<int>& ThreadSetting() {
+    static std::atomic<int> threads(DefaultThreads());
+    return threads;
+  }
+
+  int KernelThreads() {
+    return ThreadSetting().load();
+  }
+
+  int SetKernelThreads(int threads) {
+    return ThreadSetting().exchange(std::max(1,threads));
+  }
+}
@@ -0,0 +1,42 @@
+#ifndef __parallel_hpp__
+#define __parallel_hpp__
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+// Splitting of batched native kernels (e.g., one FFT per column) across
+// threads.  The threads are started for each call, so only work that is
+// large enough to amortize that should be split.
+
+namespace FM {
+
+  // The number of threads used by ParallelFor.  Defaults to FREEMAT_THREADS
+  // if set, otherwise the number of cores.  The setting is process wide.
+  int KernelThreads();
+
+  // Set the number of threads (at least 1).  Returns the previous setting.
+  int SetKernelThreads(int threads);
+
+  // Calls body(begin, end) on disjoint ranges that cover [0, count).  Each
+  // thread gets at least min_chunk items, so small counts run inline on the
+  // calling thread.  The calling thread takes the first range.  body must
+  // not throw.
+  template <class F>
+  void ParallelFor(size_t count, size_t min_chunk, F body) {
+    size_t threads = std::min<size_t>(KernelThreads(), count/std::max<size_t>(1,min_chunk));
+    if (threads <= 1) {
+      if (count) body(size_t(0),count);
+      return;
+    }
+    const size_t chunk = (count + threads - 1)/threads;
+    std::vector<std::thread> pool;
+    for (size_t begin=chunk;begin<count;begin+=chunk)
+      pool.emplace_back(body,begin,std::min(count,begin+chunk));
+    body(size_t(0),chunk);
+    for (auto &t : pool) t.join();
+  }
+}
+
+#endif
@@ -0,0 +1,195 @@
+#include "permute.hpp"
+#include "parallel.hpp"
+#include "tuning.hpp"
+#include "transpose.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+namespace FM {
+
+  PermutePlan PlanPermute(const std::vector<size_t> &dims, const std::vector<size_t> &order,
+                          const std::vector<double> &shift) {
+    std::vector<size_t> istride(order.size());
+    size_t elements = 1;
+    for (size_t d=0;d<order.size();d++) {
+      istride[d] = elements;
+      elements *= (d < dims.size()) ? dims[d] : 1;
+    }
+    PermutePlan plan;
+    plan.elements = elements;
+    plan.inner = 0;
+    for (size_t k=0;k<order.size();k++) {
+      const size_t d = order[k];
+      const size_t len = (d < dims.size()) ? dims[d] : 1;
+      if (len == 1) continue;
+      size_t s = 0;
+      if ((k < shift.size()) && (len > 0)) {
+        double r = std::fmod(shift[k],double(len));
+        if (r < 0) r += len;
+        s = std::min<size_t>(size_t(r),len-1);
+      }
+      // An unshifted dimension followed by the next one of the input is
+      // one longer dimension, and a shift of the outer one is a shift of
+      // the merged one by whole runs of the inner
+      if (!plan.n.empty() && (plan.shift.back() == 0) &&
+          (istride[d] == plan.stride.back()*plan.n.back())) {
+        plan.shift.back() = s*plan.n.back();
+        plan.n.back() *= len;
+        continue;
+      }
+      plan.n.push_back(len);
+      plan.stride.push_back(istride[d]);
+      plan.shift.push_back(s);
+    }
+    if (plan.n.empty()) {
+      plan.n.push_back(1);
+      plan.stride.push_back(1);
+      plan.shift.push_back(0);
+    }
+    for (size_t k=0;k<plan.n.size();k++)
+      if (plan.stride[k] == 1) plan.inner = k;
+    return plan;
+  }
+
+  // Where output coordinate c of a dimension of length n, shifted by s,
+  // comes from
+  static inline size_t Source(size_t c, size_t n, size_t s) {
+    return (c >= s) ? c - s : c + n - s;
+  }
+
+  // Steps through the outer (not copied by the inner loops) dimensions of
+  // a plan, keeping track of the input and output offsets
+  class OuterIndex {
+    const PermutePlan &plan;
+    std::vector<size_t> dims;
+    std::vector<size_t> ostride;
+    std::vector<size_t> coord;
+  public:
+    size_t in;
+    size_t out;
+    OuterIndex(const PermutePlan &p, size_t skip1, size_t skip2, size_t first) : plan(p), in(0), out(0) {
+      size_t os = 1;
+      for (size_t k=0;k<plan.n.size();k++) {
+        if ((k != skip1) && (k != skip2)) {
+          dims.push_back(k);
+          ostride.push_back(os);
+        }
+        os *= plan.n[k];
+      }
+      coord.resize(dims.size());
+      for (size_t j=0;j<dims.size();j++) {
+        const size_t k = dims[j];
+        coord[j] = first % plan.n[k];
+        first /= plan.n[k];
+        in += Source(coord[j],plan.n[k],plan.shift[k])*plan.stride[k];
+        out += coord[j]*ostride[j];
+      }
+    }
+    void next() {
+      for (size_t j=0;j<dims.size();j++) {
+        const size_t k = dims[j];
+        const size_t n = plan.n[k];
+        const size_t s = plan.shift[k];
+        in -= Source(coord[j],n,s)*plan.stride[k];
+        out -= coord[j]*ostride[j];
+        if (++coord[j] == n) coord[j] = 0;
+        in += Source(coord[j],n,s)*plan.stride[k];
+        out += coord[j]*ostride[j];
+        if (coord[j]) return;
+      }
+    }
+  };
+
+  // B[i + ldb*j] = A[lda*i + j] for i < ni, j < nj, tiled so that both
+  // sides stay in cache
+  static void CopyTile(const double *A, size_t lda, double *B, size_t ldb, size_t ni, size_t nj,
+                       size_t block) {
+    for (size_t i0=0;i0<ni;i0+=block) {
+      const size_t imax = std::min<size_t>(i0+block,ni);
+      for (size_t j0=0;j0<nj;j0+=block) {
+        const size_t jmax = std::min<size_t>(j0+block,nj);
+        for (size_t j=j0;j<jmax;j++)
+          for (size_t i=i0;i<imax;i++)
+            B[i+ldb*j] = A[lda*i+j];
+      }
+    }
+  }
+
+  // Output positions [begin, end) of a dimension of length n shifted by s,
+  // as at most two ranges that are each contiguous in the input.  Returns
+  // the number of ranges, each given as (output start, input start, length).
+  static int SplitShift(size_t begin, size_t end, size_t n, size_t s, size_t range[2][3]) {
+    int count = 0;
+    if (begin < std::min(s,end)) {
+      const size_t e = std::min(s,end);
+      range[count][0] = begin;
+      range[count][1] = begin + n - s;
+      range[count][2] = e - begin;
+      count++;
+      begin = e;
+    }
+    if (begin < end) {
+      range[count][0] = begin;
+      range[count][1] = begin - s;
+      range[count][2] = end - begin;
+      count++;
+    }
+    return count;
+  }
+
+  static void PermuteRuns(const PermutePlan &plan, const double *in, double *out) {
+    const size_t len = plan.n[0];
+    const size_t s = plan.shift[0];
+    const size_t runs = plan.elements/len;
+    ParallelFor(runs,std::max<size_t>(1,ParallelGrain()/len),[&](size_t begin, size_t end) {
+        OuterIndex ndx(plan,0,0,begin);
+        for (size_t r=begin;r<end;r++) {
+          const double *a = in + ndx.in;
+          double *b = out + r*len;
+          memcpy(b,a+len-s,s*sizeof(double));
+          memcpy(b+s,a,(len-s)*sizeof(double));
+          ndx.next();
+        }
+      });
+  }
+
+  static void PermuteTiled(const PermutePlan &plan, const double *in, double *out) {
+    const size_t p = plan.inner;
+    const size_t ni = plan.n[0];
+    const size_t nj = plan.n[p];
+    const size_t lda = plan.stride[0];
+    size_t ldb = 1;
+    for (size_t k=0;k<p;k++) ldb *= plan.n[k];
+    // Work items are a block of the inner input dimension for one outer
+    // position
+    const size_t block = TransposeBlock();
+    const size_t blocks = (nj + block - 1)/block;
+    const size_t items = plan.elements/(ni*nj)*blocks;
+    const size_t per_item = ni*std::min<size_t>(nj,block);
+    ParallelFor(items,std::max<size_t>(1,ParallelGrain()/per_item),[&](size_t begin, size_t end) {
+        OuterIndex ndx(plan,0,p,begin/blocks);
+        size_t irange[2][3];
+        const int icount = SplitShift(0,ni,ni,plan.shift[0],irange);
+        for (size_t item=begin;item<end;item++) {
+          const size_t jb = (item % blocks)*block;
+          size_t jrange[2][3];
+          const int jcount = SplitShift(jb,std::min<size_t>(jb+block,nj),nj,plan.shift[p],jrange);
+          for (int u=0;u<icount;u++)
+            for (int v=0;v<jcount;v++)
+              CopyTile(in + ndx.in + irange[u][1]*lda + jrange[v][1],lda,
+                       out + ndx.out + irange[u][0] + jrange[v][0]*ldb,ldb,
+                       irange[u][2],jrange[v][2],block);
+          if ((item % blocks) == blocks-1) ndx.next();
+        }
+      });
+  }
+
+  void ApplyPermute(const PermutePlan &plan, const double *in, double *out) {
+    if (plan.elements == 0) return;
+    if (plan.inner == 0)
+      PermuteRuns(plan,in,out);
+    else
+      PermuteTiled(plan,in,out);
+  }
+}
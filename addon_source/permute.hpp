@@ -0,0 +1,48 @@
+#ifndef __permute_hpp__
+#define __permute_hpp__
+
+#include <cstddef>
+#include <vector>
+
+// Rearrangement of N-D column major arrays: B = permute(A, order), with an
+// optional circular shift of each dimension, which covers permute,
+// ipermute, circshift and (with the identity order) plain copies.  Real
+// and planar complex data are handled one plane at a time with the same
+// plan.
+//
+// A plan first drops dimensions of length 1, and merges output dimensions
+// that are adjacent and in order in the input (and not shifted), so that,
+// e.g., permute(A, [1 2 4 3]) of a [64, 64, 8, 8] array copies 4096 element
+// runs.  When the innermost output dimension is contiguous in the input the
+// copy is by runs, otherwise the output dimension and the one that is
+// contiguous in the input are tiled as in blocked_transpose.  The remaining
+// (outer) dimensions are split across threads.
+
+namespace FM {
+
+  struct PermutePlan {
+    // The merged output dimensions, innermost first, with the input stride
+    // and circular shift (in [0, n)) of each
+    std::vector<size_t> n;
+    std::vector<size_t> stride;
+    std::vector<size_t> shift;
+    // The output dimension that is contiguous in the input (0 when the copy
+    // is by runs)
+    size_t inner;
+    size_t elements;
+  };
+
+  // Plans B = A with its dimensions taken in order (zero based, a
+  // permutation of 0..order.size()-1, with dims padded to that length) and
+  // output dimension k shifted circularly by shift[k], i.e., B(i) =
+  // A(i - shift) with the difference taken modulo the dimensions.  shift
+  // may be empty, and its entries may be negative or larger than the
+  // dimension.
+  PermutePlan PlanPermute(const std::vector<size_t> &dims, const std::vector<size_t> &order,
+                          const std::vector<double> &shift);
+
+  // Apply the plan to one plane of data
+  void ApplyPermute(const PermutePlan &plan, const double *in, double *out);
+}
+
+#endif
@@ -0,0 +1,100 @@
+#include "random.hpp"
+#include "cpu_dispatch.hpp"
+#include "elementary.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <vector>
+
+namespace FM {
+
+  // Blocks generated at a time, so that the words and the intermediate
+  // results of the normal transform stay in cache
+  const size_t RAND_BATCH = 512;
+
+  // The least number of blocks worth giving to a thread
+  const size_t RAND_MIN_PER_THREAD = size_t(1) << 14;
+
+  const double RAND_TWO_PI = 6.28318530717958623200e+00;
+  const double RAND_PI = 3.14159265358979311600e+00;
+
+  // The top 53 bits of a word as a double in (0,1).  Never 0, so that its
+  // log is finite.
+  static inline double UnitOpen(uint64_t w) {
+    return (double(w >> 11) + 0.5)*(1.0/9007199254740992.0);
+  }
+
+  // The high word of the 128 bit product a*b
+  static inline uint64_t MulHigh(uint64_t a, uint64_t b) {
+    const uint64_t a_lo = uint32_t(a), a_hi = a >> 32;
+    const uint64_t b_lo = uint32_t(b), b_hi = b >> 32;
+    const uint64_t ll = a_lo*b_lo;
+    const uint64_t lh = a_lo*b_hi;
+    const uint64_t hl = a_hi*b_lo;
+    const uint64_t mid = (ll >> 32) + uint32_t(lh) + uint32_t(hl);
+    return a_hi*b_hi + (lh >> 32) + (hl >> 32) + (mid >> 32);
+  }
+
+  struct RandomScratch {
+    std::vector<uint64_t> words;
+    std::vector<double> t1, t2, t3, t4;
+    RandomScratch() : words(2*RAND_BATCH), t1(RAND_BATCH), t2(RAND_BATCH),
+                      t3(RAND_BATCH), t4(RAND_BATCH) {}
+  };
+
+  // Pairs of normals from pairs of uniforms: with u1 and u2 from the two
+  // words of a block, sqrt(-2 log u1) (cos t, sin t) where t = 2 pi (u2 -
+  // 1/2).  Works on whole batches.  The kernels are called directly
+  // rather than through the dispatch table, as they would be contracted to
+  // FMAs for some instruction sets, and a seed must give the same stream
+  // on every machine.
+  static void BoxMuller(const uint64_t *words, size_t blocks, double *out, size_t count,
+                        RandomScratch &w) {
+    double *t1 = w.t1.data();
+    double *t2 = w.t2.data();
+    double *t3 = w.t3.data();
+    double *t4 = w.t4.data();
+    for (size_t j=0;j<blocks;j++) {
+      t1[j] = UnitOpen(words[2*j]);
+      t3[j] = UnitOpen(words[2*j+1])*RAND_TWO_PI - RAND_PI;
+    }
+    log_kernel(t1,t2,blocks);
+    for (size_t j=0;j<blocks;j++) t2[j] *= -2.0;
+    sqrt_kernel(t2,t1,blocks);
+    sincos_kernel(t3,t2,blocks,1);
+    sincos_kernel(t3,t4,blocks,0);
+    for (size_t j=0;j<blocks;j++) {
+      if (2*j < count) out[2*j] = t1[j]*t2[j];
+      if (2*j+1 < count) out[2*j+1] = t1[j]*t4[j];
+    }
+  }
+
+  void RandomFill(RandomDist dist, uint64_t seed, uint64_t offset, size_t n,
+                  double lo, double hi, double *out) {
+    const size_t blocks = RandomBlocks(n);
+    // Scaling the top of a word by the range biases each integer by less
+    // than range/2^64 relative to the others
+    const uint64_t range = (dist == RAND_INTEGER) ? uint64_t(hi - lo) + 1 : 0;
+    ParallelFor(blocks,RAND_MIN_PER_THREAD,[&](size_t begin, size_t end) {
+        RandomScratch w;
+        uint64_t *words = w.words.data();
+        for (size_t b=begin;b<end;b+=RAND_BATCH) {
+          const size_t len = std::min(end,b+RAND_BATCH) - b;
+          Kernels().philox(seed,offset+b,words,len);
+          const size_t first = 2*b;
+          const size_t count = std::min(n,2*(b+len)) - first;
+          double *y = out + first;
+          switch (dist) {
+          case RAND_UNIFORM:
+            for (size_t i=0;i<count;i++) y[i] = UnitOpen(words[i]);
+            break;
+          case RAND_NORMAL:
+            BoxMuller(words,len,y,count,w);
+            break;
+          case RAND_INTEGER:
+            for (size_t i=0;i<count;i++) y[i] = lo + double(MulHigh(words[i],range));
+            break;
+          }
+        }
+      });
+  }
+}
@@ -0,0 +1,75 @@
+#ifndef __random_hpp__
+#define __random_hpp__
+
+#include <cstddef>
+#include <cstdint>
+
+// Random number generation with the Philox4x32-10 counter based generator
+// (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3", SC11).
+// The generator is a keyed bijection of a 128 bit counter, so the numbers
+// at any position of a stream can be computed directly from (seed,
+// position).  Arrays are filled in parallel with each thread starting at
+// its own position, and the result does not depend on how many threads
+// there are.
+//
+// Each counter value (a block) gives two 64 bit words, and each element of
+// an output takes one word (two for normals, which come in pairs).  Block b
+// of the stream with seed s uses the counter (b, 0) and the key s.
+
+namespace FM {
+
+  enum RandomDist {
+    RAND_UNIFORM = 0,
+    RAND_NORMAL = 1,
+    RAND_INTEGER = 2
+  };
+
+  inline uint32_t philox_mulhi(uint32_t a, uint32_t b) {
+    return uint32_t((uint64_t(a)*b) >> 32);
+  }
+
+  // Ten rounds of Philox4x32 on the counter (c0, c1, c2, c3).  The high and
+  // low halves of the products are computed separately, which the compiler
+  // turns into vector multiplies.
+  inline void philox4x32(uint32_t &c0, uint32_t &c1, uint32_t &c2, uint32_t &c3,
+                         uint32_t k0, uint32_t k1) {
+    for (int r=0;r<10;r++) {
+      const uint32_t x0 = philox_mulhi(0xCD9E8D57u,c2) ^ c1 ^ k0;
+      const uint32_t x1 = 0xCD9E8D57u*c2;
+      const uint32_t x2 = philox_mulhi(0xD2511F53u,c0) ^ c3 ^ k1;
+      const uint32_t x3 = 0xD2511F53u*c0;
+      c0 = x0; c1 = x1; c2 = x2; c3 = x3;
+      k0 += 0x9E3779B9u;
+      k1 += 0xBB67AE85u;
+    }
+  }
+
+  // out[2j] and out[2j+1] get the words of block first+j, for j < blocks.
+  // The blocks are independent, so the loop vectorizes across them.
+  inline void philox_kernel(uint64_t key, uint64_t first, uint64_t *out, size_t blocks) {
+    const uint32_t k0 = uint32_t(key);
+    const uint32_t k1 = uint32_t(key >> 32);
+    for (size_t j=0;j<blocks;j++) {
+      const uint64_t b = first + j;
+      uint32_t c0 = uint32_t(b), c1 = uint32_t(b >> 32), c2 = 0, c3 = 0;
+      philox4x32(c0,c1,c2,c3,k0,k1);
+      out[2*j] = (uint64_t(c1) << 32) | c0;
+      out[2*j+1] = (uint64_t(c3) << 32) | c2;
+    }
+  }
+
+  // The number of blocks used to fill n elements
+  inline uint64_t RandomBlocks(size_t n) {
+    return (uint64_t(n) + 1)/2;
+  }
+
+  // Fill out[0..n) from the stream with the given seed, starting at block
+  // offset (so the next fill should start at offset + RandomBlocks(n)).
+  //   RAND_UNIFORM  uniform on the open interval (0,1), with 53 random bits
+  //   RAND_NORMAL   standard normal, by the Box-Muller transform
+  //   RAND_INTEGER  uniform integers in [lo, hi], where hi - lo < 2^53
+  void RandomFill(RandomDist dist, uint64_t seed, uint64_t offset, size_t n,
+                  double lo, double hi, double *out);
+}
+
+#endif
@@ -0,0 +1,257 @@
+#include "scan.hpp"
+#include "broadcast.hpp"
+#include "cpu_dispatch.hpp"
+#include "nd_layout.hpp"
+#include "parallel.hpp"
+#include "tuning.hpp"
+#include <algorithm>
+#include <cmath>
+
+namespace FM {
+
+  // Columns scanned together when scanning along the first dimension
+  const size_t SCAN_GROUP = 8;
+
+  // The most adjacent vectors scanned together along other dimensions
+  const size_t SCAN_ROW = 512;
+
+  // The size (in elements) of the blocks that differences are taken in
+  const size_t DIFF_BLOCK = size_t(1) << 15;
+
+  struct ComplexValue {
+    double re;
+    double im;
+  };
+
+  static inline bool IsNaN(const ComplexValue &a) {
+    return (a.re != a.re) || (a.im != a.im);
+  }
+
+  // Whether b comes after a in the order by magnitude and then angle
+  static inline bool ComplexAfter(const ComplexValue &b, const ComplexValue &a) {
+    const double mb = std::hypot(b.re,b.im);
+    const double ma = std::hypot(a.re,a.im);
+    if (mb != ma) return mb > ma;
+    return std::atan2(b.im,b.re) > std::atan2(a.im,a.re);
+  }
+
+  // Scans a single vector of n elements, using up to threads threads.
+  // get(j) reads element j of the input, and put(j, v) and got(j) write and
+  // read element j of the output.
+  template <class V, class Get, class Put, class Got, class Op>
+  static void ScanVector(size_t n, size_t threads, Get get, Put put, Got got, Op op) {
+    if (n == 0) return;
+    const size_t pieces = std::max<size_t>(1,std::min(threads,n/ParallelGrain()));
+    const size_t chunk = (n + pieces - 1)/pieces;
+    std::vector<V> totals(pieces);
+    ParallelFor(pieces,1,[&](size_t p0, size_t p1) {
+        for (size_t p=p0;p<p1;p++) {
+          const size_t b = p*chunk;
+          const size_t e = std::min(n,b+chunk);
+          if (b >= e) continue;
+          V acc = get(b);
+          put(b,acc);
+          for (size_t j=b+1;j<e;j++) {
+            acc = op(acc,get(j));
+            put(j,acc);
+          }
+          totals[p] = acc;
+        }
+      });
+    if (pieces == 1) return;
+    // The second pass combines everything before a piece into it
+    std::vector<V> carry(pieces);
+    carry[1] = totals[0];
+    for (size_t p=2;p<pieces;p++)
+      carry[p] = op(carry[p-1],totals[p-1]);
+    ParallelFor(pieces-1,1,[&](size_t p0, size_t p1) {
+        for (size_t p=p0+1;p<p1+1;p++) {
+          const V c = carry[p];
+          const size_t e = std::min(n,(p+1)*chunk);
+          for (size_t j=p*chunk;j<e;j++)
+            put(j,op(c,got(j)));
+        }
+      });
+  }
+
+  template <class Op>
+  static void ScanRealVector(size_t n, size_t stride, size_t threads, const double *x,
+                             double *y, Op op) {
+    ScanVector<double>(n,threads,
+                       [=](size_t j) {return x[j*stride];},
+                       [=](size_t j, double v) {y[j*stride] = v;},
+                       [=](size_t j) {return y[j*stride];},op);
+  }
+
+  template <class Op>
+  static void ScanComplexVector(size_t n, size_t stride, size_t threads,
+                                const double *xr, const double *xi, double *yr, double *yi, Op op) {
+    ScanVector<ComplexValue>(n,threads,
+                             [=](size_t j) {return ComplexValue{xr[j*stride],xi[j*stride]};},
+                             [=](size_t j, ComplexValue v) {
+                               yr[j*stride] = v.re;
+                               yi[j*stride] = v.im;
+                             },
+                             [=](size_t j) {return ComplexValue{yr[j*stride],yi[j*stride]};},op);
+  }
+
+  static void ScanReal(const VectorLayout &layout, ScanOp op, const double *x, double *y) {
+    const size_t n = layout.n;
+    const size_t stride = layout.stride;
+    const size_t count = layout.count;
+    if ((n == 0) || (count == 0)) return;
+    const KernelTable &kernels = Kernels();
+    const size_t threads = KernelThreads();
+    if (stride > 1) {
+      // Rows of up to SCAN_ROW adjacent vectors, for each outer position
+      const size_t rows = (stride + SCAN_ROW - 1)/SCAN_ROW;
+      const size_t items = (count/stride)*rows;
+      const size_t per_item = n*std::min(stride,SCAN_ROW);
+      ParallelFor(items,std::max<size_t>(1,ParallelGrain()/per_item),[&](size_t b, size_t e) {
+          for (size_t item=b;item<e;item++) {
+            const size_t i = (item % rows)*SCAN_ROW;
+            const size_t base = (item/rows)*stride*n + i;
+            kernels.dscan(op,x+base,y+base,n,stride,1,std::min(SCAN_ROW,stride-i));
+          }
+        });
+      return;
+    }
+    if (count < threads) {
+      for (size_t v=0;v<count;v++) {
+        const double *xv = x + v*n;
+        double *yv = y + v*n;
+        switch (op) {
+        case SCAN_SUM:
+          ScanRealVector(n,1,threads,xv,yv,[](double a, double b) {return a + b;});
+          break;
+        case SCAN_PROD:
+          ScanRealVector(n,1,threads,xv,yv,[](double a, double b) {return a * b;});
+          break;
+        case SCAN_MAX:
+          ScanRealVector(n,1,threads,xv,yv,[](double a, double b) {return scan_max(a,b);});
+          break;
+        case SCAN_MIN:
+          ScanRealVector(n,1,threads,xv,yv,[](double a, double b) {return scan_min(a,b);});
+          break;
+        }
+      }
+      return;
+    }
+    // Groups of columns
+    const size_t groups = (count + SCAN_GROUP - 1)/SCAN_GROUP;
+    ParallelFor(groups,std::max<size_t>(1,ParallelGrain()/(n*SCAN_GROUP)),[&](size_t b, size_t e) {
+        for (size_t g=b;g<e;g++) {
+          const size_t c = g*SCAN_GROUP;
+          kernels.dscan(op,x+c*n,y+c*n,n,1,n,std::min(SCAN_GROUP,count-c));
+        }
+      });
+  }
+
+  template <class Op>
+  static void ScanComplexVectors(const VectorLayout &layout, const double *xr, const double *xi,
+                                 double *yr, double *yi, Op op) {
+    const size_t n = layout.n;
+    const size_t threads = KernelThreads();
+    // A few long vectors are each split across the threads; otherwise
+    // whole vectors are handed out
+    const size_t split = (layout.count < threads) ? threads : 1;
+    ParallelFor(layout.count,(split > 1) ? layout.count : std::max<size_t>(1,ParallelGrain()/n),
+                [&](size_t b, size_t e) {
+        for (size_t v=b;v<e;v++) {
+          const size_t s = layout.start(v,n);
+          ScanComplexVector(n,layout.stride,split,xr+s,xi+s,yr+s,yi+s,op);
+        }
+      });
+  }
+
+  void ScanDimension(const std::vector<size_t> &dims, size_t dim, ScanOp op,
+                     const double *re, const double *im, double *out_re, double *out_im) {
+    const VectorLayout layout(dims,dim);
+    if ((layout.n == 0) || (layout.count == 0)) return;
+    if (!im || (op == SCAN_SUM)) {
+      ScanReal(layout,op,re,out_re);
+      if (im) ScanReal(layout,op,im,out_im);
+      return;
+    }
+    switch (op) {
+    case SCAN_PROD:
+      ScanComplexVectors(layout,re,im,out_re,out_im,[](ComplexValue a, ComplexValue b) {
+          ComplexValue c;
+          complex_times(a.re,a.im,b.re,b.im,c.re,c.im);
+          return c;
+        });
+      break;
+    case SCAN_MAX:
+      ScanComplexVectors(layout,re,im,out_re,out_im,[](ComplexValue a, ComplexValue b) {
+          if (IsNaN(a)) return b;
+          return (!IsNaN(b) && ComplexAfter(b,a)) ? b : a;
+        });
+      break;
+    case SCAN_MIN:
+      ScanComplexVectors(layout,re,im,out_re,out_im,[](ComplexValue a, ComplexValue b) {
+          if (IsNaN(a)) return b;
+          return (!IsNaN(b) && ComplexAfter(a,b)) ? b : a;
+        });
+      break;
+    default:
+      break;
+    }
+  }
+
+  // Differences of one plane.  Work is handed out as blocks of up to width
+  // adjacent vectors and rows output rows.  Higher orders take each block
+  // (with the order rows after it) into a buffer where the differences are
+  // taken in place.
+  static void DiffPlane(const VectorLayout &layout, size_t order, const double *x, double *y) {
+    const size_t n = layout.n;
+    const size_t m = n - order;
+    const size_t stride = layout.stride;
+    const size_t width = std::min(stride,SCAN_ROW);
+    const size_t strips = (stride + width - 1)/width;
+    const size_t rows = std::max<size_t>(1,DIFF_BLOCK/width);
+    const size_t blocks = (m + rows - 1)/rows;
+    const size_t items = (layout.count/stride)*strips*blocks;
+    ParallelFor(items,std::max<size_t>(1,ParallelGrain()/(width*std::min(rows,m))),
+                [&](size_t b, size_t e) {
+        std::vector<double> buf;
+        for (size_t item=b;item<e;item++) {
+          const size_t outer = item/(strips*blocks);
+          const size_t i = ((item/blocks) % strips)*width;
+          const size_t j = (item % blocks)*rows;
+          const size_t w = std::min(width,stride-i);
+          const size_t r = std::min(rows,m-j);
+          const size_t len = r + order;
+          const double *src = x + outer*stride*n + i + j*stride;
+          double *dst = y + outer*stride*m + i + j*stride;
+          if (order == 1) {
+            // The common case needs no buffer
+            for (size_t k=0;k<r;k++) {
+              const double *s0 = src + k*stride;
+              const double *s1 = s0 + stride;
+              double *d = dst + k*stride;
+              for (size_t c=0;c<w;c++) d[c] = s1[c] - s0[c];
+            }
+            continue;
+          }
+          buf.resize(len*w);
+          for (size_t k=0;k<len;k++)
+            std::copy(src+k*stride,src+k*stride+w,buf.data()+k*w);
+          for (size_t p=1;p<=order;p++) {
+            double *d = buf.data();
+            const size_t cnt = (len-p)*w;
+            for (size_t k=0;k<cnt;k++) d[k] = d[k+w] - d[k];
+          }
+          for (size_t k=0;k<r;k++)
+            std::copy(buf.data()+k*w,buf.data()+(k+1)*w,dst+k*stride);
+        }
+      });
+  }
+
+  void DiffDimension(const std::vector<size_t> &dims, size_t dim, size_t order,
+                     const double *re, const double *im, double *out_re, double *out_im) {
+    const VectorLayout layout(dims,dim);
+    if ((layout.n <= order) || (layout.count == 0)) return;
+    DiffPlane(layout,order,re,out_re);
+    if (im) DiffPlane(layout,order,im,out_im);
+  }
+}
@@ -0,0 +1,86 @@
+#ifndef __scan_hpp__
+#define __scan_hpp__
+
+#include <cstddef>
+#include <vector>
+
+// Cumulative operations (cumsum, cumprod, cummax, cummin) and differences
+// along one dimension of planar real and complex arrays.
+//
+// Scans along a dimension other than the first run across a row of
+// adjacent vectors at a time, so the inner loop is over contiguous data.
+// Along the first dimension, columns are scanned in groups, with the
+// inner loop over the group, which keeps several independent chains in
+// flight.  A long vector on its own is split between threads with a two
+// pass scan: each piece is scanned, and then the totals of the pieces
+// before it are combined in.  (Sums and products of long vectors so split
+// round a little differently from a sequential scan.)
+//
+// cummax and cummin skip NaNs (the result is NaN only until the first
+// number), and order complex values by magnitude and then angle.
+
+namespace FM {
+
+  enum ScanOp {
+    SCAN_SUM = 0,
+    SCAN_PROD = 1,
+    SCAN_MAX = 2,
+    SCAN_MIN = 3
+  };
+
+  inline double scan_max(double a, double b) {
+    return (a != a) ? b : (((b != b) || (b <= a)) ? a : b);
+  }
+
+  inline double scan_min(double a, double b) {
+    return (a != a) ? b : (((b != b) || (b >= a)) ? a : b);
+  }
+
+  template <class Op>
+  inline void scan_loop(const double *x, double *y, size_t n, size_t estride,
+                        size_t vstride, size_t width, Op op) {
+    for (size_t v=0;v<width;v++) y[v*vstride] = x[v*vstride];
+    for (size_t j=1;j<n;j++) {
+      const double *xj = x + j*estride;
+      double *yj = y + j*estride;
+      const double *yp = yj - estride;
+      for (size_t v=0;v<width;v++)
+        yj[v*vstride] = op(yp[v*vstride],xj[v*vstride]);
+    }
+  }
+
+  // Scans width vectors of n elements.  Element j of vector v is at
+  // v*vstride + j*estride in x and y.  The inner loop runs across the
+  // vectors, so it is contiguous when vstride is 1.
+  inline void scan_kernel(int op, const double *x, double *y, size_t n, size_t estride,
+                          size_t vstride, size_t width) {
+    if (n == 0) return;
+    switch (op) {
+    case SCAN_SUM:
+      scan_loop(x,y,n,estride,vstride,width,[](double a, double b) {return a + b;});
+      break;
+    case SCAN_PROD:
+      scan_loop(x,y,n,estride,vstride,width,[](double a, double b) {return a * b;});
+      break;
+    case SCAN_MAX:
+      scan_loop(x,y,n,estride,vstride,width,[](double a, double b) {return scan_max(a,b);});
+      break;
+    case SCAN_MIN:
+      scan_loop(x,y,n,estride,vstride,width,[](double a, double b) {return scan_min(a,b);});
+      break;
+    }
+  }
+
+  // The cumulative op along dimension dim (zero based).  im and out_im are
+  // null for real data.
+  void ScanDimension(const std::vector<size_t> &dims, size_t dim, ScanOp op,
+                     const double *re, const double *im, double *out_re, double *out_im);
+
+  // The order'th difference along dimension dim (zero based), which is
+  // order shorter along dim than the input (or empty, if it is not that
+  // long).  im and out_im are null for real data.
+  void DiffDimension(const std::vector<size_t> &dims, size_t dim, size_t order,
+                     const double *re, const double *im, double *out_re, double *out_im);
+}
+
+#endif
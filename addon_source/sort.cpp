@@ -0,0 +1,346 @@
+#include "sort.hpp"
+#include "cpu_dispatch.hpp"
+#include "nd_layout.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <memory>
+
+namespace FM {
+
+  const int RADIX_BITS = 8;
+  const size_t RADIX_BUCKETS = size_t(1) << RADIX_BITS;
+  const int RADIX_PASSES = 64/RADIX_BITS;
+
+  // Shorter vectors are sorted by insertion
+  const size_t SORT_INSERTION_MAX = 32;
+
+  // The least work (in elements) worth giving to a thread
+  const size_t SORT_MIN_PER_THREAD = size_t(1) << 16;
+
+  struct Histogram {
+    size_t count[RADIX_PASSES][RADIX_BUCKETS];
+  };
+
+  static inline size_t Digit(uint64_t key, int pass) {
+    return (key >> (pass*RADIX_BITS)) & (RADIX_BUCKETS-1);
+  }
+
+  static void CountDigits(const uint64_t *keys, size_t n, Histogram &hist) {
+    std::fill(&hist.count[0][0],&hist.count[0][0]+RADIX_PASSES*RADIX_BUCKETS,size_t(0));
+    for (size_t i=0;i<n;i++) {
+      const uint64_t k = keys[i];
+      for (int p=0;p<RADIX_PASSES;p++)
+        hist.count[p][Digit(k,p)]++;
+    }
+  }
+
+  // Stable insertion sort of keys, carrying idx along
+  static void InsertionSort(uint64_t *keys, size_t *idx, size_t n) {
+    for (size_t i=1;i<n;i++) {
+      const uint64_t k = keys[i];
+      const size_t x = idx[i];
+      size_t j = i;
+      for (;(j > 0) && (keys[j-1] > k);j--) {
+        keys[j] = keys[j-1];
+        idx[j] = idx[j-1];
+      }
+      keys[j] = k;
+      idx[j] = x;
+    }
+  }
+
+  // Stable LSD radix sort of keys, carrying idx along.  kt and it are
+  // scratch of length n.  Passes over digits on which every key agrees
+  // (e.g., the exponent bytes of data of one magnitude) are skipped.
+  static void RadixSort(uint64_t *keys, size_t *idx, size_t n, uint64_t *kt, size_t *it) {
+    if (n <= SORT_INSERTION_MAX) {
+      InsertionSort(keys,idx,n);
+      return;
+    }
+    std::unique_ptr<Histogram> hist(new Histogram);
+    CountDigits(keys,n,*hist);
+    uint64_t *src_k = keys, *dst_k = kt;
+    size_t *src_i = idx, *dst_i = it;
+    for (int p=0;p<RADIX_PASSES;p++) {
+      size_t *h = hist->count[p];
+      if (h[Digit(src_k[0],p)] == n) continue;
+      size_t offset = 0;
+      for (size_t d=0;d<RADIX_BUCKETS;d++) {
+        const size_t c = h[d];
+        h[d] = offset;
+        offset += c;
+      }
+      for (size_t i=0;i<n;i++) {
+        const size_t pos = h[Digit(src_k[i],p)]++;
+        dst_k[pos] = src_k[i];
+        dst_i[pos] = src_i[i];
+      }
+      std::swap(src_k,dst_k);
+      std::swap(src_i,dst_i);
+    }
+    if (src_k != keys) {
+      std::copy(src_k,src_k+n,keys);
+      std::copy(src_i,src_i+n,idx);
+    }
+  }
+
+  // The same sort for one long vector, with the data split into a chunk per
+  // thread.  Each pass counts the digits of each chunk, and then the chunks
+  // scatter in parallel, each to its own part of every bucket.
+  static void ParallelRadixSort(uint64_t *keys, size_t *idx, size_t n, uint64_t *kt, size_t *it,
+                                size_t threads) {
+    const size_t chunk = (n + threads - 1)/threads;
+    std::vector<std::array<size_t,RADIX_BUCKETS> > counts(threads);
+    std::unique_ptr<Histogram> total(new Histogram);
+    {
+      std::vector<std::unique_ptr<Histogram> > partial(threads);
+      ParallelFor(threads,1,[&](size_t t0, size_t t1) {
+          for (size_t t=t0;t<t1;t++) {
+            partial[t].reset(new Histogram);
+            const size_t b = std::min(n,t*chunk);
+            CountDigits(keys+b,std::min(n,b+chunk)-b,*partial[t]);
+          }
+        });
+      std::fill(&total->count[0][0],&total->count[0][0]+RADIX_PASSES*RADIX_BUCKETS,size_t(0));
+      for (auto &h : partial)
+        for (int p=0;p<RADIX_PASSES;p++)
+          for (size_t d=0;d<RADIX_BUCKETS;d++)
+            total->count[p][d] += h->count[p][d];
+    }
+    uint64_t *src_k = keys, *dst_k = kt;
+    size_t *src_i = idx, *dst_i = it;
+    for (int p=0;p<RADIX_PASSES;p++) {
+      if (total->count[p][Digit(src_k[0],p)] == n) continue;
+      ParallelFor(threads,1,[&](size_t t0, size_t t1) {
+          for (size_t t=t0;t<t1;t++) {
+            auto &c = counts[t];
+            std::fill(c.begin(),c.end(),size_t(0));
+            const size_t b = std::min(n,t*chunk);
+            const size_t e = std::min(n,b+chunk);
+            for (size_t i=b;i<e;i++) c[Digit(src_k[i],p)]++;
+          }
+        });
+      size_t offset = 0;
+      for (size_t d=0;d<RADIX_BUCKETS;d++)
+        for (size_t t=0;t<threads;t++) {
+          const size_t c = counts[t][d];
+          counts[t][d] = offset;
+          offset += c;
+        }
+      ParallelFor(threads,1,[&](size_t t0, size_t t1) {
+          for (size_t t=t0;t<t1;t++) {
+            auto &c = counts[t];
+            const size_t b = std::min(n,t*chunk);
+            const size_t e = std::min(n,b+chunk);
+            for (size_t i=b;i<e;i++) {
+              const size_t pos = c[Digit(src_k[i],p)]++;
+              dst_k[pos] = src_k[i];
+              dst_i[pos] = src_i[i];
+            }
+          }
+        });
+      std::swap(src_k,dst_k);
+      std::swap(src_i,dst_i);
+    }
+    if (src_k != keys) {
+      std::copy(src_k,src_k+n,keys);
+      std::copy(src_i,src_i+n,idx);
+    }
+  }
+
+  // Scratch for SortVector, reused from vector to vector
+  struct SortWork {
+    std::vector<uint64_t> keys, kt;
+    std::vector<size_t> it;
+    std::vector<double> a, b, mag, arg;
+    std::vector<uint64_t> sec;
+    void resize(size_t n, bool complex) {
+      keys.resize(n);
+      kt.resize(n);
+      it.resize(n);
+      if (complex) {
+        a.resize(n);
+        b.resize(n);
+        mag.resize(n);
+        arg.resize(n);
+        sec.resize(n);
+      }
+    }
+  };
+
+  // Sort n elements that are stride apart, leaving the order in idx and the
+  // sorted keys in w.keys.  For complex data the angle is sorted on first,
+  // and then (stably) the magnitude; w.sec gets the angle keys in the final
+  // order.
+  static void SortVector(const double *re, const double *im, size_t n, size_t stride,
+                         bool descending, size_t threads, SortWork &w, size_t *idx) {
+    w.resize(n,im != nullptr);
+    const uint64_t flip = descending ? ~uint64_t(0) : 0;
+    for (size_t k=0;k<n;k++) idx[k] = k;
+    auto sort = [&](uint64_t *keys) {
+      if (threads > 1)
+        ParallelRadixSort(keys,idx,n,w.kt.data(),w.it.data(),threads);
+      else
+        RadixSort(keys,idx,n,w.kt.data(),w.it.data());
+    };
+    if (!im) {
+      for (size_t k=0;k<n;k++) w.keys[k] = SortKey(re[k*stride]) ^ flip;
+      sort(w.keys.data());
+      return;
+    }
+    for (size_t k=0;k<n;k++) {
+      w.a[k] = re[k*stride];
+      w.b[k] = im[k*stride];
+    }
+    Kernels().dhypot(w.a.data(),w.b.data(),w.mag.data(),n);
+    Kernels().datan2(w.b.data(),w.a.data(),w.arg.data(),n);
+    for (size_t k=0;k<n;k++) {
+      // A NaN in either part makes the element sort with the NaNs
+      const double m = ((w.a[k] != w.a[k]) || (w.b[k] != w.b[k])) ?
+        std::numeric_limits<double>::quiet_NaN() : w.mag[k];
+      w.keys[k] = SortKey(w.arg[k]) ^ flip;
+      w.mag[k] = m;
+    }
+    sort(w.keys.data());
+    for (size_t k=0;k<n;k++) {
+      w.sec[k] = w.keys[k];
+      w.keys[k] = SortKey(w.mag[idx[k]]) ^ flip;
+    }
+    // Carry the angle keys through the second sort by sorting positions
+    std::vector<size_t> order(n), outer(idx,idx+n);
+    for (size_t k=0;k<n;k++) order[k] = k;
+    size_t *pos = order.data();
+    if (threads > 1)
+      ParallelRadixSort(w.keys.data(),pos,n,w.kt.data(),w.it.data(),threads);
+    else
+      RadixSort(w.keys.data(),pos,n,w.kt.data(),w.it.data());
+    for (size_t k=0;k<n;k++) {
+      idx[k] = outer[pos[k]];
+      w.kt[k] = w.sec[pos[k]];
+    }
+    std::copy(w.kt.begin(),w.kt.begin()+n,w.sec.begin());
+  }
+
+  void SortDimension(const std::vector<size_t> &dims, size_t dim, bool descending,
+                     const double *re, const double *im, double *out_re, double *out_im,
+                     double *index) {
+    const VectorLayout layout(dims,dim);
+    const size_t n = layout.n;
+    const size_t stride = layout.stride;
+    if (n == 0) return;
+    // A single long vector is split itself; otherwise whole vectors are
+    // handed out
+    const size_t threads = (layout.count == 1) ?
+      std::min<size_t>(KernelThreads(),n/SORT_MIN_PER_THREAD) : 1;
+    ParallelFor(layout.count,std::max<size_t>(1,SORT_MIN_PER_THREAD/n),[&](size_t v0, size_t v1) {
+        SortWork w;
+        std::vector<size_t> idx(n);
+        for (size_t v=v0;v<v1;v++) {
+          const size_t start = layout.start(v,n);
+          SortVector(re+start,im ? im+start : nullptr,n,stride,descending,threads,w,idx.data());
+          for (size_t k=0;k<n;k++) {
+            const size_t src = start + idx[k]*stride;
+            const size_t dst = start + k*stride;
+            out_re[dst] = re[src];
+            if (im) out_im[dst] = im[src];
+            if (index) index[dst] = static_cast<double>(idx[k] + 1);
+          }
+        }
+      });
+  }
+
+  void Unique(size_t n, const double *re, const double *im, std::vector<double> &c_re,
+              std::vector<double> &c_im, std::vector<double> &ia, double *ic) {
+    c_re.clear();
+    c_im.clear();
+    ia.clear();
+    if (n == 0) return;
+    SortWork w;
+    std::vector<size_t> idx(n);
+    const size_t threads = std::min<size_t>(KernelThreads(),n/SORT_MIN_PER_THREAD);
+    SortVector(re,im,n,1,false,threads,w,idx.data());
+    // w.keys holds the sorted (primary) keys.  Each NaN is a group of its
+    // own; NaN keys are all ones.
+    const uint64_t nan_key = ~uint64_t(0);
+    auto same_key = [&](size_t j, size_t k) {
+      return (w.keys[j] == w.keys[k]) && (w.keys[j] != nan_key) &&
+        (!im || (w.sec[j] == w.sec[k]));
+    };
+    // Distinct complex values can round to the same magnitude and angle, so
+    // each run of equal keys is ordered (stably) on the parts themselves,
+    // which are then compared exactly
+    if (im) {
+      for (size_t s=0;s<n;) {
+        size_t e = s+1;
+        while ((e < n) && same_key(s,e)) e++;
+        if (e - s > 1)
+          std::stable_sort(idx.begin()+s,idx.begin()+e,[&](size_t x, size_t y) {
+              return (re[x] < re[y]) || ((re[x] == re[y]) && (im[x] < im[y]));
+            });
+        s = e;
+      }
+    }
+    for (size_t k=0;k<n;k++) {
+      const bool same = (k > 0) && same_key(k,k-1) &&
+        (!im || ((re[idx[k]] == re[idx[k-1]]) && (im[idx[k]] == im[idx[k-1]])));
+      if (!same) {
+        c_re.push_back(re[idx[k]]);
+        if (im) c_im.push_back(im[idx[k]]);
+        ia.push_back(static_cast<double>(idx[k] + 1));
+      }
+      ic[idx[k]] = static_cast<double>(c_re.size());
+    }
+  }
+
+  // Elements are split into this many chunks for counting
+  static size_t FindChunks(size_t n) {
+    return std::max<size_t>(1,std::min<size_t>(KernelThreads(),n/SORT_MIN_PER_THREAD));
+  }
+
+  static size_t CountRange(const double *re, const double *im, size_t b, size_t e) {
+    size_t count = 0;
+    if (im) {
+      for (size_t i=b;i<e;i++) count += ((re[i] != 0) || (im[i] != 0)) ? 1 : 0;
+    } else {
+      for (size_t i=b;i<e;i++) count += (re[i] != 0) ? 1 : 0;
+    }
+    return count;
+  }
+
+  size_t CountNonzero(size_t n, const double *re, const double *im) {
+    const size_t chunks = FindChunks(n);
+    const size_t chunk = (n + chunks - 1)/chunks;
+    std::vector<size_t> counts(chunks);
+    ParallelFor(chunks,1,[&](size_t c0, size_t c1) {
+        for (size_t c=c0;c<c1;c++)
+          counts[c] = CountRange(re,im,std::min(n,c*chunk),std::min(n,(c+1)*chunk));
+      });
+    size_t total = 0;
+    for (auto c : counts) total += c;
+    return total;
+  }
+
+  void FindNonzero(size_t n, const double *re, const double *im, size_t count, double *index) {
+    const size_t chunks = FindChunks(n);
+    const size_t chunk = (n + chunks - 1)/chunks;
+    std::vector<size_t> offsets(chunks+1,0);
+    if (chunks > 1) {
+      ParallelFor(chunks,1,[&](size_t c0, size_t c1) {
+          for (size_t c=c0;c<c1;c++)
+            offsets[c+1] = CountRange(re,im,std::min(n,c*chunk),std::min(n,(c+1)*chunk));
+        });
+      for (size_t c=0;c<chunks;c++) offsets[c+1] += offsets[c];
+    }
+    ParallelFor(chunks,1,[&](size_t c0, size_t c1) {
+        for (size_t c=c0;c<c1;c++) {
+          size_t pos = offsets[c];
+          const size_t e = std::min(n,(c+1)*chunk);
+          for (size_t i=std::min(n,c*chunk);(i<e) && (pos<count);i++)
+            if ((re[i] != 0) || (im && (im[i] != 0)))
+              index[pos++] = static_cast<double>(i + 1);
+        }
+      });
+  }
+}
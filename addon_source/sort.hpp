@@ -0,0 +1,51 @@
+#ifndef __sort_hpp__
+#define __sort_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Sorting and searching of planar real and complex data.  Sorting is a
+// stable LSD radix sort on keys made from the IEEE bit patterns, so that it
+// costs a fixed number of passes over the data whatever the values.  NaNs
+// sort after everything else (before everything when descending), and -0
+// is equal to 0.  Complex values sort by magnitude and then by angle.
+
+namespace FM {
+
+  // An order preserving map from doubles to unsigned integers, with all NaNs
+  // mapped to the largest key and -0 to the key of 0
+  inline uint64_t SortKey(double x) {
+    if (x != x) return ~uint64_t(0);
+    if (x == 0) x = 0.0;
+    uint64_t u;
+    static_assert(sizeof(u) == sizeof(x),"doubles must be 64 bits");
+    memcpy(&u,&x,sizeof(u));
+    return (u >> 63) ? ~u : (u | 0x8000000000000000ULL);
+  }
+
+  // Sort every vector along dimension dim (zero based).  im and out_im are
+  // null for real data.  index (if not null) gets the one based position in
+  // the input of each output element.  Many vectors are split across
+  // threads, and so is a single long one.
+  void SortDimension(const std::vector<size_t> &dims, size_t dim, bool descending,
+                     const double *re, const double *im, double *out_re, double *out_im,
+                     double *index);
+
+  // The distinct values of the n elements, in sorted order, with the one
+  // based indices ia of their first occurrences, and ic such that element k
+  // is value ic[k].  NaNs are all distinct.  c_im is left empty for real
+  // data.
+  void Unique(size_t n, const double *re, const double *im, std::vector<double> &c_re,
+              std::vector<double> &c_im, std::vector<double> &ia, double *ic);
+
+  // The number of nonzero elements
+  size_t CountNonzero(size_t n, const double *re, const double *im);
+
+  // The one based indices of the first count nonzero elements, where count
+  // is at most CountNonzero(n, re, im)
+  void FindNonzero(size_t n, const double *re, const double *im, size_t count, double *index);
+}
+
+#endif
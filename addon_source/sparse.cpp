@@ -0,0 +1,319 @@
+#include "sparse.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <numeric>
+
+namespace FM {
+
+  // The least number of multiply-adds worth giving to a thread
+  const size_t SPARSE_MIN_PER_THREAD = size_t(1) << 15;
+
+  bool CheckSparse(const SparseView &S, std::string &error) {
+    if (S.colptr[0] != 0) {
+      error = "Sparse column pointers must start at zero";
+      return false;
+    }
+    for (size_t j=0;j<S.cols;j++) {
+      const int32_t p0 = S.colptr[j];
+      const int32_t p1 = S.colptr[j+1];
+      if (p1 < p0) {
+        error = "Sparse column pointers must not decrease";
+        return false;
+      }
+      for (int32_t p=p0;p<p1;p++) {
+        const int32_t i = S.rowind[p];
+        if ((i < 0) || (size_t(i) >= S.rows) || ((p > p0) && (i <= S.rowind[p-1]))) {
+          error = "Sparse row indices must be increasing and in range";
+          return false;
+        }
+      }
+    }
+    return true;
+  }
+
+  // Converts a one based index to zero based, checking it against limit
+  static bool ZeroBased(double x, size_t limit, int32_t &i) {
+    if (!(x >= 1) || (x != std::floor(x)) || (x > double(limit))) return false;
+    i = int32_t(x - 1);
+    return true;
+  }
+
+  bool SparseFromTriplets(size_t rows, size_t cols, size_t n, const double *i, const double *j,
+                          const double *v, SparseMatrix &S, std::string &error) {
+    if ((rows > SPARSE_MAX_NNZ) || (cols > SPARSE_MAX_NNZ) || (n > SPARSE_MAX_NNZ)) {
+      error = "Sparse matrix is too large";
+      return false;
+    }
+    std::vector<int32_t> row(n), col(n);
+    for (size_t k=0;k<n;k++) {
+      if (!ZeroBased(i[k],rows,row[k]) || !ZeroBased(j[k],cols,col[k])) {
+        error = "Sparse indices must be positive integers within the matrix dimensions";
+        return false;
+      }
+    }
+    // Bucket the triplets by column
+    std::vector<int32_t> start(cols+1,0);
+    for (size_t k=0;k<n;k++) start[col[k]+1]++;
+    std::partial_sum(start.begin(),start.end(),start.begin());
+    std::vector<int32_t> order(n);
+    std::vector<int32_t> next(start.begin(),start.end()-1);
+    for (size_t k=0;k<n;k++) order[next[col[k]]++] = int32_t(k);
+    // Sort each column by row, summing duplicates and dropping zeros.
+    // The columns are compacted in place, and then closed up.
+    std::vector<int32_t> count(cols,0);
+    std::vector<int32_t> srow(n);
+    std::vector<double> sval(n);
+    ParallelFor(cols,std::max<size_t>(1,SPARSE_MIN_PER_THREAD*cols/std::max<size_t>(1,n)),
+                [&](size_t b, size_t e) {
+        for (size_t c=b;c<e;c++) {
+          int32_t *o = order.data() + start[c];
+          const int32_t len = start[c+1] - start[c];
+          std::sort(o,o+len,[&](int32_t x, int32_t y) {
+              return (row[x] < row[y]) || ((row[x] == row[y]) && (x < y));
+            });
+          int32_t out = start[c];
+          int32_t k = 0;
+          while (k < len) {
+            const int32_t r = row[o[k]];
+            double sum = 0;
+            for (;(k < len) && (row[o[k]] == r);k++) sum += v[o[k]];
+            if (sum != 0) {
+              srow[out] = r;
+              sval[out] = sum;
+              out++;
+            }
+          }
+          count[c] = out - start[c];
+        }
+      });
+    S.rows = rows;
+    S.cols = cols;
+    S.colptr.assign(cols+1,0);
+    for (size_t c=0;c<cols;c++) S.colptr[c+1] = S.colptr[c] + count[c];
+    S.rowind.resize(S.colptr[cols]);
+    S.values.resize(S.colptr[cols]);
+    for (size_t c=0;c<cols;c++) {
+      std::copy(srow.begin()+start[c],srow.begin()+start[c]+count[c],S.rowind.begin()+S.colptr[c]);
+      std::copy(sval.begin()+start[c],sval.begin()+start[c]+count[c],S.values.begin()+S.colptr[c]);
+    }
+    return true;
+  }
+
+  bool SparseFromDense(size_t rows, size_t cols, const double *A, SparseMatrix &S,
+                       std::string &error) {
+    if ((rows > SPARSE_MAX_NNZ) || (cols > SPARSE_MAX_NNZ)) {
+      error = "Sparse matrix is too large";
+      return false;
+    }
+    std::vector<size_t> count(cols+1,0);
+    const size_t min_cols = std::max<size_t>(1,SPARSE_MIN_PER_THREAD/std::max<size_t>(1,rows));
+    ParallelFor(cols,min_cols,[&](size_t b, size_t e) {
+        for (size_t c=b;c<e;c++) {
+          const double *a = A + c*rows;
+          size_t cnt = 0;
+          for (size_t r=0;r<rows;r++) cnt += (a[r] != 0);
+          count[c+1] = cnt;
+        }
+      });
+    std::partial_sum(count.begin(),count.end(),count.begin());
+    if (count[cols] > SPARSE_MAX_NNZ) {
+      error = "Sparse matrix has too many nonzeros";
+      return false;
+    }
+    S.rows = rows;
+    S.cols = cols;
+    S.colptr.assign(count.begin(),count.end());
+    S.rowind.resize(count[cols]);
+    S.values.resize(count[cols]);
+    ParallelFor(cols,min_cols,[&](size_t b, size_t e) {
+        for (size_t c=b;c<e;c++) {
+          const double *a = A + c*rows;
+          size_t p = count[c];
+          for (size_t r=0;r<rows;r++)
+            if (a[r] != 0) {
+              S.rowind[p] = int32_t(r);
+              S.values[p++] = a[r];
+            }
+        }
+      });
+    return true;
+  }
+
+  void SparseToDense(const SparseView &S, double *A) {
+    ParallelFor(S.cols,std::max<size_t>(1,SPARSE_MIN_PER_THREAD/std::max<size_t>(1,S.rows)),
+                [&](size_t b, size_t e) {
+        for (size_t c=b;c<e;c++) {
+          double *a = A + c*S.rows;
+          for (int32_t p=S.colptr[c];p<S.colptr[c+1];p++)
+            a[S.rowind[p]] = S.values[p];
+        }
+      });
+  }
+
+  void SparseTranspose(const SparseView &A, SparseMatrix &T) {
+    const size_t nnz = A.nnz();
+    T.rows = A.cols;
+    T.cols = A.rows;
+    T.colptr.assign(A.rows+1,0);
+    T.rowind.resize(nnz);
+    T.values.resize(nnz);
+    for (size_t p=0;p<nnz;p++) T.colptr[A.rowind[p]+1]++;
+    std::partial_sum(T.colptr.begin(),T.colptr.end(),T.colptr.begin());
+    std::vector<int32_t> next(T.colptr.begin(),T.colptr.end()-1);
+    // Walking the columns in order leaves the rows of T increasing
+    for (size_t c=0;c<A.cols;c++)
+      for (int32_t p=A.colptr[c];p<A.colptr[c+1];p++) {
+        const int32_t q = next[A.rowind[p]]++;
+        T.rowind[q] = int32_t(c);
+        T.values[q] = A.values[p];
+      }
+  }
+
+  // y += A(:,b:e)*x(b:e)
+  static void ColumnsTimesVector(const SparseView &A, size_t b, size_t e, const double *x,
+                                 double *y) {
+    for (size_t k=b;k<e;k++) {
+      const double xk = x[k];
+      for (int32_t p=A.colptr[k];p<A.colptr[k+1];p++)
+        y[A.rowind[p]] += A.values[p]*xk;
+    }
+  }
+
+  void SparseTimesDense(const SparseView &A, const double *B, size_t bcols, double *C) {
+    const size_t m = A.rows;
+    const size_t k = A.cols;
+    const size_t nnz = A.nnz();
+    std::fill(C,C+m*bcols,0.0);
+    const size_t threads = KernelThreads();
+    const size_t work = std::max<size_t>(1,nnz);
+    if ((bcols >= threads) || (work*bcols < 2*SPARSE_MIN_PER_THREAD)) {
+      // Each thread takes whole columns of the product
+      ParallelFor(bcols,std::max<size_t>(1,SPARSE_MIN_PER_THREAD/work),[&](size_t b, size_t e) {
+          for (size_t c=b;c<e;c++)
+            ColumnsTimesVector(A,0,k,B+c*k,C+c*m);
+        });
+      return;
+    }
+    // A few long columns: the columns of A are split between the threads,
+    // each of which accumulates into its own copy of the product (the first
+    // into C), and the copies are then summed
+    const size_t pieces = std::max<size_t>(1,std::min(threads,work*bcols/SPARSE_MIN_PER_THREAD));
+    std::vector<size_t> split(pieces+1,k);
+    // Split at equal numbers of nonzeros
+    split[0] = 0;
+    for (size_t t=1;t<pieces;t++) {
+      const int32_t target = int32_t(nnz*t/pieces);
+      split[t] = size_t(std::lower_bound(A.colptr,A.colptr+k+1,target) - A.colptr);
+    }
+    std::vector<std::vector<double> > partial(pieces-1,std::vector<double>(m*bcols,0.0));
+    ParallelFor(pieces,1,[&](size_t b, size_t e) {
+        for (size_t t=b;t<e;t++) {
+          double *out = (t == 0) ? C : partial[t-1].data();
+          for (size_t c=0;c<bcols;c++)
+            ColumnsTimesVector(A,split[t],split[t+1],B+c*k,out+c*m);
+        }
+      });
+    const size_t len = m*bcols;
+    ParallelFor(len,SPARSE_MIN_PER_THREAD,[&](size_t b, size_t e) {
+        for (auto &part : partial)
+          for (size_t i=b;i<e;i++) C[i] += part[i];
+      });
+  }
+
+  void DenseTimesSparse(const double *B, size_t brows, const SparseView &A, double *C) {
+    const size_t per_col = std::max<size_t>(1,brows*A.nnz()/std::max<size_t>(1,A.cols));
+    ParallelFor(A.cols,std::max<size_t>(1,SPARSE_MIN_PER_THREAD/per_col),[&](size_t b, size_t e) {
+        for (size_t c=b;c<e;c++) {
+          double *out = C + c*brows;
+          std::fill(out,out+brows,0.0);
+          for (int32_t p=A.colptr[c];p<A.colptr[c+1];p++) {
+            const double *x = B + size_t(A.rowind[p])*brows;
+            const double a = A.values[p];
+            for (size_t r=0;r<brows;r++) out[r] += x[r]*a;
+          }
+        }
+      });
+  }
+
+  // The columns of a product computed by one thread
+  struct ProductPiece {
+    std::vector<int32_t> count;
+    std::vector<int32_t> rowind;
+    std::vector<double> values;
+  };
+
+  bool SparseTimesSparse(const SparseView &A, const SparseView &B, SparseMatrix &C,
+                         std::string &error) {
+    const size_t m = A.rows;
+    const size_t n = B.cols;
+    // The multiply-adds, to decide how to split the columns of B
+    size_t flops = 0;
+    for (size_t p=0;p<B.nnz();p++)
+      flops += size_t(A.colptr[B.rowind[p]+1] - A.colptr[B.rowind[p]]);
+    const size_t threads = KernelThreads();
+    const size_t pieces = std::max<size_t>(1,std::min(std::min(threads,n),flops/SPARSE_MIN_PER_THREAD));
+    const size_t chunk = (n + pieces - 1)/std::max<size_t>(1,pieces);
+    std::vector<ProductPiece> results(pieces);
+    // Gustavson's method: column j of C is the sum of the columns of A
+    // picked out by column j of B, accumulated in a dense workspace
+    ParallelFor(pieces,1,[&](size_t b, size_t e) {
+        std::vector<int32_t> mark(m,-1);
+        std::vector<double> acc(m);
+        std::vector<int32_t> pattern;
+        for (size_t t=b;t<e;t++) {
+          ProductPiece &piece = results[t];
+          const size_t c0 = std::min(n,t*chunk);
+          const size_t c1 = std::min(n,c0+chunk);
+          piece.count.assign(c1-c0,0);
+          for (size_t c=c0;c<c1;c++) {
+            pattern.clear();
+            for (int32_t q=B.colptr[c];q<B.colptr[c+1];q++) {
+              const size_t k = size_t(B.rowind[q]);
+              const double bkc = B.values[q];
+              for (int32_t p=A.colptr[k];p<A.colptr[k+1];p++) {
+                const int32_t i = A.rowind[p];
+                if (mark[i] != int32_t(c)) {
+                  mark[i] = int32_t(c);
+                  acc[i] = 0;
+                  pattern.push_back(i);
+                }
+                acc[i] += A.values[p]*bkc;
+              }
+            }
+            std::sort(pattern.begin(),pattern.end());
+            int32_t cnt = 0;
+            for (auto i : pattern)
+              if (acc[i] != 0) {
+                piece.rowind.push_back(i);
+                piece.values.push_back(acc[i]);
+                cnt++;
+              }
+            piece.count[c-c0] = cnt;
+          }
+        }
+      });
+    size_t nnz = 0;
+    for (auto &piece : results) nnz += piece.rowind.size();
+    if (nnz > SPARSE_MAX_NNZ) {
+      error = "Sparse product has too many nonzeros";
+      return false;
+    }
+    C.rows = m;
+    C.cols = n;
+    C.colptr.assign(n+1,0);
+    C.rowind.resize(nnz);
+    C.values.resize(nnz);
+    size_t c = 0;
+    for (auto &piece : results) {
+      const int32_t base = C.colptr[c];
+      for (auto cnt : piece.count) {
+        C.colptr[c+1] = C.colptr[c] + cnt;
+        c++;
+      }
+      std::copy(piece.rowind.begin(),piece.rowind.end(),C.rowind.begin()+base);
+      std::copy(piece.values.begin(),piece.values.end(),C.values.begin()+base);
+    }
+    return true;
+  }
+}
@@ -0,0 +1,88 @@
+#ifndef __sparse_hpp__
+#define __sparse_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+// Real sparse matrices in compressed sparse column (CSC) form.  Column j
+// holds the rows rowind[colptr[j]] .. rowind[colptr[j+1]-1] (zero based,
+// strictly increasing) with the values in the same positions.  Explicit
+// zeros are never stored.  Indices are 32 bit, which is what the
+// Int32Arrays on the JS side hold, so a matrix has fewer than 2^31
+// nonzeros.
+
+namespace FM {
+
+  // A matrix we own
+  struct SparseMatrix {
+    size_t rows = 0;
+    size_t cols = 0;
+    std::vector<int32_t> colptr;
+    std::vector<int32_t> rowind;
+    std::vector<double> values;
+  };
+
+  // A matrix held elsewhere (e.g., in the typed arrays of a JS object)
+  struct SparseView {
+    size_t rows;
+    size_t cols;
+    const int32_t *colptr;
+    const int32_t *rowind;
+    const double *values;
+    size_t nnz() const {return size_t(colptr[cols]);}
+  };
+
+  inline SparseView View(const SparseMatrix &S) {
+    return SparseView{S.rows,S.cols,S.colptr.data(),S.rowind.data(),S.values.data()};
+  }
+
+  // The most nonzeros a matrix can have
+  const size_t SPARSE_MAX_NNZ = 0x7fffffff;
+
+  // Checks that a view is well formed (pointers in order and in range, and
+  // rows increasing and in range), so that the kernels can trust it
+  bool CheckSparse(const SparseView &S, std::string &error);
+
+  // Builds S from n (one based) triplets, summing duplicates and dropping
+  // zeros
+  bool SparseFromTriplets(size_t rows, size_t cols, size_t n, const double *i, const double *j,
+                          const double *v, SparseMatrix &S, std::string &error);
+
+  // The nonzeros of a column major dense matrix
+  bool SparseFromDense(size_t rows, size_t cols, const double *A, SparseMatrix &S,
+                       std::string &error);
+
+  // Fills the rows x cols column major matrix A (which must be zeroed)
+  void SparseToDense(const SparseView &S, double *A);
+
+  void SparseTranspose(const SparseView &A, SparseMatrix &T);
+
+  // C = A*B for a dense B with bcols columns, into the (zeroed) dense C
+  void SparseTimesDense(const SparseView &A, const double *B, size_t bcols, double *C);
+
+  // C = B*A for a dense B with brows rows, into the dense C
+  void DenseTimesSparse(const double *B, size_t brows, const SparseView &A, double *C);
+
+  // C = A*B
+  bool SparseTimesSparse(const SparseView &A, const SparseView &B, SparseMatrix &C,
+                         std::string &error);
+
+  // Solves A*X = B for a square A and a dense B with bcols columns.  A
+  // symmetric matrix with a positive diagonal is factored by Cholesky (if
+  // that breaks down, by LU), after a reverse Cuthill-McKee ordering to
+  // keep the fill near the diagonal; other matrices by LU with partial
+  // pivoting (preferring the diagonal) in the same ordering.  Returns
+  // false (with error set) if a pivot is zero, and warns if one is no
+  // larger than eps*norm(A,1).
+  bool SparseSolve(const SparseView &A, const double *B, size_t bcols, double *X,
+                   std::function<void(std::string)> warn, std::string &error);
+
+  // The reverse Cuthill-McKee ordering of the pattern of A + A': perm[k]
+  // is the original index of the k'th row and column
+  void ReverseCuthillMcKee(const SparseView &A, std::vector<int32_t> &perm);
+}
+
+#endif
@@ -0,0 +1,477 @@
+#include "sparse.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <numeric>
+
+// The sparse direct solver.  The factorizations follow Davis, "Direct
+// Methods for Sparse Linear Systems" (CSparse): an up-looking Cholesky
+// driven by the elimination tree, and a left-looking (Gilbert-Peierls) LU
+// with threshold partial pivoting, both applied to the matrix permuted by
+// reverse Cuthill-McKee.
+
+namespace FM {
+
+  // Pivots smaller than this fraction of the largest candidate in their
+  // column are passed over for the diagonal, to keep the fill of the
+  // ordering
+  const double SPARSE_PIVOT_TOLERANCE = 0.1;
+
+  // The adjacency (as CSC) of the pattern of A + A', without the diagonal
+  static void SymmetricPattern(const SparseView &A, std::vector<int32_t> &ptr,
+                               std::vector<int32_t> &adj) {
+    const size_t n = A.cols;
+    SparseMatrix T;
+    SparseTranspose(A,T);
+    ptr.assign(n+1,0);
+    adj.clear();
+    adj.reserve(2*A.nnz());
+    for (size_t j=0;j<n;j++) {
+      // Merge the (sorted) rows of column j of A and of A'
+      int32_t p = A.colptr[j], pe = A.colptr[j+1];
+      int32_t q = T.colptr[j], qe = T.colptr[j+1];
+      while ((p < pe) || (q < qe)) {
+        int32_t i;
+        if ((q >= qe) || ((p < pe) && (A.rowind[p] < T.rowind[q])))
+          i = A.rowind[p++];
+        else if ((p >= pe) || (T.rowind[q] < A.rowind[p]))
+          i = T.rowind[q++];
+        else {
+          i = A.rowind[p++];
+          q++;
+        }
+        if (size_t(i) != j) adj.push_back(i);
+      }
+      ptr[j+1] = int32_t(adj.size());
+    }
+  }
+
+  // A breadth first search from root.  Fills order with the nodes reached
+  // (marking them with stamp) and returns the number of levels; last gets
+  // the position in order where the last level starts.
+  static size_t LevelStructure(int32_t root, const std::vector<int32_t> &ptr,
+                               const std::vector<int32_t> &adj, std::vector<int32_t> &mark,
+                               int32_t stamp, std::vector<int32_t> &order, size_t &last) {
+    order.clear();
+    order.push_back(root);
+    mark[root] = stamp;
+    size_t levels = 0;
+    size_t begin = 0;
+    while (begin < order.size()) {
+      const size_t end = order.size();
+      last = begin;
+      levels++;
+      for (size_t k=begin;k<end;k++) {
+        const int32_t j = order[k];
+        for (int32_t p=ptr[j];p<ptr[j+1];p++)
+          if (mark[adj[p]] != stamp) {
+            mark[adj[p]] = stamp;
+            order.push_back(adj[p]);
+          }
+      }
+      begin = end;
+    }
+    return levels;
+  }
+
+  void ReverseCuthillMcKee(const SparseView &A, std::vector<int32_t> &perm) {
+    const size_t n = A.cols;
+    std::vector<int32_t> ptr, adj;
+    SymmetricPattern(A,ptr,adj);
+    auto degree = [&](int32_t j) {return ptr[j+1] - ptr[j];};
+    std::vector<int32_t> mark(n,-1);
+    std::vector<bool> placed(n,false);
+    std::vector<int32_t> order;
+    std::vector<int32_t> neighbours;
+    int32_t stamp = 0;
+    perm.clear();
+    perm.reserve(n);
+    for (size_t s=0;s<n;s++) {
+      if (placed[s]) continue;
+      // A pseudo-peripheral root for this component: move to a node of
+      // least degree in the last level for as long as that deepens the
+      // level structure
+      int32_t root = int32_t(s);
+      size_t last = 0;
+      size_t levels = LevelStructure(root,ptr,adj,mark,stamp++,order,last);
+      while (true) {
+        int32_t best = order[last];
+        for (size_t k=last;k<order.size();k++)
+          if (degree(order[k]) < degree(best)) best = order[k];
+        const size_t depth = LevelStructure(best,ptr,adj,mark,stamp++,order,last);
+        if (depth <= levels) break;
+        levels = depth;
+        root = best;
+      }
+      // Cuthill-McKee: the nodes in breadth first order, taking the
+      // neighbours of each in order of increasing degree
+      size_t head = perm.size();
+      perm.push_back(root);
+      placed[root] = true;
+      while (head < perm.size()) {
+        const int32_t j = perm[head++];
+        neighbours.clear();
+        for (int32_t p=ptr[j];p<ptr[j+1];p++)
+          if (!placed[adj[p]]) {
+            placed[adj[p]] = true;
+            neighbours.push_back(adj[p]);
+          }
+        std::stable_sort(neighbours.begin(),neighbours.end(),[&](int32_t a, int32_t b) {
+            return degree(a) < degree(b);
+          });
+        perm.insert(perm.end(),neighbours.begin(),neighbours.end());
+      }
+    }
+    std::reverse(perm.begin(),perm.end());
+  }
+
+  // C = A(perm,perm), with the rows of each column sorted
+  static void SymmetricPermute(const SparseView &A, const std::vector<int32_t> &perm,
+                               SparseMatrix &C) {
+    const size_t n = A.cols;
+    std::vector<int32_t> pinv(n);
+    for (size_t k=0;k<n;k++) pinv[perm[k]] = int32_t(k);
+    C.rows = C.cols = n;
+    C.colptr.assign(n+1,0);
+    C.rowind.resize(A.nnz());
+    C.values.resize(A.nnz());
+    std::vector<std::pair<int32_t,double> > column;
+    for (size_t j=0;j<n;j++) {
+      const int32_t old = perm[j];
+      column.clear();
+      for (int32_t p=A.colptr[old];p<A.colptr[old+1];p++)
+        column.emplace_back(pinv[A.rowind[p]],A.values[p]);
+      std::sort(column.begin(),column.end(),[](const std::pair<int32_t,double> &a,
+                                                const std::pair<int32_t,double> &b) {
+                  return a.first < b.first;
+                });
+      int32_t q = C.colptr[j];
+      for (auto &e : column) {
+        C.rowind[q] = e.first;
+        C.values[q++] = e.second;
+      }
+      C.colptr[j+1] = q;
+    }
+  }
+
+  static bool IsSymmetric(const SparseView &A) {
+    if (A.rows != A.cols) return false;
+    SparseMatrix T;
+    SparseTranspose(A,T);
+    return std::equal(T.colptr.begin(),T.colptr.end(),A.colptr) &&
+      std::equal(T.rowind.begin(),T.rowind.end(),A.rowind) &&
+      std::equal(T.values.begin(),T.values.end(),A.values);
+  }
+
+  static bool PositiveDiagonal(const SparseView &A) {
+    for (size_t j=0;j<A.cols;j++) {
+      const int32_t *b = A.rowind + A.colptr[j];
+      const int32_t *e = A.rowind + A.colptr[j+1];
+      const int32_t *p = std::lower_bound(b,e,int32_t(j));
+      if ((p == e) || (*p != int32_t(j)) || !(A.values[p - A.rowind] > 0)) return false;
+    }
+    return true;
+  }
+
+  // The factors of a matrix.  For Cholesky, L holds the lower triangular
+  // factor with the diagonal first in each column.  For LU, L is unit lower
+  // triangular (diagonal first) and U upper triangular (diagonal last),
+  // with row i of the matrix moved to row pinv[i].
+  struct SparseFactors {
+    bool cholesky;
+    SparseMatrix L;
+    SparseMatrix U;
+    std::vector<int32_t> pinv;
+    // The smallest pivot magnitude (the square of the diagonal of L for
+    // Cholesky)
+    double min_pivot;
+  };
+
+  // The 1-norm (largest column sum) of C
+  static double Norm1(const SparseMatrix &C) {
+    double norm = 0;
+    for (size_t j=0;j<C.cols;j++) {
+      double sum = 0;
+      for (int32_t p=C.colptr[j];p<C.colptr[j+1];p++) sum += std::fabs(C.values[p]);
+      norm = std::max(norm,sum);
+    }
+    return norm;
+  }
+
+  // The nonzero pattern of row k of the Cholesky factor of the symmetric C
+  // (from the upper triangle of column k), in topological order, as
+  // stack[top..n).  Returns top.
+  static size_t RowPattern(const SparseMatrix &C, size_t k, const std::vector<int32_t> &parent,
+                           std::vector<int32_t> &mark, std::vector<int32_t> &stack) {
+    const size_t n = C.cols;
+    size_t top = n;
+    mark[k] = int32_t(k);
+    for (int32_t p=C.colptr[k];p<C.colptr[k+1];p++) {
+      int32_t i = C.rowind[p];
+      if (size_t(i) > k) continue;
+      // Walk up the elimination tree to the first marked node
+      size_t len = 0;
+      for (;mark[i] != int32_t(k);i = parent[i]) {
+        stack[len++] = i;
+        mark[i] = int32_t(k);
+      }
+      while (len > 0) stack[--top] = stack[--len];
+    }
+    return top;
+  }
+
+  static bool Cholesky(const SparseMatrix &C, SparseFactors &F) {
+    const size_t n = C.cols;
+    // The elimination tree
+    std::vector<int32_t> parent(n,-1), ancestor(n,-1);
+    for (size_t k=0;k<n;k++)
+      for (int32_t p=C.colptr[k];p<C.colptr[k+1];p++) {
+        int32_t i = C.rowind[p];
+        while ((i != -1) && (size_t(i) < k)) {
+          const int32_t next = ancestor[i];
+          ancestor[i] = int32_t(k);
+          if (next == -1) parent[i] = int32_t(k);
+          i = next;
+        }
+      }
+    // The column counts, from the row patterns
+    std::vector<int32_t> mark(n,-1), stack(n);
+    std::vector<size_t> count(n+1,0);
+    for (size_t k=0;k<n;k++) {
+      count[k+1]++;
+      for (size_t t=RowPattern(C,k,parent,mark,stack);t<n;t++) count[stack[t]+1]++;
+    }
+    std::partial_sum(count.begin(),count.end(),count.begin());
+    if (count[n] > SPARSE_MAX_NNZ) return false;
+    SparseMatrix &L = F.L;
+    L.rows = L.cols = n;
+    L.colptr.assign(count.begin(),count.end());
+    L.rowind.resize(count[n]);
+    L.values.resize(count[n]);
+    std::vector<int32_t> next(L.colptr.begin(),L.colptr.end()-1);
+    std::fill(mark.begin(),mark.end(),-1);
+    std::vector<double> x(n,0.0);
+    F.min_pivot = std::numeric_limits<double>::infinity();
+    for (size_t k=0;k<n;k++) {
+      const size_t top = RowPattern(C,k,parent,mark,stack);
+      for (int32_t p=C.colptr[k];p<C.colptr[k+1];p++)
+        if (size_t(C.rowind[p]) <= k) x[C.rowind[p]] = C.values[p];
+      double d = x[k];
+      x[k] = 0;
+      // Row k of L, by a triangular solve against the rows above it
+      for (size_t t=top;t<n;t++) {
+        const int32_t i = stack[t];
+        const double lki = x[i]/L.values[L.colptr[i]];
+        x[i] = 0;
+        for (int32_t p=L.colptr[i]+1;p<next[i];p++)
+          x[L.rowind[p]] -= L.values[p]*lki;
+        d -= lki*lki;
+        const int32_t p = next[i]++;
+        L.rowind[p] = int32_t(k);
+        L.values[p] = lki;
+      }
+      if (!(d > 0)) return false;
+      F.min_pivot = std::min(F.min_pivot,d);
+      const int32_t p = next[k]++;
+      L.rowind[p] = int32_t(k);
+      L.values[p] = std::sqrt(d);
+    }
+    F.cholesky = true;
+    return true;
+  }
+
+  // The columns of L reachable from the nonzeros of column k of C, in
+  // topological order, as xi[top..n).  xi is 2n long; its second half is
+  // the stack of positions.
+  static size_t Reach(const SparseMatrix &L, const SparseMatrix &C, size_t k,
+                      const std::vector<int32_t> &pinv, std::vector<int32_t> &mark,
+                      std::vector<int32_t> &xi) {
+    const size_t n = C.cols;
+    const int32_t stamp = int32_t(k);
+    int32_t *stack = xi.data();
+    int32_t *pstack = xi.data() + n;
+    size_t top = n;
+    for (int32_t q=C.colptr[k];q<C.colptr[k+1];q++) {
+      if (mark[C.rowind[q]] == stamp) continue;
+      // Depth first search from this row
+      int32_t head = 0;
+      stack[0] = C.rowind[q];
+      while (head >= 0) {
+        const int32_t j = stack[head];
+        const int32_t jnew = pinv[j];
+        if (mark[j] != stamp) {
+          mark[j] = stamp;
+          pstack[head] = (jnew < 0) ? 0 : L.colptr[jnew];
+        }
+        bool done = true;
+        const int32_t end = (jnew < 0) ? 0 : L.colptr[jnew+1];
+        for (int32_t p=pstack[head];p<end;p++) {
+          const int32_t i = L.rowind[p];
+          if (mark[i] == stamp) continue;
+          pstack[head] = p;
+          stack[++head] = i;
+          done = false;
+          break;
+        }
+        if (done) {
+          head--;
+          xi[--top] = j;
+        }
+      }
+    }
+    return top;
+  }
+
+  static bool LU(const SparseMatrix &C, SparseFactors &F) {
+    const size_t n = C.cols;
+    SparseMatrix &L = F.L;
+    SparseMatrix &U = F.U;
+    std::vector<int32_t> &pinv = F.pinv;
+    L.rows = L.cols = U.rows = U.cols = n;
+    L.colptr.assign(n+1,0);
+    U.colptr.assign(n+1,0);
+    L.rowind.clear();
+    L.values.clear();
+    U.rowind.clear();
+    U.values.clear();
+    L.rowind.reserve(2*C.values.size() + n);
+    L.values.reserve(2*C.values.size() + n);
+    U.rowind.reserve(2*C.values.size() + n);
+    U.values.reserve(2*C.values.size() + n);
+    pinv.assign(n,-1);
+    std::vector<double> x(n,0.0);
+    std::vector<int32_t> xi(2*n), mark(n,-1);
+    F.min_pivot = std::numeric_limits<double>::infinity();
+    for (size_t k=0;k<n;k++) {
+      L.colptr[k] = int32_t(L.rowind.size());
+      U.colptr[k] = int32_t(U.rowind.size());
+      // x = L \ C(:,k), over the pattern found by Reach.  L holds the
+      // original row indices until the end.
+      const size_t top = Reach(L,C,k,pinv,mark,xi);
+      for (size_t t=top;t<n;t++) x[xi[t]] = 0;
+      for (int32_t p=C.colptr[k];p<C.colptr[k+1];p++) x[C.rowind[p]] = C.values[p];
+      for (size_t t=top;t<n;t++) {
+        const int32_t j = xi[t];
+        const int32_t J = pinv[j];
+        if (J < 0) continue;
+        const double xj = x[j];
+        for (int32_t p=L.colptr[J]+1;p<L.colptr[J+1];p++)
+          x[L.rowind[p]] -= L.values[p]*xj;
+      }
+      // The pivot: the largest candidate, unless the diagonal is close
+      int32_t ipiv = -1;
+      double largest = -1;
+      for (size_t t=top;t<n;t++) {
+        const int32_t i = xi[t];
+        if (pinv[i] < 0) {
+          const double a = std::fabs(x[i]);
+          if (a > largest) {
+            largest = a;
+            ipiv = i;
+          }
+        } else {
+          U.rowind.push_back(pinv[i]);
+          U.values.push_back(x[i]);
+        }
+      }
+      if ((ipiv == -1) || !(largest > 0)) return false;
+      if ((pinv[k] < 0) && (std::fabs(x[k]) >= largest*SPARSE_PIVOT_TOLERANCE))
+        ipiv = int32_t(k);
+      const double pivot = x[ipiv];
+      F.min_pivot = std::min(F.min_pivot,std::fabs(pivot));
+      U.rowind.push_back(int32_t(k));
+      U.values.push_back(pivot);
+      pinv[ipiv] = int32_t(k);
+      L.rowind.push_back(ipiv);
+      L.values.push_back(1.0);
+      for (size_t t=top;t<n;t++) {
+        const int32_t i = xi[t];
+        if (pinv[i] < 0) {
+          L.rowind.push_back(i);
+          L.values.push_back(x[i]/pivot);
+        }
+        x[i] = 0;
+      }
+      if (std::max(L.rowind.size(),U.rowind.size()) > SPARSE_MAX_NNZ) return false;
+    }
+    L.colptr[n] = int32_t(L.rowind.size());
+    U.colptr[n] = int32_t(U.rowind.size());
+    for (auto &i : L.rowind) i = pinv[i];
+    F.cholesky = false;
+    return true;
+  }
+
+  // Solves with the factors in place in y
+  static void FactorSolve(const SparseFactors &F, std::vector<double> &y,
+                          std::vector<double> &w) {
+    const size_t n = y.size();
+    const SparseMatrix &L = F.L;
+    if (F.cholesky) {
+      for (size_t j=0;j<n;j++) {
+        y[j] /= L.values[L.colptr[j]];
+        const double yj = y[j];
+        for (int32_t p=L.colptr[j]+1;p<L.colptr[j+1];p++)
+          y[L.rowind[p]] -= L.values[p]*yj;
+      }
+      for (size_t j=n;j-- > 0;) {
+        double s = y[j];
+        for (int32_t p=L.colptr[j]+1;p<L.colptr[j+1];p++)
+          s -= L.values[p]*y[L.rowind[p]];
+        y[j] = s/L.values[L.colptr[j]];
+      }
+      return;
+    }
+    const SparseMatrix &U = F.U;
+    for (size_t i=0;i<n;i++) w[F.pinv[i]] = y[i];
+    for (size_t j=0;j<n;j++) {
+      const double wj = w[j];
+      for (int32_t p=L.colptr[j]+1;p<L.colptr[j+1];p++)
+        w[L.rowind[p]] -= L.values[p]*wj;
+    }
+    for (size_t j=n;j-- > 0;) {
+      w[j] /= U.values[U.colptr[j+1]-1];
+      const double wj = w[j];
+      for (int32_t p=U.colptr[j];p<U.colptr[j+1]-1;p++)
+        w[U.rowind[p]] -= U.values[p]*wj;
+    }
+    std::copy(w.begin(),w.end(),y.begin());
+  }
+
+  bool SparseSolve(const SparseView &A, const double *B, size_t bcols, double *X,
+                   std::function<void(std::string)> warn, std::string &error) {
+    if (A.rows != A.cols) {
+      error = "Sparse systems must be square";
+      return false;
+    }
+    const size_t n = A.cols;
+    std::vector<int32_t> perm;
+    ReverseCuthillMcKee(A,perm);
+    SparseMatrix C;
+    SymmetricPermute(A,perm,C);
+    SparseFactors F;
+    if (!(IsSymmetric(A) && PositiveDiagonal(A) && Cholesky(C,F)) && !LU(C,F)) {
+      error = "Sparse matrix is singular to working precision";
+      return false;
+    }
+    // A pivot no larger than eps*norm(A,1) is lost in the rounding of the
+    // elimination.  Their ratio stands in for the RCOND that the dense
+    // solve checks against eps.
+    const double rcond = (n == 0) ? 1.0 : F.min_pivot/Norm1(C);
+    if (rcond < std::numeric_limits<double>::epsilon())
+      warn(std::string("Matrix is singular to working precision.  RCOND = ") + std::to_string(rcond));
+    // The right hand sides are independent
+    const size_t per_column = std::max<size_t>(1,F.L.rowind.size() + F.U.rowind.size());
+    ParallelFor(bcols,std::max<size_t>(1,(size_t(1) << 15)/per_column),[&](size_t b, size_t e) {
+        std::vector<double> y(n), w(n);
+        for (size_t c=b;c<e;c++) {
+          const double *bc = B + c*n;
+          double *xc = X + c*n;
+          for (size_t k=0;k<n;k++) y[k] = bc[perm[k]];
+          FactorSolve(F,y,w);
+          for (size_t k=0;k<n;k++) xc[perm[k]] = y[k];
+        }
+      });
+    return true;
+  }
+}
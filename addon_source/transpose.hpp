@@ -1,32 +1,44 @@
 #ifndef __transpose_hpp__
 #define __transpose_hpp__
 
+#include <cstddef>
+#include <algorithm>
 #include "Complex.hpp"
-const int BLOCKSIZE = 100; // TODO - Optimize the transpose block size?
+#include "tuning.hpp"
 
 namespace FM {
   using ndx_t = size_t;
-  
-  template <class T, int block = BLOCKSIZE>
-  inline void blocked_hermitian(const T *A, T *B, ndx_t N, ndx_t M)
+
+  // The block bounds are hoisted out of the inner loops so that the
+  // compiler can vectorize them for whichever instruction set the
+  // caller is being compiled for (see cpu_dispatch.cpp).  The block size
+  // is a tuning parameter (see tuning.hpp).
+  template <class T>
+  inline void blocked_hermitian(const T *A, T *B, ndx_t N, ndx_t M, ndx_t block = TransposeBlock())
   {
-    for (ndx_t i=0;i<N;i+=block)
-      for (ndx_t j=0;j<M;j+=block)
-        for (ndx_t k=0;k<block;k++)
-          for (int n=0;n<block;n++)
-            if (((j+n) < M) && ((i+k) < N))
-              B[(j+n)+M*(i+k)] = complex_conj(A[(i+k)+N*(j+n)]);
+    for (ndx_t i=0;i<N;i+=block) {
+      const ndx_t imax = std::min<ndx_t>(i+block,N);
+      for (ndx_t j=0;j<M;j+=block) {
+        const ndx_t jmax = std::min<ndx_t>(j+block,M);
+        for (ndx_t k=i;k<imax;k++)
+          for (ndx_t n=j;n<jmax;n++)
+            B[n+M*k] = complex_conj(A[k+N*n]);
+      }
+    }
   }  
   
-  template <class T, int block = BLOCKSIZE>
-  inline void blocked_transpose(const T *A, T *B, ndx_t N, ndx_t M)
+  template <class T>
+  inline void blocked_transpose(const T *A, T *B, ndx_t N, ndx_t M, ndx_t block = TransposeBlock())
   {
-    for (int i=0;i<N;i+=block)
-      for (int j=0;j<M;j+=block)
-        for (int k=0;k<block;k++)
-          for (int n=0;n<block;n++)
-            if (((j+n) < M) && ((i+k) < N))
-              B[(j+n)+M*(i+k)] = A[(i+k)+N*(j+n)];
+    for (ndx_t i=0;i<N;i+=block) {
+      const ndx_t imax = std::min<ndx_t>(i+block,N);
+      for (ndx_t j=0;j<M;j+=block) {
+        const ndx_t jmax = std::min<ndx_t>(j+block,M);
+        for (ndx_t k=i;k<imax;k++)
+          for (ndx_t n=j;n<jmax;n++)
+            B[n+M*k] = A[k+N*n];
+      }
+    }
   }
 }
 
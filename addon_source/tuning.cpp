@@ -0,0 +1,231 @@
+#include "tuning.hpp"
+#include "cpu_dispatch.hpp"
+#include "broadcast.hpp"
+#include "transpose.hpp"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace FM {
+
+  const size_t TRANSPOSE_BLOCK_MIN = 8;
+  const size_t TRANSPOSE_BLOCK_MAX = 512;
+  const size_t PARALLEL_GRAIN_MIN = size_t(1) << 10;
+  const size_t PARALLEL_GRAIN_MAX = size_t(1) << 22;
+
+  // The transpose blocks tried by AutoTune
+  static const size_t BLOCK_CANDIDATES[] = {16, 32, 48, 64, 96, 128, 192, 256};
+
+  // AutoTune gives a thread at least this many times the cost of starting it
+  const double GRAIN_OVERHEAD_FACTOR = 8.0;
+
+  static std::atomic<size_t> transpose_block(100);
+  static std::atomic<size_t> parallel_grain(size_t(1) << 15);
+  static std::atomic<int> tuning_source(TUNING_DEFAULT);
+
+  TuningProfile DefaultTuning() {
+    return TuningProfile{100,size_t(1) << 15};
+  }
+
+  TuningProfile CurrentTuning() {
+    return TuningProfile{transpose_block.load(),parallel_grain.load()};
+  }
+
+  TuningSource CurrentTuningSource() {
+    return TuningSource(tuning_source.load());
+  }
+
+  const char* TuningSourceName(TuningSource source) {
+    switch (source) {
+    case TUNING_DEFAULT:
+      return "default";
+    case TUNING_PROFILE:
+      return "profile";
+    case TUNING_TUNED:
+      return "tuned";
+    case TUNING_SET:
+      return "set";
+    }
+    return "";
+  }
+
+  void ApplyTuning(const TuningProfile &p, TuningSource source) {
+    transpose_block = std::min(TRANSPOSE_BLOCK_MAX,std::max(TRANSPOSE_BLOCK_MIN,p.transpose_block));
+    parallel_grain = std::min(PARALLEL_GRAIN_MAX,std::max(PARALLEL_GRAIN_MIN,p.parallel_grain));
+    tuning_source = source;
+  }
+
+  size_t TransposeBlock() {
+    return transpose_block.load(std::memory_order_relaxed);
+  }
+
+  size_t ParallelGrain() {
+    return parallel_grain.load(std::memory_order_relaxed);
+  }
+
+  static long CacheSize(int name) {
+    long size = sysconf(name);
+    return (size > 0) ? size : 0;
+  }
+
+  std::string MachineSignature() {
+    std::ostringstream sig;
+    sig << ISAName(DetectISALevel());
+#ifdef _SC_LEVEL1_DCACHE_SIZE
+    sig << " l1=" << CacheSize(_SC_LEVEL1_DCACHE_SIZE)
+        << " l2=" << CacheSize(_SC_LEVEL2_CACHE_SIZE)
+        << " l3=" << CacheSize(_SC_LEVEL3_CACHE_SIZE);
+#endif
+    sig << " cores=" << std::thread::hardware_concurrency();
+    return sig.str();
+  }
+
+  std::string TuningProfilePath() {
+    const char *path = getenv("FREEMAT_TUNING");
+    if (path && *path) return path;
+    const char *home = getenv("HOME");
+    if (home && *home) return std::string(home) + "/.freemat_tuning";
+    return "";
+  }
+
+  static bool ParseSize(const std::string &text, size_t &value) {
+    char *end = nullptr;
+    unsigned long long v = strtoull(text.c_str(),&end,10);
+    if (text.empty() || !end || *end) return false;
+    value = size_t(v);
+    return true;
+  }
+
+  bool LoadTuningProfile(const std::string &path, TuningProfile &p, std::string &error) {
+    std::ifstream in(path);
+    if (!in) {
+      error = "Unable to read tuning profile " + path;
+      return false;
+    }
+    std::string line, machine;
+    bool have_block = false, have_grain = false;
+    while (std::getline(in,line)) {
+      if (line.empty() || (line[0] == '#')) continue;
+      const size_t space = line.find(' ');
+      const std::string key = line.substr(0,space);
+      const std::string value = (space == std::string::npos) ? "" : line.substr(space+1);
+      if (key == "machine")
+        machine = value;
+      else if (key == "transpose_block")
+        have_block = ParseSize(value,p.transpose_block);
+      else if (key == "parallel_grain")
+        have_grain = ParseSize(value,p.parallel_grain);
+    }
+    if (!have_block || !have_grain) {
+      error = "Tuning profile " + path + " is malformed";
+      return false;
+    }
+    if (machine != MachineSignature()) {
+      error = "Tuning profile " + path + " was made on a different machine";
+      return false;
+    }
+    return true;
+  }
+
+  bool SaveTuningProfile(const std::string &path, const TuningProfile &p, std::string &error) {
+    if (path.empty()) {
+      error = "No tuning profile path (set FREEMAT_TUNING or HOME)";
+      return false;
+    }
+    std::ofstream out(path,std::ios::trunc);
+    out << "# freemat-js kernel tuning profile\n"
+        << "machine " << MachineSignature() << "\n"
+        << "transpose_block " << p.transpose_block << "\n"
+        << "parallel_grain " << p.parallel_grain << "\n";
+    out.close();
+    if (!out) {
+      error = "Unable to write tuning profile " + path;
+      return false;
+    }
+    return true;
+  }
+
+  // The best of a few timings of f, in seconds
+  template <class F>
+  static double BestTime(int runs, F f) {
+    double best = 1e30;
+    for (int r=0;r<runs;r++) {
+      auto t0 = std::chrono::steady_clock::now();
+      f();
+      auto t1 = std::chrono::steady_clock::now();
+      best = std::min(best,std::chrono::duration<double>(t1-t0).count());
+    }
+    return best;
+  }
+
+  // The transpose block, timed on a matrix well outside the caches (of an
+  // awkward size, so that no candidate divides it).  Each candidate is
+  // passed to the kernel, so transposes running meanwhile keep the block
+  // in use until the result is applied.
+  static size_t TuneTransposeBlock() {
+    const size_t N = 1031, M = 1013;
+    std::vector<double> A(N*M), B(N*M);
+    for (size_t i=0;i<A.size();i++) A[i] = double(i);
+    size_t best_block = TransposeBlock();
+    double best = 1e30;
+    for (auto block : BLOCK_CANDIDATES) {
+      blocked_transpose(A.data(),B.data(),N,M,block);
+      const double t = BestTime(3,[&]() {blocked_transpose(A.data(),B.data(),N,M,block);});
+      if (t < best) {
+        best = t;
+        best_block = block;
+      }
+    }
+    return best_block;
+  }
+
+  // The grain, from the cost of starting and joining a thread against the
+  // time per element of a streaming kernel
+  static size_t TuneParallelGrain() {
+    const int spawns = 16;
+    const double spawn = BestTime(3,[&]() {
+        for (int i=0;i<spawns;i++) std::thread([]() {}).join();
+      })/spawns;
+    const size_t n = size_t(1) << 20;
+    std::vector<double> a(n,1.0), b(n,2.0), y(n);
+    const KernelTable &kernels = Kernels();
+    kernels.dbinary(BINARY_PLUS,a.data(),1,b.data(),1,y.data(),n);
+    const double element = BestTime(3,[&]() {
+        kernels.dbinary(BINARY_PLUS,a.data(),1,b.data(),1,y.data(),n);
+      })/double(n);
+    const double want = GRAIN_OVERHEAD_FACTOR*spawn/std::max(element,1e-12);
+    size_t grain = PARALLEL_GRAIN_MIN;
+    while ((grain < PARALLEL_GRAIN_MAX) && (double(grain) < want)) grain <<= 1;
+    return grain;
+  }
+
+  TuningProfile AutoTune() {
+    static std::mutex lock;
+    std::lock_guard<std::mutex> guard(lock);
+    TuningProfile p;
+    p.transpose_block = TuneTransposeBlock();
+    p.parallel_grain = TuneParallelGrain();
+    return p;
+  }
+
+  bool LoadSavedTuning() {
+    const std::string path = TuningProfilePath();
+    TuningProfile p;
+    std::string error;
+    if (path.empty() || !LoadTuningProfile(path,p,error)) return false;
+    ApplyTuning(p,TUNING_PROFILE);
+    return true;
+  }
+
+  void InitTuning() {
+    static std::once_flag once;
+    std::call_once(once,[]() {LoadSavedTuning();});
+  }
+}
@@ -0,0 +1,72 @@
+#ifndef __tuning_hpp__
+#define __tuning_hpp__
+
+#include <cstddef>
+#include <string>
+
+// Kernel parameters that depend on the machine: the edge of the tiles
+// that transposes and permutations are done in, and the least number of
+// elements worth giving to a thread in the streaming kernels (elementwise
+// functions, fused expressions, broadcasting, permutations and scans).
+//
+// The defaults suit a typical x86 core.  AutoTune benchmarks candidates on
+// the local machine, and the winners can be saved to a tuning profile,
+// which is loaded when the module is.  The profile is read from
+// FREEMAT_TUNING if that is set, and otherwise from ~/.freemat_tuning.  It
+// records the cache sizes, instruction set and core count of the machine
+// it was made on, and is ignored on a machine that differs.
+
+namespace FM {
+
+  struct TuningProfile {
+    size_t transpose_block;
+    size_t parallel_grain;
+  };
+
+  // Where the parameters in use came from
+  enum TuningSource {
+    TUNING_DEFAULT = 0,
+    TUNING_PROFILE = 1,
+    TUNING_TUNED = 2,
+    TUNING_SET = 3
+  };
+
+  TuningProfile DefaultTuning();
+
+  TuningProfile CurrentTuning();
+
+  TuningSource CurrentTuningSource();
+
+  const char* TuningSourceName(TuningSource source);
+
+  // Use p from now on.  Values are clamped to sensible ranges.
+  void ApplyTuning(const TuningProfile &p, TuningSource source);
+
+  size_t TransposeBlock();
+
+  size_t ParallelGrain();
+
+  // A description of the machine, which a profile must match
+  std::string MachineSignature();
+
+  // The profile file, or empty if there is nowhere to keep one
+  std::string TuningProfilePath();
+
+  // Reads a profile, failing if the file is missing or malformed, or was
+  // made on a different machine
+  bool LoadTuningProfile(const std::string &path, TuningProfile &p, std::string &error);
+
+  bool SaveTuningProfile(const std::string &path, const TuningProfile &p, std::string &error);
+
+  // Benchmarks the candidates and returns the best (without applying them)
+  TuningProfile AutoTune();
+
+  // Apply the saved profile, if there is one for this machine.  Returns
+  // whether one was applied.
+  bool LoadSavedTuning();
+
+  // Load the saved profile once, at module load
+  void InitTuning();
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef __workspace_hpp__
+#define __workspace_hpp__
+
+#include <cstddef>
+#include "Complex.hpp"
+#include <vector>
+
+namespace FM {
+
+  // Workspaces bigger than this are released after use rather than kept
+  const size_t WORKSPACE_KEEP_BYTES = size_t(64) << 20;
+
+  // Tags naming the arrays of a LAPACK call, so that each keeps a cached
+  // buffer of its own (WORK and TAU are both of the matrix type, and
+  // RWORK is double whatever the matrix is)
+  struct WorkTag {};
+  struct TauTag {};
+  struct RealWorkTag {};
+  struct IntWorkTag {};
+  struct PivotTag {};
+
+  // Scratch memory for LAPACK calls that is kept between calls on the same
+  // thread, so that repeated factorizations of the same size do not go
+  // back to the allocator.  There is one cached buffer per type and tag; a
+  // Workspace takes it for its lifetime, so nested workspaces of the same
+  // type and tag simply allocate.  Buffers are not cleared between uses.
+  template <class T, class Tag = WorkTag>
+  class Workspace {
+    std::vector<T> buffer;
+    static std::vector<T>& Cache() {
+      static thread_local std::vector<T> cache;
+      return cache;
+    }
+  public:
+    explicit Workspace(size_t count) {
+      buffer.swap(Cache());
+      if (buffer.size() < count) buffer.resize(count);
+    }
+    ~Workspace() {
+      if ((buffer.size()*sizeof(T) <= WORKSPACE_KEEP_BYTES) && (buffer.size() > Cache().size()))
+        buffer.swap(Cache());
+    }
+    Workspace(const Workspace&) = delete;
+    Workspace& operator=(const Workspace&) = delete;
+    T* operator&() {return buffer.empty() ? nullptr : &buffer[0];}
+    size_t size() const {return buffer.size();}
+  };
+
+  // The size returned by an LWORK = -1 query
+  inline int WorkSize(double w) {
+    return static_cast<int>(w);
+  }
+
+  template <class T>
+  inline int WorkSize(const Complex<T> &w) {
+    return static_cast<int>(w.real);
+  }
+}
+
+#endif
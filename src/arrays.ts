@@ -1,13 +1,46 @@
 import { cnumber } from './complex';
 
 import {is_complex, is_scalar} from './inspect';
+import { FORMAT, CONVERT } from './mat.node';
 
-export type NumericArray = Array<number> | Float64Array | Float32Array;
+export type NumericArray = Array<number> | Float64Array | Float32Array |
+    Int8Array | Uint8Array | Int16Array | Uint16Array | Int32Array | Uint32Array;
 
+// The storage classes.  The native code (integer.hpp) uses the same
+// numbers.
 export enum ArrayType {
     Double = 1,
     Logical = 2,
-    Single = 3
+    Single = 3,
+    Int8 = 4,
+    UInt8 = 5,
+    Int16 = 6,
+    UInt16 = 7,
+    Int32 = 8,
+    UInt32 = 9
+}
+
+export function IsIntegerType(t: ArrayType): boolean {
+    return (t >= ArrayType.Int8) && (t <= ArrayType.UInt32);
+}
+
+// The ranges of the integer classes, indexed by ArrayType - ArrayType.Int8
+const integer_limits = [[-128, 127], [0, 255], [-32768, 32767], [0, 65535],
+                        [-2147483648, 2147483647], [0, 4294967295]];
+
+// v as stored in an array of type t.  Integers are rounded (ties away from
+// zero) and saturated, where a typed array would truncate and wrap, and
+// logicals are 0 or 1.
+export function ClassValue(t: ArrayType, v: number): number {
+    if (t === ArrayType.Logical) {
+        if (v !== v) throw new TypeError("NaN's cannot be converted to logicals");
+        return (v !== 0) ? 1 : 0;
+    }
+    if (!IsIntegerType(t)) return v;
+    if (v !== v) return 0;
+    const limits = integer_limits[t - ArrayType.Int8];
+    const r = (v < 0) ? -Math.round(-v) : Math.round(v);
+    return Math.min(limits[1], Math.max(limits[0], r));
 }
 
 function NewSize(x: number[], lim: NumericArray): number[] {
@@ -84,6 +117,17 @@ function AllZeros(x: NumericArray): boolean {
 }
 
 export function AllocateNumericArray(length: number, typecode?: ArrayType): NumericArray {
+    // The integer classes and logical are always held at their own width,
+    // which the native code reads in place
+    switch (typecode) {
+        case ArrayType.Logical:
+        case ArrayType.UInt8: return new Uint8Array(length);
+        case ArrayType.Int8: return new Int8Array(length);
+        case ArrayType.Int16: return new Int16Array(length);
+        case ArrayType.UInt16: return new Uint16Array(length);
+        case ArrayType.Int32: return new Int32Array(length);
+        case ArrayType.UInt32: return new Uint32Array(length);
+    }
     // TODO - check corner cases where we have a single-precision number that is actually
     // represented as a double...
     if (length === 1)
@@ -95,7 +139,7 @@ export function AllocateNumericArray(length: number, typecode?: ArrayType): Nume
         for (let t = 0; t < length; t++) foo[t] = 0;
         return foo;
     }
-    if (!typecode || (typecode === ArrayType.Double) || (typecode === ArrayType.Logical))
+    if (!typecode || (typecode === ArrayType.Double))
         return new Float64Array(length);
     return new Float32Array(length);
 }
@@ -104,27 +148,32 @@ export function Elements(dims: number[]): number {
     return dims.reduce((x: number, y: number): number => x * y, 1);
 }
 
-function print_real(A: FMArray): string {
-    let line = '';
-    for (let i = 0; i < A.dims[0]; i++) {
-        for (let j = 0; j < A.dims[1]; j++) {
-            line += A.real[i + j * A.dims[0]] + " ";
-        }
-        line += '\n';
-    }
-    return line;
+// How arrays are displayed.  page_width is the line length that columns
+// are wrapped to, and max_rows and max_cols limit the rows and columns
+// shown (0 for no limit).  long shows 15 decimals (7 for single) rather
+// than 4.
+export type DisplayOptions = {
+    page_width?: number,
+    max_rows?: number,
+    max_cols?: number,
+    long?: boolean
+};
+
+let display_options = { page_width: 80, max_rows: 0, max_cols: 0, long: false };
+
+// Changes the display options used by toString, and returns the previous
+// ones
+export function display_format(opts: DisplayOptions): DisplayOptions {
+    const previous = Object.assign({}, display_options);
+    Object.assign(display_options, opts);
+    return previous;
 }
 
-function print_complex(A: FMArray): string {
-    if (!A.imag) return print_real(A);
-    let line = '';
-    for (let i = 0; i < A.dims[0]; i++) {
-        for (let j = 0; j < A.dims[1]; j++) {
-            line += A.real[i + j * A.dims[0]] + "+" + A.imag[i + j * A.dims[0]] + "i  ";
-        }
-        line += '\n';
-    }
-    return line;
+// The text of A, formatted natively with a common format for all of its
+// elements (as in MATLAB's format short)
+export function format_array(A: FMArray, opts?: DisplayOptions): string {
+    const o = Object.assign({}, display_options, opts || {});
+    return FORMAT(A, o.page_width, o.max_rows, o.max_cols, o.long, A.mytype === ArrayType.Single);
 }
 
 export class FMArray {
@@ -157,9 +206,7 @@ export class FMArray {
             this.mytype = ArrayType.Double;
     }
     toString(): string {
-        if (this.imag)
-            return print_complex(this);
-        return print_real(this);
+        return format_array(this);
     }
     inspect(depth: number, options: any): string {
         depth; options;
@@ -200,6 +247,8 @@ export type FMValue = FMArray | basic;
 
 export function MakeComplex(x: FMArray): FMArray {
     if (x.imag) return x;
+    if (IsIntegerType(x.mytype))
+        throw new TypeError("Complex values are not supported for integer arrays");
     x.imag = AllocateNumericArray(x.length);
     return x;
 }
@@ -234,40 +283,66 @@ function DimString(dims: number[]): string {
     return '[' + dims.toString() + ']';
 }
 
-function SameDims(a: number[], b: number[]): boolean {
+export function SameDims(a: number[], b: number[]): boolean {
     for (let i = 0; i < Math.max(a.length, b.length); i++) {
         if ((a[i] || 1) !== (b[i] || 1)) return false;
     }
     return true;
 }
 
+// Each dimension of the operands must agree or be 1, and the result takes
+// the larger (so scalars combine with anything, and a column with a row)
 export function ComputeBinaryOpOutputDim(a: FMArray, b: FMArray): number[] {
     if ((a.length === 1) && (b.length === 1)) return [1, 1];
     if (a.length === 1) return b.dims;
     if (b.length === 1) return a.dims;
-    if ((a.length !== b.length) || !SameDims(a.dims, b.dims))
-        throw new TypeError("Cannot apply an operator to variables of size " + DimString(a.dims) + " and " + DimString(b.dims) + " - mismatch in dimensions");
-    return a.dims;
+    if (SameDims(a.dims, b.dims)) return a.dims;
+    let dims: number[] = [];
+    for (let i = 0; i < Math.max(a.dims.length, b.dims.length); i++) {
+        const na = (i < a.dims.length) ? a.dims[i] : 1;
+        const nb = (i < b.dims.length) ? b.dims[i] : 1;
+        if ((na !== nb) && (na !== 1) && (nb !== 1))
+            throw new TypeError("Cannot apply an operator to variables of size " + DimString(a.dims) + " and " + DimString(b.dims) + " - mismatch in dimensions");
+        dims.push((na === 1) ? nb : na);
+    }
+    return dims;
 }
 
 export function Copy(from: FMArray, to: FMArray): void {
-    for (let ndx = 0; ndx < from.length; ndx++)
-        to.real[ndx] = from.real[ndx];
+    if ((to.mytype === from.mytype) || !(IsIntegerType(to.mytype) || (to.mytype === ArrayType.Logical))) {
+        for (let ndx = 0; ndx < from.length; ndx++)
+            to.real[ndx] = from.real[ndx];
+    } else {
+        for (let ndx = 0; ndx < from.length; ndx++)
+            to.real[ndx] = ClassValue(to.mytype, from.real[ndx]);
+    }
     if (from.imag && to.imag) {
         for (let ndx = 0; ndx < from.length; ndx++)
             to.imag[ndx] = from.imag[ndx];
     }
 }
 
+// The maker for native results of any class
+export function mk_typed(n: number[], realv: NumericArray, imagv: NumericArray | undefined, t: ArrayType): FMArray {
+    return new FMArray(n, realv, imagv, t);
+}
+
 export function ToType(a: FMArray, totype: ArrayType): FMArray {
     if (a.mytype === totype)
         return a;
+    // Conversions to and from the integer classes round and saturate, and
+    // to logical check for NaN, natively
+    if (IsIntegerType(totype) || IsIntegerType(a.mytype) || (totype === ArrayType.Logical))
+        return CONVERT(a, totype, mk_typed);
     let p: FMArray = new FMArray(a.dims, undefined, undefined, totype);
     if (a.imag) p = MakeComplex(p);
     Copy(a, p);
     return p;
 }
 
+// The elements of array (of class typecode) placed in a new array of that
+// class with the larger dimensions new_dims.  The values are already of the
+// class, so they are copied as they are.
 function CopyLoop(orig_dims: number[], array: NumericArray, typecode: ArrayType, new_dims: number[]): NumericArray {
     const capacity = Count(new_dims) * 2;
     let op = AllocateNumericArray(capacity, typecode);
@@ -380,7 +455,7 @@ function SetNDimScalar(to: FMArray, where: FMValue[], what: FMValue): FMArray {
     }
     let ndx = ComputeIndex(to.dims, scalars);
     if (ndx >= 0) {
-        to.real[ndx] = realScalar(what);
+        to.real[ndx] = ClassValue(to.mytype, realScalar(what));
         if (to.imag) {
             to.imag[ndx] = imagScalar(what);
             return RealDemote(to);
@@ -413,7 +488,7 @@ function SetScalar(to: FMArray, where: FMValue, what: FMValue): FMArray {
         }
     }
     if (!is_complex(what)) {
-        to.real[ndx - 1] = realScalar( what);
+        to.real[ndx - 1] = ClassValue(to.mytype, realScalar(what));
         if (to.imag) {
             to.imag[ndx - 1] = 0;
             return RealDemote(to);
@@ -421,7 +496,7 @@ function SetScalar(to: FMArray, where: FMValue, what: FMValue): FMArray {
         return to;
     }
     if (to.imag) {
-        to.real[ndx - 1] = realScalar(what);
+        to.real[ndx - 1] = ClassValue(to.mytype, realScalar(what));
         to.imag[ndx - 1] = imagScalar(what);
     }
     return to;
@@ -430,7 +505,10 @@ function SetScalar(to: FMArray, where: FMValue, what: FMValue): FMArray {
 export function Set(to: FMValue, where: FMValue[], what: FMValue): FMArray {
     // Target of a Set should always be an array
     to = mkArray(to);
-    // If we need complex promotion, do it first
+    // If we need complex promotion, do it first.  Integer and logical
+    // arrays cannot hold complex values.
+    if (is_complex(what) && (IsIntegerType(to.mytype) || (to.mytype === ArrayType.Logical)))
+        throw new TypeError("Complex values cannot be assigned to integer or logical arrays");
     if (is_complex(what) && !is_complex(to)) {
         return Set(MakeComplex(to), where, what);
     }
@@ -465,9 +543,19 @@ export function isFMArray(A: FMValue): A is FMArray {
         (typeof (A) === 'boolean'));
 }
 
+// Integer arrays take part only in the operations that define how their
+// results round and saturate (the elementwise arithmetic and comparisons,
+// and those that just move or select elements).  The others call this,
+// which throws if any argument is an integer array.
+export function RejectIntegers(fn: string, ...args: FMValue[]): void {
+    for (let x of args)
+        if (isFMArray(x) && IsIntegerType(x.mytype))
+            throw new TypeError(fn + " is not supported for integer classes");
+}
+
 export function mkArray(A: FMValue): FMArray {
     if (isFMArray(A)) return A;
     if (typeof (A) === 'number')
         return new FMArray(1, [A]);
-    return new FMArray(1, [A ? 1 : 0], undefined, ArrayType.Logical);
+    return new FMArray(1, new Uint8Array([A ? 1 : 0]), undefined, ArrayType.Logical);
 }
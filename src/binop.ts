@@ -8,6 +8,7 @@ import {
 } from './arrays';
 import { FMValue } from './arrays';
 import { Operator } from './operators';
+import { use_broadcast, broadcast } from './broadcast';
 
 function binop_complex_scalar(a: FMArray, b: FMArray, op: Operator): FMArray {
     // Type assertions added because Compiler doesn't know how we got here...
@@ -82,6 +83,8 @@ export function BinOp(a: FMValue, b: FMValue, op: Operator): FMValue {
         return binop_basic(a, b, op);
     a = mkArray(a);
     b = mkArray(b);
+    if (use_broadcast(a, b))
+        return broadcast(a, b, op.native_op());
     if (a.imag || b.imag) {
         let acomp = MakeComplex(a);
         let bcomp = MakeComplex(b);
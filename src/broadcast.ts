@@ -0,0 +1,54 @@
+import { FMArray, NumericArray, ArrayType, Elements, SameDims, ComputeBinaryOpOutputDim, IsIntegerType, mk_typed } from './arrays';
+import { BINARY, TYPEDBINARY } from './mat.node';
+
+// The operations of the native BINARY function (see broadcast.hpp)
+export const enum BinaryOp {
+    Plus = 0,
+    Minus = 1,
+    Times = 2,
+    RDivide = 3,
+    LDivide = 4,
+    LessThan = 5,
+    LessEquals = 6,
+    GreaterThan = 7,
+    GreaterEquals = 8,
+    Equals = 9,
+    NotEquals = 10
+}
+
+// Smaller operations of one shape (or with a scalar) are left to the
+// loops in binop.ts and cmpop.ts, where the call costs more than the work
+const BROADCAST_MIN_ELEMENTS = 1024;
+
+function mk_real(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv);
+}
+
+function mk_comp(n: number[], realv: NumericArray, imagv: NumericArray): FMArray {
+    return new FMArray(n, realv, imagv);
+}
+
+function mk_logical(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv, undefined, ArrayType.Logical);
+}
+
+// Whether a op b should be done natively: when the operands have to be
+// expanded to a common size, or when there are enough elements
+export function use_broadcast(a: FMArray, b: FMArray): boolean {
+    // Integer arithmetic saturates, which only the native code does
+    if (IsIntegerType(a.mytype) || IsIntegerType(b.mytype)) return true;
+    const dims = ComputeBinaryOpOutputDim(a, b);
+    if (!SameDims(a.dims, dims) && (a.length !== 1)) return true;
+    if (!SameDims(b.dims, dims) && (b.length !== 1)) return true;
+    return Elements(dims) >= BROADCAST_MIN_ELEMENTS;
+}
+
+// a op b with singleton dimensions expanded natively, without copies of
+// the operands.  Comparisons give logical arrays, of one byte per element
+// for real operands.  Integer operands are read at their own width.
+export function broadcast(a: FMArray, b: FMArray, op: BinaryOp): FMArray {
+    const compare = (op >= BinaryOp.LessThan);
+    if (IsIntegerType(a.mytype) || IsIntegerType(b.mytype) || (compare && !a.imag && !b.imag))
+        return TYPEDBINARY(a, b, op, mk_typed);
+    return BINARY(a, b, op, compare ? mk_logical : mk_real, mk_comp);
+}
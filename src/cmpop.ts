@@ -5,6 +5,7 @@ import {
     MakeComplex, ComputeBinaryOpOutputDim, Elements
 } from './arrays';
 import { Comparator } from './comparators';
+import { use_broadcast, broadcast } from './broadcast';
 
 function cmpop_complex_vector(a: FMArray, b: FMArray, op: Comparator): FMArray {
     const cdims = ComputeBinaryOpOutputDim(a, b);
@@ -84,6 +85,8 @@ export function CmpOp(a: FMValue, b: FMValue, op: Comparator): FMValue {
         return cmpop_basic(a, b, op);
     a = mkArray(a);
     b = mkArray(b);
+    if (use_broadcast(a, b))
+        return broadcast(a, b, op.native_op());
     if (a.imag || b.imag) {
         let acomp = MakeComplex(a);
         let bcomp = MakeComplex(b);
@@ -1,8 +1,11 @@
+import { BinaryOp } from './broadcast';
 import { cnumber } from './complex';
 
 export interface Comparator {
     op_real(a: number, b: number): boolean;
     op_complex(a: cnumber, b: cnumber): boolean;
+    // The same comparison in the native kernels
+    native_op(): BinaryOp;
 };
 
 export class LessThan implements Comparator {
@@ -13,6 +16,9 @@ export class LessThan implements Comparator {
     op_complex(a: cnumber, b: cnumber): boolean {
         return a.real < b.real;
     }
+    native_op(): BinaryOp {
+        return BinaryOp.LessThan;
+    }
 };
 
 export class LessEquals implements Comparator {
@@ -23,6 +29,9 @@ export class LessEquals implements Comparator {
     op_complex(a: cnumber, b: cnumber): boolean {
         return a.real <= b.real;
     }
+    native_op(): BinaryOp {
+        return BinaryOp.LessEquals;
+    }
 };
 
 export class GreaterThan implements Comparator {
@@ -33,6 +42,9 @@ export class GreaterThan implements Comparator {
     op_complex(a: cnumber, b: cnumber): boolean {
         return a.real > b.real;
     }
+    native_op(): BinaryOp {
+        return BinaryOp.GreaterThan;
+    }
 };
 
 export class GreaterEquals implements Comparator {
@@ -43,6 +55,9 @@ export class GreaterEquals implements Comparator {
     op_complex(a: cnumber, b: cnumber): boolean {
         return a.real >= b.real;
     }
+    native_op(): BinaryOp {
+        return BinaryOp.GreaterEquals;
+    }
 };
 
 export class Equals implements Comparator {
@@ -52,6 +67,9 @@ export class Equals implements Comparator {
     op_complex(a: cnumber, b: cnumber): boolean {
         return ((a.real === b.real) && (a.imag === b.imag));
     }
+    native_op(): BinaryOp {
+        return BinaryOp.Equals;
+    }
 };
 
 export class NotEquals implements Comparator {
@@ -62,4 +80,7 @@ export class NotEquals implements Comparator {
     op_complex(a: cnumber, b: cnumber): boolean {
         return ((a.real !== b.real) || (a.imag !== b.imag));
     }
+    native_op(): BinaryOp {
+        return BinaryOp.NotEquals;
+    }
 };
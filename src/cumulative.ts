@@ -0,0 +1,80 @@
+import { FMValue, FMArray, NumericArray, ArrayType, ToType, mkArray, IsIntegerType, RejectIntegers } from './arrays';
+import { SCAN, DIFF } from './mat.node';
+
+function mk_real(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv);
+}
+
+function mk_comp(n: number[], realv: NumericArray, imagv: NumericArray): FMArray {
+    return new FMArray(n, realv, imagv);
+}
+
+const enum ScanOp {
+    Sum = 0,
+    Prod = 1,
+    Max = 2,
+    Min = 3
+}
+
+// The zero based dimension to work along: dim if given, otherwise the
+// first that is not 1
+function work_dim(X: FMArray, dim: number | undefined, name: string): number {
+    if (dim === undefined) return Math.max(0, X.dims.findIndex(n => n !== 1));
+    if (!Number.isInteger(dim) || (dim < 1))
+        throw new TypeError("Dimension argument to " + name + " must be a positive integer");
+    return dim - 1;
+}
+
+// Results are double, except that single precision stays single
+function result_type(X: FMArray, C: FMArray): FMArray {
+    return ToType(C, (X.mytype === ArrayType.Single) ? ArrayType.Single : ArrayType.Double);
+}
+
+// Running sums and products of integers would have to saturate at each
+// step, which the native scan (in double precision) does not do
+function scan(A: FMValue, dim: number | undefined, op: ScanOp, name: string): FMArray {
+    const X = mkArray(A);
+    RejectIntegers(name, X);
+    return result_type(X, SCAN(X, work_dim(X, dim, name), op, mk_real, mk_comp));
+}
+
+// The cumulative sum along dimension dim (by default the first that is
+// not 1)
+export function cumsum(A: FMValue, dim?: number): FMArray {
+    return scan(A, dim, ScanOp.Sum, "cumsum");
+}
+
+// The cumulative product along dimension dim
+export function cumprod(A: FMValue, dim?: number): FMArray {
+    return scan(A, dim, ScanOp.Prod, "cumprod");
+}
+
+// The running maximum along dimension dim.  NaNs are skipped, and complex
+// values are compared by magnitude and then angle.
+export function cummax(A: FMValue, dim?: number): FMArray {
+    const X = mkArray(A);
+    return ToType(SCAN(X, work_dim(X, dim, "cummax"), ScanOp.Max, mk_real, mk_comp), X.mytype);
+}
+
+// The running minimum along dimension dim, as for cummax
+export function cummin(A: FMValue, dim?: number): FMArray {
+    const X = mkArray(A);
+    return ToType(SCAN(X, work_dim(X, dim, "cummin"), ScanOp.Min, mk_real, mk_comp), X.mytype);
+}
+
+// The order'th difference along dimension dim, which is order elements
+// shorter along dim (and empty if A is not that long).  Integer
+// differences keep the class, saturating after each order.
+export function diff(A: FMValue, order?: number, dim?: number): FMArray {
+    const X = mkArray(A);
+    const k = (order === undefined) ? 1 : order;
+    if (!Number.isInteger(k) || (k < 0))
+        throw new TypeError("Difference order must be a non-negative integer");
+    const d = work_dim(X, dim, "diff");
+    if (IsIntegerType(X.mytype)) {
+        let D = X;
+        for (let i = 0; i < k; i++) D = ToType(DIFF(D, 1, d, mk_real, mk_comp), X.mytype);
+        return D;
+    }
+    return result_type(X, DIFF(X, k, d, mk_real, mk_comp));
+}
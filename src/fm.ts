@@ -1,7 +1,8 @@
 import { FMArray, FnMakeScalarReal, FnMakeScalarComplex, Copy, Set } from './arrays';
-import { rnaz, hermitian, plus, minus, times, mtimes, transpose, mldivide, mrdivide } from './math';
+import { rnaz, hermitian, plus, minus, times, neg, mtimes, transpose, mldivide, mrdivide } from './math';
 import { le, ge, lt, gt, eq, ne } from './math';
 import { ncat } from './ncat';
+import { fuse } from './fuse';
 import { start } from 'repl';
 import { JSWriter } from './jswalker';
 import {Symbols} from './symbol'
@@ -19,6 +20,7 @@ const sandbox = {
     plus: plus,
     minus: minus,
     times: times,
+    neg: neg,
     mtimes: mtimes,
     transpose: transpose,
     mldivide: mldivide,
@@ -36,7 +38,8 @@ const sandbox = {
     eq: eq,
     ne: ne,
     sv: realScalar,
-    rnaz: rnaz
+    rnaz: rnaz,
+    fuse: fuse
 };
 
 const context = {
@@ -0,0 +1,96 @@
+import { FMValue, FMArray, NumericArray, ArrayType, isFMArray, SameDims } from './arrays';
+import { plus, minus, times, rdivide, ldivide, neg } from './math';
+import { FUSE } from './mat.node';
+
+// Operations of a fused elementwise expression.  A program lists them in
+// postfix order, with Leaf taking the next of the expression's leaves.
+export const enum FuseOp {
+    Leaf = 0,
+    Plus = 1,
+    Minus = 2,
+    Times = 3,
+    RDivide = 4,
+    LDivide = 5,
+    Neg = 6
+}
+
+// Below this many elements, the operations are applied one at a time
+const FUSE_MIN_ELEMENTS = 1024;
+
+// The deepest stack the native evaluator takes (FUSE_MAX_DEPTH in fuse.hpp)
+const FUSE_MAX_DEPTH = 64;
+
+function mk_real(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv);
+}
+
+// The deepest the evaluation stack gets in running program
+function program_depth(program: FuseOp[]): number {
+    let sp = 0;
+    let depth = 0;
+    for (let op of program) {
+        if (op === FuseOp.Leaf)
+            sp++;
+        else if (op !== FuseOp.Neg)
+            sp--;
+        depth = Math.max(depth, sp);
+    }
+    return depth;
+}
+
+// Applies the operations one at a time, as the unfused code would
+function replay(program: FuseOp[], leaves: FMValue[]): FMValue {
+    let stack: FMValue[] = [];
+    let next = 0;
+    for (let op of program) {
+        if (op === FuseOp.Leaf) {
+            stack.push(leaves[next++]);
+            continue;
+        }
+        if (op === FuseOp.Neg) {
+            stack.push(neg(stack.pop() as FMValue));
+            continue;
+        }
+        const b = stack.pop() as FMValue;
+        const a = stack.pop() as FMValue;
+        switch (op) {
+            case FuseOp.Plus: stack.push(plus(a, b)); break;
+            case FuseOp.Minus: stack.push(minus(a, b)); break;
+            case FuseOp.Times: stack.push(times(a, b)); break;
+            case FuseOp.RDivide: stack.push(rdivide(a, b)); break;
+            case FuseOp.LDivide: stack.push(ldivide(a, b)); break;
+            default: throw new TypeError("Unknown fused operation " + op);
+        }
+    }
+    return stack[0];
+}
+
+// The leaves can go to the native evaluator if they are real doubles and
+// the arrays among them have one size that is worth it.  Integer and
+// logical arrays are held in typed arrays of their own width, and are
+// replayed, so that integer results saturate at each operation (negating
+// int8(-128) gives 127).  So are programs that nest more deeply than the
+// native stack allows.
+function can_fuse(program: FuseOp[], leaves: FMValue[]): boolean {
+    if (program_depth(program) > FUSE_MAX_DEPTH) return false;
+    let dims: number[] | undefined = undefined;
+    for (let x of leaves) {
+        if (!isFMArray(x)) continue;
+        if (x.imag || (x.mytype === ArrayType.Single) || !(x.real instanceof Float64Array))
+            return false;
+        if (x.length === 1) continue;
+        if (dims && !SameDims(dims, x.dims)) return false;
+        dims = x.dims;
+    }
+    return (dims !== undefined) && (leaves.some(x => isFMArray(x) && (x.length >= FUSE_MIN_ELEMENTS)));
+}
+
+// Evaluates an elementwise expression, given as a postfix program over its
+// leaves, in one pass with a single output.  Generated by JSWriter for
+// chains of +, -, .*, ./, .\ and unary minus.  Expressions that the native
+// evaluator does not handle (complex or single precision data, sizes that
+// need an error, very deep nesting) are evaluated an operation at a time.
+export function fuse(program: FuseOp[], leaves: FMValue[]): FMValue {
+    if (!can_fuse(program, leaves)) return replay(program, leaves);
+    return FUSE(program, leaves.map(x => (typeof (x) === 'boolean') ? (x ? 1 : 0) : x), mk_real);
+}
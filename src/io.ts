@@ -0,0 +1,27 @@
+import { FMValue, FMArray, mkArray } from './arrays';
+import { MAPOPEN, MAPSAVE, OOCGEMM, OOCTRANSPOSE, TilePlan } from './mat.node';
+
+// Binary array files.  The file is mapped rather than read, so opening a
+// large array is cheap, and only the parts that are used are brought in
+// from disk.  Changes to the loaded array are private unless the file is
+// opened writable, in which case they go through to the file.
+export function load_mapped(filename: string, writable?: boolean): FMArray {
+    const A = MAPOPEN(filename, writable);
+    return new FMArray(A.dims, A.real, A.imag, A.mytype);
+}
+
+export function save_mapped(filename: string, A: FMValue): void {
+    MAPSAVE(filename, mkArray(A));
+}
+
+// Out of core versions of mtimes and transpose, for arrays in files that
+// are too large to load.  The result is written to a new file.  The
+// operands are worked on in tiles that fit in budget bytes (256MB by
+// default).  Returns the tiling used.
+export function mtimes_mapped(A: string, B: string, C: string, budget?: number): TilePlan {
+    return OOCGEMM(A, B, C, budget);
+}
+
+export function transpose_mapped(A: string, B: string, budget?: number): TilePlan {
+    return OOCTRANSPOSE(A, B, budget);
+}
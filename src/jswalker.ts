@@ -1,5 +1,6 @@
 import * as AST from './ast';
 import { inspect } from 'util';
+import { FuseOp } from './fuse';
 
 
 class JSWalker {
@@ -66,6 +67,56 @@ class JSWalker {
             case AST.SyntaxKind.ColonToken: return ('colon');
         }
     }
+    // The fused operation for an elementwise operator, if there is one
+    fuseOp(tree: AST.Expression): FuseOp | undefined {
+        if (tree.kind === AST.SyntaxKind.InfixExpression) {
+            switch ((tree as AST.InfixExpression).operator.kind) {
+                case AST.SyntaxKind.PlusToken: return FuseOp.Plus;
+                case AST.SyntaxKind.MinusToken: return FuseOp.Minus;
+                case AST.SyntaxKind.DotTimesToken: return FuseOp.Times;
+                case AST.SyntaxKind.DotRightDivideToken: return FuseOp.RDivide;
+                case AST.SyntaxKind.DotLeftDivideToken: return FuseOp.LDivide;
+            }
+        }
+        if ((tree.kind === AST.SyntaxKind.PrefixExpression) &&
+            ((tree as AST.UnaryExpression).operator === AST.SyntaxKind.UnaryMinusToken))
+            return FuseOp.Neg;
+        return undefined;
+    }
+    // Postfix program and leaves of the elementwise expression rooted at tree
+    collectFused(tree: AST.Expression, program: FuseOp[], leaves: string[]): void {
+        const op = this.fuseOp(tree);
+        if (op === undefined) {
+            program.push(FuseOp.Leaf);
+            leaves.push(this.writeExpression(tree));
+            return;
+        }
+        if (op === FuseOp.Neg) {
+            this.collectFused((tree as AST.UnaryExpression).operand, program, leaves);
+        } else {
+            this.collectFused((tree as AST.InfixExpression).leftOperand, program, leaves);
+            this.collectFused((tree as AST.InfixExpression).rightOperand, program, leaves);
+        }
+        program.push(op);
+    }
+    // The number of elementwise operations in the expression rooted at tree
+    countFused(tree: AST.Expression): number {
+        const op = this.fuseOp(tree);
+        if (op === undefined) return 0;
+        if (op === FuseOp.Neg)
+            return 1 + this.countFused((tree as AST.UnaryExpression).operand);
+        return 1 + this.countFused((tree as AST.InfixExpression).leftOperand) +
+            this.countFused((tree as AST.InfixExpression).rightOperand);
+    }
+    // Chains of two or more elementwise operations are evaluated in one
+    // pass by fuse, instead of making a temporary for each operation
+    writeFusedExpression(tree: AST.Expression): string | undefined {
+        if (this.countFused(tree) < 2) return undefined;
+        let program: FuseOp[] = [];
+        let leaves: string[] = [];
+        this.collectFused(tree, program, leaves);
+        return '$ws.fuse([' + program.join(',') + '],[' + leaves.join(',') + '])';
+    }
     writeInfixExpression(tree: AST.InfixExpression): string {
         return '$ws.'+this.operatorName(tree.operator) + '(' +
             this.writeExpression(tree.leftOperand) + ',' +
@@ -114,9 +165,11 @@ class JSWalker {
     writeExpression(tree: AST.Expression): string {
         switch (tree.kind) {
             case AST.SyntaxKind.InfixExpression:
-                return this.writeInfixExpression(tree as AST.InfixExpression);
+                return this.writeFusedExpression(tree) ||
+                    this.writeInfixExpression(tree as AST.InfixExpression);
             case AST.SyntaxKind.PrefixExpression:
-                return this.writePrefixExpression(tree as AST.UnaryExpression);
+                return this.writeFusedExpression(tree) ||
+                    this.writePrefixExpression(tree as AST.UnaryExpression);
             case AST.SyntaxKind.PostfixExpression:
                 return this.writePostfixExpression(tree as AST.PostfixExpression);
             case AST.SyntaxKind.VariableDereference:
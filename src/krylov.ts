@@ -0,0 +1,74 @@
+import { FMValue, FMArray, NumericArray, mkArray, RejectIntegers } from './arrays';
+import { KRYLOV, Logger } from './mat.node';
+import { SparseArray, issparse } from './sparse';
+
+function mk_real(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv);
+}
+
+const enum KrylovMethod {
+    CG = 0,
+    GMRES = 1,
+    BiCGSTAB = 2
+}
+
+export type Preconditioner = 'none' | 'jacobi' | 'ilu';
+
+// tol is the relative residual to stop at (by default 1e-6), maxit the
+// most iterations (by default min(n, 20); for gmres, inner steps), and
+// restart the gmres cycle length (by default min(n, 30)).  'ilu' is the
+// zero fill incomplete LU, for sparse matrices.  With verbose set, the
+// residual history goes to the logger once the solve is done.
+export type KrylovOptions = {
+    tol?: number,
+    maxit?: number,
+    restart?: number,
+    precond?: Preconditioner,
+    x0?: FMValue,
+    verbose?: boolean
+};
+
+// flag is 0 if the method converged, 1 if it ran out of iterations, and 4
+// if it broke down.  resvec holds the residual norm after each iteration,
+// starting with that of x0.
+export type KrylovResult = {
+    x: FMArray,
+    flag: number,
+    relres: number,
+    iter: number,
+    resvec: FMArray
+};
+
+const preconditioners: { [name: string]: number } = { none: 0, jacobi: 1, ilu: 2 };
+
+function krylov(method: KrylovMethod, A: FMValue | SparseArray, b: FMValue, logger: Logger,
+    opts: KrylovOptions = {}): KrylovResult {
+    const M = issparse(A) ? A : mkArray(A);
+    const n = M.dims[0];
+    const precond = preconditioners[opts.precond || 'none'];
+    if (precond === undefined)
+        throw new TypeError("Unknown preconditioner " + opts.precond);
+    const x0 = (opts.x0 === undefined) ? new FMArray([0, 1], []) : mkArray(opts.x0);
+    RejectIntegers(["pcg", "gmres", "bicgstab"][method], issparse(M) ? 0 : M, b, x0);
+    const maxit = (opts.maxit === undefined) ? Math.min(n, 20) : opts.maxit;
+    const restart = (opts.restart === undefined) ? Math.max(1, Math.min(n, 30)) : opts.restart;
+    const [x, flag, relres, iter, resvec] = KRYLOV(method, M, mkArray(b), x0,
+        (opts.tol === undefined) ? 1e-6 : opts.tol, maxit, restart, precond,
+        !!opts.verbose, logger, mk_real);
+    return { x, flag, relres, iter, resvec };
+}
+
+// Preconditioned conjugate gradients, for symmetric positive definite A
+export function pcg(A: FMValue | SparseArray, b: FMValue, logger: Logger, opts?: KrylovOptions): KrylovResult {
+    return krylov(KrylovMethod.CG, A, b, logger, opts);
+}
+
+// Restarted GMRES, preconditioned on the right
+export function gmres(A: FMValue | SparseArray, b: FMValue, logger: Logger, opts?: KrylovOptions): KrylovResult {
+    return krylov(KrylovMethod.GMRES, A, b, logger, opts);
+}
+
+// BiCGSTAB, preconditioned on the right
+export function bicgstab(A: FMValue | SparseArray, b: FMValue, logger: Logger, opts?: KrylovOptions): KrylovResult {
+    return krylov(KrylovMethod.BiCGSTAB, A, b, logger, opts);
+}
@@ -1,13 +1,85 @@
 import { FMArray, NumericArray } from './arrays';
+import { SparseArray } from './sparse';
 
 type RealMaker = (dims: number[], real: NumericArray) => FMArray;
 type ComplexMaker = (dims: number[], real: NumericArray, imag: NumericArray) => FMArray;
+type TypedMaker = (dims: number[], real: NumericArray, imag: NumericArray | undefined, mytype: number) => FMArray;
+type SparseMaker = (dims: number[], colptr: Int32Array, rowind: Int32Array, real: Float64Array) => SparseArray;
 type Logger = (msg: string) => void;
+type ISAInfo = { active: string, detected: string };
+type BLASInfo = { name: string, blas: string, lapack: string, threads: number, missing: string[] };
+type MappedArray = { dims: number[], real: NumericArray, imag?: NumericArray, mytype: number };
+type TilePlan = { rows: number, cols: number, inner: number, bytes: number };
+type FFTCacheInfo = { plans: number, bytes: number };
+type TuningInfo = { transpose_block: number, parallel_grain: number, source: string, path: string, machine: string };
+type PoolInfo = { hits: number, misses: number, cached: number, live: number, limit: number, external: number };
 
 export function DGEMM(A: FMArray, B: FMArray, maker: RealMaker): FMArray;
 export function ZGEMM(A: FMArray, B: FMArray, maker: ComplexMaker): FMArray;
+export function DGEMMACC(A: FMArray, B: FMArray, C: FMArray, alpha: number, beta: number): FMArray;
+export function ZGEMMACC(A: FMArray, B: FMArray, C: FMArray, alpha: number, beta: number): FMArray;
 export function DTRANSPOSE(A: FMArray, maker: RealMaker): FMArray;
 export function ZTRANSPOSE(A: FMArray, maker: ComplexMaker): FMArray;
 export function ZHERMITIAN(A: FMArray, maker: ComplexMaker): FMArray;
-export function DSOLVE(A: FMArray, B: FMArray, logger: Logger, maker: RealMaker): FMArray;
-export function ZSOLVE(A: FMArray, B: FMArray, logger: Logger, maker: ComplexMaker): FMArray;
+export function DSOLVE(A: FMArray, B: FMArray, logger: Logger, maker: RealMaker, mode?: number): FMArray;
+export function ZSOLVE(A: FMArray, B: FMArray, logger: Logger, maker: ComplexMaker, mode?: number): FMArray;
+export function DLU(A: FMArray, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function ZLU(A: FMArray, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function DINVERSE(A: FMArray, inverse: boolean, logger: Logger, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function ZINVERSE(A: FMArray, inverse: boolean, logger: Logger, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function DMATFUN(A: FMArray, op: number, logger: Logger, real: RealMaker, complex: ComplexMaker): FMArray;
+export function ZMATFUN(A: FMArray, op: number, logger: Logger, real: RealMaker, complex: ComplexMaker): FMArray;
+export function DQR(A: FMArray, economy: boolean, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function ZQR(A: FMArray, economy: boolean, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function DCHOL(A: FMArray, real: RealMaker, complex: ComplexMaker): FMArray;
+export function ZCHOL(A: FMArray, real: RealMaker, complex: ComplexMaker): FMArray;
+export function DSVD(A: FMArray, mode: number, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function ZSVD(A: FMArray, mode: number, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function DEIG(A: FMArray, vectors: boolean, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function ZEIG(A: FMArray, vectors: boolean, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function SETISA(level: string): string;
+export function GETISA(): ISAInfo;
+export function SETBLAS(blas?: string, lapack?: string): BLASInfo;
+export function BLASINFO(): BLASInfo;
+export function SETBLASTHREADS(threads: number): boolean;
+export function SETSHARED(shared: boolean): boolean;
+export function POOLSTATS(): PoolInfo;
+export function FORMAT(A: FMArray, page_width: number, max_rows: number, max_cols: number,
+    long: boolean, single: boolean): string;
+export function GETTUNING(): TuningInfo;
+export function TUNE(save: boolean): TuningInfo;
+export function SETTUNING(block?: number, grain?: number): TuningInfo;
+export function LOADTUNING(): TuningInfo;
+export function POOLTRIM(): void;
+export function SETPOOLLIMIT(bytes: number): void;
+export function MAPOPEN(filename: string, writable?: boolean): MappedArray;
+export function MAPSAVE(filename: string, A: FMArray): void;
+export function OOCGEMM(A: string, B: string, C: string, budget?: number): TilePlan;
+export function OOCTRANSPOSE(A: string, B: string, budget?: number): TilePlan;
+export function FFT(A: FMArray, len: number, dim: number, inverse: boolean, real: RealMaker, complex: ComplexMaker): FMArray;
+export function FFTCACHE(clear?: boolean): FFTCacheInfo;
+export function CONV(u: FMArray, v: FMArray, shape: number, method: number, real: RealMaker, complex: ComplexMaker): FMArray;
+export function CONV2(A: FMArray, B: FMArray, shape: number, method: number, real: RealMaker, complex: ComplexMaker): FMArray;
+export function FILTER(b: FMArray, a: FMArray, x: FMArray, dim: number, real: RealMaker, complex: ComplexMaker): FMArray;
+export function ELEMENTARY(A: FMArray, op: number, real: RealMaker, complex: ComplexMaker): FMArray;
+export function ATAN2(Y: FMArray, X: FMArray, real: RealMaker): FMArray;
+export function SORT(A: FMArray, dim: number, descending: boolean, index: boolean, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function UNIQUE(A: FMArray, real: RealMaker, complex: ComplexMaker): FMArray[];
+export function FIND(A: FMArray, limit: number, real: RealMaker): FMArray;
+export function RANDOM(dims: number[], dist: number, seed: number, offset: number, lo: number, hi: number, real: RealMaker): FMArray;
+export function FUSE(ops: number[], leaves: (number | FMArray)[], real: RealMaker): FMArray;
+export function PERMUTE(A: FMArray, order: number[], shift: number[], real: RealMaker, complex: ComplexMaker): FMArray;
+export function BINARY(A: FMArray, B: FMArray, op: number, real: RealMaker, complex: ComplexMaker): FMArray;
+export function TYPEDBINARY(A: FMArray, B: FMArray, op: number, make: TypedMaker): FMArray;
+export function CONVERT(A: FMArray, mytype: number, make: TypedMaker): FMArray;
+export function SCAN(A: FMArray, dim: number, op: number, real: RealMaker, complex: ComplexMaker): FMArray;
+export function DIFF(A: FMArray, order: number, dim: number, real: RealMaker, complex: ComplexMaker): FMArray;
+export function SPARSE(i: FMArray, j: FMArray, v: FMArray, rows: number, cols: number, sparse: SparseMaker): SparseArray;
+export function SPDENSE(A: FMArray, sparse: SparseMaker): SparseArray;
+export function SPFULL(S: SparseArray, real: RealMaker): FMArray;
+export function SPTRANSPOSE(S: SparseArray, sparse: SparseMaker): SparseArray;
+export function SPMTIMES(A: FMArray | SparseArray, B: FMArray | SparseArray, real: RealMaker, sparse: SparseMaker): FMArray | SparseArray;
+export function SPSOLVE(A: SparseArray, B: FMArray, logger: Logger, real: RealMaker): FMArray;
+export function KRYLOV(method: number, A: FMArray | SparseArray, b: FMArray, x0: FMArray, tol: number, maxit: number, restart: number,
+    precond: number, verbose: boolean, logger: Logger, real: RealMaker): [FMArray, number, number, number, FMArray];
+export function SETTHREADS(threads?: number): number;
@@ -2,8 +2,14 @@ import { Adder, Subtractor, Multiplier, RightDivider, LeftDivider } from './oper
 import { LessThan, LessEquals, GreaterThan, GreaterEquals, Equals, NotEquals } from './comparators';
 import { BinOp } from './binop';
 import { CmpOp } from './cmpop';
-import { FMValue, FMArray, NumericArray, ArrayType, ToType, MakeComplex, isFMArray, mkArray } from './arrays';
-import { DGEMM, ZGEMM, DTRANSPOSE, ZTRANSPOSE, ZHERMITIAN, Logger, DSOLVE, ZSOLVE } from './mat.node';
+import { FMValue, FMArray, NumericArray, ArrayType, ToType, MakeComplex, isFMArray, mkArray, IsIntegerType,
+    RejectIntegers } from './arrays';
+import { DGEMM, ZGEMM, DGEMMACC, ZGEMMACC, DTRANSPOSE, ZTRANSPOSE, ZHERMITIAN, Logger, DSOLVE, ZSOLVE, SETISA, GETISA,
+    SETBLAS, BLASINFO, SETBLASTHREADS, BLASInfo, SETSHARED, SETTHREADS,
+    POOLSTATS, POOLTRIM, SETPOOLLIMIT, PoolInfo, GETTUNING, TUNE, SETTUNING, LOADTUNING, TuningInfo,
+    ELEMENTARY, ATAN2,
+    DLU, ZLU, DINVERSE, ZINVERSE, DMATFUN, ZMATFUN, DQR, ZQR, DCHOL, ZCHOL, DSVD, ZSVD, DEIG, ZEIG } from './mat.node';
+import { SparseArray, issparse, full, sparse_mtimes, sparse_mldivide } from './sparse';
 
 export function lt(A: FMValue, B: FMValue): FMValue {
     return CmpOp(A, B, new LessThan);
@@ -49,6 +55,11 @@ export function rdivide(A: FMValue, B: FMValue): FMValue {
     return BinOp(A, B, new RightDivider);
 }
 
+// Unary minus.  Integers saturate, so -int8(-128) is 127.
+export function neg(A: FMValue): FMValue {
+    return times(-1, A);
+}
+
 function mk_real(n: number[], realv: NumericArray): FMArray {
     return new FMArray(n, realv);
 }
@@ -65,21 +76,42 @@ function mtimes_real(A: FMArray, B: FMArray): FMArray {
 }
 
 function mtimes_complex(A: FMArray, B: FMArray): FMArray {
-    let C = ZGEMM(A, B, mk_comp);
+    let C = ZGEMM(MakeComplex(A), MakeComplex(B), mk_comp);
     if ((A.mytype === ArrayType.Single) || (B.mytype === ArrayType.Single))
         return ToType(C, ArrayType.Single);
     return C;
 }
 
-export function mtimes(A: FMValue, B: FMValue): FMValue {
+// Either operand may be sparse (see sparse.ts), in which case so is the
+// product of two sparse matrices.  As in MATLAB, an integer operand needs
+// the other to be a scalar, for an elementwise product of its class.
+export function mtimes(A: FMValue, B: FMValue): FMValue;
+export function mtimes(A: FMValue | SparseArray, B: FMValue | SparseArray): FMValue | SparseArray;
+export function mtimes(A: FMValue | SparseArray, B: FMValue | SparseArray): FMValue | SparseArray {
+    if (issparse(A) || issparse(B)) return sparse_mtimes(A, B);
     if (!isFMArray(A) && !isFMArray(B)) return times(A, B);
     A = mkArray(A);
     B = mkArray(B);
     if ((A.length === 1) || (B.length === 1)) return times(A, B);
+    RejectIntegers("Matrix multiplication", A, B);
     if (!(A.imag) && !(B.imag)) return mtimes_real(A, B);
     return mtimes_complex(A, B);
 }
 
+// Computes C = alpha*A*B + beta*C.  When the product is a true matrix
+// product, the update is done by a single BLAS call that writes into
+// the storage of C.  Callers should use the returned value, as the
+// scalar cases fall back to the elementwise operators.
+export function gemm(alpha: number, A: FMValue, B: FMValue, beta: number, C: FMValue): FMValue {
+    if (!isFMArray(C) || !isFMArray(A) || !isFMArray(B) ||
+        (A.length === 1) || (B.length === 1))
+        return plus(times(alpha, mtimes(A, B)), times(beta, C));
+    RejectIntegers("Matrix multiplication", A, B, C);
+    if (!(A.imag) && !(B.imag) && !(C.imag))
+        return DGEMMACC(A, B, C, alpha, beta);
+    return ZGEMMACC(MakeComplex(A), MakeComplex(B), MakeComplex(C), alpha, beta);
+}
+
 function transpose_complex(A: FMArray): FMArray {
     let C = ZTRANSPOSE(A, mk_comp);
     return ToType(C, A.mytype);
@@ -116,32 +148,306 @@ export function conj(A: FMValue): FMValue {
     return B;
 }
 
-export function mldivide(A: FMValue, B: FMValue, logger: Logger): FMValue {
+// A as the storage class t.  Conversions to the integer classes round
+// (ties away from zero) and saturate, as MATLAB's int8, uint8, etc. do.
+export function cast(A: FMValue, t: ArrayType): FMArray {
+    return ToType(mkArray(A), t);
+}
+
+// How non-square systems are solved by mldivide and mrdivide.  'qr' assumes
+// A has full rank, 'gelsy' uses a rank revealing QR and 'svd' the SVD.  The
+// default 'auto' uses QR unless A looks rank deficient.
+export type LeastSquaresMode = 'auto' | 'qr' | 'gelsy' | 'svd';
+
+function least_squares_code(mode?: LeastSquaresMode): number {
+    if (mode === undefined) return 0;
+    const code = ['auto', 'qr', 'gelsy', 'svd'].indexOf(mode);
+    if (code < 0) throw new TypeError("Unknown least squares mode " + mode);
+    return code;
+}
+
+// The class of a floating point result: single if either argument is,
+// and otherwise double (for logical arguments too)
+function float_type(A: FMArray, B: FMArray): ArrayType {
+    return ((A.mytype === ArrayType.Single) || (B.mytype === ArrayType.Single)) ?
+        ArrayType.Single : ArrayType.Double;
+}
+
+// A sparse A is solved by a sparse factorization (see sparse.ts)
+export function mldivide(A: FMValue | SparseArray, B: FMValue | SparseArray, logger: Logger, mode?: LeastSquaresMode): FMValue {
+    if (issparse(A)) return sparse_mldivide(A, B, logger);
+    if (issparse(B)) B = full(B);
     if (!isFMArray(A) && !isFMArray(B)) return ldivide(A, B);
     A = mkArray(A);
     B = mkArray(B);
     if ((A.length === 1) || (B.length === 1)) return ldivide(A, B);
+    RejectIntegers("mldivide", A, B);
+    const code = least_squares_code(mode);
     let C: FMArray;
     if (A.imag || B.imag)
-        C = ZSOLVE(A, B, logger, mk_comp);
+        C = ZSOLVE(A, B, logger, mk_comp, code);
     else
-        C = DSOLVE(A, B, logger, mk_real);
-    return ToType(C, Math.max(A.mytype, B.mytype));
+        C = DSOLVE(A, B, logger, mk_real, code);
+    return ToType(C, float_type(A, B));
 }
 
-export function mrdivide(A: FMValue, B: FMValue, logger: Logger): FMValue {
+export function mrdivide(A: FMValue, B: FMValue, logger: Logger, mode?: LeastSquaresMode): FMValue {
     if (!isFMArray(A) && !isFMArray(B)) return rdivide(A, B);
     A = mkArray(A);
     B = mkArray(B);
     if ((A.length === 1) || (B.length === 1)) return rdivide(A, B);
+    RejectIntegers("mrdivide", A, B);
+    const code = least_squares_code(mode);
     let C: FMValue;
     if (A.imag || B.imag)
         C = hermitian(ZSOLVE(hermitian(B) as FMArray,
-            hermitian(A) as FMArray, logger, mk_comp));
+            hermitian(A) as FMArray, logger, mk_comp, code));
     else
         C = transpose(DSOLVE(transpose(B) as FMArray,
-            transpose(A) as FMArray, logger, mk_real));
-    return ToType(C as FMArray, Math.max(A.mytype, B.mytype));
+            transpose(A) as FMArray, logger, mk_real, code));
+    return ToType(C as FMArray, float_type(A, B));
+}
+
+// The factorizations are computed in double precision, and the results
+// stored in single precision if the argument was.
+function factors_like(A: FMArray, factors: FMArray[]): FMArray[] {
+    if (A.mytype !== ArrayType.Single) return factors;
+    return factors.map((F: FMArray): FMArray => ToType(F, ArrayType.Single));
+}
+
+// Returns [L, U, P] with P*A = L*U
+export function lu(A: FMValue): FMArray[] {
+    const M = mkArray(A);
+    RejectIntegers("lu", M);
+    return factors_like(M, M.imag ? ZLU(M, mk_real, mk_comp) : DLU(M, mk_real, mk_comp));
+}
+
+// Returns [Q, R] with A = Q*R.  In economy mode, Q has only as many
+// columns as A when A has more rows than columns.
+export function qr(A: FMValue, economy?: boolean): FMArray[] {
+    const M = mkArray(A);
+    RejectIntegers("qr", M);
+    const econ = !!economy;
+    return factors_like(M, M.imag ? ZQR(M, econ, mk_real, mk_comp) : DQR(M, econ, mk_real, mk_comp));
+}
+
+// Returns upper triangular R with A = R'*R
+export function chol(A: FMValue): FMArray {
+    const M = mkArray(A);
+    RejectIntegers("chol", M);
+    return factors_like(M, [M.imag ? ZCHOL(M, mk_real, mk_comp) : DCHOL(M, mk_real, mk_comp)])[0];
+}
+
+// With no mode, returns [s], the singular values as a column vector.
+// Otherwise returns [U, S, V] with A = U*S*V', in 'full' or 'econ' sizes.
+export function svd(A: FMValue, mode?: string): FMArray[] {
+    const M = mkArray(A);
+    RejectIntegers("svd", M);
+    let code = 0;
+    if (mode === 'full') code = 1;
+    else if (mode === 'econ') code = 2;
+    else if (mode !== undefined) throw new TypeError("Unknown svd mode " + mode);
+    return factors_like(M, M.imag ? ZSVD(M, code, mk_real, mk_comp) : DSVD(M, code, mk_real, mk_comp));
+}
+
+// Returns [d], the eigenvalues as a column vector, or with vectors set,
+// [V, D] with A*V = V*D.
+export function eig(A: FMValue, vectors?: boolean): FMArray[] {
+    const M = mkArray(A);
+    RejectIntegers("eig", M);
+    const vecs = !!vectors;
+    return factors_like(M, M.imag ? ZEIG(M, vecs, mk_real, mk_comp) : DEIG(M, vecs, mk_real, mk_comp));
+}
+
+// inv, det and rcond each take one LU factorization of A natively
+function inverse(A: FMValue, want_inverse: boolean, logger: Logger): FMArray[] {
+    const M = mkArray(A);
+    RejectIntegers(want_inverse ? "inv" : "det and rcond", M);
+    const parts = M.imag ? ZINVERSE(M, want_inverse, logger, mk_real, mk_comp) :
+        DINVERSE(M, want_inverse, logger, mk_real, mk_comp);
+    return factors_like(M, parts);
+}
+
+// A singular or badly conditioned matrix is reported through the logger
+export function inv(A: FMValue, logger: Logger): FMArray {
+    return inverse(A, true, logger)[0];
+}
+
+export function det(A: FMValue): FMArray {
+    return inverse(A, false, () => { })[1];
+}
+
+// The reciprocal of the 1-norm condition number, estimated from the LU
+// factorization (0 for a singular matrix)
+export function rcond(A: FMValue): number {
+    return inverse(A, false, () => { })[2].real[0];
+}
+
+const enum MatrixFunction {
+    Exp = 0,
+    Sqrt = 1,
+    Log = 2
+}
+
+function matrix_function(op: MatrixFunction, A: FMValue, logger: Logger): FMArray {
+    const M = mkArray(A);
+    RejectIntegers(["expm", "sqrtm", "logm"][op], M);
+    const F = M.imag ? ZMATFUN(M, op, logger, mk_real, mk_comp) : DMATFUN(M, op, logger, mk_real, mk_comp);
+    return factors_like(M, [F])[0];
+}
+
+// The matrix exponential, by scaling and squaring
+export function expm(A: FMValue): FMArray {
+    return matrix_function(MatrixFunction.Exp, A, () => { });
+}
+
+// The principal square root and logarithm.  For a real matrix these are
+// real unless it has negative real eigenvalues.  A singular matrix is
+// reported through the logger.
+export function sqrtm(A: FMValue, logger: Logger): FMArray {
+    return matrix_function(MatrixFunction.Sqrt, A, logger);
+}
+
+export function logm(A: FMValue, logger: Logger): FMArray {
+    return matrix_function(MatrixFunction.Log, A, logger);
+}
+
+// The elementary functions run natively over whole arrays.  Real scalars
+// use Math directly, unless the result is complex.  Of the integer classes
+// only abs is defined, and keeps the class (saturating abs(-128) in int8).
+const elementary_ops = ['exp', 'log', 'sqrt', 'sin', 'cos', 'abs'];
+
+function elementary(name: string, A: FMValue): FMValue {
+    if ((typeof (A) === 'number') && !(((name === 'log') || (name === 'sqrt')) && (A < 0)))
+        return (Math as any)[name](A);
+    const X = mkArray(A);
+    if (name !== 'abs') RejectIntegers(name, X);
+    const C = ELEMENTARY(X, elementary_ops.indexOf(name), mk_real, mk_comp);
+    if (IsIntegerType(X.mytype)) return ToType(C, X.mytype);
+    return ToType(C, (X.mytype === ArrayType.Single) ? ArrayType.Single : ArrayType.Double);
+}
+
+export function exp(A: FMValue): FMValue {
+    return elementary('exp', A);
+}
+
+// The log of a negative number is complex
+export function log(A: FMValue): FMValue {
+    return elementary('log', A);
+}
+
+// The square root of a negative number is complex
+export function sqrt(A: FMValue): FMValue {
+    return elementary('sqrt', A);
+}
+
+export function sin(A: FMValue): FMValue {
+    return elementary('sin', A);
+}
+
+export function cos(A: FMValue): FMValue {
+    return elementary('cos', A);
+}
+
+// The magnitude, which is real for complex arguments
+export function abs(A: FMValue): FMValue {
+    return elementary('abs', A);
+}
+
+// Four quadrant arctangent of Y/X, for real arguments of the same size
+// (or a scalar and an array)
+export function atan2(Y: FMValue, X: FMValue): FMValue {
+    if ((typeof (Y) === 'number') && (typeof (X) === 'number'))
+        return Math.atan2(Y, X);
+    const A = mkArray(Y);
+    const B = mkArray(X);
+    RejectIntegers("atan2", A, B);
+    const C = ATAN2(A, B, mk_real);
+    const single = (A.mytype === ArrayType.Single) || (B.mytype === ArrayType.Single);
+    return ToType(C, single ? ArrayType.Single : ArrayType.Double);
+}
+
+// Selects the instruction set level used by the native kernels
+// (generic, sse2, avx2 or avx512), and returns the level in effect.
+export function isa_level(level?: string): string {
+    if (level) return SETISA(level);
+    return GETISA().active;
+}
+
+// When set, results computed by the native code are allocated in
+// SharedArrayBuffers, so that they can be posted to other workers
+// without a copy.  Inputs backed by SharedArrayBuffers are always read
+// in place.  The setting applies to the calling thread only, and the
+// previous setting is returned.
+export function shared_results(shared: boolean): boolean {
+    return SETSHARED(shared);
+}
+
+// Switches the BLAS/LAPACK implementation used by the native code.  The
+// name is a shared library path, or one of openblas, mkl or reference.
+// With no arguments, returns to the implementation the addon was linked
+// against.  Returns a description of the active backend, whose missing
+// field lists the routines that the libraries do not provide, which are
+// taken from the linked implementation instead.
+export function blas_backend(blas?: string, lapack?: string): BLASInfo {
+    return SETBLAS(blas, lapack);
+}
+
+export function blas_info(): BLASInfo {
+    return BLASINFO();
+}
+
+export function blas_threads(threads: number): boolean {
+    return SETBLASTHREADS(threads);
+}
+
+// Sets the number of threads that batched native kernels (such as the
+// columns of an fft) are split across.  The setting is process wide, and
+// defaults to FREEMAT_THREADS or the number of cores.  Returns the
+// previous setting, or with no argument the current one.
+export function kernel_threads(threads?: number): number {
+    return SETTHREADS(threads);
+}
+
+// Benchmarks the transpose block size and the parallel grain (the least
+// work given to a kernel thread) on this machine, and uses the winners.
+// With save set, they are written to the tuning profile (FREEMAT_TUNING,
+// or ~/.freemat_tuning), which is loaded whenever the module is.
+export function autotune(save?: boolean): TuningInfo {
+    return TUNE(!!save);
+}
+
+// Sets the transpose block size and parallel grain by hand (an omitted or
+// zero value is left alone), or with no arguments returns to the defaults.
+export function kernel_tuning(block?: number, grain?: number): TuningInfo {
+    if (block === undefined && grain === undefined) return SETTUNING();
+    return SETTUNING(block || 0, grain || 0);
+}
+
+export function tuning_info(): TuningInfo {
+    return GETTUNING();
+}
+
+// Re-reads the tuning profile, falling back to the defaults if there is
+// none for this machine
+export function load_tuning(): TuningInfo {
+    return LOADTUNING();
+}
+
+// Large native results come from a pool of buffers that are recycled when
+// the arrays holding them are collected.  Reports on the pool.
+export function pool_stats(): PoolInfo {
+    return POOLSTATS();
+}
+
+// Releases the buffers held in the pool for reuse
+export function pool_trim(): void {
+    POOLTRIM();
+}
+
+// Sets the most memory (in bytes) that the pool will hold for reuse
+export function pool_limit(bytes: number): void {
+    SETPOOLLIMIT(bytes);
 }
 
 // How is empty handled?
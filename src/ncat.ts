@@ -1,4 +1,14 @@
-import { FMArray, mkArray, FMValue } from './arrays';
+import { FMArray, mkArray, FMValue, ArrayType, IsIntegerType, ClassValue, MakeComplex } from './arrays';
+
+// The class of a concatenation, as in MATLAB: the first integer class if
+// there is one, then single, and logical only if every part is logical
+function ConcatType(args: FMArray[]): ArrayType {
+    for (let d of args)
+        if (IsIntegerType(d.mytype)) return d.mytype;
+    if (args.some(d => d.mytype === ArrayType.Single)) return ArrayType.Single;
+    if (args.every(d => d.mytype === ArrayType.Logical)) return ArrayType.Logical;
+    return ArrayType.Double;
+}
 
 export function ncat(args_v: FMValue[], dim: number): FMArray {
     let args : FMArray[] = [];
@@ -28,13 +38,26 @@ export function ncat(args_v: FMValue[], dim: number): FMArray {
         pagesize[ndx] = pagesze;
         offsets[ndx] = 0;
     }
-    let op = new FMArray(outputSize);
+    const optype = ConcatType(args);
+    let op = new FMArray(outputSize, undefined, undefined, optype);
+    if (args.some(d => d.imag !== undefined)) op = MakeComplex(op);
+    // Parts of other classes are converted as they are stored
+    const convert = IsIntegerType(optype) || (optype === ArrayType.Logical);
     let outputOffset = 0;
     let outputCount = op.length;
     let k = 0;
     while (outputOffset < outputCount) {
-        for (let ndx = 0; ndx < pagesize[k]; ndx++) {
-            op.real[outputOffset + ndx] = args[k].real[ndx + offsets[k]];
+        const part = args[k];
+        if (convert && (part.mytype !== optype)) {
+            for (let ndx = 0; ndx < pagesize[k]; ndx++)
+                op.real[outputOffset + ndx] = ClassValue(optype, part.real[ndx + offsets[k]]);
+        } else {
+            for (let ndx = 0; ndx < pagesize[k]; ndx++)
+                op.real[outputOffset + ndx] = part.real[ndx + offsets[k]];
+        }
+        if (part.imag) {
+            for (let ndx = 0; ndx < pagesize[k]; ndx++)
+                op.imag![outputOffset + ndx] = part.imag[ndx + offsets[k]];
         }
         outputOffset += pagesize[k];
         offsets[k] += pagesize[k];
@@ -1,8 +1,11 @@
 import { cnumber, cmul, cdiv } from './complex';
+import { BinaryOp } from './broadcast';
 
 export interface Operator {
     op_real(a: number, b: number): number;
     op_complex(a: cnumber, b: cnumber): cnumber;
+    // The same operation in the native kernels
+    native_op(): BinaryOp;
 };
 
 export class Adder implements Operator {
@@ -15,6 +18,9 @@ export class Adder implements Operator {
             imag: a.imag + b.imag
         };
     }
+    native_op(): BinaryOp {
+        return BinaryOp.Plus;
+    }
 };
 
 export class Subtractor implements Operator {
@@ -27,6 +33,9 @@ export class Subtractor implements Operator {
             imag: a.imag - b.imag
         };
     }
+    native_op(): BinaryOp {
+        return BinaryOp.Minus;
+    }
 };
 
 
@@ -37,6 +46,9 @@ export class Multiplier implements Operator {
     op_complex(a: cnumber, b: cnumber): cnumber {
         return cmul(a, b);
     }
+    native_op(): BinaryOp {
+        return BinaryOp.Times;
+    }
 };
 
 export class RightDivider implements Operator {
@@ -46,6 +58,9 @@ export class RightDivider implements Operator {
     op_complex(a: cnumber, b: cnumber): cnumber {
         return cdiv(a, b);
     }
+    native_op(): BinaryOp {
+        return BinaryOp.RDivide;
+    }
 }
 
 export class LeftDivider implements Operator {
@@ -55,5 +70,8 @@ export class LeftDivider implements Operator {
     op_complex(a: cnumber, b: cnumber): cnumber {
         return cdiv(b, a);
     }
+    native_op(): BinaryOp {
+        return BinaryOp.LDivide;
+    }
 }
 
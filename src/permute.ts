@@ -0,0 +1,93 @@
+import { FMValue, FMArray, NumericArray, ToType, Elements, mkArray } from './arrays';
+import { PERMUTE } from './mat.node';
+
+function mk_real(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv);
+}
+
+function mk_comp(n: number[], realv: NumericArray, imagv: NumericArray): FMArray {
+    return new FMArray(n, realv, imagv);
+}
+
+function rearrange(X: FMArray, order: number[], shift: number[]): FMArray {
+    return ToType(PERMUTE(X, order, shift, mk_real, mk_comp), X.mytype);
+}
+
+// Checks a one based dimension order and makes it zero based
+function zero_based(X: FMArray, order: number[]): number[] {
+    if (order.length < X.dims.length)
+        throw new TypeError("Permutation must list all of the dimensions of the array");
+    const seen = order.map(() => false);
+    for (let d of order) {
+        if (!Number.isInteger(d) || (d < 1) || (d > order.length) || seen[d - 1])
+            throw new TypeError("Order is not a permutation of the dimensions");
+        seen[d - 1] = true;
+    }
+    return order.map(d => d - 1);
+}
+
+// B = A with its dimensions rearranged, so that dimension k of B is
+// dimension order[k] of A (one based)
+export function permute(A: FMValue, order: number[]): FMArray {
+    const X = mkArray(A);
+    return rearrange(X, zero_based(X, order), []);
+}
+
+// The inverse of permute, so that ipermute(permute(A, order), order) is A
+export function ipermute(A: FMValue, order: number[]): FMArray {
+    const X = mkArray(A);
+    const inverse = order.slice();
+    zero_based(X, order).forEach((d, k) => { inverse[d] = k; });
+    return rearrange(X, inverse, []);
+}
+
+// Shifts the elements of A circularly, by K along dimension dim, or (with
+// no dim) by K[k] along dimension k.  A single shift with no dim applies
+// to the first dimension that is not 1.
+export function circshift(A: FMValue, K: number | number[], dim?: number): FMArray {
+    const X = mkArray(A);
+    let shift: number[];
+    if (dim !== undefined) {
+        if (!Number.isInteger(dim) || (dim < 1))
+            throw new TypeError("Dimension argument to circshift must be a positive integer");
+        if (typeof (K) !== 'number')
+            throw new TypeError("A shift along one dimension must be a scalar");
+        shift = [];
+        shift[dim - 1] = K;
+    } else if (typeof (K) === 'number') {
+        shift = [];
+        shift[Math.max(0, X.dims.findIndex(n => n !== 1))] = K;
+    } else {
+        shift = K.slice();
+    }
+    for (let k = 0; k < shift.length; k++) {
+        if (shift[k] === undefined) shift[k] = 0;
+        if (!Number.isInteger(shift[k]))
+            throw new TypeError("Shifts must be integers");
+    }
+    const order = X.dims.map((_, k) => k);
+    while (order.length < shift.length) order.push(order.length);
+    return rearrange(X, order, shift);
+}
+
+// A copy of A with the given dimensions, which must have as many elements
+export function reshape(A: FMValue, ...dims: number[]): FMArray {
+    const X = mkArray(A);
+    if (dims.length === 1) dims.push(1);
+    for (let v of dims)
+        if (!Number.isInteger(v) || (v < 0))
+            throw new TypeError("Dimensions must be non-negative integers");
+    if (Elements(dims) !== X.length)
+        throw new TypeError("Reshape cannot change the number of elements");
+    const B = rearrange(X, X.dims.map((_, k) => k), []);
+    return new FMArray(dims, B.real, B.imag, B.mytype);
+}
+
+// A with its singleton dimensions removed.  Matrices are left as they are.
+export function squeeze(A: FMValue): FMArray {
+    const X = mkArray(A);
+    if (X.dims.length <= 2) return reshape(X, ...X.dims);
+    const dims = X.dims.filter(n => n !== 1);
+    while (dims.length < 2) dims.push(1);
+    return reshape(X, ...dims);
+}
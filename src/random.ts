@@ -0,0 +1,76 @@
+import { FMArray, NumericArray } from './arrays';
+import { RANDOM } from './mat.node';
+
+function mk_real(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv);
+}
+
+// A position in a random stream.  Streams are identified by their seed,
+// and each offset is a counter value that gives two numbers, so the
+// numbers at any point of a stream can be generated directly (e.g., by
+// another worker) given its state.
+export interface RNGState {
+    seed: number;
+    offset: number;
+}
+
+const enum RandomDist {
+    Uniform = 0,
+    Normal = 1,
+    Integer = 2
+}
+
+let state: RNGState = { seed: 0, offset: 0 };
+
+// Selects the stream given by a seed (starting at its beginning) or by a
+// saved state.  Returns the previous state, which with no argument is
+// left unchanged.
+export function rng(seed?: number | RNGState): RNGState {
+    const previous = { seed: state.seed, offset: state.offset };
+    if (seed === undefined) return previous;
+    const next = (typeof (seed) === 'number') ? { seed: seed, offset: 0 } : seed;
+    for (let v of [next.seed, next.offset])
+        if (!Number.isInteger(v) || (v < 0) || (v > Number.MAX_SAFE_INTEGER))
+            throw new TypeError("Random seeds and offsets must be non-negative integers below 2^53");
+    state = { seed: next.seed, offset: next.offset };
+    return previous;
+}
+
+// Dimensions as in MATLAB: none for a scalar, one for a square matrix, or
+// a list (possibly as an array)
+function random_dims(dims: (number | number[])[]): number[] {
+    if (dims.length === 0) return [1, 1];
+    let d: number[] = [];
+    for (let v of dims)
+        d = d.concat(v);
+    if (d.length === 1) d.push(d[0]);
+    for (let v of d)
+        if (!Number.isInteger(v) || (v < 0))
+            throw new TypeError("Dimensions must be non-negative integers");
+    return d;
+}
+
+function draw(dist: RandomDist, dims: number[], lo: number, hi: number): FMArray {
+    const A = RANDOM(dims, dist, state.seed, state.offset, lo, hi, mk_real);
+    state.offset += Math.ceil(A.length / 2);
+    return A;
+}
+
+// Uniform random numbers on (0,1)
+export function rand(...dims: (number | number[])[]): FMArray {
+    return draw(RandomDist.Uniform, random_dims(dims), 0, 0);
+}
+
+// Standard normal random numbers
+export function randn(...dims: (number | number[])[]): FMArray {
+    return draw(RandomDist.Normal, random_dims(dims), 0, 0);
+}
+
+// Uniform random integers in 1..imax, or in lo..hi if given [lo, hi]
+export function randi(imax: number | number[], ...dims: (number | number[])[]): FMArray {
+    const [lo, hi] = (typeof (imax) === 'number') ? [1, imax] : imax;
+    if ((lo === undefined) || (hi === undefined) || !Number.isInteger(lo) ||
+        !Number.isInteger(hi) || (lo > hi))
+        throw new TypeError("Integer range must be a positive integer or [lo, hi] with lo <= hi");
+    return draw(RandomDist.Integer, random_dims(dims), lo, hi);
+}
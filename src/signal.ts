@@ -0,0 +1,123 @@
+import { FMValue, FMArray, NumericArray, ArrayType, ToType, mkArray, RejectIntegers } from './arrays';
+import { FFT, FFTCACHE, FFTCacheInfo, CONV, CONV2, FILTER } from './mat.node';
+
+function mk_real(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv);
+}
+
+function mk_comp(n: number[], realv: NumericArray, imagv: NumericArray): FMArray {
+    return new FMArray(n, realv, imagv);
+}
+
+// The dimension fft works along by default: the first one that is not 1
+function first_nonsingleton(A: FMArray): number {
+    const dim = A.dims.findIndex(d => d !== 1);
+    return (dim < 0) ? 0 : dim;
+}
+
+function transform(A: FMValue, inverse: boolean, n?: number, dim?: number): FMArray {
+    const X = mkArray(A);
+    RejectIntegers(inverse ? "ifft" : "fft", X);
+    let d = first_nonsingleton(X);
+    if (dim !== undefined) {
+        if (!Number.isInteger(dim) || (dim < 1))
+            throw new TypeError("Dimension argument to fft must be a positive integer");
+        d = dim - 1;
+    }
+    let len = (d < X.dims.length) ? X.dims[d] : 1;
+    if (n !== undefined) {
+        if (!Number.isInteger(n) || (n < 0))
+            throw new TypeError("Length argument to fft must be a non-negative integer");
+        len = n;
+    }
+    const C = FFT(X, len, d, inverse, mk_real, mk_comp);
+    return ToType(C, (X.mytype === ArrayType.Single) ? ArrayType.Single : ArrayType.Double);
+}
+
+// The discrete Fourier transform along dimension dim (by default the first
+// that is not 1), padded with zeros or truncated to n points.
+export function fft(A: FMValue, n?: number, dim?: number): FMArray {
+    return transform(A, false, n, dim);
+}
+
+// The inverse transform.  The result is real if the input is conjugate
+// symmetric along dim.
+export function ifft(A: FMValue, n?: number, dim?: number): FMArray {
+    return transform(A, true, n, dim);
+}
+
+// Plans (factorizations and twiddle factors) are cached by length.
+// Reports on the cache, emptying it first if clear is set.
+export function fft_cache(clear?: boolean): FFTCacheInfo {
+    return FFTCACHE(clear);
+}
+
+export type ConvShape = 'full' | 'same' | 'valid';
+
+export type ConvMethod = 'auto' | 'direct' | 'fft';
+
+function conv_codes(shape?: ConvShape, method?: ConvMethod): [number, number] {
+    const s = (shape === undefined) ? 0 : ['full', 'same', 'valid'].indexOf(shape);
+    if (s < 0) throw new TypeError("Unknown convolution shape " + shape);
+    const m = (method === undefined) ? 0 : ['auto', 'direct', 'fft'].indexOf(method);
+    if (m < 0) throw new TypeError("Unknown convolution method " + method);
+    return [s, m];
+}
+
+function is_vector(A: FMArray): boolean {
+    return A.dims.filter(d => d !== 1).length <= 1;
+}
+
+function result_type(...args: FMArray[]): ArrayType {
+    return args.some(A => A.mytype === ArrayType.Single) ? ArrayType.Single : ArrayType.Double;
+}
+
+// Convolution of the vectors u and v (polynomial multiplication).  Short
+// kernels are applied directly and long ones through the FFT, unless the
+// method is given.  The result is a column if u is one (or if u is a
+// scalar and v a column), and a row otherwise.
+export function conv(u: FMValue, v: FMValue, shape?: ConvShape, method?: ConvMethod): FMArray {
+    const U = mkArray(u);
+    const V = mkArray(v);
+    RejectIntegers("conv", U, V);
+    if (!is_vector(U) || !is_vector(V))
+        throw new TypeError("Arguments to conv must be vectors");
+    const [s, m] = conv_codes(shape, method);
+    const column = (U.length === 1) ? (V.dims[0] === V.length) && (V.length > 1) :
+        (U.dims[0] === U.length);
+    const orient = (d: number[]) => column ? [d[0], 1] : [1, d[0]];
+    const C = CONV(U, V, s, m,
+        (d: number[], re: NumericArray) => mk_real(orient(d), re),
+        (d: number[], re: NumericArray, im: NumericArray) => mk_comp(orient(d), re, im));
+    return ToType(C, result_type(U, V));
+}
+
+// Two dimensional convolution of the matrices A and B
+export function conv2(A: FMValue, B: FMValue, shape?: ConvShape, method?: ConvMethod): FMArray {
+    const X = mkArray(A);
+    const Y = mkArray(B);
+    RejectIntegers("conv2", X, Y);
+    const [s, m] = conv_codes(shape, method);
+    const C = CONV2(X, Y, s, m, mk_real, mk_comp);
+    return ToType(C, result_type(X, Y));
+}
+
+// Apply the filter with numerator b and denominator a to x along
+// dimension dim (by default the first that is not 1).  Filters with a
+// single denominator coefficient are done as convolutions.
+export function filter(b: FMValue, a: FMValue, x: FMValue, dim?: number): FMArray {
+    const B = mkArray(b);
+    const A = mkArray(a);
+    const X = mkArray(x);
+    RejectIntegers("filter", B, A, X);
+    if (!is_vector(B) || !is_vector(A))
+        throw new TypeError("Filter coefficients must be vectors");
+    let d = first_nonsingleton(X);
+    if (dim !== undefined) {
+        if (!Number.isInteger(dim) || (dim < 1))
+            throw new TypeError("Dimension argument to filter must be a positive integer");
+        d = dim - 1;
+    }
+    const C = FILTER(B, A, X, d, mk_real, mk_comp);
+    return ToType(C, result_type(B, A, X));
+}
@@ -0,0 +1,71 @@
+import { FMValue, FMArray, NumericArray, ToType, mkArray } from './arrays';
+import { SORT, UNIQUE, FIND } from './mat.node';
+
+function mk_real(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv);
+}
+
+function mk_comp(n: number[], realv: NumericArray, imagv: NumericArray): FMArray {
+    return new FMArray(n, realv, imagv);
+}
+
+export type SortMode = 'ascend' | 'descend';
+
+function is_row(A: FMArray): boolean {
+    return (A.dims.length === 2) && (A.dims[0] === 1);
+}
+
+// Results that are a list of values keep the orientation of a row vector
+// argument, and are columns otherwise
+function orient(A: FMArray, C: FMArray): FMArray {
+    if (!is_row(A)) return C;
+    return new FMArray([1, C.length], C.real, C.imag, C.mytype);
+}
+
+function sort_native(A: FMValue, dim: number | undefined, mode: SortMode | undefined,
+    index: boolean): FMArray[] {
+    const X = mkArray(A);
+    let d = X.dims.findIndex(n => n !== 1);
+    if (d < 0) d = 0;
+    if (dim !== undefined) {
+        if (!Number.isInteger(dim) || (dim < 1))
+            throw new TypeError("Dimension argument to sort must be a positive integer");
+        d = dim - 1;
+    }
+    if ((mode !== undefined) && (mode !== 'ascend') && (mode !== 'descend'))
+        throw new TypeError("Unknown sort mode " + mode);
+    const outputs = SORT(X, d, mode === 'descend', index, mk_real, mk_comp);
+    outputs[0] = ToType(outputs[0], X.mytype);
+    return outputs;
+}
+
+// Sorts along dimension dim (by default the first that is not 1).  The
+// sort is stable, NaNs go last (first when descending), and complex
+// values are ordered by magnitude and then angle.
+export function sort(A: FMValue, dim?: number, mode?: SortMode): FMArray {
+    return sort_native(A, dim, mode, false)[0];
+}
+
+// Returns [B, I], the sorted array and the (one based) positions along
+// the sorted dimension that its elements came from
+export function sort_index(A: FMValue, dim?: number, mode?: SortMode): FMArray[] {
+    return sort_native(A, dim, mode, true);
+}
+
+// Returns [C, ia, ic]: the distinct values C of A in sorted order, with
+// C = A(ia) and A(:) = C(ic).  ia gives first occurrences.  NaNs are
+// never equal, so each one appears in C.
+export function unique(A: FMValue): FMArray[] {
+    const X = mkArray(A);
+    const [C, ia, ic] = UNIQUE(X, mk_real, mk_comp);
+    return [orient(X, ToType(C, X.mytype)), ia, ic];
+}
+
+// The (one based) linear indices of the nonzero elements of A, or of the
+// first limit of them
+export function find(A: FMValue, limit?: number): FMArray {
+    const X = mkArray(A);
+    if ((limit !== undefined) && (!Number.isInteger(limit) || (limit < 0)))
+        throw new TypeError("Limit argument to find must be a non-negative integer");
+    return orient(X, FIND(X, (limit === undefined) ? -1 : limit, mk_real));
+}
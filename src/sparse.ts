@@ -0,0 +1,151 @@
+import { FMValue, FMArray, NumericArray, mkArray, RejectIntegers } from './arrays';
+import { SPARSE, SPDENSE, SPFULL, SPTRANSPOSE, SPMTIMES, SPSOLVE, Logger } from './mat.node';
+
+// A real sparse matrix in compressed sparse column form.  Column j holds
+// the rows rowind[colptr[j]] .. rowind[colptr[j+1]-1] (zero based and
+// increasing), with the values in the same positions of real.  The arrays
+// are built natively and are not changed afterwards.
+export class SparseArray {
+    dims: number[];
+    colptr: Int32Array;
+    rowind: Int32Array;
+    real: Float64Array;
+    constructor(dims: number[], colptr: Int32Array, rowind: Int32Array, real: Float64Array) {
+        this.dims = dims;
+        this.colptr = colptr;
+        this.rowind = rowind;
+        this.real = real;
+    }
+    get nnz(): number {
+        return this.colptr[this.dims[1]];
+    }
+}
+
+function mk_real(n: number[], realv: NumericArray): FMArray {
+    return new FMArray(n, realv);
+}
+
+function mk_sparse(n: number[], colptr: Int32Array, rowind: Int32Array, realv: Float64Array): SparseArray {
+    return new SparseArray(n, colptr, rowind, realv);
+}
+
+export function issparse(A: any): A is SparseArray {
+    return A instanceof SparseArray;
+}
+
+function real_values(X: FMArray): FMArray {
+    if (X.imag) throw new TypeError("Sparse matrices must be real");
+    RejectIntegers("sparse", X);
+    return X;
+}
+
+// The largest of a list of (one based) indices
+function extent(X: FMArray): number {
+    let n = 0;
+    for (let k = 0; k < X.length; k++) n = Math.max(n, X.real[k]);
+    return n;
+}
+
+// sparse(A) is the nonzeros of the matrix A, sparse(m, n) an m x n matrix
+// of zeros, and sparse(i, j, v, m, n) the m x n matrix with v[k] at row
+// i[k] and column j[k] (one based).  Values at the same position are
+// summed.  m and n default to the largest indices, and a scalar v goes
+// everywhere.
+export function sparse(A: FMValue | SparseArray, j?: FMValue, v?: FMValue, m?: number, n?: number): SparseArray {
+    if (issparse(A)) return A;
+    if (j === undefined)
+        return SPDENSE(real_values(mkArray(A)), mk_sparse);
+    if (v === undefined) {
+        const none = new FMArray([0, 1], []);
+        return SPARSE(none, none, none, A as number, j as number, mk_sparse);
+    }
+    const I = mkArray(A);
+    const J = mkArray(j);
+    let V = real_values(mkArray(v));
+    if ((V.length === 1) && (I.length !== 1))
+        V = new FMArray([I.length, 1], new Float64Array(I.length).fill(V.real[0]));
+    return SPARSE(I, J, V, (m === undefined) ? extent(I) : m,
+        (n === undefined) ? extent(J) : n, mk_sparse);
+}
+
+// The dense form of a matrix
+export function full(A: FMValue | SparseArray): FMArray {
+    if (issparse(A)) return SPFULL(A, mk_real);
+    return mkArray(A);
+}
+
+// The number of nonzeros
+export function nnz(A: FMValue | SparseArray): number {
+    if (issparse(A)) return A.nnz;
+    const X = mkArray(A);
+    let count = 0;
+    for (let k = 0; k < X.length; k++)
+        if ((X.real[k] !== 0) || (X.imag && (X.imag[k] !== 0))) count++;
+    return count;
+}
+
+export function sptranspose(A: SparseArray): SparseArray {
+    return SPTRANSPOSE(A, mk_sparse);
+}
+
+// s*S.  Products that underflow to zero are dropped, so that no zeros are
+// stored.  A NaN or infinite s makes the implicit zeros NaN, so the
+// product is formed in full.
+function scale(S: SparseArray, s: number): SparseArray {
+    if (!isFinite(s)) {
+        const F = full(S);
+        return sparse(new FMArray(F.dims, F.real.map(x => x * s)));
+    }
+    const cols = S.dims[1];
+    const colptr = new Int32Array(cols + 1);
+    const rowind = new Int32Array(S.nnz);
+    const real = new Float64Array(S.nnz);
+    let k = 0;
+    for (let j = 0; j < cols; j++) {
+        for (let p = S.colptr[j]; p < S.colptr[j + 1]; p++) {
+            const v = S.real[p] * s;
+            if (v === 0) continue;
+            rowind[k] = S.rowind[p];
+            real[k++] = v;
+        }
+        colptr[j + 1] = k;
+    }
+    return new SparseArray(S.dims.slice(), colptr, rowind.slice(0, k), real.slice(0, k));
+}
+
+// The product of two matrices of which at least one is sparse.  The
+// product of two sparse matrices (or of one and a scalar) is sparse, and
+// of a sparse and a dense matrix is dense.  A complex dense operand is
+// multiplied a part at a time.
+export function sparse_mtimes(A: FMValue | SparseArray, B: FMValue | SparseArray): FMArray | SparseArray {
+    if (issparse(A) && issparse(B)) return SPMTIMES(A, B, mk_real, mk_sparse);
+    if (!issparse(A) && (mkArray(A).length === 1))
+        return scale(B as SparseArray, real_values(mkArray(A)).real[0]);
+    if (!issparse(B) && (mkArray(B).length === 1))
+        return scale(A as SparseArray, real_values(mkArray(B)).real[0]);
+    const D = mkArray((issparse(A) ? B : A) as FMValue);
+    RejectIntegers("Matrix multiplication", D);
+    const part = (X: FMArray) => issparse(A) ? SPMTIMES(A, X, mk_real, mk_sparse) :
+        SPMTIMES(X, B as SparseArray, mk_real, mk_sparse);
+    if (!D.imag) return part(new FMArray(D.dims, D.real));
+    const re = part(new FMArray(D.dims, D.real)) as FMArray;
+    const im = part(new FMArray(D.dims, D.imag)) as FMArray;
+    return new FMArray(re.dims, re.real, im.real);
+}
+
+// Solves A*X = B for a sparse A by a sparse Cholesky or LU factorization
+// (see sparse.hpp).  The real and imaginary parts of a complex B are
+// solved together, as twice as many right hand sides.  A nearly singular A
+// is reported through the logger.
+export function sparse_mldivide(A: SparseArray, B: FMValue | SparseArray, logger: Logger): FMArray {
+    const D = full(B);
+    RejectIntegers("mldivide", D);
+    if (!D.imag) return SPSOLVE(A, new FMArray(D.dims, D.real), logger, mk_real);
+    const len = D.length;
+    const stacked = new Float64Array(2 * len);
+    stacked.set(D.real, 0);
+    stacked.set(D.imag, len);
+    const X = SPSOLVE(A, new FMArray([D.dims[0], 2 * len / Math.max(1, D.dims[0])], stacked), logger, mk_real);
+    const half = X.length / 2;
+    return new FMArray([X.dims[0], X.dims[1] / 2], X.real.slice(0, half), X.real.slice(half));
+}
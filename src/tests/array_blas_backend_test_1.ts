@@ -0,0 +1,39 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray } from "../arrays";
+import { mtimes, blas_backend, blas_info } from "../math";
+import { mat_equal, test_mat } from "./test_utils";
+
+@suite
+export class BLASBackendTests {
+    @test "should report the active backend"() {
+        const info = blas_info();
+        assert.isAbove(info.name.length, 0);
+        assert.isAtLeast(info.threads, 1);
+    }
+    @test "should keep the current backend if a library fails to load"() {
+        const before = blas_info();
+        assert.throws(() => blas_backend("/no/such/libblas.so"));
+        assert.deepEqual(blas_info(), before);
+    }
+    @test "should give the same product after returning to the linked backend"() {
+        const C = test_mat(20, 30);
+        const D = test_mat(30, 10);
+        const ref = mtimes(C, D) as FMArray;
+        const linked = blas_info();
+        assert.equal(linked.name.indexOf("linked"), 0);
+        assert.deepEqual(linked.missing, []);
+        // Load the linked library again, by path, as a backend of its own
+        const loaded = blas_backend(linked.blas);
+        try {
+            assert.equal(loaded.blas, linked.blas);
+            assert.notEqual(loaded.name.indexOf("linked"), 0);
+            assert.isTrue(Array.isArray(loaded.missing));
+            assert.isTrue(mat_equal(ref, mtimes(C, D)));
+        } finally {
+            blas_backend();
+        }
+        assert.deepEqual(blas_info(), linked);
+        assert.isTrue(mat_equal(ref, mtimes(C, D)));
+    }
+}
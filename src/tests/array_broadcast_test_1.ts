@@ -0,0 +1,104 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType } from "../arrays";
+import { plus, minus, times, rdivide, ldivide, lt, eq } from "../math";
+import { cmul, cdiv } from "../complex";
+import { rand_array, rand_array_complex } from "./test_utils";
+
+// The element of A that lands at coord of a broadcast result
+function at(A: FMArray, coord: number[]): number {
+    let ndx = 0;
+    let stride = 1;
+    for (let k = 0; k < A.dims.length; k++) {
+        if (A.dims[k] !== 1) ndx += coord[k] * stride;
+        stride *= A.dims[k];
+    }
+    return ndx;
+}
+
+function each_coord(dims: number[], body: (coord: number[], i: number) => void): void {
+    const coord = dims.map(() => 0);
+    const count = dims.reduce((x, y) => x * y, 1);
+    for (let i = 0; i < count; i++) {
+        body(coord, i);
+        for (let k = 0; k < dims.length; k++) {
+            if (++coord[k] < dims[k]) break;
+            coord[k] = 0;
+        }
+    }
+}
+
+function same(x: number, y: number): boolean {
+    return (x === y) || (isNaN(x) && isNaN(y));
+}
+
+@suite
+export class BroadcastTests {
+    @test "should combine a column with a row"() {
+        const a = new FMArray([3, 1], [1, 2, 3]);
+        const b = new FMArray([1, 4], [10, 20, 30, 40]);
+        const C = plus(a, b) as FMArray;
+        assert.deepEqual(C.dims, [3, 4]);
+        assert.deepEqual(Array.from(C.real), [11, 12, 13, 21, 22, 23, 31, 32, 33, 41, 42, 43]);
+        const D = minus(b, a) as FMArray;
+        assert.deepEqual(D.dims, [3, 4]);
+        assert.equal(D.real[5], 20 - 3);
+    }
+    @test "should expand N-D operands along any dimension"() {
+        const dims = [20, 6, 30, 4];
+        for (let shapes of [[[20, 6, 30, 4], [20, 1, 30]], [[1, 6, 1, 4], [20, 1, 30, 1]],
+            [[20, 6], [1, 1, 30, 4]], [[20, 6, 30, 4], [1, 6]]]) {
+            const A = rand_array(shapes[0]);
+            const B = rand_array(shapes[1]);
+            const C = times(A, B) as FMArray;
+            assert.deepEqual(C.dims, dims.slice(0, C.dims.length));
+            each_coord(C.dims, (coord, i) => {
+                assert.equal(C.real[i], A.real[at(A, coord)] * B.real[at(B, coord)]);
+            });
+        }
+    }
+    @test "should mix complex and real operands"() {
+        const A = rand_array_complex([50, 40]);
+        const b = rand_array([50, 1]);
+        b.real[3] = 0;
+        A.imag![7] = 0;
+        for (let [f, g] of [[times, cmul], [rdivide, (x: any, y: any) => cdiv(x, y)],
+            [ldivide, (x: any, y: any) => cdiv(y, x)]] as any[]) {
+            const C = f(A, b) as FMArray;
+            assert.isOk(C.imag);
+            each_coord(C.dims, (coord, i) => {
+                const x = { real: A.real[i], imag: A.imag![i] };
+                const y = { real: b.real[coord[0]], imag: 0 };
+                const z = g(x, y);
+                assert.isTrue(same(C.real[i], z.real));
+                assert.isTrue(same(C.imag![i], z.imag));
+            });
+        }
+    }
+    @test "should compare with logical results"() {
+        const a = new FMArray([4, 1], [1, 2, 3, 4]);
+        const b = new FMArray([1, 3], [2, 3, 4]);
+        const C = lt(a, b) as FMArray;
+        assert.equal(C.mytype, ArrayType.Logical);
+        assert.deepEqual(C.dims, [4, 3]);
+        assert.deepEqual(Array.from(C.real), [1, 0, 0, 0, 1, 1, 0, 0, 1, 1, 1, 0]);
+        const Z = new FMArray([1, 3], [1, 2, 3], [1, 0, -1]);
+        const E = eq(Z, new FMArray([3, 1], [1, 2, 3])) as FMArray;
+        assert.isUndefined(E.imag);
+        assert.deepEqual(Array.from(E.real), [0, 0, 0, 0, 1, 0, 0, 0, 0]);
+    }
+    @test "should give the same results as the loops for large arrays"() {
+        const A = rand_array([200, 100]);
+        const B = rand_array([200, 100]);
+        const C = rdivide(A, B) as FMArray;
+        for (let i = 0; i < C.length; i++)
+            assert.isTrue(same(C.real[i], A.real[i] / B.real[i]));
+        const D = plus(A, 2) as FMArray;
+        for (let i = 0; i < D.length; i++)
+            assert.equal(D.real[i], A.real[i] + 2);
+    }
+    @test "should reject dimensions that do not agree"() {
+        assert.throws(() => plus(rand_array([3, 4]), rand_array([4, 1])));
+        assert.throws(() => lt(rand_array([3, 4, 2]), rand_array([3, 4, 3])));
+    }
+}
@@ -0,0 +1,131 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType } from "../arrays";
+import { conv, conv2, filter, ConvShape } from "../signal";
+import { rand_array, rand_array_complex, max_diff } from "./test_utils";
+
+// Direct evaluation of the full convolution of two vectors, as a column
+function naive_conv(u: FMArray, v: FMArray): FMArray {
+    const n = u.length + v.length - 1;
+    let C = new FMArray([n, 1], undefined, new Float64Array(n));
+    for (let i = 0; i < u.length; i++)
+        for (let j = 0; j < v.length; j++) {
+            const a = u.real[i], b = u.imag ? u.imag[i] : 0;
+            const c = v.real[j], d = v.imag ? v.imag[j] : 0;
+            C.real[i + j] += a * c - b * d;
+            C.imag![i + j] += a * d + b * c;
+        }
+    return C;
+}
+
+// Direct evaluation of a filter along a column
+function naive_filter(b: number[], a: number[], x: FMArray): FMArray {
+    let y = new FMArray([x.length, 1]);
+    for (let t = 0; t < x.length; t++) {
+        let s = 0;
+        for (let j = 0; j < b.length; j++)
+            if (t >= j) s += b[j] * x.real[t - j];
+        for (let j = 1; j < a.length; j++)
+            if (t >= j) s -= a[j] * y.real[t - j];
+        y.real[t] = s / a[0];
+    }
+    return y;
+}
+
+const sizes = [[1, 1], [7, 3], [3, 7], [200, 9], [2000, 700]];
+
+const shapes: ConvShape[] = ['full', 'same', 'valid'];
+
+@suite
+export class ConvTests {
+    @test "should match direct evaluation of real convolutions"() {
+        for (let [n, k] of sizes) {
+            const u = rand_array([n, 1]);
+            const v = rand_array([k, 1]);
+            const C = naive_conv(u, v);
+            C.imag = undefined;
+            assert.isBelow(max_diff(conv(u, v, 'full', 'direct'), C), 1e-8);
+            assert.isBelow(max_diff(conv(u, v, 'full', 'fft'), C), 1e-8);
+        }
+    }
+    @test "should match direct evaluation of complex convolutions"() {
+        for (let [n, k] of sizes) {
+            const u = rand_array_complex([n, 1]);
+            const v = rand_array([k, 1]);
+            const C = naive_conv(u, v);
+            assert.isBelow(max_diff(conv(u, v, 'full', 'direct'), C), 1e-8);
+            assert.isBelow(max_diff(conv(u, v, 'full', 'fft'), C), 1e-8);
+            assert.isBelow(max_diff(conv(v, u), C), 1e-8);
+        }
+    }
+    @test "should return the same part of the convolution with either method"() {
+        for (let [n, k] of sizes)
+            for (let shape of shapes) {
+                const u = rand_array([1, n]);
+                const v = rand_array([1, k]);
+                assert.isBelow(max_diff(conv(u, v, shape, 'direct'), conv(u, v, shape, 'fft')), 1e-8);
+            }
+    }
+    @test "should size the result by the shape"() {
+        const u = rand_array([1, 10]);
+        const v = rand_array([1, 4]);
+        assert.deepEqual(conv(u, v).dims, [1, 13]);
+        assert.deepEqual(conv(u, v, 'same').dims, [1, 10]);
+        assert.deepEqual(conv(u, v, 'valid').dims, [1, 7]);
+        assert.deepEqual(conv(v, u, 'valid').dims, [1, 0]);
+        assert.deepEqual(conv(rand_array([10, 1]), v).dims, [13, 1]);
+    }
+    @test "should split long convolutions across threads"() {
+        const u = rand_array([100000, 1]);
+        const v = rand_array([300, 1]);
+        assert.isBelow(max_diff(conv(u, v, 'full', 'direct'), conv(u, v, 'full', 'fft')), 1e-7);
+    }
+    @test "should keep single precision inputs single"() {
+        const u = new FMArray([4, 1], new Float32Array([1, 2, 3, 4]), undefined, ArrayType.Single);
+        const C = conv(u, new FMArray([2, 1], [1, 1]));
+        assert.equal(C.mytype, ArrayType.Single);
+        assert.deepEqual(Array.from(C.real), [1, 3, 5, 7, 4]);
+    }
+    @test "should refuse an unknown convolution shape"() {
+        const u = rand_array([10, 1]);
+        assert.throws(() => conv(u, u, 'middle' as ConvShape), TypeError, /shape/);
+    }
+    @test "should agree between methods for 2D convolutions"() {
+        for (let [m, n, p, q] of [[5, 4, 3, 2], [40, 30, 7, 9], [3, 2, 6, 5]])
+            for (let shape of shapes) {
+                const A = rand_array_complex([m, n]);
+                const B = rand_array([p, q]);
+                assert.isBelow(max_diff(conv2(A, B, shape, 'direct'), conv2(A, B, shape, 'fft')), 1e-8);
+            }
+    }
+    @test "should reduce to conv for a single column"() {
+        const u = rand_array([50, 1]);
+        const v = rand_array([8, 1]);
+        assert.isBelow(max_diff(conv2(u, v), conv(u, v)), 1e-10);
+    }
+    @test "should match direct evaluation of FIR and IIR filters"() {
+        const x = rand_array([60, 1]);
+        for (let [b, a] of [[[1, 2, 3], [2]], [[0.5, 0.3], [1, -0.5]], [[1], [1, -0.9, 0.2]]]) {
+            const B = new FMArray([1, b.length], b);
+            const A = new FMArray([1, a.length], a);
+            assert.isBelow(max_diff(filter(B, A, x), naive_filter(b, a, x)), 1e-9);
+        }
+    }
+    @test "should filter each vector along the given dimension"() {
+        const X = rand_array([6, 40]);
+        const b = new FMArray([1, 2], [1, 1]);
+        const a = new FMArray([1, 2], [1, -0.5]);
+        const Y = filter(b, a, X, 2);
+        for (let r = 0; r < 6; r++) {
+            let x = new FMArray([40, 1]);
+            for (let t = 0; t < 40; t++) x.real[t] = X.real[r + 6 * t];
+            const y = naive_filter([1, 1], [1, -0.5], x);
+            for (let t = 0; t < 40; t++)
+                assert.closeTo(Y.real[r + 6 * t], y.real[t], 1e-9);
+        }
+    }
+    @test "should refuse a filter whose first denominator term is zero"() {
+        const x = rand_array([10, 1]);
+        assert.throws(() => filter(new FMArray([1, 1], [1]), new FMArray([1, 2], [0, 1]), x), /nonzero/);
+    }
+}
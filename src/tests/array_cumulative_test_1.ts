@@ -0,0 +1,103 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType } from "../arrays";
+import { cumsum, cumprod, cummax, cummin, diff } from "../cumulative";
+import { kernel_threads } from "../math";
+import { cmul } from "../complex";
+import { rand_array, rand_array_complex, values } from "./test_utils";
+
+// Sequential scan of every vector along dim (one based), for checking
+function naive_scan(A: FMArray, dim: number, op: (a: number, b: number) => number): number[] {
+    const n = A.dims[dim - 1];
+    const stride = A.dims.slice(0, dim - 1).reduce((x, y) => x * y, 1);
+    const out = Array.from(A.real);
+    for (let v = 0; v < A.length / n; v++) {
+        const start = Math.floor(v / stride) * stride * n + v % stride;
+        for (let j = 1; j < n; j++)
+            out[start + j * stride] = op(out[start + (j - 1) * stride], A.real[start + j * stride]);
+    }
+    return out;
+}
+
+@suite
+export class CumulativeTests {
+    @test "should scan along any dimension"() {
+        const A = rand_array([17, 13, 9]);
+        for (let dim = 1; dim <= 3; dim++) {
+            assert.deepEqual(values(cumsum(A, dim)), naive_scan(A, dim, (a, b) => a + b));
+            assert.deepEqual(values(cumprod(A, dim)), naive_scan(A, dim, (a, b) => a * b));
+            assert.deepEqual(values(cummax(A, dim)), naive_scan(A, dim, Math.max));
+            assert.deepEqual(values(cummin(A, dim)), naive_scan(A, dim, Math.min));
+        }
+        const B = rand_array([1, 600]);
+        assert.deepEqual(cumsum(B).dims, [1, 600]);
+        assert.deepEqual(values(cumsum(B)), naive_scan(B, 2, (a, b) => a + b));
+    }
+    @test "should skip NaNs in the running extremes"() {
+        const A = new FMArray([1, 6], [NaN, 3, NaN, 1, 5, NaN]);
+        const M = values(cummax(A));
+        assert.isTrue(isNaN(M[0]));
+        assert.deepEqual(M.slice(1), [3, 3, 3, 5, 5]);
+        assert.deepEqual(values(cummin(A)).slice(1), [3, 3, 1, 1, 1]);
+    }
+    @test "should scan complex data"() {
+        const A = rand_array_complex([12, 5]);
+        const S = cumsum(A);
+        assert.deepEqual(values(S), naive_scan(A, 1, (a, b) => a + b));
+        const P = cumprod(A);
+        for (let c = 0; c < 5; c++) {
+            let acc = { real: A.real[c * 12], imag: A.imag![c * 12] };
+            for (let j = 1; j < 12; j++) {
+                const i = c * 12 + j;
+                acc = cmul(acc, { real: A.real[i], imag: A.imag![i] });
+                assert.equal(P.real[i], acc.real);
+                assert.equal(P.imag![i], acc.imag);
+            }
+        }
+        const Z = new FMArray([1, 4], [1, 0, -3, 2], [0, 2, 0, 2]);
+        const M = cummax(Z);
+        assert.deepEqual(values(M), [1, 0, -3, -3]);
+        assert.deepEqual(Array.from(M.imag!), [0, 2, 0, 0]);
+    }
+    @test "should split long vectors across threads"() {
+        const previous = kernel_threads(4);
+        try {
+            const A = rand_array([400000, 1]);
+            const S = cumsum(A);
+            const expected = naive_scan(A, 1, (a, b) => a + b);
+            for (let i = 0; i < A.length; i += 997)
+                assert.closeTo(S.real[i], expected[i], 1e-9 * Math.abs(expected[i]) + 1e-9);
+            assert.deepEqual(values(cummax(A)), naive_scan(A, 1, Math.max));
+        } finally {
+            kernel_threads(previous);
+        }
+    }
+    @test "should take differences of any order"() {
+        const A = new FMArray([1, 6], [1, 4, 9, 16, 25, 36]);
+        assert.deepEqual(values(diff(A)), [3, 5, 7, 9, 11]);
+        assert.deepEqual(values(diff(A, 2)), [2, 2, 2, 2]);
+        assert.deepEqual(values(diff(A, 3)), [0, 0, 0]);
+        assert.deepEqual(diff(A, 6).dims, [1, 0]);
+        assert.deepEqual(diff(A, 9).dims, [1, 0]);
+        assert.deepEqual(values(diff(A, 0)), values(A));
+        const B = rand_array([30, 700, 3]);
+        for (let dim = 1; dim <= 3; dim++) {
+            let expected = B;
+            for (let k = 0; k < 2; k++) expected = diff(expected, 1, dim);
+            const D = diff(B, 2, dim);
+            assert.deepEqual(D.dims, expected.dims);
+            assert.deepEqual(values(D), values(expected));
+        }
+        const n = B.dims[1];
+        const D = diff(B, 1, 2);
+        assert.equal(D.real[5 + 30 * 7], B.real[5 + 30 * 8] - B.real[5 + 30 * 7]);
+        assert.equal(D.real[5 + 30 * (n - 1) * 2 + 30 * 3], B.real[5 + 30 * n * 2 + 30 * 4] - B.real[5 + 30 * n * 2 + 30 * 3]);
+    }
+    @test "should keep single precision and promote logicals"() {
+        const A = new FMArray([1, 3], [1, 2, 3], undefined, ArrayType.Single);
+        assert.equal(cumsum(A).mytype, ArrayType.Single);
+        const L = new FMArray([1, 3], [1, 1, 0], undefined, ArrayType.Logical);
+        assert.equal(cumsum(L).mytype, ArrayType.Double);
+        assert.deepEqual(values(cumsum(L)), [1, 2, 2]);
+    }
+}
@@ -0,0 +1,61 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray } from "../arrays";
+import { mtimes, hermitian, lu, qr, chol, svd, eig } from "../math";
+import { rand_array, rand_array_complex, max_diff } from "./test_utils";
+
+const shapes = [[6, 4], [4, 6], [5, 5], [120, 80], [80, 120]];
+
+@suite
+export class DecompositionTests {
+    @test "should factor real and complex matrices with lu"() {
+        for (let [r, c] of shapes)
+            for (let A of [rand_array([r, c]), rand_array_complex([r, c])]) {
+                const [L, U, P] = lu(A);
+                assert.isBelow(max_diff(mtimes(P, A), mtimes(L, U)), 1e-9);
+            }
+    }
+    @test "should factor matrices with qr in both sizes"() {
+        for (let [r, c] of shapes)
+            for (let A of [rand_array([r, c]), rand_array_complex([r, c])]) {
+                const [Q, R] = qr(A);
+                assert.deepEqual(Q.dims, [r, r]);
+                assert.isBelow(max_diff(A, mtimes(Q, R)), 1e-9);
+                const [Qe, Re] = qr(A, true);
+                assert.deepEqual(Qe.dims, [r, Math.min(r, c)]);
+                assert.isBelow(max_diff(A, mtimes(Qe, Re)), 1e-9);
+            }
+    }
+    @test "should factor positive definite matrices with chol"() {
+        const B = rand_array([30, 30]);
+        const A = mtimes(hermitian(B), B) as FMArray;
+        const R = chol(A);
+        assert.isBelow(max_diff(A, mtimes(hermitian(R), R)), 1e-8);
+        assert.throws(() => chol(new FMArray([2, 2], [1, 2, 2, 1])), /positive definite/);
+    }
+    @test "should compute the svd with either driver"() {
+        for (let [r, c] of shapes)
+            for (let A of [rand_array([r, c]), rand_array_complex([r, c])]) {
+                const [s] = svd(A);
+                assert.deepEqual(s.dims, [Math.min(r, c), 1]);
+                for (let mode of ['full', 'econ']) {
+                    const [U, S, V] = svd(A, mode);
+                    assert.isBelow(max_diff(A, mtimes(mtimes(U, S), hermitian(V))), 1e-8);
+                    assert.isBelow(Math.abs(S.real[0] - s.real[0]), 1e-9);
+                }
+            }
+    }
+    @test "should find eigenvalues of symmetric and general matrices"() {
+        for (let n of [5, 100]) {
+            const B = rand_array([n, n]);
+            const S = mtimes(hermitian(B), B) as FMArray;
+            const [V, D] = eig(S, true);
+            assert.isUndefined(D.imag);
+            assert.isBelow(max_diff(mtimes(S, V), mtimes(V, D)), 1e-7);
+            const [W, E] = eig(B, true);
+            assert.isBelow(max_diff(mtimes(B, W), mtimes(W, E)), 1e-8);
+            const [d] = eig(B);
+            assert.deepEqual(d.dims, [n, 1]);
+        }
+    }
+}
@@ -0,0 +1,132 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, FMValue, ArrayType, mkArray } from "../arrays";
+import { exp, log, sqrt, sin, cos, abs, atan2 } from "../math";
+import { rand_array, rand_array_complex } from "./test_utils";
+
+// Largest error relative to the magnitude of the reference (or to 1 for
+// small references)
+function max_rel_diff(A: FMValue, B: FMValue): number {
+    const X = mkArray(A);
+    const Y = mkArray(B);
+    assert.deepEqual(X.dims, Y.dims);
+    let err = 0;
+    for (let i = 0; i < X.length; i++) {
+        const yr = Y.real[i];
+        const yi = Y.imag ? Y.imag[i] : 0;
+        err = Math.max(err, Math.abs(X.real[i] - yr) / Math.max(1, Math.abs(yr)));
+        const xi = X.imag ? X.imag[i] : 0;
+        err = Math.max(err, Math.abs(xi - yi) / Math.max(1, Math.abs(yi)));
+    }
+    return err;
+}
+
+function spread(n: number, lo: number, hi: number): FMArray {
+    let A = new FMArray([n, 1]);
+    for (let i = 0; i < n; i++)
+        A.real[i] = lo + (hi - lo) * i / (n - 1);
+    return A;
+}
+
+function apply(A: FMArray, f: (x: number) => number): FMArray {
+    let B = new FMArray(A.dims.slice());
+    for (let i = 0; i < A.length; i++)
+        B.real[i] = f(A.real[i]);
+    return B;
+}
+
+// Reference for a complex function, from its real and imaginary parts
+function apply_complex(A: FMArray, f: (a: number, b: number) => number[]): FMArray {
+    let B = new FMArray(A.dims.slice(), undefined, new Float64Array(A.length));
+    for (let i = 0; i < A.length; i++) {
+        const [re, im] = f(A.real[i], A.imag![i]);
+        B.real[i] = re;
+        B.imag![i] = im;
+    }
+    return B;
+}
+
+@suite
+export class ElementaryTests {
+    @test "should match Math for real arguments"() {
+        const wide = spread(10001, -700, 700);
+        const positive = spread(10001, 1e-300, 1e300);
+        const angles = spread(10001, -1e5, 1e5);
+        assert.isBelow(max_rel_diff(exp(wide), apply(wide, Math.exp)), 1e-15);
+        assert.isBelow(max_rel_diff(log(positive), apply(positive, Math.log)), 1e-15);
+        assert.isBelow(max_rel_diff(sqrt(positive), apply(positive, Math.sqrt)), 1e-15);
+        assert.isBelow(max_rel_diff(sin(angles), apply(angles, Math.sin)), 1e-15);
+        assert.isBelow(max_rel_diff(cos(angles), apply(angles, Math.cos)), 1e-15);
+        assert.isBelow(max_rel_diff(abs(wide), apply(wide, Math.abs)), 1e-15);
+    }
+    @test "should handle special values like Math"() {
+        const special = new FMArray([1, 6], [0, -0, Infinity, -Infinity, NaN, 1e-320]);
+        for (let [f, g] of [[exp, Math.exp], [sin, Math.sin], [cos, Math.cos]] as [(A: FMValue) => FMValue, (x: number) => number][]) {
+            const Y = mkArray(f(special));
+            for (let i = 0; i < special.length; i++)
+                assert.deepEqual(Y.real[i], g(special.real[i]));
+        }
+        assert.equal(mkArray(exp(new FMArray([1, 1], [750]))).real[0], Infinity);
+        const L = mkArray(log(new FMArray([1, 3], [0, Infinity, 1e-320])));
+        assert.deepEqual(Array.from(L.real.slice(0, 2)), [-Infinity, Infinity]);
+        assert.closeTo(L.real[2], Math.log(1e-320), 1e-12);
+    }
+    @test "should promote the log and square root of negative numbers to complex"() {
+        const X = new FMArray([1, 3], [-4, 0, 9]);
+        const S = mkArray(sqrt(X));
+        assert.deepEqual(Array.from(S.real), [0, 0, 3]);
+        assert.deepEqual(Array.from(S.imag!), [2, 0, 0]);
+        const L = mkArray(log(X));
+        assert.closeTo(L.imag![0], Math.PI, 1e-15);
+        assert.isUndefined(mkArray(sqrt(new FMArray([1, 2], [4, 9]))).imag);
+        assert.isTrue(mkArray(sqrt(-1)).imag![0] === 1);
+    }
+    @test "should evaluate functions of complex arguments"() {
+        const Z = rand_array_complex([50, 40]);
+        for (let i = 0; i < Z.length; i++) {
+            Z.real[i] -= 4.5;
+            Z.imag![i] -= 4.5;
+        }
+        const tol = 1e-14;
+        assert.isBelow(max_rel_diff(exp(Z), apply_complex(Z, (a, b) =>
+            [Math.exp(a) * Math.cos(b), Math.exp(a) * Math.sin(b)])), tol);
+        assert.isBelow(max_rel_diff(log(Z), apply_complex(Z, (a, b) =>
+            [Math.log(Math.hypot(a, b)), Math.atan2(b, a)])), tol);
+        assert.isBelow(max_rel_diff(sin(Z), apply_complex(Z, (a, b) =>
+            [Math.sin(a) * Math.cosh(b), Math.cos(a) * Math.sinh(b)])), tol);
+        assert.isBelow(max_rel_diff(cos(Z), apply_complex(Z, (a, b) =>
+            [Math.cos(a) * Math.cosh(b), -Math.sin(a) * Math.sinh(b)])), tol);
+        const S = mkArray(sqrt(Z));
+        for (let i = 0; i < Z.length; i++) {
+            const re = S.real[i], im = S.imag![i];
+            assert.isAtLeast(re, 0);
+            assert.closeTo(re * re - im * im, Z.real[i], 1e-12);
+            assert.closeTo(2 * re * im, Z.imag![i], 1e-12);
+        }
+        const A = mkArray(abs(Z));
+        assert.isUndefined(A.imag);
+        assert.closeTo(A.real[7], Math.hypot(Z.real[7], Z.imag![7]), 1e-15);
+    }
+    @test "should split large arrays across threads"() {
+        const X = rand_array([300000, 1]);
+        assert.isBelow(max_rel_diff(sin(X), apply(X, Math.sin)), 1e-15);
+    }
+    @test "should keep single precision arguments single"() {
+        const X = new FMArray([2, 1], new Float32Array([1, 4]), undefined, ArrayType.Single);
+        assert.equal(mkArray(sqrt(X)).mytype, ArrayType.Single);
+    }
+    @test "should compute atan2 in every quadrant"() {
+        const Y = rand_array([20, 20]);
+        const X = rand_array([20, 20]);
+        for (let i = 0; i < X.length; i++) {
+            Y.real[i] -= 4.5;
+            X.real[i] -= 4.5;
+        }
+        const T = mkArray(atan2(Y, X));
+        for (let i = 0; i < X.length; i++)
+            assert.closeTo(T.real[i], Math.atan2(Y.real[i], X.real[i]), 2e-15);
+        const S = mkArray(atan2(1, new FMArray([1, 4], [1, -1, 0, -0])));
+        assert.deepEqual(Array.from(S.real), [1, -1, 0, -0].map(x => Math.atan2(1, x)));
+        assert.throws(() => atan2(rand_array_complex([2, 2]), 1), /real/);
+    }
+}
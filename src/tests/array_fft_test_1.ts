@@ -0,0 +1,118 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType } from "../arrays";
+import { fft, ifft, fft_cache } from "../signal";
+import { kernel_threads } from "../math";
+import { rand_array, rand_array_complex, max_diff } from "./test_utils";
+
+// Direct evaluation of the transform of a column vector
+function dft(A: FMArray): FMArray {
+    const n = A.length;
+    let X = new FMArray([n, 1], undefined, new Float64Array(n));
+    for (let k = 0; k < n; k++)
+        for (let j = 0; j < n; j++) {
+            const t = -2 * Math.PI * ((j * k) % n) / n;
+            const xr = A.real[j];
+            const xi = A.imag ? A.imag[j] : 0;
+            X.real[k] += xr * Math.cos(t) - xi * Math.sin(t);
+            X.imag![k] += xr * Math.sin(t) + xi * Math.cos(t);
+        }
+    return X;
+}
+
+// Lengths with small factors, with large prime factors (Bluestein) and
+// powers of two
+const lengths = [1, 2, 3, 7, 12, 30, 64, 97, 100, 127, 210, 256, 1031];
+
+@suite
+export class FFTTests {
+    @test "should match the direct transform for real and complex vectors"() {
+        for (let n of lengths)
+            for (let A of [rand_array([n, 1]), rand_array_complex([n, 1])])
+                assert.isBelow(max_diff(fft(A), dft(A)), 1e-8 * n);
+    }
+    @test "should invert the transform"() {
+        for (let n of lengths)
+            for (let A of [rand_array([n, 3]), rand_array_complex([n, 3])])
+                assert.isBelow(max_diff(ifft(fft(A)), A), 1e-10);
+    }
+    @test "should return a real inverse for conjugate symmetric input"() {
+        for (let n of [7, 8, 97]) {
+            const A = rand_array([n, 2]);
+            const B = ifft(fft(A));
+            assert.isUndefined(B.imag);
+            assert.isBelow(max_diff(B, A), 1e-10);
+        }
+    }
+    @test "should transform along the first non-singleton dimension"() {
+        const A = rand_array([1, 12]);
+        const X = fft(A);
+        assert.deepEqual(X.dims, [1, 12]);
+        assert.isBelow(max_diff(new FMArray([12, 1], X.real, X.imag), dft(new FMArray([12, 1], A.real))), 1e-9);
+    }
+    @test "should transform along any dimension of an N-D array"() {
+        const A = rand_array_complex([3, 4, 5]);
+        const X = fft(A, undefined, 3);
+        assert.deepEqual(X.dims, [3, 4, 5]);
+        for (let i = 0; i < 3; i++)
+            for (let j = 0; j < 4; j++) {
+                let v = new FMArray([5, 1], new Float64Array(5), new Float64Array(5));
+                for (let k = 0; k < 5; k++) {
+                    v.real[k] = A.real[i + 3 * j + 12 * k];
+                    v.imag![k] = A.imag![i + 3 * j + 12 * k];
+                }
+                const V = dft(v);
+                for (let k = 0; k < 5; k++) {
+                    assert.closeTo(X.real[i + 3 * j + 12 * k], V.real[k], 1e-9);
+                    assert.closeTo(X.imag![i + 3 * j + 12 * k], V.imag![k], 1e-9);
+                }
+            }
+        assert.deepEqual(fft(A, 2, 4).dims, [3, 4, 5, 2]);
+    }
+    @test "should pad and truncate to the requested length"() {
+        const A = rand_array([6, 2]);
+        let P = new FMArray([10, 2]);
+        for (let j = 0; j < 2; j++)
+            for (let i = 0; i < 6; i++)
+                P.real[i + 10 * j] = A.real[i + 6 * j];
+        assert.isBelow(max_diff(fft(A, 10), fft(P)), 1e-10);
+        let T = new FMArray([4, 2]);
+        for (let j = 0; j < 2; j++)
+            for (let i = 0; i < 4; i++)
+                T.real[i + 4 * j] = A.real[i + 6 * j];
+        assert.isBelow(max_diff(fft(A, 4), fft(T)), 1e-10);
+        assert.deepEqual(fft(A, 0).dims, [0, 2]);
+    }
+    @test "should give the same results when the columns are split across threads"() {
+        const A = rand_array_complex([256, 300]);
+        const previous = kernel_threads(1);
+        const X = fft(A);
+        kernel_threads(4);
+        const Y = fft(A);
+        kernel_threads(previous);
+        assert.equal(max_diff(X, Y), 0);
+    }
+    @test "should keep single precision"() {
+        const A = new FMArray([4, 1], new Float32Array([1, 2, 3, 4]), undefined, ArrayType.Single);
+        const X = fft(A);
+        assert.equal(X.mytype, ArrayType.Single);
+        // Short arrays are not stored in Float32Arrays, so compare loosely
+        [10, -2, -2, -2].forEach((v, i) => assert.closeTo(X.real[i], v, 1e-6));
+        [0, 2, 0, -2].forEach((v, i) => assert.closeTo(X.imag![i], v, 1e-6));
+    }
+    @test "should cache plans by length"() {
+        fft_cache(true);
+        fft(rand_array([64, 4]));
+        const info = fft_cache();
+        assert.isAbove(info.plans, 0);
+        fft(rand_array([64, 4]));
+        assert.equal(fft_cache().plans, info.plans);
+        assert.equal(fft_cache(true).plans, 0);
+    }
+    @test "should refuse bad lengths and dimensions"() {
+        const A = rand_array([4, 4]);
+        assert.throws(() => fft(A, -1), TypeError, /Length/);
+        assert.throws(() => fft(A, 2.5), TypeError, /Length/);
+        assert.throws(() => fft(A, undefined, 0), TypeError, /Dimension/);
+    }
+}
@@ -0,0 +1,65 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType, format_array, display_format } from "../arrays";
+
+function lines(text: string): string[] {
+    return text.split('\n');
+}
+
+@suite
+export class FormatTests {
+    @test "should show integers without decimals"() {
+        const A = new FMArray([2, 2], [1, 3, -20, 4]);
+        assert.equal(format_array(A), "     1   -20\n     3     4\n");
+        assert.equal(A.toString(), format_array(A));
+    }
+    @test "should use a common format for every element"() {
+        const A = new FMArray([1, 3], [1.5, 0, -2.25]);
+        assert.equal(format_array(A), "    1.5000         0   -2.2500\n");
+        const B = new FMArray([1, 3], [NaN, Infinity, -Infinity]);
+        assert.equal(format_array(B), "    NaN    Inf   -Inf\n");
+        const long = format_array(new FMArray([1, 1], [Math.PI]), { long: true });
+        assert.equal(long, "   3.141592653589793\n");
+        const single = new FMArray([1, 1], [0.5], undefined, ArrayType.Single);
+        assert.equal(format_array(single, { long: true }), "   0.5000000\n");
+    }
+    @test "should factor out a common scale"() {
+        const A = new FMArray([1, 2], [1234.5, 2]);
+        assert.deepEqual(lines(format_array(A)), ["   1.0e+03 *", "", "   1.2345   0.0020", ""]);
+        const B = new FMArray([1, 2], [0.00005, -0.00002]);
+        assert.deepEqual(lines(format_array(B)), ["   1.0e-05 *", "", "    5.0000   -2.0000", ""]);
+        // Rounding up can add a digit
+        assert.equal(format_array(new FMArray([1, 2], [999.99999, 1.5])), "   1000.0000      1.5000\n");
+        // Down to subnormals, whose scale has no normal power of ten
+        assert.deepEqual(lines(format_array(new FMArray([1, 1], [5e-324]))), ["   1.0e-324 *", "", "   4.9407", ""]);
+        assert.deepEqual(lines(format_array(new FMArray([1, 2], [2.5e-310, -1e-311]))),
+            ["   1.0e-310 *", "", "    2.5000   -0.1000", ""]);
+    }
+    @test "should show complex values"() {
+        const A = new FMArray([1, 3], [1, -2, 0.5], [0.25, -1, NaN]);
+        assert.equal(format_array(A), "    1.0000 + 0.2500i   -2.0000 - 1.0000i    0.5000 +    NaNi\n");
+        const B = new FMArray([1, 2], [1, 2], [-3, 4]);
+        assert.equal(format_array(B), "   1 - 3i   2 + 4i\n");
+    }
+    @test "should page columns and pages"() {
+        const A = new FMArray([2, 30], Array.from({ length: 60 }, (_, i) => i + 0.5));
+        const text = format_array(A, { page_width: 40 });
+        const widths = lines(text).map(l => l.length);
+        assert.isAtMost(Math.max(...widths), 40);
+        assert.include(text, "  Columns 1 through 4\n\n");
+        assert.include(text, "  Columns 29 through 30\n\n");
+        const B = new FMArray([1, 2, 2], [1, 2, 3, 4]);
+        assert.equal(format_array(B), "(:,:,1) =\n\n   1   2\n\n(:,:,2) =\n\n   3   4\n\n");
+        assert.equal(format_array(new FMArray([0, 3], [])), "  [](0x3)\n");
+    }
+    @test "should truncate large arrays"() {
+        const A = new FMArray([300, 200], new Float64Array(60000).map((_, i) => i));
+        const text = format_array(A, { max_rows: 2, max_cols: 3 });
+        assert.equal(text, "       0     300     600\n       1     301     601\n" +
+            "  ... (298 more rows)\n  ... (197 more columns)\n");
+        const previous = display_format({ max_rows: 1, max_cols: 1 });
+        assert.equal(A.toString(), "       0\n  ... (299 more rows)\n  ... (199 more columns)\n");
+        display_format(previous);
+        assert.isTrue(/Columns 1 through/.test(A.toString()));
+    }
+}
@@ -0,0 +1,82 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, FMValue, mkArray } from "../arrays";
+import { plus, minus, times, rdivide, ldivide } from "../math";
+import { fuse, FuseOp } from "../fuse";
+import { JSWriter } from "../jswalker";
+import { Parser } from "../parser";
+import Tokenize from "../scanner";
+import { rand_array, rand_array_complex } from "./test_utils";
+
+function same(A: FMValue, B: FMValue): void {
+    const X = mkArray(A);
+    const Y = mkArray(B);
+    assert.deepEqual(X.dims, Y.dims);
+    for (let i = 0; i < X.length; i++)
+        assert.isTrue(Object.is(X.real[i], Y.real[i]), "element " + i);
+    if (X.imag || Y.imag)
+        assert.deepEqual(Array.from(X.imag!), Array.from(Y.imag!));
+}
+
+function shifted(dims: number[]): FMArray {
+    const A = rand_array(dims);
+    for (let i = 0; i < A.length; i++)
+        A.real[i] -= 4.5;
+    return A;
+}
+
+const L = FuseOp.Leaf;
+
+@suite
+export class FuseTests {
+    @test "should match the unfused operations exactly"() {
+        const [a, x, b, c, d] = [1, 2, 3, 4, 5].map(() => shifted([300, 200]));
+        // y = a.*x + b - c./d
+        const y = fuse([L, L, FuseOp.Times, L, FuseOp.Plus, L, L, FuseOp.RDivide, FuseOp.Minus],
+            [a, x, b, c, d]);
+        same(y, minus(plus(times(a, x), b), rdivide(c, d)));
+        // z = -(a.\b) - 2.5.*c
+        const z = fuse([L, L, FuseOp.LDivide, FuseOp.Neg, L, L, FuseOp.Times, FuseOp.Minus],
+            [a, b, 2.5, c]);
+        same(z, minus(times(-1, ldivide(a, b)), times(2.5, c)));
+    }
+    @test "should treat scalars and logicals as scalars"() {
+        const a = shifted([50, 40]);
+        const s = new FMArray([1, 1], new Float64Array([3]));
+        same(fuse([L, L, FuseOp.Times, L, FuseOp.Plus], [a, s, true]), plus(times(a, 3), 1));
+        same(fuse([L, L, FuseOp.Plus, L, FuseOp.Times], [1, 2, a]), times(3, a));
+    }
+    @test "should fall back for complex data and small arrays"() {
+        const a = rand_array_complex([40, 40]);
+        const b = rand_array([40, 40]);
+        same(fuse([L, L, FuseOp.Times, L, FuseOp.Plus], [a, b, b]), plus(times(a, b), b));
+        const c = rand_array([3, 3]);
+        same(fuse([L, L, FuseOp.Times, L, FuseOp.Minus], [c, c, 1]), minus(times(c, c), 1));
+        assert.equal(fuse([L, L, FuseOp.Plus, L, FuseOp.Times], [1, 2, 4]), 12);
+    }
+    @test "should report mismatched sizes as the operators do"() {
+        const a = rand_array([100, 20]);
+        const b = rand_array([20, 100]);
+        assert.throws(() => fuse([L, L, FuseOp.Plus, L, FuseOp.Times], [a, b, 2]), /mismatch in dimensions/);
+    }
+    @test "should split large expressions across threads"() {
+        const [a, b, c] = [1, 2, 3].map(() => shifted([400000, 1]));
+        same(fuse([L, L, FuseOp.Times, L, FuseOp.RDivide], [a, b, c]), rdivide(times(a, b), c));
+    }
+    @test "should evaluate expressions nested deeper than the native stack"() {
+        // x1 + (x2 + (... + x70)) needs a stack 70 deep
+        const leaves = Array.from({ length: 70 }, () => shifted([100, 20]));
+        const program: FuseOp[] = leaves.map(() => L);
+        for (let k = 1; k < leaves.length; k++) program.push(FuseOp.Plus);
+        let expected: FMValue = leaves[leaves.length - 1];
+        for (let k = leaves.length - 2; k >= 0; k--) expected = plus(leaves[k], expected);
+        same(fuse(program, leaves), expected);
+    }
+    @test "should be generated for chains of elementwise operators"() {
+        const write = (cmd: string) => JSWriter(new Parser(Tokenize(cmd), cmd).block());
+        const fused = write('y = a.*x + b - c./d;\n');
+        assert.include(fused, '$ws.fuse([0,0,3,0,1,0,0,4,2],[$ws.a,$ws.x,$ws.b,$ws.c,$ws.d])');
+        assert.include(write('z = a + b;\n'), '$ws.plus($ws.a,$ws.b)');
+        assert.include(write('w = a * b + c;\n'), '$ws.plus($ws.mtimes($ws.a,$ws.b),$ws.c)');
+    }
+}
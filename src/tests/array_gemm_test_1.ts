@@ -0,0 +1,51 @@
+import { suite, test } from "mocha-typescript";
+
+import { FMArray, Copy, MakeComplex } from "../arrays";
+
+import { plus, times, mtimes, gemm } from "../math";
+
+import { assert } from "chai";
+
+import { mat_equal, test_mat, test_mat_complex } from "./test_utils";
+
+function clone(A: FMArray): FMArray {
+    let B = new FMArray(A.dims);
+    if (A.imag) B = MakeComplex(B);
+    Copy(A, B);
+    return B;
+}
+
+function gemm_test(alpha: number, A: FMArray, B: FMArray, beta: number, C: FMArray): void {
+    const F = plus(times(alpha, mtimes(A, B)), times(beta, clone(C)));
+    const G = gemm(alpha, A, B, beta, C);
+    assert.isTrue(mat_equal(F, G));
+    // The update should land in the storage of C
+    assert.isTrue(mat_equal(F, C));
+}
+
+const sizes = [2, 4, 8, 100];
+
+@suite
+export class GemmTests {
+    @test "should accumulate a real product into an existing matrix"() {
+        for (let dim of sizes) {
+            gemm_test(1, test_mat(dim, 2 * dim), test_mat(2 * dim, dim), 1, test_mat(dim, dim));
+        }
+    }
+    @test "should scale the accumulator and subtract the product"() {
+        for (let dim of sizes) {
+            gemm_test(-1, test_mat(dim, dim), test_mat(dim, dim), 2, test_mat(dim, dim));
+        }
+    }
+    @test "should accumulate a complex product into an existing matrix"() {
+        for (let dim of sizes) {
+            gemm_test(1, test_mat_complex(dim, 2 * dim), test_mat_complex(2 * dim, dim), 1,
+                test_mat_complex(dim, dim));
+        }
+    }
+    @test "should promote a real accumulator when the product is complex"() {
+        for (let dim of sizes) {
+            gemm_test(2, test_mat_complex(dim, dim), test_mat(dim, dim), -1, test_mat(dim, dim));
+        }
+    }
+}
@@ -0,0 +1,160 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType, Set, mkArray, FnMakeScalarComplex } from "../arrays";
+import { ncat } from "../ncat";
+import { plus, minus, times, rdivide, ldivide, gt, le, eq, ne, cast, transpose, neg, mtimes, abs,
+    exp, sqrt, atan2, lu, inv, mldivide } from "../math";
+import { fuse, FuseOp } from "../fuse";
+import { cumsum, cumprod, cummax, diff } from "../cumulative";
+import { sort } from "../sorting";
+import { permute } from "../permute";
+import { fft, conv, filter } from "../signal";
+import { sparse } from "../sparse";
+import { rand_array, values } from "./test_utils";
+
+// n values cycling through -300 to 300 in steps of 7.5
+function ramp(n: number): FMArray {
+    const A = new FMArray([n, 1]);
+    for (let i = 0; i < n; i++) A.real[i] = -300 + (i * 7.5) % 600;
+    return A;
+}
+
+function fill(n: number, v: number): FMArray {
+    const A = new FMArray([n, 1]);
+    for (let i = 0; i < n; i++) A.real[i] = v;
+    return A;
+}
+
+@suite
+export class IntegerTests {
+    @test "should round and saturate conversions"() {
+        const A = new FMArray([1, 7], [-1.5, 2.5, 300, NaN, -300, Infinity, 0.49]);
+        const B = cast(A, ArrayType.Int8);
+        assert.equal(B.mytype, ArrayType.Int8);
+        assert.isTrue(B.real instanceof Int8Array);
+        assert.deepEqual(values(B), [-2, 3, 127, 0, -128, 127, 0]);
+        assert.deepEqual(values(cast(A, ArrayType.UInt8)), [0, 3, 255, 0, 0, 255, 0]);
+        assert.deepEqual(values(cast(A, ArrayType.UInt32)), [0, 3, 300, 0, 0, 4294967295, 0]);
+        const D = cast(B, ArrayType.Double);
+        assert.isTrue(D.real instanceof Float64Array);
+        assert.deepEqual(values(D), values(B));
+        // Each class has the width of its typed array
+        const R = ramp(5000);
+        for (let [t, kind] of [[ArrayType.Int16, Int16Array], [ArrayType.UInt16, Uint16Array],
+                               [ArrayType.Int32, Int32Array]] as [ArrayType, any][]) {
+            const C = cast(R, t);
+            assert.isTrue(C.real instanceof kind);
+            assert.deepEqual(values(C), values(R).map((x: number) =>
+                (t === ArrayType.UInt16) ? Math.max(0, (x < 0) ? -Math.round(-x) : Math.round(x)) :
+                    ((x < 0) ? -Math.round(-x) : Math.round(x))));
+        }
+        // Transposes keep the class
+        const T = transpose(cast(rand_array([40, 30]), ArrayType.UInt8)) as FMArray;
+        assert.equal(T.mytype, ArrayType.UInt8);
+    }
+    @test "should saturate integer arithmetic"() {
+        for (let n of [4, 5000]) {
+            const a = cast(fill(n, 200), ArrayType.UInt8);
+            const C = plus(a, 100) as FMArray;
+            assert.equal(C.mytype, ArrayType.UInt8);
+            assert.isTrue(values(C).every((x: number) => x === 255));
+            assert.isTrue(values(minus(a, 300)).every((x: number) => x === 0));
+            assert.isTrue(values(minus(100, a)).every((x: number) => x === 0));
+            assert.isTrue(values(times(a, 0.5)).every((x: number) => x === 100));
+        }
+        // Quotients are rounded, and division by zero saturates
+        const p = cast(new FMArray([1, 5], [7, -7, 5, 0, -3]), ArrayType.Int32);
+        assert.deepEqual(values(rdivide(p, 2)), [4, -4, 3, 0, -2]);
+        assert.deepEqual(values(ldivide(2, p)), [4, -4, 3, 0, -2]);
+        assert.deepEqual(values(rdivide(p, 0)), [2147483647, -2147483648, 2147483647, 0, -2147483648]);
+        // Integers of the same class combine, with expansion
+        const col = cast(new FMArray([3, 1], [100, -100, 50]), ArrayType.Int8);
+        const row = cast(new FMArray([1, 2], [50, -50]), ArrayType.Int8);
+        const S = plus(col, row) as FMArray;
+        assert.deepEqual(S.dims, [3, 2]);
+        assert.deepEqual(values(S), [127, -50, 100, 50, -128, 0]);
+        // Logicals combine with integers, but other integer classes do not
+        const L = gt(new FMArray([3, 1], [1, 0, 1]), 0);
+        assert.deepEqual(values(plus(col, L)), [101, -100, 51]);
+        assert.throws(() => plus(col, cast(row, ArrayType.Int16)));
+    }
+    @test "should give byte logicals from comparisons"() {
+        for (let n of [10, 5000]) {
+            const A = ramp(n);
+            const M = gt(A, 0) as FMArray;
+            assert.equal(M.mytype, ArrayType.Logical);
+            assert.isTrue(M.real instanceof Uint8Array);
+            assert.deepEqual(values(M), values(A).map((x: number) => (x > 0) ? 1 : 0));
+            const I = cast(A, ArrayType.Int16);
+            assert.deepEqual(values(le(I, I)), values(A).map(() => 1));
+            assert.deepEqual(values(eq(I, A)), values(A).map((x: number) => (x === Math.round(x)) ? 1 : 0));
+            assert.deepEqual(values(ne(M, M)), values(A).map(() => 0));
+        }
+        // Complex comparisons give the same byte logicals
+        const Z = new FMArray([1, 2000], new Float64Array(2000), new Float64Array(2000));
+        const E = eq(Z, 0) as FMArray;
+        assert.equal(E.mytype, ArrayType.Logical);
+        assert.isTrue(E.real instanceof Uint8Array);
+        assert.isTrue(values(E).every((x: number) => x === 1));
+        assert.isTrue(mkArray(true).real instanceof Uint8Array);
+    }
+    @test "should convert to logical and saturate stores"() {
+        assert.deepEqual(values(cast(new FMArray([1, 3], [0, -2, 0.5]), ArrayType.Logical)), [0, 1, 1]);
+        assert.throws(() => cast(new FMArray([1, 2], [1, NaN]), ArrayType.Logical));
+        assert.throws(() => cast(FnMakeScalarComplex(1, 2), ArrayType.Int32), /Complex/);
+        const A = cast(new FMArray([1, 3], [1, 2, 3]), ArrayType.Int8);
+        Set(A, [2], 1000);
+        Set(A, [1, 3], -2.5);
+        assert.deepEqual(values(A), [1, 127, -3]);
+        assert.equal(A.toString(), "      1    127     -3\n");
+        // Growing the array stores through the class too
+        const G = Set(A, [5], 200.6);
+        assert.equal(G.mytype, ArrayType.Int8);
+        assert.deepEqual(values(G), [1, 127, -3, 0, 127]);
+        assert.throws(() => Set(A, [1], FnMakeScalarComplex(1, 2)), /Complex/);
+        // Concatenations take the integer class, converting the other parts
+        const C = ncat([A, new FMArray([1, 2], [200.6, -300.5])], 1);
+        assert.equal(C.mytype, ArrayType.Int8);
+        assert.deepEqual(values(C), [1, 127, -3, 127, -128]);
+        const L = ncat([gt(A, 0), new FMArray([1, 1], [2])], 1);
+        assert.equal(L.mytype, ArrayType.Double);
+        assert.deepEqual(values(L), [1, 1, 0, 2]);
+    }
+    @test "should keep the class or refuse in other operations"() {
+        const A = cast(new FMArray([1, 4], [-128, 5, 100, -100]), ArrayType.Int8);
+        // Negation saturates, fused or not
+        for (let N of [neg(A), fuse([FuseOp.Leaf, FuseOp.Neg], [A]),
+                       fuse([FuseOp.Leaf, FuseOp.Leaf, FuseOp.Plus, FuseOp.Neg], [A, A])] as FMArray[])
+            assert.equal(N.mytype, ArrayType.Int8);
+        assert.deepEqual(values(neg(A)), [127, -5, -100, 100]);
+        assert.deepEqual(values(fuse([FuseOp.Leaf, FuseOp.Neg], [A])), [127, -5, -100, 100]);
+        assert.deepEqual(values(fuse([FuseOp.Leaf, FuseOp.Leaf, FuseOp.Plus, FuseOp.Neg], [A, A])),
+            [127, -10, -127, 127]);
+        // Products with a scalar are elementwise; matrix products are refused
+        const P = mtimes(A, 2) as FMArray;
+        assert.equal(P.mytype, ArrayType.Int8);
+        assert.deepEqual(values(P), [-128, 10, 127, -128]);
+        assert.throws(() => mtimes(transpose(A), A), /integer/);
+        // abs, diff, cummax, sort and permute keep the class
+        const B = abs(A) as FMArray;
+        assert.equal(B.mytype, ArrayType.Int8);
+        assert.deepEqual(values(B), [127, 5, 100, 100]);
+        const D = diff(A);
+        assert.equal(D.mytype, ArrayType.Int8);
+        assert.deepEqual(values(D), [127, 95, -128]);
+        assert.deepEqual(values(diff(A, 2)), [-32, -128]);
+        assert.equal(cummax(A).mytype, ArrayType.Int8);
+        assert.deepEqual(values(cummax(A)), [-128, 5, 100, 100]);
+        assert.equal(sort(A).mytype, ArrayType.Int8);
+        assert.deepEqual(values(sort(A)), [-128, -100, 5, 100]);
+        assert.equal(permute(A, [2, 1]).mytype, ArrayType.Int8);
+        // The rest refuse integers
+        const M = cast(new FMArray([2, 2], [2, 1, 1, 3]), ArrayType.Int16);
+        const refused: (() => any)[] = [() => exp(A), () => sqrt(A), () => atan2(A, 1),
+            () => cumsum(A), () => cumprod(A), () => fft(A), () => conv(A, 1),
+            () => filter(1, 1, A), () => lu(M), () => inv(M, () => { }),
+            () => mldivide(M, M, () => { }), () => sparse(M)];
+        for (let f of refused)
+            assert.throws(f, /not supported for integer classes/);
+    }
+}
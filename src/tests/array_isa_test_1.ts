@@ -0,0 +1,42 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType } from "../arrays";
+import { hermitian, transpose, isa_level, cast, rdivide, gt } from "../math";
+import { mat_equal, rand_array, rand_array_complex } from "./test_utils";
+
+const levels = ["generic", "sse2", "avx2", "avx512"];
+
+function same_on_all_levels(A: FMArray, op: (x: FMArray) => FMArray): void {
+    const initial = isa_level();
+    isa_level("generic");
+    const ref = op(A);
+    for (let level of levels) {
+        isa_level(level);
+        assert.isTrue(mat_equal(ref, op(A)));
+    }
+    isa_level(initial);
+}
+
+@suite
+export class ISADispatchTests {
+    @test "should clamp the requested level to the detected level"() {
+        const initial = isa_level();
+        assert.include(levels, isa_level("avx512"));
+        assert.equal(isa_level("generic"), "generic");
+        isa_level(initial);
+    }
+    @test "should reject unknown levels"() {
+        assert.throws(() => isa_level("mmx"));
+    }
+    @test "should give identical real transposes on all levels"() {
+        same_on_all_levels(rand_array([257, 131]), (x) => transpose(x) as FMArray);
+    }
+    @test "should give identical complex hermitians on all levels"() {
+        same_on_all_levels(rand_array_complex([131, 257]), (x) => hermitian(x) as FMArray);
+    }
+    @test "should give identical integer quotients and comparisons on all levels"() {
+        const A = cast(rand_array([3000, 1]), ArrayType.Int16);
+        same_on_all_levels(A, (x) => rdivide(x, 7.3) as FMArray);
+        same_on_all_levels(A, (x) => gt(x, 4) as FMArray);
+    }
+}
@@ -0,0 +1,101 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray } from "../arrays";
+import { SparseArray, sparse } from "../sparse";
+import { pcg, gmres, bicgstab } from "../krylov";
+import { mtimes, mldivide, transpose } from "../math";
+import { rand_array, values, logger } from "./test_utils";
+
+// The 2-D Laplacian on a k x k grid, with a convection term c making it
+// unsymmetric
+function grid_operator(k: number, c: number): SparseArray {
+    const I: number[] = [], J: number[] = [], V: number[] = [];
+    const add = (i: number, j: number, v: number) => { I.push(i + 1); J.push(j + 1); V.push(v); };
+    for (let x = 0; x < k; x++)
+        for (let y = 0; y < k; y++) {
+            const p = x * k + y;
+            add(p, p, 4);
+            if (x > 0) add(p, p - k, -1 - c);
+            if (x < k - 1) add(p, p + k, -1 + c);
+            if (y > 0) add(p, p - 1, -1);
+            if (y < k - 1) add(p, p + 1, -1);
+        }
+    return sparse(new FMArray([I.length, 1], I), new FMArray([J.length, 1], J),
+        new FMArray([V.length, 1], V), k * k, k * k);
+}
+
+function relative_residual(A: SparseArray | FMArray, x: FMArray, b: FMArray): number {
+    const r = values(mtimes(A, x) as FMArray);
+    const bv = values(b);
+    let num = 0, den = 0;
+    r.forEach((ri, i) => { num += (ri - bv[i]) ** 2; den += bv[i] ** 2; });
+    return Math.sqrt(num / den);
+}
+
+@suite
+export class KrylovTests {
+    @test "should solve a symmetric positive definite system by pcg"() {
+        const A = grid_operator(30, 0);
+        const b = rand_array([900, 1]);
+        let previous = Infinity;
+        for (let precond of ['none', 'jacobi', 'ilu'] as ('none' | 'jacobi' | 'ilu')[]) {
+            const res = pcg(A, b, logger, { tol: 1e-8, maxit: 500, precond });
+            assert.equal(res.flag, 0);
+            assert.isAtMost(res.relres, 1e-8);
+            assert.isBelow(relative_residual(A, res.x, b), 1e-8);
+            assert.equal(res.resvec.length, res.iter + 1);
+            if (precond === 'ilu') assert.isBelow(res.iter, previous);
+            previous = res.iter;
+        }
+    }
+    @test "should solve unsymmetric systems by gmres and bicgstab"() {
+        const A = grid_operator(25, 0.4);
+        const b = rand_array([625, 1]);
+        for (let precond of ['none', 'ilu'] as ('none' | 'ilu')[]) {
+            const g = gmres(A, b, logger, { tol: 1e-8, maxit: 1000, restart: 20, precond });
+            assert.equal(g.flag, 0);
+            assert.isBelow(relative_residual(A, g.x, b), 1e-8);
+            const s = bicgstab(A, b, logger, { tol: 1e-8, maxit: 1000, precond });
+            assert.equal(s.flag, 0);
+            assert.isBelow(relative_residual(A, s.x, b), 1e-8);
+        }
+    }
+    @test "should solve dense systems"() {
+        // R'*R plus a multiple of the identity is positive definite
+        const R = rand_array([60, 60]);
+        const D = values(mtimes(transpose(R), R) as FMArray);
+        for (let i = 0; i < 60; i++) D[i * 61] += 60;
+        const M = new FMArray([60, 60], D);
+        const b = rand_array([60, 1]);
+        const res = pcg(M, b, logger, { tol: 1e-10, maxit: 200, precond: 'jacobi' });
+        assert.equal(res.flag, 0);
+        const direct = values(mldivide(M, b, logger) as FMArray);
+        values(res.x).forEach((x, i) => assert.closeTo(x, direct[i], 1e-8));
+        assert.throws(() => pcg(M, b, logger, { precond: 'ilu' }), /sparse/);
+    }
+    @test "should report a failure to converge"() {
+        const A = grid_operator(20, 0);
+        const b = rand_array([400, 1]);
+        const messages: string[] = [];
+        const res = pcg(A, b, (msg: string) => messages.push(msg), { tol: 1e-12, maxit: 3 });
+        assert.equal(res.flag, 1);
+        assert.equal(res.iter, 3);
+        assert.equal(messages.length, 1);
+        assert.isTrue(/without converging/.test(messages[0]));
+        const traced: string[] = [];
+        const t = bicgstab(A, b, (msg: string) => traced.push(msg), { maxit: 200, verbose: true });
+        assert.equal(t.flag, 0);
+        assert.equal(traced.length, t.resvec.length);
+    }
+    @test "should start from an initial guess"() {
+        const A = grid_operator(10, 0.2);
+        const b = rand_array([100, 1]);
+        const exact = mldivide(A, b, logger) as FMArray;
+        const res = gmres(A, b, logger, { x0: exact, tol: 1e-8 });
+        assert.equal(res.iter, 0);
+        assert.equal(res.flag, 0);
+        const zero = bicgstab(A, new FMArray([100, 1], new Float64Array(100)), logger);
+        assert.equal(zero.flag, 0);
+        assert.deepEqual(values(zero.x), new Array(100).fill(0));
+    }
+}
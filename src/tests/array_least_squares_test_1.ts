@@ -0,0 +1,59 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, mkArray } from "../arrays";
+import { mldivide, mrdivide, LeastSquaresMode } from "../math";
+import { rand_array, rand_array_complex, max_diff } from "./test_utils";
+
+const modes: LeastSquaresMode[] = ['auto', 'qr', 'gelsy', 'svd'];
+
+const shapes = [[40, 6, 1], [40, 6, 3], [6, 40, 2], [300, 20, 4]];
+
+@suite
+export class LeastSquaresTests {
+    @test "should give the same solution in every mode for full rank real systems"() {
+        for (let [m, n, k] of shapes) {
+            const A = rand_array([m, n]);
+            const B = rand_array([m, k]);
+            const X = mldivide(A, B, console.log, 'gelsy');
+            for (let mode of modes)
+                assert.isBelow(max_diff(mldivide(A, B, console.log, mode), X), 1e-9);
+        }
+    }
+    @test "should give the same solution in every mode for full rank complex systems"() {
+        for (let [m, n, k] of shapes) {
+            const A = rand_array_complex([m, n]);
+            const B = rand_array_complex([m, k]);
+            const X = mldivide(A, B, console.log, 'gelsy');
+            for (let mode of modes)
+                assert.isBelow(max_diff(mldivide(A, B, console.log, mode), X), 1e-9);
+        }
+    }
+    @test "should pass the mode through mrdivide"() {
+        const A = rand_array([6, 30]);
+        const B = rand_array([2, 30]);
+        const X = mrdivide(B, A, console.log);
+        for (let mode of modes)
+            assert.isBelow(max_diff(mrdivide(B, A, console.log, mode), X), 1e-9);
+    }
+    @test "should find the minimum norm solution of a rank deficient system with svd"() {
+        let A = rand_array([30, 3]);
+        for (let i = 0; i < 30; i++)
+            A.real[i + 60] = A.real[i];
+        const B = rand_array([30, 1]);
+        let warnings: string[] = [];
+        const X = mkArray(mldivide(A, B, (msg: string) => warnings.push(msg), 'svd'));
+        assert.isAbove(warnings.length, 0);
+        assert.closeTo(X.real[0], X.real[2], 1e-9);
+    }
+    @test "should handle empty systems"() {
+        for (let mode of modes) {
+            const X = mldivide(new FMArray([0, 3]), new FMArray([0, 2]), console.log, mode) as FMArray;
+            assert.deepEqual(X.dims, [3, 2]);
+        }
+    }
+    @test "should refuse an unknown least squares mode"() {
+        const A = rand_array([10, 3]);
+        const B = rand_array([10, 1]);
+        assert.throws(() => mldivide(A, B, console.log, 'normal' as LeastSquaresMode), TypeError, /least squares/);
+    }
+}
@@ -0,0 +1,111 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType } from "../arrays";
+import { mtimes, transpose } from "../math";
+import { load_mapped, save_mapped } from "../io";
+import { mat_equal, test_mat, test_mat_complex } from "./test_utils";
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+function temp_file(name: string): string {
+    return path.join(os.tmpdir(), 'freemat_' + process.pid + '_' + name + '.fma');
+}
+
+function remove(...names: string[]): void {
+    for (let name of names)
+        if (fs.existsSync(name)) fs.unlinkSync(name);
+}
+
+@suite
+export class MappedIOTests {
+    @test "should round trip a real matrix"() {
+        const C = test_mat(50, 30);
+        const name = temp_file('real');
+        try {
+            save_mapped(name, C);
+            const D = load_mapped(name);
+            assert.deepEqual(D.dims, [50, 30]);
+            assert.isTrue(mat_equal(C, D));
+            assert.isTrue(mat_equal(mtimes(transpose(C), C), mtimes(transpose(D), D)));
+        } finally {
+            remove(name);
+        }
+    }
+    @test "should round trip a complex matrix"() {
+        const C = test_mat_complex(40, 40);
+        const name = temp_file('complex');
+        try {
+            save_mapped(name, C);
+            const D = load_mapped(name);
+            assert.isOk(D.imag);
+            assert.isTrue(mat_equal(C, D));
+        } finally {
+            remove(name);
+        }
+    }
+    @test "should keep the type and shape of N-D arrays"() {
+        const C = new FMArray([2, 3, 4], undefined, undefined, ArrayType.Single);
+        for (let i = 0; i < C.length; i++) C.real[i] = i;
+        const name = temp_file('single');
+        try {
+            save_mapped(name, C);
+            const D = load_mapped(name);
+            assert.deepEqual(D.dims, [2, 3, 4]);
+            assert.equal(D.mytype, ArrayType.Single);
+            assert.isTrue(D.real instanceof Float32Array);
+            assert.equal(D.real[23], 23);
+        } finally {
+            remove(name);
+        }
+    }
+    @test "should store integers and logicals at their own width"() {
+        const A = new FMArray([3, 4], undefined, undefined, ArrayType.Int16);
+        for (let i = 0; i < A.length; i++) A.real[i] = 1000 * i - 6000;
+        const L = new FMArray([2, 5], undefined, undefined, ArrayType.Logical);
+        L.real[3] = 1;
+        L.real[8] = 1;
+        const a = temp_file('int16');
+        const l = temp_file('logical');
+        try {
+            save_mapped(a, A);
+            save_mapped(l, L);
+            const B = load_mapped(a);
+            assert.equal(B.mytype, ArrayType.Int16);
+            assert.isTrue(B.real instanceof Int16Array);
+            assert.deepEqual(Array.from(B.real as Int16Array), Array.from(A.real as Int16Array));
+            const M = load_mapped(l);
+            assert.equal(M.mytype, ArrayType.Logical);
+            assert.isTrue(M.real instanceof Uint8Array);
+            assert.deepEqual(Array.from(M.real as Uint8Array), [0, 0, 0, 1, 0, 0, 0, 0, 1, 0]);
+            // One byte per element after the 64 byte aligned header
+            assert.equal(fs.statSync(l).size, 64 + 10);
+        } finally {
+            remove(a, l);
+        }
+    }
+    @test "should only write changes through when writable"() {
+        const name = temp_file('writable');
+        try {
+            save_mapped(name, test_mat(20, 20));
+            const P = load_mapped(name);
+            P.real[0] = 1234;
+            assert.notEqual(load_mapped(name).real[0], 1234);
+            const W = load_mapped(name, true);
+            W.real[0] = 1234;
+            assert.equal(load_mapped(name).real[0], 1234);
+        } finally {
+            remove(name);
+        }
+    }
+    @test "should reject files that are not arrays"() {
+        const name = temp_file('bogus');
+        try {
+            fs.writeFileSync(name, 'not an array');
+            assert.throws(() => load_mapped(name), /Not an array file/);
+        } finally {
+            remove(name);
+        }
+    }
+}
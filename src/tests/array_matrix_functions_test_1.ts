@@ -0,0 +1,99 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType, mkArray } from "../arrays";
+import { mtimes, inv, det, rcond, expm, sqrtm, logm } from "../math";
+import { rand_array, rand_array_complex, max_diff, logger } from "./test_utils";
+
+function eye(n: number): FMArray {
+    const I = new FMArray([n, n], new Float64Array(n * n));
+    for (let i = 0; i < n; i++) I.real[i * (n + 1)] = 1;
+    return I;
+}
+
+// A random matrix with entries of about scale/sqrt(n), centred on zero
+// (the random arrays hold the integers 0 to 9), so that its exponential
+// is of moderate size
+function scaled_rand(n: number, scale: number, complex?: boolean): FMArray {
+    const A = complex ? rand_array_complex([n, n]) : rand_array([n, n]);
+    const s = scale / (4.5 * Math.sqrt(n));
+    const re = A.real.map((x: number) => (x - 4.5) * s);
+    const im = A.imag ? A.imag.map((x: number) => (x - 4.5) * s) : undefined;
+    return new FMArray([n, n], re, im);
+}
+
+@suite
+export class MatrixFunctionTests {
+    @test "should invert matrices with their determinant and condition"() {
+        const A = new FMArray([3, 3], [4, 1, 2, 1, 5, 3, 2, 3, 6]);
+        assert.closeTo(det(A).real[0], 70, 1e-12);
+        assert.isBelow(max_diff(mtimes(A, inv(A, logger)), eye(3)), 1e-14);
+        assert.isAbove(rcond(A), 0.1);
+        for (let B of [scaled_rand(60, 1), scaled_rand(60, 1, true)]) {
+            assert.isBelow(max_diff(mtimes(B, inv(B, logger)), eye(60)), 1e-9);
+            assert.equal(!!det(B).imag, !!B.imag);
+        }
+        const C = new FMArray([2, 2], [1, 0, 2, 3], [1, 0, 0, -1]);
+        const d = det(C);
+        assert.closeTo(d.real[0], 4, 1e-14);
+        assert.closeTo((d.imag as Float64Array)[0], 2, 1e-14);
+        assert.throws(() => inv(rand_array([2, 3]), logger));
+    }
+    @test "should report singular matrices"() {
+        const messages: string[] = [];
+        const S = new FMArray([2, 2], [1, 2, 2, 4]);
+        const X = inv(S, (msg: string) => messages.push(msg));
+        assert.isTrue(X.real.every((x: number) => x === Infinity));
+        assert.equal(messages.length, 1);
+        assert.isTrue(/singular/.test(messages[0]));
+        assert.equal(rcond(S), 0);
+        assert.equal(det(S).real[0], 0);
+        assert.equal(det(new FMArray([0, 0], [])).real[0], 1);
+    }
+    @test "should compute the matrix exponential"() {
+        // exp([0 1; -1 0]) is a rotation
+        const E = expm(new FMArray([2, 2], [0, -1, 1, 0]));
+        assert.isBelow(max_diff(E, new FMArray([2, 2], [Math.cos(1), -Math.sin(1), Math.sin(1), Math.cos(1)])), 1e-14);
+        // Upper triangular, with a large norm so that it is scaled
+        const T = expm(new FMArray([2, 2], [1, 0, 10, 2]));
+        const e = Math.E;
+        assert.isBelow(max_diff(T, new FMArray([2, 2], [e, 0, 10 * (e * e - e), e * e])), 1e-12);
+        // exp(A)*exp(-A) = I for each degree of approximant
+        for (let scale of [0.01, 0.2, 0.8, 2, 20]) {
+            const A = scaled_rand(20, scale);
+            const minus = new FMArray(A.dims, A.real.map((x: number) => -x));
+            const P = mkArray(mtimes(expm(A), expm(minus)));
+            assert.isBelow(max_diff(P, eye(20)), 1e-10 * Math.max(1, Math.exp(2 * scale)));
+        }
+    }
+    @test "should take square roots and logarithms"() {
+        for (let A of [scaled_rand(40, 2), scaled_rand(40, 2, true)]) {
+            const E = expm(A);
+            const S = sqrtm(E, logger);
+            assert.isBelow(max_diff(mtimes(S, S), E), 1e-10);
+            const L = logm(E, logger);
+            assert.equal(!!L.imag, !!A.imag);
+            assert.isBelow(max_diff(L, A), 1e-10);
+        }
+        const D = sqrtm(new FMArray([2, 2], [4, 0, 0, 9]), logger);
+        assert.deepEqual(Array.from(D.real), [2, 0, 0, 3]);
+    }
+    @test "should give complex results for negative eigenvalues"() {
+        const A = new FMArray([2, 2], [-4, 0, 1, -9]);
+        const S = sqrtm(A, logger);
+        assert.isOk(S.imag);
+        assert.isBelow(max_diff(mtimes(S, S), A), 1e-12);
+        const L = logm(A, logger);
+        assert.isOk(L.imag);
+        assert.isBelow(max_diff(expm(L), A), 1e-12);
+        const messages: string[] = [];
+        sqrtm(new FMArray([2, 2], [0, 0, 1, 0]), (msg: string) => messages.push(msg));
+        logm(new FMArray([2, 2], [0, 0, 1, 0]), (msg: string) => messages.push(msg));
+        assert.equal(messages.length, 2);
+    }
+    @test "should keep single precision"() {
+        const A = new FMArray([2, 2], [1, 0.5, 0.25, 2], undefined, ArrayType.Single);
+        assert.equal(inv(A, logger).mytype, ArrayType.Single);
+        assert.equal(expm(A).mytype, ArrayType.Single);
+        assert.equal(sqrtm(A, logger).mytype, ArrayType.Single);
+    }
+}
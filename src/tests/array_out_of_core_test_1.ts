@@ -0,0 +1,100 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType } from "../arrays";
+import { mtimes, transpose, cast } from "../math";
+import { load_mapped, save_mapped, mtimes_mapped, transpose_mapped } from "../io";
+import { mat_equal, test_mat, test_mat_complex } from "./test_utils";
+
+const fs = require('fs');
+const os = require('os');
+const path = require('path');
+
+function temp_file(name: string): string {
+    return path.join(os.tmpdir(), 'freemat_ooc_' + process.pid + '_' + name + '.fma');
+}
+
+function remove(...names: string[]): void {
+    for (let name of names)
+        if (fs.existsSync(name)) fs.unlinkSync(name);
+}
+
+@suite
+export class OutOfCoreTests {
+    @test "should multiply matrices in tiles"() {
+        const C = test_mat(120, 70);
+        const D = test_mat(70, 90);
+        const [a, b, c] = [temp_file('a'), temp_file('b'), temp_file('c')];
+        try {
+            save_mapped(a, C);
+            save_mapped(b, D);
+            const plan = mtimes_mapped(a, b, c, 32768);
+            assert.isAtMost(plan.bytes, 32768);
+            assert.isBelow(plan.rows, 120);
+            assert.isTrue(mat_equal(mtimes(C, D), load_mapped(c)));
+        } finally {
+            remove(a, b, c);
+        }
+    }
+    @test "should multiply matrices that fit in one tile"() {
+        const C = test_mat(20, 30);
+        const D = test_mat(30, 10);
+        const [a, b, c] = [temp_file('a1'), temp_file('b1'), temp_file('c1')];
+        try {
+            save_mapped(a, C);
+            save_mapped(b, D);
+            mtimes_mapped(a, b, c);
+            assert.isTrue(mat_equal(mtimes(C, D), load_mapped(c)));
+        } finally {
+            remove(a, b, c);
+        }
+    }
+    @test "should reject mismatched dimensions"() {
+        const [a, c] = [temp_file('a2'), temp_file('c2')];
+        try {
+            save_mapped(a, test_mat(20, 30));
+            assert.throws(() => mtimes_mapped(a, a, c), /Mismatch/);
+        } finally {
+            remove(a, c);
+        }
+    }
+    @test "should transpose real matrices in tiles"() {
+        const C = test_mat(130, 75);
+        const [t, tt] = [temp_file('t'), temp_file('tt')];
+        try {
+            save_mapped(t, C);
+            const plan = transpose_mapped(t, tt, 16384);
+            assert.isAtMost(plan.bytes, 16384);
+            assert.isTrue(mat_equal(transpose(C), load_mapped(tt)));
+        } finally {
+            remove(t, tt);
+        }
+    }
+    @test "should transpose complex matrices in tiles"() {
+        const C = test_mat_complex(64, 48);
+        const [z, zt] = [temp_file('z'), temp_file('zt')];
+        try {
+            save_mapped(z, C);
+            transpose_mapped(z, zt, 8192);
+            assert.isTrue(mat_equal(transpose(C), load_mapped(zt)));
+        } finally {
+            remove(z, zt);
+        }
+    }
+    @test "should transpose integer and logical matrices, but not multiply them"() {
+        const [a, t, c] = [temp_file('i'), temp_file('it'), temp_file('ic')];
+        try {
+            for (let type of [ArrayType.Int8, ArrayType.UInt16, ArrayType.Int32, ArrayType.Logical]) {
+                const C = cast(test_mat(70, 45), type) as FMArray;
+                save_mapped(a, C);
+                transpose_mapped(a, t, 4096);
+                const T = load_mapped(t);
+                assert.equal(T.mytype, type);
+                assert.deepEqual(T.dims, [45, 70]);
+                assert.deepEqual(Array.from(T.real), Array.from((transpose(C) as FMArray).real));
+            }
+            assert.throws(() => mtimes_mapped(a, t, c), /double and single/);
+        } finally {
+            remove(a, t, c);
+        }
+    }
+}
@@ -0,0 +1,96 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType } from "../arrays";
+import { permute, ipermute, circshift, reshape, squeeze } from "../permute";
+import { mat_equal, rand_array, rand_array_complex, values } from "./test_utils";
+
+// Element by element permutation with shifts, for checking
+function naive_permute(A: FMArray, order: number[], shift: number[]): FMArray {
+    const dims = order.map(d => (d <= A.dims.length) ? A.dims[d - 1] : 1);
+    const B = new FMArray(dims.slice());
+    if (A.imag) B.imag = new Float64Array(B.length);
+    const stride = [1];
+    for (let k = 1; k < order.length; k++)
+        stride.push(stride[k - 1] * ((k <= A.dims.length) ? A.dims[k - 1] : 1));
+    const coord = dims.map(() => 0);
+    for (let i = 0; i < B.length; i++) {
+        let src = 0;
+        for (let k = 0; k < dims.length; k++) {
+            const n = dims[k];
+            const c = ((coord[k] - (shift[k] || 0)) % n + n) % n;
+            src += c * stride[order[k] - 1];
+        }
+        B.real[i] = A.real[src];
+        if (A.imag && B.imag) B.imag[i] = A.imag[src];
+        for (let k = 0; k < dims.length; k++) {
+            if (++coord[k] < dims[k]) break;
+            coord[k] = 0;
+        }
+    }
+    return B;
+}
+
+@suite
+export class PermuteTests {
+    @test "should match an element by element permutation"() {
+        const A = rand_array([6, 5, 4, 3]);
+        for (let order of [[1, 2, 3, 4], [2, 1, 3, 4], [3, 1, 4, 2], [4, 3, 2, 1], [1, 2, 4, 3]]) {
+            const B = permute(A, order);
+            assert.deepEqual(B.dims, order.map(d => A.dims[d - 1]));
+            assert.isTrue(mat_equal(B, naive_permute(A, order, [])));
+        }
+    }
+    @test "should tile large permutations across threads"() {
+        const A = rand_array([300, 7, 211]);
+        for (let order of [[3, 2, 1], [2, 3, 1], [3, 1, 2]])
+            assert.isTrue(mat_equal(permute(A, order), naive_permute(A, order, [])));
+    }
+    @test "should permute complex and single arrays"() {
+        const A = rand_array_complex([4, 9, 5]);
+        const B = permute(A, [3, 1, 2]);
+        assert.isOk(B.imag);
+        assert.isTrue(mat_equal(B, naive_permute(A, [3, 1, 2], [])));
+        const C = new FMArray([2, 3], [1, 2, 3, 4, 5, 6], undefined, ArrayType.Single);
+        const D = permute(C, [2, 1]);
+        assert.equal(D.mytype, ArrayType.Single);
+        assert.deepEqual(values(D), [1, 3, 5, 2, 4, 6]);
+    }
+    @test "should add and drop singleton dimensions"() {
+        const A = rand_array([5, 4]);
+        const B = permute(A, [3, 1, 2]);
+        assert.deepEqual(B.dims, [1, 5, 4]);
+        assert.deepEqual(permute(B, [2, 3, 1]).dims, [5, 4]);
+        assert.isTrue(mat_equal(ipermute(B, [3, 1, 2]), A));
+        assert.deepEqual(squeeze(B).dims, [5, 4]);
+        assert.deepEqual(squeeze(rand_array([1, 1, 6])).dims, [6, 1]);
+    }
+    @test "should undo a permutation with ipermute"() {
+        const A = rand_array_complex([3, 4, 5, 2]);
+        const order = [2, 4, 1, 3];
+        assert.isTrue(mat_equal(ipermute(permute(A, order), order), A));
+    }
+    @test "should shift circularly"() {
+        const A = new FMArray([1, 5], [1, 2, 3, 4, 5]);
+        assert.deepEqual(values(circshift(A, 2)), [4, 5, 1, 2, 3]);
+        assert.deepEqual(values(circshift(A, -1)), [2, 3, 4, 5, 1]);
+        assert.deepEqual(values(circshift(A, 12)), [4, 5, 1, 2, 3]);
+        assert.deepEqual(values(circshift(A, 1, 1)), [1, 2, 3, 4, 5]);
+        const B = rand_array_complex([40, 30, 20]);
+        for (let shift of [[1, 0, 0], [0, -3, 0], [5, 7, -2], [0, 0, 19]])
+            assert.isTrue(mat_equal(circshift(B, shift), naive_permute(B, [1, 2, 3], shift)));
+        assert.isTrue(mat_equal(circshift(B, 4, 3), naive_permute(B, [1, 2, 3], [0, 0, 4])));
+    }
+    @test "should reshape without changing the order of the elements"() {
+        const A = rand_array([6, 4]);
+        const B = reshape(A, 3, 2, 4);
+        assert.deepEqual(B.dims, [3, 2, 4]);
+        assert.deepEqual(values(B), values(A));
+        assert.throws(() => reshape(A, 5, 5));
+    }
+    @test "should reject orders that are not permutations"() {
+        const A = rand_array([2, 3, 4]);
+        assert.throws(() => permute(A, [1, 2]));
+        assert.throws(() => permute(A, [1, 1, 2]));
+        assert.throws(() => permute(A, [0, 1, 2]));
+    }
+}
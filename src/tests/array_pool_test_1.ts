@@ -0,0 +1,36 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray } from "../arrays";
+import { mtimes, pool_stats, pool_trim, pool_limit } from "../math";
+import { mat_equal, test_mat, test_mat_complex } from "./test_utils";
+
+@suite
+export class BufferPoolTests {
+    @test "should give the same results from pooled buffers"() {
+        const C = test_mat(100, 100);
+        const G = mtimes(C, C);
+        for (let i = 0; i < 20; i++)
+            assert.isTrue(mat_equal(G, mtimes(C, C)));
+    }
+    @test "should pool complex results"() {
+        const C = test_mat_complex(100, 100);
+        const G = mtimes(C, C) as FMArray;
+        assert.isTrue(mat_equal(G, mtimes(C, C)));
+        assert.isAtLeast(pool_stats().live, 2 * 100 * 100 * 8);
+    }
+    @test "should report external memory for live results"() {
+        const C = test_mat(100, 100);
+        const G = mtimes(C, C);
+        assert.isAtLeast(pool_stats().external, 100 * 100 * 8);
+        assert.isTrue(G instanceof FMArray);
+    }
+    @test "should release cached buffers on trim"() {
+        const limit = pool_stats().limit;
+        pool_limit(0);
+        assert.equal(pool_stats().cached, 0);
+        pool_limit(limit);
+        pool_trim();
+        assert.equal(pool_stats().cached, 0);
+        assert.equal(pool_stats().limit, limit);
+    }
+}
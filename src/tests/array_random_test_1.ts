@@ -0,0 +1,96 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { kernel_threads } from "../math";
+import { rand, randn, randi, rng } from "../random";
+
+function moments(x: ArrayLike<number>): number[] {
+    let s = 0, s2 = 0;
+    for (let i = 0; i < x.length; i++) {
+        s += x[i];
+        s2 += x[i] * x[i];
+    }
+    const mean = s / x.length;
+    return [mean, s2 / x.length - mean * mean];
+}
+
+@suite
+export class RandomTests {
+    @test "should take MATLAB style dimensions"() {
+        assert.deepEqual(rand().dims, [1, 1]);
+        assert.deepEqual(rand(3).dims, [3, 3]);
+        assert.deepEqual(randn(2, 4, 5).dims, [2, 4, 5]);
+        assert.deepEqual(randi(6, [3, 2]).dims, [3, 2]);
+        assert.throws(() => rand(2.5), /non-negative integers/);
+    }
+    @test "should repeat a stream from its seed or state"() {
+        rng(17);
+        const A = rand(5, 7);
+        const saved = rng();
+        const B = randn(6, 1);
+        rng(17);
+        assert.deepEqual(Array.from(rand(5, 7).real), Array.from(A.real));
+        rng(saved);
+        assert.deepEqual(Array.from(randn(6, 1).real), Array.from(B.real));
+        rng(18);
+        assert.notDeepEqual(Array.from(rand(5, 7).real), Array.from(A.real));
+    }
+    @test "should continue a stream across calls"() {
+        rng(5);
+        const whole = rand(1, 4000).real;
+        rng(5);
+        const first = rand(1, 1000).real;
+        const rest = rand(1, 3000).real;
+        for (let i = 0; i < 1000; i++)
+            assert.equal(first[i], whole[i]);
+        for (let i = 0; i < 3000; i++)
+            assert.equal(rest[i], whole[1000 + i]);
+    }
+    @test "should not depend on the number of threads"() {
+        const previous = kernel_threads(1);
+        rng(3);
+        const A = randn(400000, 1);
+        kernel_threads(4);
+        rng(3);
+        const B = randn(400000, 1);
+        kernel_threads(previous);
+        assert.deepEqual(Array.from(A.real), Array.from(B.real));
+    }
+    @test "should give the same normals on every instruction set"() {
+        // FREEMAT_ISA is read when the addon loads, so each level needs its
+        // own process
+        const child_process = require('child_process');
+        const path = require('path');
+        const script = 'const r = require(' + JSON.stringify(path.join(__dirname, '..', 'random')) + ');' +
+            'r.rng(29); process.stdout.write(JSON.stringify(Array.from(r.randn(1, 5000).real)));';
+        const streams = ["generic", "sse2", "avx2", "avx512"].map(level =>
+            child_process.execFileSync(process.execPath, ['-e', script],
+                { env: Object.assign({}, process.env, { FREEMAT_ISA: level }) }).toString());
+        for (let stream of streams)
+            assert.equal(stream, streams[0]);
+        rng(29);
+        assert.deepEqual(JSON.parse(streams[0]), Array.from(randn(1, 5000).real));
+    }
+    @test "should have the right distributions"() {
+        rng(11);
+        const U = rand(200000, 1).real;
+        const [um, uv] = moments(U);
+        assert.closeTo(um, 0.5, 0.005);
+        assert.closeTo(uv, 1 / 12, 0.002);
+        assert.isTrue(U.every(x => (x > 0) && (x < 1)));
+        const [nm, nv] = moments(randn(200000, 1).real);
+        assert.closeTo(nm, 0, 0.01);
+        assert.closeTo(nv, 1, 0.02);
+        const I = randi([-2, 3], 60000, 1).real;
+        let counts = [0, 0, 0, 0, 0, 0];
+        for (let x of I) {
+            assert.isTrue(Number.isInteger(x) && (x >= -2) && (x <= 3));
+            counts[x + 2]++;
+        }
+        for (let c of counts)
+            assert.closeTo(c, 10000, 500);
+    }
+    @test "should reject bad seeds and ranges"() {
+        assert.throws(() => rng(-1), /non-negative/);
+        assert.throws(() => randi([3, 1]), /lo <= hi/);
+    }
+}
@@ -2,7 +2,7 @@ import { suite, test } from "mocha-typescript";
 
 import { assert } from "chai";
 
-import { Resize, realScalar, Get, FMArray, Set } from "../arrays";
+import { Resize, realScalar, Get, FMArray, Set, ArrayType } from "../arrays";
 
 import { rand_array, test_mat, test_mat_complex, mks } from "./test_utils";
 
@@ -132,4 +132,16 @@ export class ResizeTests {
             assert.equal(realScalar(Get(P, [mks(ndx)])), ndx);
         }
     }
+    @test "should keep the class of both parts of a complex single matrix"() {
+        const re = new Float32Array(100).map((_, k) => k);
+        const im = new Float32Array(100).map((_, k) => -k);
+        const P = new FMArray([10, 10], re, im, ArrayType.Single);
+        const Q = Resize(P, [20, 10]);
+        assert.equal(Q.mytype, ArrayType.Single);
+        assert.isTrue(Q.real instanceof Float32Array);
+        assert.isTrue(Q.imag instanceof Float32Array);
+        for (let row = 1; row <= 10; row++)
+            for (let col = 1; col <= 10; col++)
+                assert.deepEqual(Get(P, [row, col]), Get(Q, [row, col]));
+    }
 }
@@ -0,0 +1,44 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, MakeComplex } from "../arrays";
+import { mtimes, transpose, shared_results } from "../math";
+import { mat_equal, test_mat, test_mat_complex } from "./test_utils";
+
+declare var SharedArrayBuffer: any;
+
+function to_shared(A: FMArray): FMArray {
+    const real = new Float64Array(new SharedArrayBuffer(A.length * 8));
+    real.set(A.real as ArrayLike<number>);
+    if (!A.imag) return new FMArray(A.dims, real);
+    const imag = new Float64Array(new SharedArrayBuffer(A.length * 8));
+    imag.set(A.imag as ArrayLike<number>);
+    return new FMArray(A.dims, real, imag);
+}
+
+function is_shared(A: FMArray): boolean {
+    return (A.real instanceof Float64Array) && (A.real.buffer instanceof SharedArrayBuffer);
+}
+
+@suite
+export class SharedArrayTests {
+    @test "should read shared real inputs in place"() {
+        const C = test_mat(20, 10);
+        const D = test_mat(10, 30);
+        assert.isTrue(mat_equal(mtimes(C, D), mtimes(to_shared(C), to_shared(D))));
+        assert.isTrue(mat_equal(transpose(C), transpose(to_shared(C))));
+    }
+    @test "should read shared complex inputs in place"() {
+        const C = test_mat_complex(20, 10);
+        const D = MakeComplex(test_mat(10, 30));
+        assert.isTrue(mat_equal(mtimes(C, D), mtimes(to_shared(C), to_shared(D))));
+    }
+    @test "should allocate results in shared memory when asked"() {
+        const C = test_mat(20, 20);
+        const previous = shared_results(true);
+        const G = mtimes(C, C) as FMArray;
+        shared_results(previous);
+        assert.isTrue(is_shared(G));
+        assert.isTrue(mat_equal(G, mtimes(C, C)));
+        assert.isFalse(is_shared(mtimes(C, C) as FMArray));
+    }
+}
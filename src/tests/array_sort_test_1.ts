@@ -0,0 +1,116 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray, ArrayType, mkArray } from "../arrays";
+import { sort, sort_index, unique, find } from "../sorting";
+import { abs } from "../math";
+import { rand_array, rand_array_complex, values } from "./test_utils";
+
+function is_sorted(x: ArrayLike<number>): boolean {
+    for (let i = 1; i < x.length; i++)
+        if (x[i - 1] > x[i]) return false;
+    return true;
+}
+
+@suite
+export class SortTests {
+    @test "should sort a vector and keep its orientation"() {
+        const B = sort(new FMArray([1, 6], [3, -1, 0, 7, -0, 2]));
+        assert.deepEqual(B.dims, [1, 6]);
+        assert.deepEqual(values(B), [-1, 0, -0, 2, 3, 7]);
+        assert.deepEqual(values(sort(new FMArray([4, 1], [2, 1, 4, 3]), 1, 'descend')),
+            [4, 3, 2, 1]);
+    }
+    @test "should put NaNs last, or first when descending"() {
+        const A = new FMArray([1, 5], [2, NaN, -Infinity, NaN, 1]);
+        const up = values(sort(A));
+        assert.deepEqual(up.slice(0, 3), [-Infinity, 1, 2]);
+        assert.isTrue(isNaN(up[3]) && isNaN(up[4]));
+        const down = values(sort(A, 2, 'descend'));
+        assert.isTrue(isNaN(down[0]) && isNaN(down[1]));
+        assert.deepEqual(down.slice(2), [2, 1, -Infinity]);
+    }
+    @test "should give stable indices"() {
+        const [B, I] = sort_index(new FMArray([1, 7], [2, 1, 2, 1, 3, 2, 1]));
+        assert.deepEqual(values(B), [1, 1, 1, 2, 2, 2, 3]);
+        assert.deepEqual(values(I), [2, 4, 7, 1, 3, 6, 5]);
+        const [D, J] = sort_index(new FMArray([1, 4], [1, 2, 1, 2]), 2, 'descend');
+        assert.deepEqual(values(D), [2, 2, 1, 1]);
+        assert.deepEqual(values(J), [2, 4, 1, 3]);
+    }
+    @test "should sort along any dimension"() {
+        const A = rand_array([5, 6, 3]);
+        for (let dim = 1; dim <= 3; dim++) {
+            const [B, I] = sort_index(A, dim);
+            assert.deepEqual(B.dims, A.dims);
+            const stride = A.dims.slice(0, dim - 1).reduce((a, b) => a * b, 1);
+            const n = A.dims[dim - 1];
+            for (let k = 0; k < A.length; k++) {
+                if (Math.floor(k / stride) % n !== 0) continue;
+                let col: number[] = [];
+                for (let j = 0; j < n; j++) {
+                    const src = k + (I.real[k + j * stride] - 1) * stride;
+                    assert.equal(B.real[k + j * stride], A.real[src]);
+                    col.push(B.real[k + j * stride]);
+                }
+                assert.isTrue(is_sorted(col));
+            }
+        }
+    }
+    @test "should sort complex values by magnitude and then angle"() {
+        const A = new FMArray([1, 5], [3, -1, 0, 1, 1], [4, 0, 1, -1, 0]);
+        const B = sort(A);
+        assert.deepEqual(values(B), [1, 0, -1, 1, 3]);
+        assert.deepEqual(Array.from(B.imag!), [0, 1, 0, -1, 4]);
+        // The order agrees with abs
+        const Z = sort(rand_array_complex([200, 1]));
+        assert.isTrue(is_sorted(mkArray(abs(Z)).real));
+    }
+    @test "should keep single precision data single"() {
+        const X = new FMArray([3, 1], new Float32Array([3, 1, 2]), undefined, ArrayType.Single);
+        const B = sort(X);
+        assert.equal(B.mytype, ArrayType.Single);
+        assert.deepEqual(values(B), [1, 2, 3]);
+    }
+    @test "should sort a long vector in parallel"() {
+        const A = rand_array([1, 300000]);
+        for (let i = 0; i < A.length; i++)
+            A.real[i] += i * 1e-6;
+        const B = sort(A);
+        const ref = Float64Array.from(A.real).sort();
+        assert.deepEqual(Array.from(B.real), Array.from(ref));
+    }
+    @test "should find the unique values with their maps"() {
+        const A = new FMArray([1, 7], [3, 1, NaN, 3, 2, 1, NaN]);
+        const [C, ia, ic] = unique(A);
+        assert.deepEqual(C.dims, [1, 5]);
+        assert.deepEqual(values(C).slice(0, 3), [1, 2, 3]);
+        assert.isTrue(isNaN(C.real[3]) && isNaN(C.real[4]));
+        assert.deepEqual(values(ia), [2, 5, 1, 3, 7]);
+        assert.deepEqual(values(ic), [3, 1, 4, 3, 2, 1, 5]);
+        const M = rand_array([20, 30]);
+        const [D, ja, jc] = unique(M);
+        assert.equal(D.dims[1], 1);
+        for (let k = 0; k < M.length; k++)
+            assert.equal(D.real[jc.real[k] - 1], M.real[k]);
+        for (let k = 0; k < D.length; k++)
+            assert.equal(M.real[ja.real[k] - 1], D.real[k]);
+        // Complex values with the same rounded magnitude and angle are
+        // still told apart
+        const Z = new FMArray([1, 3], [4.6849237399254232e-09, 4.684923739925424e-09, 4.6849237399254232e-09],
+            [-0.075682752251381658, -0.075682752251381658, -0.075682752251381658]);
+        const [E, ka, kc] = unique(Z);
+        assert.equal(E.length, 2);
+        assert.deepEqual(values(kc), [1, 2, 1]);
+        assert.deepEqual(values(ka), [1, 2]);
+    }
+    @test "should find nonzero elements"() {
+        const A = new FMArray([1, 6], [0, 2, 0, -1, NaN, 0]);
+        const F = find(A);
+        assert.deepEqual(F.dims, [1, 3]);
+        assert.deepEqual(values(F), [2, 4, 5]);
+        assert.deepEqual(values(find(A, 2)), [2, 4]);
+        assert.deepEqual(values(find(new FMArray([3, 1], [0, 0, 0], [0, 1, 0]))), [2]);
+        assert.deepEqual(find(new FMArray([2, 2], [1, 0, 0, 1])).dims, [2, 1]);
+        assert.throws(() => find(A, -1), /non-negative/);
+    }
+}
@@ -0,0 +1,173 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray } from "../arrays";
+import { SparseArray, sparse, full, nnz, issparse, sptranspose } from "../sparse";
+import { mtimes, mldivide, kernel_threads } from "../math";
+import { rand_array, rand_array_complex, values, logger, random_triplets } from "./test_utils";
+
+// The matrix of the 2-D Laplacian on a k x k grid
+function laplacian(k: number): SparseArray {
+    const I: number[] = [], J: number[] = [], V: number[] = [];
+    const add = (i: number, j: number, v: number) => { I.push(i + 1); J.push(j + 1); V.push(v); };
+    for (let x = 0; x < k; x++)
+        for (let y = 0; y < k; y++) {
+            const p = x * k + y;
+            add(p, p, 4);
+            if (x > 0) add(p, p - k, -1);
+            if (x < k - 1) add(p, p + k, -1);
+            if (y > 0) add(p, p - 1, -1);
+            if (y < k - 1) add(p, p + 1, -1);
+        }
+    return sparse(new FMArray([I.length, 1], I), new FMArray([J.length, 1], J),
+        new FMArray([V.length, 1], V), k * k, k * k);
+}
+
+function residual(A: SparseArray, X: FMArray, B: FMArray): number {
+    const R = values(mtimes(A, X) as FMArray);
+    const b = values(B);
+    return Math.max(...R.map((r, i) => Math.abs(r - b[i])));
+}
+
+@suite
+export class SparseTests {
+    @test "should build from triplets, summing duplicates"() {
+        const S = sparse(new FMArray([1, 5], [1, 3, 1, 2, 3]), new FMArray([1, 5], [1, 2, 1, 4, 2]),
+            new FMArray([1, 5], [5, 2, 1, -1, -2]));
+        assert.deepEqual(S.dims, [3, 4]);
+        assert.equal(nnz(S), 2);
+        assert.deepEqual(values(full(S)), [6, 0, 0, 0, 0, 0, 0, 0, 0, 0, -1, 0]);
+        assert.deepEqual(sparse(2, 3).dims, [2, 3]);
+        assert.equal(nnz(sparse(2, 3)), 0);
+        assert.throws(() => sparse(new FMArray([1, 1], [0]), new FMArray([1, 1], [1]), 1));
+        assert.throws(() => sparse(new FMArray([1, 1], [4]), new FMArray([1, 1], [1]), 1, 3, 3));
+    }
+    @test "should convert to and from dense"() {
+        const A = rand_array([40, 30]);
+        for (let k = 0; k < A.length; k += 3) A.real[k] = 0;
+        const S = sparse(A);
+        assert.isTrue(issparse(S));
+        assert.equal(nnz(S), nnz(A));
+        assert.deepEqual(values(full(S)), values(A));
+        const T = sptranspose(S);
+        assert.deepEqual(T.dims, [30, 40]);
+        assert.equal(full(T).real[5 + 30 * 7], A.real[7 + 40 * 5]);
+    }
+    @test "should multiply by dense matrices"() {
+        const A = rand_array([50, 60]);
+        for (let k = 0; k < A.length; k += 2) A.real[k] = 0;
+        const S = sparse(A);
+        for (let cols of [1, 7]) {
+            const B = rand_array([60, cols]);
+            const expected = values(mtimes(A, B) as FMArray);
+            const C = values(mtimes(S, B) as FMArray);
+            C.forEach((c, i) => assert.closeTo(c, expected[i], 1e-12));
+        }
+        const D = rand_array([9, 50]);
+        const expected = values(mtimes(D, A) as FMArray);
+        values(mtimes(D, S) as FMArray).forEach((c, i) => assert.closeTo(c, expected[i], 1e-12));
+        const Z = rand_array_complex([60, 2]);
+        const P = mtimes(S, Z) as FMArray;
+        const Q = mtimes(A, Z) as FMArray;
+        values(P).forEach((c, i) => assert.closeTo(c, Q.real[i], 1e-12));
+        Array.from(P.imag!).forEach((c, i) => assert.closeTo(c, Q.imag![i], 1e-12));
+        assert.isTrue(issparse(mtimes(S, 2)));
+        assert.deepEqual(values(full(mtimes(2, S) as SparseArray)), values(A).map(x => 2 * x));
+    }
+    @test "should not store zeros when scaling"() {
+        const S = sparse(new FMArray([1, 3], [1, 2, 3]), new FMArray([1, 3], [1, 1, 2]),
+            new FMArray([1, 3], [1e-300, 2, Infinity]));
+        const T = mtimes(S, 1e-300) as SparseArray;
+        assert.equal(nnz(T), 2);
+        assert.deepEqual(values(full(T)), [0, 2e-300, 0, 0, 0, Infinity]);
+        const Z = mtimes(0, S) as SparseArray;
+        assert.equal(nnz(Z), 1);
+        assert.isTrue(isNaN(full(Z).real[5]));
+        const N = mtimes(S, NaN) as SparseArray;
+        assert.equal(nnz(N), 6);
+        assert.isTrue(values(full(N)).every(isNaN));
+        const bad = new SparseArray([-1, 2], new Int32Array(3), new Int32Array(0), new Float64Array(0));
+        assert.throws(() => full(bad), /non-negative integers/);
+        const fractional = new SparseArray([1.5, 2], new Int32Array(3), new Int32Array(0), new Float64Array(0));
+        assert.throws(() => sptranspose(fractional), /non-negative integers/);
+    }
+    @test "should split a sparse matrix-vector product across threads"() {
+        const previous = kernel_threads(4);
+        try {
+            const [I, J, V] = random_triplets(3000, 0.01, 7);
+            const S = sparse(new FMArray([I.length, 1], I), new FMArray([J.length, 1], J),
+                new FMArray([V.length, 1], V), 3000, 3000);
+            const x = rand_array([3000, 1]);
+            const y = values(mtimes(S, x) as FMArray);
+            const expected = values(mtimes(full(S), x) as FMArray);
+            y.forEach((c, i) => assert.closeTo(c, expected[i], 1e-12));
+        } finally {
+            kernel_threads(previous);
+        }
+    }
+    @test "should multiply sparse matrices"() {
+        const [I, J, V] = random_triplets(200, 0.02, 3);
+        const S = sparse(new FMArray([I.length, 1], I), new FMArray([J.length, 1], J),
+            new FMArray([V.length, 1], V), 200, 200);
+        const T = sptranspose(S);
+        const P = mtimes(S, T) as SparseArray;
+        assert.isTrue(issparse(P));
+        const expected = values(mtimes(full(S), full(T)) as FMArray);
+        values(full(P)).forEach((c, i) => assert.closeTo(c, expected[i], 1e-12));
+        assert.throws(() => mtimes(S, sparse(3, 3)));
+    }
+    @test "should solve symmetric positive definite systems"() {
+        const A = laplacian(30);
+        const B = rand_array([900, 2]);
+        const X = mldivide(A, B, logger) as FMArray;
+        assert.deepEqual(X.dims, [900, 2]);
+        assert.isBelow(residual(A, X, B), 1e-10);
+        const Z = rand_array_complex([900, 1]);
+        const Y = mldivide(A, Z, logger) as FMArray;
+        const R = mtimes(A, Y) as FMArray;
+        values(R).forEach((c, i) => assert.closeTo(c, Z.real[i], 1e-10));
+        Array.from(R.imag!).forEach((c, i) => assert.closeTo(c, Z.imag![i], 1e-10));
+    }
+    @test "should solve unsymmetric and indefinite systems"() {
+        const [I, J, V] = random_triplets(400, 0.01, 11);
+        for (let k = 1; k <= 400; k++) {
+            I.push(k);
+            J.push(k);
+            V.push((k % 3 === 0) ? -2 : 2);
+        }
+        const A = sparse(new FMArray([I.length, 1], I), new FMArray([J.length, 1], J),
+            new FMArray([V.length, 1], V), 400, 400);
+        const B = rand_array([400, 3]);
+        const warnings: string[] = [];
+        const X = mldivide(A, B, (msg: string) => warnings.push(msg)) as FMArray;
+        assert.isBelow(residual(A, X, B), 1e-10);
+        assert.deepEqual(warnings, []);
+        const dense = values(mldivide(full(A), B, logger) as FMArray);
+        values(X).forEach((c, i) => assert.closeTo(c, dense[i], 1e-8));
+        // Needs row exchanges
+        const P = sparse(new FMArray([1, 3], [2, 1, 3]), new FMArray([1, 3], [1, 2, 3]),
+            new FMArray([1, 3], [1, 1, 1]));
+        assert.deepEqual(values(mldivide(P, new FMArray([3, 1], [1, 2, 3]), logger) as FMArray), [2, 1, 3]);
+    }
+    @test "should report singular systems and reject non-square ones"() {
+        const S = sparse(new FMArray([1, 2], [1, 2]), new FMArray([1, 2], [1, 1]), 1, 2, 2);
+        assert.throws(() => mldivide(S, new FMArray([2, 1], [1, 1]), logger), /singular/);
+        // Singular to working precision: the last column is a combination
+        // of the first two, so its pivot is at most rounding error
+        const [I, J, V] = random_triplets(60, 0.05, 5);
+        for (let k = 1; k <= 60; k++) {
+            I.push(k);
+            J.push(k);
+            V.push(3);
+        }
+        const D = full(sparse(new FMArray([I.length, 1], I), new FMArray([J.length, 1], J),
+            new FMArray([V.length, 1], V), 60, 60));
+        for (let i = 0; i < 60; i++)
+            D.real[i + 59 * 60] = D.real[i] / 3 + 0.7 * D.real[i + 60];
+        const warnings: string[] = [];
+        mldivide(sparse(D), rand_array([60, 1]), (msg: string) => warnings.push(msg));
+        assert.equal(warnings.length, 1);
+        assert.isTrue(/singular to working precision/.test(warnings[0]));
+        const R = sparse(new FMArray([1, 2], [1, 2]), new FMArray([1, 2], [1, 2]), 1, 3, 2);
+        assert.throws(() => mldivide(R, new FMArray([3, 1], [1, 1, 1]), logger), /square/);
+    }
+}
@@ -0,0 +1,70 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray } from "../arrays";
+import { transpose, hermitian, autotune, kernel_tuning, tuning_info, load_tuning } from "../math";
+import { permute } from "../permute";
+import { cumsum } from "../cumulative";
+import { mat_equal, rand_array, rand_array_complex } from "./test_utils";
+import * as fs from "fs";
+
+const candidates = [16, 32, 48, 64, 96, 128, 192, 256];
+
+@suite
+export class TuningTests {
+    @test "should give the same results with any parameters"() {
+        const initial = tuning_info();
+        const A = rand_array([257, 131]);
+        const Z = rand_array_complex([97, 203]);
+        const P = rand_array([70, 3, 90]);
+        const ops = () => [transpose(A) as FMArray, hermitian(Z) as FMArray,
+            permute(P, [3, 2, 1]), cumsum(A, 1)];
+        const ref = ops();
+        for (let [block, grain] of [[8, 1024], [16, 4096], [256, 1 << 22]]) {
+            const info = kernel_tuning(block, grain);
+            assert.equal(info.transpose_block, block);
+            assert.equal(info.parallel_grain, grain);
+            assert.equal(info.source, 'set');
+            ops().forEach((X, i) => assert.isTrue(mat_equal(X, ref[i])));
+        }
+        kernel_tuning(initial.transpose_block, initial.parallel_grain);
+    }
+    @test "should clamp parameters and return to the defaults"() {
+        const initial = tuning_info();
+        assert.equal(kernel_tuning(1, 1).transpose_block, 8);
+        assert.equal(kernel_tuning(100000).transpose_block, 512);
+        assert.equal(tuning_info().parallel_grain, 1024);
+        const defaults = kernel_tuning();
+        assert.equal(defaults.source, 'default');
+        assert.equal(defaults.transpose_block, 100);
+        assert.throws(() => kernel_tuning(-4));
+        kernel_tuning(initial.transpose_block, initial.parallel_grain);
+    }
+    @test "should tune and persist a profile"() {
+        const initial = tuning_info();
+        const saved_path = process.env.FREEMAT_TUNING;
+        const path = "/tmp/freemat_tuning_test_" + process.pid;
+        process.env.FREEMAT_TUNING = path;
+        try {
+            const tuned = autotune(true);
+            assert.equal(tuned.source, 'tuned');
+            assert.equal(tuned.path, path);
+            assert.include(candidates, tuned.transpose_block);
+            const text = fs.readFileSync(path, 'utf8');
+            assert.isTrue(/transpose_block \d+/.test(text));
+            assert.include(text, "machine " + tuned.machine);
+            kernel_tuning();
+            const loaded = load_tuning();
+            assert.equal(loaded.source, 'profile');
+            assert.equal(loaded.transpose_block, tuned.transpose_block);
+            assert.equal(loaded.parallel_grain, tuned.parallel_grain);
+            // A profile from another machine is ignored
+            fs.writeFileSync(path, text.replace(/machine .*/, "machine elsewhere"));
+            assert.equal(load_tuning().source, 'default');
+        } finally {
+            if (fs.existsSync(path)) fs.unlinkSync(path);
+            if (saved_path === undefined) delete process.env.FREEMAT_TUNING;
+            else process.env.FREEMAT_TUNING = saved_path;
+            kernel_tuning(initial.transpose_block, initial.parallel_grain);
+        }
+    }
+}
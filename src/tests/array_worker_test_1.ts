@@ -0,0 +1,45 @@
+import { suite, test } from "mocha-typescript";
+import { assert } from "chai";
+import { FMArray } from "../arrays";
+import { mtimes } from "../math";
+import { test_mat } from "./test_utils";
+
+const path = require('path');
+
+// Each worker loads its own instance of the addon and multiplies the
+// same matrix.  Worker threads need a node with worker_threads support.
+const worker_source = `
+const { parentPort, workerData } = require('worker_threads');
+const arrays = require(workerData.dir + '/arrays');
+const math = require(workerData.dir + '/math');
+const A = new arrays.FMArray(workerData.dims, Float64Array.from(workerData.real));
+const C = math.mtimes(A, A);
+parentPort.postMessage(Array.from(C.real));
+`;
+
+function run_worker(A: FMArray): Promise<number[]> {
+    const { Worker } = require('worker_threads');
+    return new Promise((resolve, reject) => {
+        const w = new Worker(worker_source, {
+            eval: true,
+            workerData: { dir: path.join(__dirname, '..'), dims: A.dims, real: Array.from(A.real) }
+        });
+        w.on('message', resolve);
+        w.on('error', reject);
+    });
+}
+
+@suite
+export class WorkerTests {
+    @test "should multiply matrices in several workers at once"() {
+        const A = test_mat(100, 100);
+        const ref = Array.from((mtimes(A, A) as FMArray).real);
+        let jobs: Promise<number[]>[] = [];
+        for (let i = 0; i < 4; i++)
+            jobs.push(run_worker(A));
+        return Promise.all(jobs).then((results) => {
+            for (let res of results)
+                assert.deepEqual(res, ref);
+        });
+    }
+}
@@ -90,3 +90,45 @@ export function mat_equal(A: FMValue, B: FMValue): boolean {
     return true;
 }
 
+// The largest difference between the elements of two arrays of the same
+// size, real or complex
+export function max_diff(A: FMValue, B: FMValue): number {
+    const X = mkArray(A);
+    const Y = mkArray(B);
+    assert.deepEqual(X.dims, Y.dims);
+    let err = 0;
+    for (let i = 0; i < X.length; i++) {
+        err = Math.max(err, Math.abs(X.real[i] - Y.real[i]));
+        const xi = X.imag ? X.imag[i] : 0;
+        const yi = Y.imag ? Y.imag[i] : 0;
+        err = Math.max(err, Math.abs(xi - yi));
+    }
+    return err;
+}
+
+// The elements of an array (its real part) as plain numbers
+export function values(A: FMValue): number[] {
+    const M = mkArray(A);
+    return Array.from(M.real as ArrayLike<number>).slice(0, M.length);
+}
+
+// A logger for functions that warn, for tests that ignore the warnings
+export function logger(_msg: string) { }
+
+// A random n x n matrix with about density*n*n nonzeros, as one based
+// triplets [I, J, V].  The generator is seeded, so the matrix is the same
+// on every run.
+export function random_triplets(n: number, density: number, seed: number): number[][] {
+    let state = seed;
+    const next = () => {
+        state = (state * 1103515245 + 12345) % 2147483648;
+        return state / 2147483648;
+    };
+    const I: number[] = [], J: number[] = [], V: number[] = [];
+    for (let k = 0; k < density * n * n; k++) {
+        I.push(1 + Math.floor(next() * n));
+        J.push(1 + Math.floor(next() * n));
+        V.push(next() - 0.5);
+    }
+    return [I, J, V];
+}